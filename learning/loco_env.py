@@ -4,6 +4,8 @@ from gym.utils import seeding
 import numpy as np
 import ctypes
 
+from stable_baselines3.common.vec_env.base_vec_env import VecEnv
+
 class PhysicsDLL() :
     def __init__(self):
         self._physics = ctypes.CDLL('bin/Release_x86_64/Physics-Lib.dll')
@@ -45,6 +47,112 @@ class PhysicsDLL() :
         return result_state, out_reward[0], done != 0
 
 
+class PhysicsBatchDLL(PhysicsDLL) :
+    # Steps num_envs environments in parallel on num_threads threads (0 = one per core) inside the DLL.
+    # The states, rewards and dones are numpy arrays, which the DLL writes to directly. They are overwritten by the next call.
+    def __init__(self, num_envs, num_threads=0, seed=0):
+        super(PhysicsBatchDLL, self).__init__()
+
+        float_ptr = np.ctypeslib.ndpointer(dtype=np.float32, flags='C_CONTIGUOUS')
+        int_ptr = np.ctypeslib.ndpointer(dtype=np.int32, flags='C_CONTIGUOUS')
+
+        self._physics.createPhysicsBatch.restype = ctypes.c_void_p
+        self._physics.createPhysicsBatch.argtypes = (ctypes.c_int, ctypes.c_int, ctypes.c_int)
+        self._physics.destroyPhysicsBatch.argtypes = (ctypes.c_void_p,)
+        self._physics.resetPhysicsBatch.argtypes = (ctypes.c_void_p, float_ptr)
+        self._physics.updatePhysicsBatch.argtypes = (ctypes.c_void_p, float_ptr, float_ptr, float_ptr, int_ptr, float_ptr)
+
+        self.num_envs = num_envs
+        self.num_threads = num_threads
+        self._batch = self._physics.createPhysicsBatch(num_envs, num_threads, seed)
+
+        self.states = np.zeros((num_envs, self.state_size), dtype=np.float32)
+        self.terminal_states = np.zeros((num_envs, self.state_size), dtype=np.float32)
+        self.rewards = np.zeros(num_envs, dtype=np.float32)
+        self.dones = np.zeros(num_envs, dtype=np.int32)
+
+    def close(self):
+        if self._batch :
+            self._physics.destroyPhysicsBatch(self._batch)
+            self._batch = None
+
+    # The random generators live in the DLL, so the batch is recreated. All environments need a reset afterwards.
+    def reseed(self, seed):
+        self.close()
+        self._batch = self._physics.createPhysicsBatch(self.num_envs, self.num_threads, seed)
+
+    def reset(self):
+        self._physics.resetPhysicsBatch(self._batch, self.states)
+        return self.states
+
+    # Environments which are done are reset automatically. Their final states are in terminal_states.
+    def step(self, actions):
+        actions = np.ascontiguousarray(actions, dtype=np.float32)
+        self._physics.updatePhysicsBatch(self._batch, actions, self.states, self.rewards, self.dones, self.terminal_states)
+        return self.states, self.rewards, self.dones != 0
+
+
+# Vectorized environment for stable-baselines3, which replaces SubprocVecEnv over LocoEnv. All environments live in one process.
+class LocoVecEnv(VecEnv):
+    def __init__(self, num_envs, num_threads=0, seed=0):
+        self.dll = PhysicsBatchDLL(num_envs, num_threads, seed)
+
+        observation_space = spaces.Box(np.float32(self.dll.state_min), np.float32(self.dll.state_max))
+        action_space = spaces.Box(np.float32(self.dll.action_min), np.float32(self.dll.action_max))
+        super(LocoVecEnv, self).__init__(num_envs, observation_space, action_space)
+
+        self.actions = None
+        self._env_attrs = {}
+
+    def reset(self):
+        return self.dll.reset().copy()
+
+    def step_async(self, actions):
+        self.actions = actions
+
+    def step_wait(self):
+        states, rewards, dones = self.dll.step(self.actions)
+        infos = [ { 'terminal_observation': self.dll.terminal_states[i].copy() } if dones[i] else {} for i in range(self.num_envs) ]
+        return states.copy(), rewards.copy(), dones.copy(), infos
+
+    def close(self):
+        self.dll.close()
+
+    # Environment i is seeded with seed + 1 + i * 7919 inside the DLL.
+    def seed(self, seed=None):
+        if seed is None :
+            seed = np.random.randint(0, 2**31 - 1 - 7919 * self.num_envs)
+        self.dll.reseed(seed)
+        return [ seed + 1 + i * 7919 for i in range(self.num_envs) ]
+
+    # All environments share this object. Values set for a subset of them are kept per environment.
+    def get_attr(self, attr_name, indices=None):
+        if attr_name in self._env_attrs :
+            values = self._env_attrs[attr_name]
+            return [ values[i] for i in self._get_indices(indices) ]
+        return [ getattr(self, attr_name) for _ in self._get_indices(indices) ]
+
+    def set_attr(self, attr_name, value, indices=None):
+        if attr_name not in self._env_attrs :
+            self._env_attrs[attr_name] = [ getattr(self, attr_name, None) ] * self.num_envs
+        values = self._env_attrs[attr_name]
+        for i in self._get_indices(indices) :
+            values[i] = value
+
+    def env_method(self, method_name, *method_args, indices=None, **method_kwargs):
+        raise NotImplementedError()
+
+    def env_is_wrapped(self, wrapper_class, indices=None):
+        return [ False for _ in self._get_indices(indices) ]
+
+    def _get_indices(self, indices):
+        if indices is None :
+            return range(self.num_envs)
+        if isinstance(indices, int) :
+            return [ indices ]
+        return indices
+
+
 # https://blog.paperspace.com/creating-custom-environments-openai-gym/
 # Simple example: https://github.com/openai/gym/blob/master/gym/envs/classic_control/pendulum.py
 
@@ -218,6 +218,10 @@ project "D3D12Renderer"
 		"shaders/**.hlsl*",
 	}
 
+	removefiles {
+		"src/benchmark/**",
+	}
+
 	vpaths {
 		["Headers/*"] = { "src/**.h" },
 		["Sources/*"] = { "src/**.cpp" },
@@ -266,6 +270,17 @@ project "D3D12Renderer"
 	vectorextensions "AVX2"
 	floatingpoint "Fast"
 
+	-- The SIMD physics and inference kernels are compiled once per vector width and picked at runtime (see physics_simd.h).
+	-- They use their own instruction sets, so they can't share the precompiled header.
+	filter "files:src/physics/physics_simd_w*.cpp or src/learning/policy_inference_w*.cpp"
+		flags { "NoPCH" }
+
+	filter "files:src/physics/physics_simd_w8.cpp or src/learning/policy_inference_w8.cpp"
+		buildoptions { "/arch:AVX2" }
+
+	filter "files:src/physics/physics_simd_w16.cpp or src/learning/policy_inference_w16.cpp"
+		buildoptions { "/arch:AVX512" }
+
 	filter "configurations:Debug"
         runtime "Debug"
 		symbols "On"
@@ -382,6 +397,41 @@ project "D3D12Renderer"
 
 
 
+-- Shared by the physics library and its benchmark.
+local physics_lib_files = {
+	"src/physics/aabb_tree.*",
+	"src/physics/bounding_volumes.*",
+	"src/physics/collision_broad.*",
+	"src/physics/collision_broad_simd.h",
+	"src/physics/collision_epa.*",
+	"src/physics/collision_gjk.*",
+	"src/physics/collision_narrow.*",
+	"src/physics/collision_narrow_simd.h",
+	"src/physics/collision_sat.*",
+	"src/physics/constraints.*",
+	"src/physics/constraints_simd.h",
+	"src/physics/island.*",
+	"src/physics/physics.*",
+	"src/physics/physics_index.h",
+	"src/physics/physics_simd*",
+	"src/physics/physics_snapshot.*",
+	"src/physics/cloth.*",
+	"src/physics/rigid_body.*",
+	"src/physics/ragdoll.*",
+	"src/physics/scene_query.*",
+	"src/physics/heightmap_collision.*",
+	"src/physics/mesh_collider.*",
+	"src/learning/**",
+	"src/core/cpu_features.*",
+	"src/core/math.*",
+	"src/core/memory.*",
+	"src/core/threading.*",
+	"src/scene/scene.*",
+	"src/terrain/heightmap_collider.*",
+	"src/pch.*",
+}
+
+
 -----------------------------------------
 -- GENERATE PHYSICS ONLY DLL
 -----------------------------------------
@@ -413,29 +463,84 @@ project "Physics-Lib"
 		"ext",
 	}
 
-	vectorextensions "AVX2"
+	-- No global vector extensions, so that the library runs on any CPU with SSE4.1. The wider SIMD kernels are selected at runtime.
 	floatingpoint "Fast"
 
+	files(physics_lib_files)
+
+	vpaths {
+		["Headers/*"] = { "src/**.h" },
+		["Sources/*"] = { "src/**.cpp" },
+	}
+
+	-- Same as in D3D12Renderer.
+	filter "files:src/physics/physics_simd_w*.cpp or src/learning/policy_inference_w*.cpp"
+		flags { "NoPCH" }
+
+	filter "files:src/physics/physics_simd_w8.cpp or src/learning/policy_inference_w8.cpp"
+		buildoptions { "/arch:AVX2" }
+
+	filter "files:src/physics/physics_simd_w16.cpp or src/learning/policy_inference_w16.cpp"
+		buildoptions { "/arch:AVX512" }
+
+	filter "system:windows"
+		systemversion "latest"
+
+		defines {
+			"PHYSICS_ONLY",
+			"_UNICODE",
+			"UNICODE",
+			"_CRT_SECURE_NO_WARNINGS",
+			"ENABLE_CPU_PROFILING=0",
+			"ENABLE_DX_PROFILING=0",
+		}
+
+	filter "configurations:Debug"
+        runtime "Debug"
+		symbols "On"
+		
+	filter "configurations:Release"
+        runtime "Release"
+		optimize "On"
+		inlining "Auto"
+
+
+
+
+-----------------------------------------
+-- GENERATE HEADLESS PHYSICS BENCHMARK
+-----------------------------------------
+
+project "Physics-Benchmark"
+	kind "ConsoleApp"
+	language "C++"
+	cppdialect "C++17"
+	staticruntime "Off"
+
+	targetdir ("./bin/" .. outputdir)
+	objdir ("./bin_int/" .. outputdir ..  "/%{prj.name}")
+
+	debugdir "."
+
+	pchheader "pch.h"
+	pchsource "src/pch.cpp"
+
+	includedirs {
+		"src",
+	}
+
+	sysincludedirs {
+		"ext/entt/src",
+		"ext",
+	}
+
+	-- Same compiler settings as Physics-Lib, so that the numbers are representative for the library.
+	floatingpoint "Fast"
+
+	files(physics_lib_files)
 	files {
-		"src/physics/bounding_volumes.*",
-		"src/physics/collision_broad.*",
-		"src/physics/collision_epa.*",
-		"src/physics/collision_gjk.*",
-		"src/physics/collision_narrow.*",
-		"src/physics/collision_sat.*",
-		"src/physics/constraints.*",
-		"src/physics/physics.*",
-		"src/physics/cloth.*",
-		"src/physics/rigid_body.*",
-		"src/physics/ragdoll.*",
-		"src/physics/heightmap_collision.*",
-		"src/learning/**",
-		"src/core/math.*",
-		"src/core/memory.*",
-		"src/core/threading.*",
-		"src/scene/scene.*",
-		"src/terrain/heightmap_collider.*",
-		"src/pch.*",
+		"src/benchmark/**",
+		"src/core/job_system.*", -- Unlike Physics-Lib, the benchmark runs the parallel paths of the physics step.
 	}
 
 	vpaths {
@@ -443,11 +548,21 @@ project "Physics-Lib"
 		["Sources/*"] = { "src/**.cpp" },
 	}
 
+	filter "files:src/physics/physics_simd_w*.cpp or src/learning/policy_inference_w*.cpp"
+		flags { "NoPCH" }
+
+	filter "files:src/physics/physics_simd_w8.cpp or src/learning/policy_inference_w8.cpp"
+		buildoptions { "/arch:AVX2" }
+
+	filter "files:src/physics/physics_simd_w16.cpp or src/learning/policy_inference_w16.cpp"
+		buildoptions { "/arch:AVX512" }
+
 	filter "system:windows"
 		systemversion "latest"
 
 		defines {
 			"PHYSICS_ONLY",
+			"PHYSICS_WITH_JOB_SYSTEM",
 			"_UNICODE",
 			"UNICODE",
 			"_CRT_SECURE_NO_WARNINGS",
@@ -463,4 +578,3 @@ project "Physics-Lib"
         runtime "Release"
 		optimize "On"
 		inlining "Auto"
-
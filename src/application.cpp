@@ -9,6 +9,7 @@
 #include "dx/dx_context.h"
 #include "dx/dx_profiling.h"
 #include "physics/physics.h"
+#include "physics/physics_thread.h"
 #include "physics/ragdoll.h"
 #include "physics/vehicle.h"
 #include "core/threading.h"
@@ -551,8 +552,27 @@ void application::update(const user_input& input, float dt)
 	}
 
 
+	// The physics thread only runs while playing. When it stops, its state is written back into the runtime scene, so that the simulation continues from there.
 	static float physicsTimer = 0.f;
-	physicsStep(scene, stackArena, physicsTimer, editor.physicsSettings, dt);
+	static physics_thread physicsThread;
+	bool asyncPhysics = editor.physicsSettings.asynchronous && editor.physicsSettings.fixedFrameRate && this->scene.mode == scene_mode_runtime_playing;
+	if (asyncPhysics && !physicsThread.isRunning())
+	{
+		physicsThread.start(scene, editor.physicsSettings);
+	}
+	else if (!asyncPhysics && physicsThread.isRunning())
+	{
+		physicsThread.stop((this->scene.mode != scene_mode_editor) ? &scene : 0);
+	}
+
+	if (physicsThread.isRunning())
+	{
+		physicsThread.update(scene, dt);
+	}
+	else
+	{
+		physicsStep(scene, stackArena, physicsTimer, editor.physicsSettings, dt);
+	}
 
 
 	// Particles.
@@ -0,0 +1,526 @@
+#include "pch.h"
+#include "physics/physics.h"
+#include "physics/physics_simd.h"
+#include "physics/ragdoll.h"
+#include "terrain/heightmap_collider.h"
+#include "core/random.h"
+#include "core/job_system.h"
+
+// Headless benchmark of the physics step. Builds a few standard scenes, runs a fixed number of steps on each
+// and prints the time spent in the individual phases. Run with --help for the options.
+// The parallel paths (island groups, narrow phase chunks, colored SIMD batches, heightmap jobs and cloths) run on the high priority job queue,
+// like in the engine.
+
+enum benchmark_scene
+{
+	benchmark_scene_box_stacks,
+	benchmark_scene_sphere_pile,
+	benchmark_scene_ragdoll_crowd,
+	benchmark_scene_hull_debris,
+	benchmark_scene_constraint_chains,
+
+	benchmark_scene_count,
+};
+
+static const char* benchmarkSceneNames[] =
+{
+	"box_stacks",
+	"sphere_pile",
+	"ragdoll_crowd",
+	"hull_debris",
+	"constraint_chains",
+};
+
+static_assert(arraysize(benchmarkSceneNames) == benchmark_scene_count);
+
+struct benchmark_options
+{
+	uint32 numSteps = 600;
+	uint32 scale = 1; // Multiplies the number of objects in each scene.
+	uint32 sceneMask = (1 << benchmark_scene_count) - 1;
+	uint32 maxNumHullVertices = 32; // Budget for the debris hulls, which are built from dense point clouds.
+
+	physics_settings settings;
+};
+
+static const physics_material benchmarkGroundMaterial = { physics_material_type_metal, 0.1f, 1.f, 4.f };
+static const physics_material benchmarkObjectMaterial = { physics_material_type_wood, 0.1f, 0.5f, 1.f };
+
+// The heightmap only references the heights, so they have to stay alive while the scene exists.
+static std::vector<std::vector<uint16>> heightmapHeights;
+
+static void createGround(game_scene& scene, float radius)
+{
+	scene.createEntity("Ground")
+		.addComponent<transform_component>(vec3(0.f, -4.f, 0.f), quat::identity)
+		.addComponent<collider_component>(collider_component::asAABB(bounding_box::fromCenterRadius(vec3(0.f), vec3(radius, 4.f, radius)), benchmarkGroundMaterial));
+}
+
+static void createBoxStacks(game_scene& scene, uint32 scale, random_number_generator& rng)
+{
+	const uint32 numStacks = 16 * scale;
+	const uint32 boxesPerStack = 12;
+	const uint32 stacksPerRow = (uint32)ceil(sqrt((float)numStacks));
+	const vec3 radius(0.5f, 0.25f, 0.5f);
+
+	createGround(scene, stacksPerRow * 3.f);
+
+	for (uint32 s = 0; s < numStacks; ++s)
+	{
+		float x = ((float)(s % stacksPerRow) - stacksPerRow * 0.5f) * 3.f;
+		float z = ((float)(s / stacksPerRow) - stacksPerRow * 0.5f) * 3.f;
+
+		for (uint32 i = 0; i < boxesPerStack; ++i)
+		{
+			// Slight jitter, so that the stacks are not perfectly symmetric.
+			vec3 position = vec3(x, radius.y + i * radius.y * 2.f, z) + vec3(rng.randomFloatBetween(-0.02f, 0.02f), 0.f, rng.randomFloatBetween(-0.02f, 0.02f));
+
+			scene.createEntity("Box")
+				.addComponent<transform_component>(position, quat(vec3(0.f, 1.f, 0.f), rng.randomFloatBetween(-0.05f, 0.05f)))
+				.addComponent<collider_component>(collider_component::asAABB(bounding_box::fromCenterRadius(vec3(0.f), radius), benchmarkObjectMaterial))
+				.addComponent<rigid_body_component>(false, 1.f);
+		}
+	}
+}
+
+static void createSpherePile(game_scene& scene, uint32 scale, random_number_generator& rng)
+{
+	const uint32 numSpheres = 1024 * scale;
+	const float pileRadius = 6.f * sqrt((float)scale);
+
+	createGround(scene, pileRadius * 2.f);
+
+	for (uint32 i = 0; i < numSpheres; ++i)
+	{
+		float r = rng.randomFloatBetween(0.2f, 0.4f);
+		vec3 position(rng.randomFloatBetween(-pileRadius, pileRadius), 1.f + i * 0.02f / scale, rng.randomFloatBetween(-pileRadius, pileRadius));
+
+		scene.createEntity("Sphere")
+			.addComponent<transform_component>(position, quat::identity)
+			.addComponent<collider_component>(collider_component::asSphere({ vec3(0.f), r }, benchmarkObjectMaterial))
+			.addComponent<rigid_body_component>(false, 1.f);
+	}
+}
+
+static void createRagdollCrowd(game_scene& scene, uint32 scale, random_number_generator& rng)
+{
+	const uint32 numRagdolls = 64 * scale;
+	const uint32 ragdollsPerRow = (uint32)ceil(sqrt((float)numRagdolls));
+
+	createGround(scene, ragdollsPerRow * 1.5f);
+
+	for (uint32 i = 0; i < numRagdolls; ++i)
+	{
+		// Close enough to each other, that they tumble into their neighbors.
+		float x = ((float)(i % ragdollsPerRow) - ragdollsPerRow * 0.5f) * 1.2f;
+		float z = ((float)(i / ragdollsPerRow) - ragdollsPerRow * 0.5f) * 1.2f;
+
+		humanoid_ragdoll::create(scene, vec3(x, 1.25f, z), rng.randomFloatBetween(-M_PI, M_PI));
+	}
+}
+
+static uint32 createDebrisGeometry(uint32 maxNumHullVertices, random_number_generator& rng)
+{
+	// Rock-like point cloud: A randomly stretched ellipsoid with a rough surface. The exact hull has most of these points as vertices.
+	const uint32 numPoints = 256;
+	vec3 radius = rng.randomVec3Between(0.2f, 0.6f);
+
+	vec3 points[numPoints];
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		points[i] = rng.randomPointOnUnitSphere() * radius * rng.randomFloatBetween(0.85f, 1.f);
+	}
+
+	return allocateBoundingHullGeometry(bounding_hull_geometry::fromPoints(points, numPoints, maxNumHullVertices, 2 * maxNumHullVertices - 4));
+}
+
+static void createHullDebris(game_scene& scene, uint32 scale, uint32 maxNumHullVertices, random_number_generator& rng)
+{
+	const uint32 numChunksPerDim = 2;
+	const float chunkSize = 32.f;
+	const float amplitude = 4.f;
+	const uint32 numDebris = 512 * scale;
+	const uint32 numGeometries = 16;
+
+	heightmapHeights.resize(numChunksPerDim * numChunksPerDim);
+
+	vec3 minCorner(-0.5f * numChunksPerDim * chunkSize, -amplitude, -0.5f * numChunksPerDim * chunkSize);
+
+	heightmap_collider_component& heightmap = scene.createEntity("Heightmap")
+		.addComponent<heightmap_collider_component>(numChunksPerDim, chunkSize, benchmarkGroundMaterial)
+		.getComponent<heightmap_collider_component>();
+
+	heightmap.update(minCorner, amplitude);
+
+	const uint32 numVertices = TERRAIN_LOD_0_VERTICES_PER_DIMENSION;
+	const float vertexSpacing = chunkSize / (numVertices - 1);
+
+	for (uint32 cz = 0; cz < numChunksPerDim; ++cz)
+	{
+		for (uint32 cx = 0; cx < numChunksPerDim; ++cx)
+		{
+			std::vector<uint16>& heights = heightmapHeights[cz * numChunksPerDim + cx];
+			heights.resize(numVertices * numVertices);
+
+			for (uint32 z = 0; z < numVertices; ++z)
+			{
+				for (uint32 x = 0; x < numVertices; ++x)
+				{
+					// Rolling hills. The chunks share their border vertices, so the height only depends on the global position.
+					float wx = (cx * (numVertices - 1) + x) * vertexSpacing;
+					float wz = (cz * (numVertices - 1) + z) * vertexSpacing;
+					float h = 0.5f + 0.25f * sin(wx * 0.3f) + 0.25f * cos(wz * 0.2f);
+					heights[z * numVertices + x] = (uint16)(clamp01(h) * UINT16_MAX);
+				}
+			}
+
+			heightmap.collider(cx, cz).setHeights(heights.data());
+		}
+	}
+
+	uint32 geometries[numGeometries];
+	for (uint32 i = 0; i < numGeometries; ++i)
+	{
+		geometries[i] = createDebrisGeometry(maxNumHullVertices, rng);
+	}
+
+	float extent = 0.4f * numChunksPerDim * chunkSize;
+	for (uint32 i = 0; i < numDebris; ++i)
+	{
+		bounding_hull hull;
+		hull.rotation = quat::identity;
+		hull.position = vec3(0.f);
+		hull.geometryIndex = geometries[i % numGeometries];
+
+		vec3 position(rng.randomFloatBetween(-extent, extent), rng.randomFloatBetween(2.f, 10.f), rng.randomFloatBetween(-extent, extent));
+
+		scene.createEntity("Debris")
+			.addComponent<transform_component>(position, rng.randomRotation())
+			.addComponent<collider_component>(collider_component::asHull(hull, benchmarkObjectMaterial))
+			.addComponent<rigid_body_component>(false, 1.f);
+	}
+}
+
+static void createConstraintChains(game_scene& scene, uint32 scale, random_number_generator& rng)
+{
+	const uint32 numChains = 8 * scale;
+	const uint32 linksPerChain = 64;
+	const float linkLength = 0.5f;
+	const float linkRadius = 0.1f;
+	const float height = linksPerChain * linkLength + 2.f;
+
+	createGround(scene, numChains * 2.f);
+
+	bounding_capsule linkCapsule = { vec3(-0.5f * linkLength + linkRadius, 0.f, 0.f), vec3(0.5f * linkLength - linkRadius, 0.f, 0.f), linkRadius };
+
+	for (uint32 c = 0; c < numChains; ++c)
+	{
+		float z = ((float)c - numChains * 0.5f) * 2.f;
+
+		// Anchored at one end, starting horizontally, so that the chains swing down.
+		scene_entity prev = scene.createEntity("Anchor")
+			.addComponent<transform_component>(vec3(0.f, height, z), quat::identity)
+			.addComponent<collider_component>(collider_component::asSphere({ vec3(0.f), linkRadius }, benchmarkObjectMaterial))
+			.addComponent<rigid_body_component>(true, 1.f);
+
+		for (uint32 i = 0; i < linksPerChain; ++i)
+		{
+			float x = (i + 0.5f) * linkLength;
+
+			scene_entity link = scene.createEntity("Link")
+				.addComponent<transform_component>(vec3(x, height, z), quat::identity)
+				.addComponent<collider_component>(collider_component::asCapsule(linkCapsule, benchmarkObjectMaterial))
+				.addComponent<rigid_body_component>(false, 1.f);
+
+			addBallConstraintFromGlobalPoints(prev, link, vec3(i * linkLength, height, z));
+
+			prev = link;
+		}
+	}
+}
+
+// Distance between the two anchors of each ball joint. On the chains this shows how far the solver is from converging for the 
+// given number of iterations or substeps.
+static void getBallJointError(game_scene& scene, float& outAverage, float& outMax)
+{
+	float sum = 0.f;
+	float maxError = 0.f;
+	uint32 count = 0;
+
+	for (auto [entityHandle, constraint, ref] : scene.view<ball_constraint, constraint_entity_reference_component>().each())
+	{
+		scene_entity a = { ref.entityA, scene };
+		scene_entity b = { ref.entityB, scene };
+
+		vec3 globalAnchorA = transformPosition(a.getComponent<transform_component>(), constraint.localAnchorA);
+		vec3 globalAnchorB = transformPosition(b.getComponent<transform_component>(), constraint.localAnchorB);
+
+		float error = length(globalAnchorB - globalAnchorA);
+		sum += error;
+		maxError = max(maxError, error);
+		++count;
+	}
+
+	outAverage = (count > 0) ? (sum / count) : 0.f;
+	outMax = maxError;
+}
+
+// Distance of each box from where it was placed. The stacks start at rest, so this shows how much they jitter, slide and sink for the
+// given number of iterations or substeps (compare e.g. --iterations 8 against the default, with and without warm starting).
+static void getStackDrift(game_scene& scene, const std::vector<std::pair<entity_handle, vec3>>& startPositions, float& outAverage, float& outMax)
+{
+	float sum = 0.f;
+	float maxDrift = 0.f;
+
+	for (auto [entityHandle, startPosition] : startPositions)
+	{
+		float drift = length(scene_entity{ entityHandle, scene }.getComponent<transform_component>().position - startPosition);
+		sum += drift;
+		maxDrift = max(maxDrift, drift);
+	}
+
+	uint32 count = (uint32)startPositions.size();
+	outAverage = (count > 0) ? (sum / count) : 0.f;
+	outMax = maxDrift;
+}
+
+static void runBenchmark(benchmark_scene sceneType, const benchmark_options& options)
+{
+	game_scene scene;
+	random_number_generator rng = { 51923 + sceneType };
+
+	switch (sceneType)
+	{
+		case benchmark_scene_box_stacks: createBoxStacks(scene, options.scale, rng); break;
+		case benchmark_scene_sphere_pile: createSpherePile(scene, options.scale, rng); break;
+		case benchmark_scene_ragdoll_crowd: createRagdollCrowd(scene, options.scale, rng); break;
+		case benchmark_scene_hull_debris: createHullDebris(scene, options.scale, options.maxNumHullVertices, rng); break;
+		case benchmark_scene_constraint_chains: createConstraintChains(scene, options.scale, rng); break;
+	}
+
+	uint32 numRigidBodies = scene.numberOfComponentsOfType<rigid_body_component>();
+	uint32 numColliders = scene.numberOfComponentsOfType<collider_component>();
+
+	memory_arena arena;
+	arena.initialize();
+
+	// Always exactly one step per call, so that the stats are not skewed by dropped or accumulated frames.
+	physics_settings settings = options.settings;
+	settings.fixedFrameRate = false;
+	const float dt = 1.f / (float)settings.frameRate;
+
+	// The physics step reorders the rigid bodies, so the start positions are stored by entity.
+	std::vector<std::pair<entity_handle, vec3>> startPositions;
+	for (auto [entityHandle, rb, transform] : scene.view<rigid_body_component, transform_component>().each())
+	{
+		startPositions.push_back({ entityHandle, transform.position });
+	}
+
+	physics_step_stats stats = {};
+	float timer = 0.f;
+
+	for (uint32 i = 0; i < options.numSteps; ++i)
+	{
+		physicsStep(scene, arena, timer, settings, dt, &stats);
+	}
+
+	uint32 numSteps = max(stats.numSteps, 1u);
+	float invNumSteps = 1.f / numSteps;
+	float totalMilliseconds = stats.broadphaseMilliseconds + stats.narrowphaseMilliseconds + stats.solverMilliseconds + stats.integrateMilliseconds;
+
+	printf("%s: %u rigid bodies, %u colliders, %u steps\n", benchmarkSceneNames[sceneType], numRigidBodies, numColliders, stats.numSteps);
+	printf("    Broadphase:          %8.3f ms/step\n", stats.broadphaseMilliseconds * invNumSteps);
+	printf("    Narrowphase:         %8.3f ms/step\n", stats.narrowphaseMilliseconds * invNumSteps);
+	printf("    Solver:              %8.3f ms/step\n", stats.solverMilliseconds * invNumSteps);
+	printf("    Integrate:           %8.3f ms/step\n", stats.integrateMilliseconds * invNumSteps);
+	printf("    Total:               %8.3f ms/step\n", totalMilliseconds * invNumSteps);
+	printf("    Broadphase overlaps: %8u per step\n", stats.numBroadphaseOverlaps / numSteps);
+	printf("    Collisions:          %8u per step\n", stats.numCollisions / numSteps);
+	printf("    Contacts:            %8u per step\n", stats.numContacts / numSteps);
+	printf("    Arena peak:          %8u KB\n", (uint32)BYTE_TO_KB(stats.arenaHighWaterMark));
+	if (scene.numberOfComponentsOfType<ball_constraint>() > 0)
+	{
+		float averageJointError, maxJointError;
+		getBallJointError(scene, averageJointError, maxJointError);
+		printf("    Ball joint error:    %8.3f mm average, %.3f mm max\n", averageJointError * 1000.f, maxJointError * 1000.f);
+	}
+	if (sceneType == benchmark_scene_box_stacks)
+	{
+		float averageDrift, maxDrift;
+		getStackDrift(scene, startPositions, averageDrift, maxDrift);
+		printf("    Stack drift:         %8.3f mm average, %.3f mm max\n", averageDrift * 1000.f, maxDrift * 1000.f);
+	}
+	printf("\n");
+
+	scene.clearAll();
+	heightmapHeights.clear();
+}
+
+static void printUsage()
+{
+	const physics_settings defaults;
+
+	printf("Usage: Physics-Benchmark [options]\n");
+	printf("    --scene <name>              Only run this scene (can be repeated). Default: all.\n");
+	printf("    --steps <n>                 Number of physics steps per scene. Default: 600.\n");
+	printf("    --scale <n>                 Multiplies the number of objects in each scene. Default: 1.\n");
+	printf("    --frame-rate <n>            Steps per simulated second. Default: %u.\n", defaults.frameRate);
+	printf("    --iterations <n>            Rigid body solver iterations. Default: %u.\n", defaults.numRigidSolverIterations);
+	printf("    --substeps <n>              Solve in n substeps with one iteration each instead. Default: %u%s.\n", 
+		defaults.numRigidSolverSubsteps, (defaults.numRigidSolverSubsteps == 1) ? " (off)" : "");
+	printf("    --broadphase <sap|tree>     Broadphase type. Default: sap.\n");
+	printf("    --simd-broadphase <on|off>  SIMD sweep and prune. Default: on.\n");
+	printf("    --simd-narrowphase <on|off> SIMD narrow phase. Default: on.\n");
+	printf("    --simd-solver <on|off>      SIMD constraint solver. Default: on.\n");
+	printf("    --simd-width <auto|4|8|16>  Forces a SIMD width, if supported by the CPU. Default: auto.\n");
+	printf("    --warm-start <on|off>       Warm starting of contacts. Default: on.\n");
+	printf("    --sleeping <on|off>         Sleeping of bodies at rest. Default: off.\n");
+	printf("    --axis-cache <on|off>       Separating axis cache for OBB and hull pairs. Default: on.\n");
+	printf("    --hull-vertices <n>         Vertex budget of the debris hulls (>= 4). Default: 32.\n");
+	printf("\nThe parallel parts of the step run on the job system's high priority workers.\n");
+	printf("\nScenes:");
+	for (uint32 i = 0; i < benchmark_scene_count; ++i)
+	{
+		printf(" %s", benchmarkSceneNames[i]);
+	}
+	printf("\n");
+}
+
+static bool parseOnOff(const char* value, bool& out)
+{
+	if (strcmp(value, "on") == 0) { out = true; return true; }
+	if (strcmp(value, "off") == 0) { out = false; return true; }
+	return false;
+}
+
+static bool parseUint(const char* value, uint32& out)
+{
+	char* end;
+	unsigned long v = strtoul(value, &end, 10);
+	if (end == value || *end != 0)
+	{
+		return false;
+	}
+	out = (uint32)v;
+	return true;
+}
+
+static bool parseOptions(int argc, char** argv, benchmark_options& options)
+{
+	options.settings.enableSleeping = false; // Sleeping bodies would make the later steps meaningless.
+
+	bool sceneSpecified = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			return false;
+		}
+
+		if (i + 1 >= argc)
+		{
+			printf("Missing value for '%s'.\n", arg);
+			return false;
+		}
+
+		const char* value = argv[++i];
+		bool valid = true;
+
+		if (strcmp(arg, "--scene") == 0)
+		{
+			if (!sceneSpecified)
+			{
+				options.sceneMask = 0;
+				sceneSpecified = true;
+			}
+
+			valid = false;
+			for (uint32 s = 0; s < benchmark_scene_count; ++s)
+			{
+				if (strcmp(value, benchmarkSceneNames[s]) == 0)
+				{
+					options.sceneMask |= (1 << s);
+					valid = true;
+				}
+			}
+		}
+		else if (strcmp(arg, "--steps") == 0) { valid = parseUint(value, options.numSteps); }
+		else if (strcmp(arg, "--scale") == 0) { valid = parseUint(value, options.scale) && options.scale > 0; }
+		else if (strcmp(arg, "--frame-rate") == 0) { valid = parseUint(value, options.settings.frameRate) && options.settings.frameRate > 0; }
+		else if (strcmp(arg, "--iterations") == 0) { valid = parseUint(value, options.settings.numRigidSolverIterations); }
+		else if (strcmp(arg, "--substeps") == 0) { valid = parseUint(value, options.settings.numRigidSolverSubsteps) && options.settings.numRigidSolverSubsteps > 0; }
+		else if (strcmp(arg, "--broadphase") == 0)
+		{
+			if (strcmp(value, "sap") == 0) { options.settings.broadphaseType = broadphase_type_sweep_and_prune; }
+			else if (strcmp(value, "tree") == 0) { options.settings.broadphaseType = broadphase_type_aabb_tree; }
+			else { valid = false; }
+		}
+		else if (strcmp(arg, "--simd-broadphase") == 0) { valid = parseOnOff(value, options.settings.simdBroadPhase); }
+		else if (strcmp(arg, "--simd-narrowphase") == 0) { valid = parseOnOff(value, options.settings.simdNarrowPhase); }
+		else if (strcmp(arg, "--simd-solver") == 0) { valid = parseOnOff(value, options.settings.simdConstraintSolver); }
+		else if (strcmp(arg, "--simd-width") == 0)
+		{
+			if (strcmp(value, "auto") == 0) { options.settings.simdWidth = physics_simd_width_auto; }
+			else if (strcmp(value, "4") == 0) { options.settings.simdWidth = physics_simd_width_4; }
+			else if (strcmp(value, "8") == 0) { options.settings.simdWidth = physics_simd_width_8; }
+			else if (strcmp(value, "16") == 0) { options.settings.simdWidth = physics_simd_width_16; }
+			else { valid = false; }
+		}
+		else if (strcmp(arg, "--warm-start") == 0) { valid = parseOnOff(value, options.settings.warmStartContacts); }
+		else if (strcmp(arg, "--sleeping") == 0) { valid = parseOnOff(value, options.settings.enableSleeping); }
+		else if (strcmp(arg, "--axis-cache") == 0) { valid = parseOnOff(value, options.settings.cacheSeparatingAxes); }
+		else if (strcmp(arg, "--hull-vertices") == 0) { valid = parseUint(value, options.maxNumHullVertices) && options.maxNumHullVertices >= 4; }
+		else
+		{
+			printf("Unknown option '%s'.\n", arg);
+			return false;
+		}
+
+		if (!valid)
+		{
+			printf("Invalid value '%s' for '%s'.\n", value, arg);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	benchmark_options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	initializeJobSystem();
+
+	const physics_settings& settings = options.settings;
+	const physics_simd_kernels* simd = getPhysicsSIMDKernels(settings.simdWidth);
+
+	printf("Job system: on, broadphase: %s, SIMD width: %u, SIMD broadphase: %s, SIMD narrowphase: %s, SIMD solver: %s, axis cache: %s, solver iterations: %u, substeps: %u, %u Hz\n\n",
+		broadphaseTypeNames[settings.broadphaseType],
+		simd ? simd->width : 1,
+		settings.simdBroadPhase ? "on" : "off",
+		settings.simdNarrowPhase ? "on" : "off",
+		settings.simdConstraintSolver ? "on" : "off",
+		settings.cacheSeparatingAxes ? "on" : "off",
+		settings.numRigidSolverIterations,
+		settings.numRigidSolverSubsteps,
+		settings.frameRate);
+
+	for (uint32 i = 0; i < benchmark_scene_count; ++i)
+	{
+		if (options.sceneMask & (1 << i))
+		{
+			runBenchmark((benchmark_scene)i, options);
+		}
+	}
+
+	return 0;
+}
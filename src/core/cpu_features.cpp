@@ -0,0 +1,56 @@
+#include "pch.h"
+#include "cpu_features.h"
+
+#include <intrin.h>
+
+static bool isBitSet(int value, uint32 bit)
+{
+	return (value & (1 << bit)) != 0;
+}
+
+static cpu_features queryCPUFeatures()
+{
+	cpu_features result = {};
+
+	int cpuInfo[4] = { -1 };
+	__cpuid(cpuInfo, 0);
+	int maxLeaf = cpuInfo[0];
+
+	__cpuid(cpuInfo, 1);
+	result.sse4_1 = isBitSet(cpuInfo[2], 19);
+	result.fma = isBitSet(cpuInfo[2], 12);
+	result.avx = isBitSet(cpuInfo[2], 28);
+	bool osxsave = isBitSet(cpuInfo[2], 27);
+
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(cpuInfo, 7, 0);
+		result.avx2 = isBitSet(cpuInfo[1], 5);
+		result.avx512f = isBitSet(cpuInfo[1], 16);
+		result.avx512dq = isBitSet(cpuInfo[1], 17);
+		result.avx512bw = isBitSet(cpuInfo[1], 30);
+		result.avx512vl = isBitSet(cpuInfo[1], 31);
+	}
+
+	// The operating system has to save the wide registers on context switches. Otherwise the instructions fault, even if the CPU supports them.
+	uint64 xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool osSavesYMM = (xcr0 & 0x6) == 0x6; // XMM and YMM.
+	bool osSavesZMM = (xcr0 & 0xE6) == 0xE6; // Additionally the opmask registers and the upper halves of ZMM0-15 and ZMM16-31.
+
+	result.avx &= osSavesYMM;
+	result.avx2 &= osSavesYMM;
+	result.fma &= osSavesYMM;
+
+	result.avx512f &= osSavesZMM;
+	result.avx512dq &= osSavesZMM;
+	result.avx512bw &= osSavesZMM;
+	result.avx512vl &= osSavesZMM;
+
+	return result;
+}
+
+const cpu_features& getCPUFeatures()
+{
+	static const cpu_features features = queryCPUFeatures();
+	return features;
+}
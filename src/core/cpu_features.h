@@ -0,0 +1,18 @@
+#pragma once
+
+// Instruction set extensions supported by the CPU (and the operating system) the program is running on.
+struct cpu_features
+{
+	bool sse4_1;
+	bool avx;
+	bool avx2;
+	bool fma;
+
+	bool avx512f;
+	bool avx512dq;
+	bool avx512bw;
+	bool avx512vl;
+};
+
+// Queried once on the first call.
+const cpu_features& getCPUFeatures();
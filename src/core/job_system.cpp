@@ -1,7 +1,6 @@
 #include "pch.h"
 #include "job_system.h"
 #include "math.h"
-#include "imgui.h"
 
 
 job_queue highPriorityJobQueue;
@@ -100,20 +99,26 @@ bool job_queue::isComplete(int32 globalIndex)
 void job_queue::finishJob(int32 globalIndex)
 {
     job_queue_entry& job = allJobs[globalIndex & indexMask];
+
+    // Read before finishing, because another thread may reuse the slot as soon as the count reaches zero.
+    // A continuation added concurrently holds its own count, so this copy is only used if it is up to date.
+    int32 parentGlobalIndex = job.parentGlobalIndex;
+    job_handle continuation = job.continuation;
+
     int32 numUnfinishedJobs = --job.numUnfinishedJobs;
     ASSERT(numUnfinishedJobs >= 0);
     if (numUnfinishedJobs == 0)
     {
         --runningJobs;
 
-        if (job.parentGlobalIndex != -1)
+        if (parentGlobalIndex != -1)
         {
-            finishJob(job.parentGlobalIndex);
+            finishJob(parentGlobalIndex);
         }
 
-        if (job.continuation.globalIndex != -1)
+        if (continuation.globalIndex != -1)
         {
-            queues[job.continuation.queueIndex]->submit(job.continuation.globalIndex);
+            queues[continuation.queueIndex]->submit(continuation.globalIndex);
         }
     }
 }
@@ -26,8 +26,17 @@ struct job_queue
     {
         static_assert(sizeof(data_t) <= job_queue_entry::DATA_SIZE);
 
+        // The slot is claimed atomically, so several threads can create jobs in the same queue (e.g. the main thread and the physics thread).
+        // If the ring buffer has wrapped around to a job which is still running, help out until it is finished instead of overwriting it.
         int32 globalIndex = nextFreeJob++;
         auto& job = allJobs[globalIndex & indexMask];
+        while (job.numUnfinishedJobs > 0)
+        {
+            if (!executeNextJob())
+            {
+                std::this_thread::yield();
+            }
+        }
         job.numUnfinishedJobs = 1;
         job.parentGlobalIndex = parent.globalIndex;
         job.continuation.globalIndex = -1;
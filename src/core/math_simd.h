@@ -3,11 +3,6 @@
 #include "simd.h"
 #include "soa.h"
 
-
-struct w4_float;
-struct w8_float;
-struct w16_float;
-
 template <typename simd_t>
 union wN_vec2
 {
@@ -64,6 +64,11 @@ void* memory_arena::allocate(uint64 size, uint64 alignment, bool clearToZero)
 	sizeLeftCurrent -= size;
 	sizeLeftTotal -= size;
 
+	if (current > highWaterMark)
+	{
+		highWaterMark = current;
+	}
+
 	mutex.unlock();
 
 	if (clearToZero)
@@ -84,6 +89,11 @@ void memory_arena::setCurrentTo(void* ptr)
 	current = (uint8*)ptr - memory;
 	sizeLeftCurrent = committedMemory - current;
 	sizeLeftTotal = reserveSize - current;
+
+	if (current > highWaterMark)
+	{
+		highWaterMark = current;
+	}
 }
 
 void memory_arena::reset(bool freeMemory)
@@ -96,6 +106,7 @@ void memory_arena::reset(bool freeMemory)
 	}
 
 	resetToMarker(memory_marker{ 0 });
+	highWaterMark = 0;
 }
 
 memory_marker memory_arena::getMarker()
@@ -88,6 +88,10 @@ struct memory_arena
 	memory_marker getMarker();
 	void resetToMarker(memory_marker marker);
 
+	// Largest offset ever allocated up to since the last reset of the high water mark.
+	uint64 getHighWaterMark() { return highWaterMark; }
+	void resetHighWaterMark() { highWaterMark = current; }
+
 	uint8* base() { return memory; }
 
 
@@ -108,9 +112,69 @@ protected:
 
 	uint64 reserveSize = 0;
 
+	uint64 highWaterMark = 0;
+
 	std::mutex mutex;
 };
 
+// Growable array living in a memory arena. Use this for buffers whose final size is not known up front.
+// If the array is the last allocation in the arena, it grows in place. Otherwise the contents are moved to a new
+// allocation of twice the size, and the old memory is only freed when the arena is reset.
+// Not thread safe, and the data pointer may change on every push or reserve.
+template <typename T>
+struct arena_array
+{
+	memory_arena& arena;
+	T* data = 0;
+	uint32 count = 0;
+	uint32 capacity = 0;
+
+	arena_array(memory_arena& arena, uint32 initialCapacity = 0) : arena(arena) { reserve(initialCapacity); }
+
+	void reserve(uint32 newCapacity)
+	{
+		if (newCapacity <= capacity)
+		{
+			return;
+		}
+
+		if (newCapacity < capacity * 2)
+		{
+			newCapacity = capacity * 2;
+		}
+
+		if (data && (uint8*)(data + capacity) == arena.getCurrent())
+		{
+			arena.allocate(sizeof(T) * (newCapacity - capacity));
+		}
+		else
+		{
+			T* newData = arena.allocate<T>(newCapacity);
+			if (count)
+			{
+				memcpy(newData, data, sizeof(T) * count);
+			}
+			data = newData;
+		}
+		capacity = newCapacity;
+	}
+
+	T& push(const T& t)
+	{
+		if (count == capacity)
+		{
+			reserve(count + 1);
+		}
+		return data[count++] = t;
+	}
+
+	T& operator[](uint32 index) { return data[index]; }
+	const T& operator[](uint32 index) const { return data[index]; }
+
+	T* begin() { return data; }
+	T* end() { return data + count; }
+};
+
 struct scope_temp_memory
 {
 	memory_arena& arena;
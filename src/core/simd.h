@@ -152,7 +152,7 @@ static float_t acosInternal(float_t x)
 {
 	// https://developer.download.nvidia.com/cg/acos.html
 
-	float_t negate = ifThen(x < 0.f, 1.f, 0.f);
+	float_t negate = ifThen(x < 0.f, float_t(1.f), float_t(0.f));
 	x = abs(x);
 	float_t ret = -0.0187293f;
 	ret = fmadd(ret, x, 0.0742610f);
@@ -164,6 +164,19 @@ static float_t acosInternal(float_t x)
 }
 
 
+// The wide types live in a namespace per instruction set. The SIMD physics kernels are compiled once per instruction set (see 
+// physics/physics_simd.h), and this keeps the linker from merging their inline member functions with the ones of other translation units.
+#if defined(SIMD_AVX_512)
+#define SIMD_ISA_NAMESPACE simd_avx_512
+#elif defined(SIMD_AVX_2)
+#define SIMD_ISA_NAMESPACE simd_avx_2
+#else
+#define SIMD_ISA_NAMESPACE simd_sse_2
+#endif
+
+namespace SIMD_ISA_NAMESPACE
+{
+
 #if defined(SIMD_SSE_2)
 
 struct w4_float
@@ -312,6 +325,17 @@ static w4_float operator*(w4_float a, w4_float b) { return _mm_mul_ps(a, b); }
 static w4_float& operator*=(w4_float& a, w4_float b) { a = a * b; return a; }
 static w4_float operator/(w4_float a, w4_float b) { return _mm_div_ps(a, b); }
 static w4_float& operator/=(w4_float& a, w4_float b) { a = a / b; return a; }
+
+// Without these, mixing floats and w4_floats is ambiguous with the vec4 and quat operators, which also convert from w4_float.
+static w4_float operator+(w4_float a, float b) { return a + w4_float(b); }
+static w4_float operator+(float a, w4_float b) { return w4_float(a) + b; }
+static w4_float operator-(w4_float a, float b) { return a - w4_float(b); }
+static w4_float operator-(float a, w4_float b) { return w4_float(a) - b; }
+static w4_float operator*(w4_float a, float b) { return a * w4_float(b); }
+static w4_float operator*(float a, w4_float b) { return w4_float(a) * b; }
+static w4_float operator/(w4_float a, float b) { return a / w4_float(b); }
+static w4_float operator/(float a, w4_float b) { return w4_float(a) / b; }
+
 static w4_float operator&(w4_float a, w4_float b) { return _mm_and_ps(a, b); }
 static w4_float& operator&=(w4_float& a, w4_float b) { a = a & b; return a; }
 static w4_float operator|(w4_float a, w4_float b) { return _mm_or_ps(a, b); }
@@ -348,14 +372,21 @@ static w4_float operator-(w4_float a) { return _mm_xor_ps(a, reinterpret(w4_int(
 
 static float addElements(w4_float a) { __m128 aa = _mm_hadd_ps(a, a); aa = _mm_hadd_ps(aa, aa); return aa.m128_f32[0]; }
 
+#if defined(SIMD_AVX_2)
 static w4_float fmadd(w4_float a, w4_float b, w4_float c) { return _mm_fmadd_ps(a, b, c); }
 static w4_float fmsub(w4_float a, w4_float b, w4_float c) { return _mm_fmsub_ps(a, b, c); }
+#else
+// Without AVX2, FMA can't be assumed, so these are a separate multiply and add.
+static w4_float fmadd(w4_float a, w4_float b, w4_float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static w4_float fmsub(w4_float a, w4_float b, w4_float c) { return _mm_sub_ps(_mm_mul_ps(a, b), c); }
+#endif
 
 static w4_float sqrt(w4_float a) { return _mm_sqrt_ps(a); }
 static w4_float rsqrt(w4_float a) { return _mm_rsqrt_ps(a); }
 
 static w4_float ifThen(w4_float cond, w4_float ifCase, w4_float elseCase) { return _mm_blendv_ps(elseCase, ifCase, cond); }
 static w4_int ifThen(w4_int cond, w4_int ifCase, w4_int elseCase) { return reinterpret(ifThen(reinterpret(cond), reinterpret(ifCase), reinterpret(elseCase))); }
+static w4_float ifThen(w4_int cond, w4_float ifCase, w4_float elseCase) { return ifThen(reinterpret(cond), ifCase, elseCase); }
 
 static int toBitMask(w4_float a) { return _mm_movemask_ps(a); }
 static int toBitMask(w4_int a) { return toBitMask(reinterpret(a)); }
@@ -414,7 +445,8 @@ static void transpose(w4_float& out0, w4_float& out1, w4_float& out2, w4_float&
 	_MM_TRANSPOSE4_PS(out0.f, out1.f, out2.f, out3.f);
 }
 
-static void load4(const float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void load4(const float* baseAddress, const index_t* indices, uint32 stride,
 	w4_float& out0, w4_float& out1, w4_float& out2, w4_float& out3)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -427,7 +459,8 @@ static void load4(const float* baseAddress, const uint16* indices, uint32 stride
 	transpose(out0, out1, out2, out3);
 }
 
-static void store4(float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void store4(float* baseAddress, const index_t* indices, uint32 stride,
 	w4_float in0, w4_float in1, w4_float in2, w4_float in3)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -440,7 +473,8 @@ static void store4(float* baseAddress, const uint16* indices, uint32 stride,
 	in3.store(baseAddress + strideInFloats * indices[3]);
 }
 
-static void load8(const float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void load8(const float* baseAddress, const index_t* indices, uint32 stride,
 	w4_float& out0, w4_float& out1, w4_float& out2, w4_float& out3, w4_float& out4, w4_float& out5, w4_float& out6, w4_float& out7)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -458,7 +492,8 @@ static void load8(const float* baseAddress, const uint16* indices, uint32 stride
 	transpose(out4, out5, out6, out7);
 }
 
-static void store8(float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void store8(float* baseAddress, const index_t* indices, uint32 stride,
 	w4_float in0, w4_float in1, w4_float in2, w4_float in3, w4_float in4, w4_float in5, w4_float in6, w4_float in7)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -539,7 +574,7 @@ struct w8_int
 	w8_int(int i_) { i = _mm256_set1_epi32(i_); }
 	w8_int(__m256i i_) { i = i_; }
 	w8_int(int a, int b, int c, int d, int e, int f, int g, int h) { this->i = _mm256_setr_epi32(a, b, c, d, e, f, g, h); }
-	w8_int(const int* i_) { i = _mm256_loadu_epi32(i_); }
+	w8_int(const int* i_) { i = _mm256_loadu_si256((const __m256i*)i_); }
 
 	w8_int(const int* baseAddress, __m256i indices) { i = _mm256_i32gather_epi32(baseAddress, indices, 4); }
 	w8_int(const int* baseAddress, int a, int b, int c, int d, int e, int f, int g, int h) : w8_int(baseAddress, _mm256_setr_epi32(a, b, c, d, e, f, g, h)) {}
@@ -547,7 +582,7 @@ struct w8_int
 	operator __m256i() { return i; }
 	int operator[](uint32 i) const { return this->i.m256i_i32[i]; }
 
-	void store(int* i_) const { _mm256_storeu_epi32(i_, i); }
+	void store(int* i_) const { _mm256_storeu_si256((__m256i*)i_, i); }
 
 #if defined(SIMD_AVX_512)
 	void scatter(int* baseAddress, __m256i indices) { _mm256_i32scatter_epi32(baseAddress, indices, i, 4); }
@@ -709,6 +744,7 @@ static bool anyFalse(uint8 a) { return !allTrue(a); }
 #else
 static w8_float ifThen(w8_float cond, w8_float ifCase, w8_float elseCase) { return _mm256_blendv_ps(elseCase, ifCase, cond); }
 static w8_int ifThen(w8_int cond, w8_int ifCase, w8_int elseCase) { return reinterpret(ifThen(reinterpret(cond), reinterpret(ifCase), reinterpret(elseCase))); }
+static w8_float ifThen(w8_int cond, w8_float ifCase, w8_float elseCase) { return ifThen(reinterpret(cond), ifCase, elseCase); }
 
 static bool allTrue(w8_float a) { return toBitMask(a) == (1 << 8) - 1; }
 static bool allFalse(w8_float a) { return toBitMask(a) == 0; }
@@ -827,7 +863,8 @@ static void transpose(w8_float& out0, w8_float& out1, w8_float& out2, w8_float&
 	transpose32(out4, out5, out6, out7);
 }
 
-static void load4(const float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void load4(const float* baseAddress, const index_t* indices, uint32 stride,
 	w8_float& out0, w8_float& out1, w8_float& out2, w8_float& out3)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -849,7 +886,8 @@ static void load4(const float* baseAddress, const uint16* indices, uint32 stride
 	transpose32(out0, out1, out2, out3);
 }
 
-static void load8(const float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void load8(const float* baseAddress, const index_t* indices, uint32 stride,
 	w8_float& out0, w8_float& out1, w8_float& out2, w8_float& out3, w8_float& out4, w8_float& out5, w8_float& out6, w8_float& out7)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -866,7 +904,8 @@ static void load8(const float* baseAddress, const uint16* indices, uint32 stride
 	transpose(out0, out1, out2, out3, out4, out5, out6, out7);
 }
 
-static void store4(float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void store4(float* baseAddress, const index_t* indices, uint32 stride,
 	w8_float in0, w8_float in1, w8_float in2, w8_float in3)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -892,7 +931,8 @@ static void store4(float* baseAddress, const uint16* indices, uint32 stride,
 	tmp7.store(baseAddress + strideInFloats * indices[7]);
 }
 
-static void store8(float* baseAddress, const uint16* indices, uint32 stride,
+template <typename index_t>
+static void store8(float* baseAddress, const index_t* indices, uint32 stride,
 	w8_float in0, w8_float in1, w8_float in2, w8_float in3, w8_float in4, w8_float in5, w8_float in6, w8_float in7)
 {
 	const uint32 strideInFloats = stride / sizeof(float);
@@ -928,11 +968,15 @@ struct w16_float
 	w16_float(const float* baseAddress, int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k, int l, int m, int n, int o, int p) : w16_float(baseAddress, _mm512_setr_epi32(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)) {}
 
 	operator __m512() { return f; }
+	float operator[](uint32 i) const { return this->f.m512_f32[i]; }
 
 	void store(float* f_) const { _mm512_storeu_ps(f_, f); }
 
 	void scatter(float* baseAddress, __m512i indices) const { _mm512_i32scatter_ps(baseAddress, indices, f, 4); }
 	void scatter(float* baseAddress, int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k, int l, int m, int n, int o, int p) const { scatter(baseAddress, _mm512_setr_epi32(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)); }
+
+	static w16_float allOnes() { const float nnan = (const float&)0xFFFFFFFF; return nnan; }
+	static w16_float zero() { return _mm512_setzero_ps(); }
 };
 
 struct w16_int
@@ -949,8 +993,11 @@ struct w16_int
 	w16_int(const int* baseAddress, int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k, int l, int m, int n, int o, int p) : w16_int(baseAddress, _mm512_setr_epi32(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)) {}
 
 	operator __m512i() { return i; }
+	int operator[](uint32 i) const { return this->i.m512i_i32[i]; }
 
 	void store(int* i_) const { _mm512_storeu_epi32(i_, i); }
+
+	static w16_int zero() { return _mm512_setzero_si512(); }
 };
 
 static w16_float truex16() { const float nnan = (const float&)0xFFFFFFFF; return nnan; }
@@ -1048,6 +1095,9 @@ static w16_float rsqrt(w16_float a) { return 1.f / _mm512_sqrt_ps(a); }
 static w16_float ifThen(uint16 cond, w16_float ifCase, w16_float elseCase) { return _mm512_mask_blend_ps(cond, elseCase, ifCase); }
 static w16_int ifThen(uint16 cond, w16_int ifCase, w16_int elseCase) { return reinterpret(ifThen(cond, reinterpret(ifCase), reinterpret(elseCase))); }
 
+static int toBitMask(uint16 a) { return a; }
+static int toBitMask(int a) { return a; } // Combined masks, e.g. (a < b) & (c < d).
+
 static bool allTrue(uint16 a) { return a == (1 << 16) - 1; }
 static bool allFalse(uint16 a) { return a == 0; }
 static bool anyTrue(uint16 a) { return a > 0; }
@@ -1079,14 +1129,87 @@ static w16_float atan(w16_float x) { return atanInternal<w16_float, w16_int>(x);
 static w16_float atan2(w16_float y, w16_float x) { return atan2Internal<w16_float, w16_int>(y, x); }
 static w16_float acos(w16_float x) { return acosInternal(x); }
 
+static w16_int fillWithFirstLane(w16_int a)
+{
+	return _mm512_broadcastd_epi32(_mm512_castsi512_si128(a));
+}
 
-#endif
+// There is no cheap 16x16 transpose, so the strided loads and stores gather and scatter each component instead.
+template <typename index_t>
+static w16_int stridedOffsets(const index_t* indices, uint32 stride)
+{
+	const int32 strideInFloats = (int32)(stride / sizeof(float));
 
-static bool anyTrue(int32 mask) { return mask > 0; }
-static bool anyTrue(uint32 mask) { return mask > 0; }
+	int32 offsets[16];
+	for (uint32 i = 0; i < 16; ++i)
+	{
+		offsets[i] = (int32)indices[i] * strideInFloats;
+	}
+	return w16_int(offsets);
+}
+
+template <typename index_t>
+static void load4(const float* baseAddress, const index_t* indices, uint32 stride,
+	w16_float& out0, w16_float& out1, w16_float& out2, w16_float& out3)
+{
+	w16_int offsets = stridedOffsets(indices, stride);
+
+	out0 = w16_float(baseAddress + 0, offsets);
+	out1 = w16_float(baseAddress + 1, offsets);
+	out2 = w16_float(baseAddress + 2, offsets);
+	out3 = w16_float(baseAddress + 3, offsets);
+}
+
+template <typename index_t>
+static void load8(const float* baseAddress, const index_t* indices, uint32 stride,
+	w16_float& out0, w16_float& out1, w16_float& out2, w16_float& out3, w16_float& out4, w16_float& out5, w16_float& out6, w16_float& out7)
+{
+	w16_int offsets = stridedOffsets(indices, stride);
+
+	out0 = w16_float(baseAddress + 0, offsets);
+	out1 = w16_float(baseAddress + 1, offsets);
+	out2 = w16_float(baseAddress + 2, offsets);
+	out3 = w16_float(baseAddress + 3, offsets);
+	out4 = w16_float(baseAddress + 4, offsets);
+	out5 = w16_float(baseAddress + 5, offsets);
+	out6 = w16_float(baseAddress + 6, offsets);
+	out7 = w16_float(baseAddress + 7, offsets);
+}
 
+template <typename index_t>
+static void store4(float* baseAddress, const index_t* indices, uint32 stride,
+	w16_float in0, w16_float in1, w16_float in2, w16_float in3)
+{
+	w16_int offsets = stridedOffsets(indices, stride);
+
+	in0.scatter(baseAddress + 0, offsets);
+	in1.scatter(baseAddress + 1, offsets);
+	in2.scatter(baseAddress + 2, offsets);
+	in3.scatter(baseAddress + 3, offsets);
+}
+
+template <typename index_t>
+static void store8(float* baseAddress, const index_t* indices, uint32 stride,
+	w16_float in0, w16_float in1, w16_float in2, w16_float in3, w16_float in4, w16_float in5, w16_float in6, w16_float in7)
+{
+	w16_int offsets = stridedOffsets(indices, stride);
+
+	in0.scatter(baseAddress + 0, offsets);
+	in1.scatter(baseAddress + 1, offsets);
+	in2.scatter(baseAddress + 2, offsets);
+	in3.scatter(baseAddress + 3, offsets);
+	in4.scatter(baseAddress + 4, offsets);
+	in5.scatter(baseAddress + 5, offsets);
+	in6.scatter(baseAddress + 6, offsets);
+	in7.scatter(baseAddress + 7, offsets);
+}
 
 
+#endif
 
+static bool anyTrue(int32 mask) { return mask > 0; }
+static bool anyTrue(uint32 mask) { return mask > 0; }
 
+}
 
+using namespace SIMD_ISA_NAMESPACE;
@@ -0,0 +1,17 @@
+#pragma once
+
+// High resolution timestamps for measuring code outside of the profiler, e.g. for stats shown in the UI.
+
+static uint64 getTimestamp()
+{
+	uint64 timestamp;
+	QueryPerformanceCounter((LARGE_INTEGER*)&timestamp);
+	return timestamp;
+}
+
+static float getMilliseconds(uint64 start, uint64 end)
+{
+	static uint64 clockFrequency;
+	static bool performanceFrequencyQueried = QueryPerformanceFrequency((LARGE_INTEGER*)&clockFrequency);
+	return (float)(end - start) / clockFrequency * 1000.f;
+}
@@ -11,6 +11,7 @@
 #include "geometry/mesh.h"
 #include "physics/ragdoll.h"
 #include "physics/vehicle.h"
+#include "physics/collision_broad.h"
 #include "scene/serialization_yaml.h"
 #include "scene/serialization_binary.h"
 #include "audio/audio.h"
@@ -1110,6 +1111,8 @@ bool scene_editor::drawSceneHierarchy()
 								ImGui::PropertySlider("Angular velocity damping", rb.angularDamping));
 							UNDOABLE_COMPONENT_SETTING("rigid body gravity factor", rb.gravityFactor,
 								ImGui::PropertySlider("Gravity factor", rb.gravityFactor));
+							UNDOABLE_COMPONENT_SETTING("rigid body continuous collision detection", rb.continuousCollisionDetection,
+								ImGui::PropertyCheckbox("Continuous collision detection", rb.continuousCollisionDetection));
 
 							//ImGui::PropertyValue("Linear velocity", rb.linearVelocity);
 							//ImGui::PropertyValue("Angular velocity", rb.angularVelocity);
@@ -1215,6 +1218,12 @@ bool scene_editor::drawSceneHierarchy()
 									ImGui::PropertySlider("Friction", collider.material.friction);
 									dirty |= ImGui::PropertyDrag("Density", collider.material.density, 0.05f, 0.f);
 
+									uint32 layer = collider.layer;
+									if (ImGui::PropertySlider("Layer", layer, 0, 31))
+									{
+										collider.layer = (uint8)layer;
+									}
+
 									bool editCollider = selectedColliderEntity == colliderEntity;
 									if (ImGui::PropertyCheckbox("Edit", editCollider))
 									{
@@ -1556,6 +1565,19 @@ bool scene_editor::drawSceneHierarchy()
 								ImGui::PropertySlider("Velocity damping", cloth.damping, 0.f, 1.f));
 							UNDOABLE_COMPONENT_SETTING("cloth gravity factor", cloth.gravityFactor,
 								ImGui::PropertySlider("Gravity factor", cloth.gravityFactor, 0.f, 1.f));
+							UNDOABLE_COMPONENT_SETTING("cloth stretch compliance", cloth.stretchCompliance,
+								ImGui::PropertyDrag("Stretch compliance (XPBD)", cloth.stretchCompliance, 1e-7f, 0.f, FLT_MAX, "%.2e"));
+							UNDOABLE_COMPONENT_SETTING("cloth bend compliance", cloth.bendCompliance,
+								ImGui::PropertyDrag("Bend compliance (XPBD)", cloth.bendCompliance, 1e-5f, 0.f, FLT_MAX, "%.2e"));
+							UNDOABLE_COMPONENT_SETTING("cloth thickness", cloth.thickness,
+								ImGui::PropertySlider("Thickness", cloth.thickness, 0.f, 0.2f));
+							UNDOABLE_COMPONENT_SETTING("cloth self collision", cloth.selfCollision,
+								ImGui::PropertyCheckbox("Self collision", cloth.selfCollision));
+							if (cloth.selfCollision)
+							{
+								UNDOABLE_COMPONENT_SETTING("cloth self collision distance", cloth.selfCollisionDistance,
+									ImGui::PropertySlider("Self collision distance", cloth.selfCollisionDistance, 0.001f, 0.2f));
+							}
 
 							ImGui::EndProperties();
 						}
@@ -2662,10 +2684,20 @@ void scene_editor::drawSettings(float dt)
 
 					UNDOABLE_SETTING("max physics steps per frame", physicsSettings.maxPhysicsIterationsPerFrame,
 						ImGui::PropertyDrag("Max physics steps per frame", physicsSettings.maxPhysicsIterationsPerFrame));
+					UNDOABLE_SETTING("asynchronous physics", physicsSettings.asynchronous,
+						ImGui::PropertyCheckbox("Asynchronous (own thread)", physicsSettings.asynchronous));
 				}
 
 				UNDOABLE_SETTING("rigid solver iterations", physicsSettings.numRigidSolverIterations,
 					ImGui::PropertySlider("Rigid solver iterations", physicsSettings.numRigidSolverIterations, 1, 200));
+				UNDOABLE_SETTING("rigid solver substeps", physicsSettings.numRigidSolverSubsteps,
+					ImGui::PropertySlider("Rigid solver substeps", physicsSettings.numRigidSolverSubsteps, 1, 32));
+				UNDOABLE_SETTING("warm start contacts", physicsSettings.warmStartContacts,
+					ImGui::PropertyCheckbox("Warm start contacts", physicsSettings.warmStartContacts));
+				UNDOABLE_SETTING("enable sleeping", physicsSettings.enableSleeping,
+					ImGui::PropertyCheckbox("Enable sleeping", physicsSettings.enableSleeping));
+				UNDOABLE_SETTING("cache separating axes", physicsSettings.cacheSeparatingAxes,
+					ImGui::PropertyCheckbox("Cache separating axes", physicsSettings.cacheSeparatingAxes));
 
 				UNDOABLE_SETTING("cloth velocity iterations", physicsSettings.numClothVelocityIterations,
 					ImGui::PropertySlider("Cloth velocity iterations", physicsSettings.numClothVelocityIterations, 0, 10));
@@ -2673,19 +2705,41 @@ void scene_editor::drawSettings(float dt)
 					ImGui::PropertySlider("Cloth position iterations", physicsSettings.numClothPositionIterations, 0, 10));
 				UNDOABLE_SETTING("cloth drift iterations", physicsSettings.numClothDriftIterations,
 					ImGui::PropertySlider("Cloth drift iterations", physicsSettings.numClothDriftIterations, 0, 10));
+				UNDOABLE_SETTING("cloth XPBD substeps", physicsSettings.numClothXPBDSubsteps,
+					ImGui::PropertySlider("Cloth XPBD substeps", physicsSettings.numClothXPBDSubsteps, 0, 32));
+				UNDOABLE_SETTING("cloth collisions", physicsSettings.clothCollisions,
+					ImGui::PropertyCheckbox("Cloth collisions", physicsSettings.clothCollisions));
 
 				UNDOABLE_SETTING("test force", physicsTestForce,
 					ImGui::PropertySlider("Test force", physicsTestForce, 1.f, 10000.f));
 
-				UNDOABLE_SETTING("SIMD broad phase", physicsSettings.simdBroadPhase,
-					ImGui::PropertyCheckbox("SIMD broad phase", physicsSettings.simdBroadPhase));
+				UNDOABLE_SETTING("broad phase", physicsSettings.broadphaseType,
+					ImGui::PropertyDropdown("Broad phase", broadphaseTypeNames, broadphase_type_count, (uint32&)physicsSettings.broadphaseType));
+				if (physicsSettings.broadphaseType == broadphase_type_sweep_and_prune)
+				{
+					UNDOABLE_SETTING("SIMD broad phase", physicsSettings.simdBroadPhase,
+						ImGui::PropertyCheckbox("SIMD broad phase", physicsSettings.simdBroadPhase));
+				}
 				UNDOABLE_SETTING("SIMD narrow phase", physicsSettings.simdNarrowPhase,
 					ImGui::PropertyCheckbox("SIMD narrow phase", physicsSettings.simdNarrowPhase));
 				UNDOABLE_SETTING("SIMD constraint solver", physicsSettings.simdConstraintSolver,
 					ImGui::PropertyCheckbox("SIMD constraint solver", physicsSettings.simdConstraintSolver));
+				UNDOABLE_SETTING("SIMD width", physicsSettings.simdWidth,
+					ImGui::PropertyDropdown("SIMD width", physicsSIMDWidthNames, physics_simd_width_count, (uint32&)physicsSettings.simdWidth));
 
 				ImGui::EndProperties();
 			}
+
+			if (ImGui::Button("Benchmark broad phase"))
+			{
+				broadphase_benchmark_result results[8];
+				uint32 numResults = benchmarkBroadphase(results);
+				for (uint32 i = 0; i < numResults; ++i)
+				{
+					LOG_MESSAGE("Broad phase benchmark '%s' (%u overlaps): Sweep and prune %.3fms, AABB tree %.3fms",
+						results[i].distribution, results[i].numOverlaps, results[i].sapMilliseconds, results[i].aabbTreeMilliseconds);
+				}
+			}
 			ImGui::EndTree();
 		}
 
@@ -1,28 +1,31 @@
 #include "pch.h"
 #include "learned_locomotion.h"
 #include "core/random.h"
+#include "core/threading.h"
+#include "policy_inference.h"
+
+#include <thread>
+#include <condition_variable>
 
 
 #if __has_include("../tmp/network.h")
 #define INFERENCE_POSSIBLE
 #include "../tmp/network.h"
 
-
-template <uint32 inputSize, uint32 outputSize>
-static void applyLayer(const float(&weights)[outputSize][inputSize], const float(&bias)[outputSize], const float* from, float* to, bool activation)
+static const policy_network& getPolicy()
 {
-	for (uint32 y = 0; y < outputSize; ++y)
+	static policy_network policy = []()
 	{
-		const float* row = weights[y];
-
-		float sum = 0.f;
-		for (uint32 x = 0; x < inputSize; ++x)
-		{
-			sum += row[x] * from[x];
-		}
-		sum += bias[y];
-		to[y] = activation ? tanh(sum) : sum;
-	}
+		policy_network result;
+		result.addLayer(&policyWeights1[0][0], policyBias1, arraysize(policyWeights1[0]), arraysize(policyWeights1), true);
+		result.addLayer(&policyWeights2[0][0], policyBias2, arraysize(policyWeights2[0]), arraysize(policyWeights2), true);
+		result.addLayer(&actionWeights[0][0], actionBias, arraysize(actionWeights[0]), arraysize(actionWeights), false);
+
+		ASSERT(result.getInputSize() == sizeof(learned_locomotion::learning_state) / 4);
+		ASSERT(result.getOutputSize() == sizeof(learned_locomotion::learning_action) / 4);
+		return result;
+	}();
+	return policy;
 }
 #endif
 
@@ -44,26 +47,44 @@ void learned_locomotion::reset(game_scene& scene)
 void learned_locomotion::update(game_scene& scene)
 {
 #ifdef INFERENCE_POSSIBLE
+	const policy_network& policy = getPolicy();
+
 	learning_state state;
 	getState(state);
 
 	learning_action action;
 
-	float* buffers = (float*)alloca(sizeof(float) * HIDDEN_LAYER_SIZE * 2);
+	float* scratch = (float*)alloca(sizeof(float) * policy.getScratchSize(1));
+	policy.evaluate((const float*)&state, (float*)&action, 1, scratch);
+
+	applyAction(scene, action);
+#endif
+}
 
-	float* a = buffers;
-	float* b = buffers + HIDDEN_LAYER_SIZE;
+void learned_locomotion::update(game_scene& scene, learned_locomotion* locomotions, uint32 count, memory_arena& arena)
+{
+#ifdef INFERENCE_POSSIBLE
+	const policy_network& policy = getPolicy();
 
-	// State to a.
-	applyLayer(policyWeights1, policyBias1, (const float*)&state, a, true);
+	memory_marker marker = arena.getMarker();
 
-	// a to b.
-	applyLayer(policyWeights2, policyBias2, a, b, true);
+	learning_state* states = arena.allocate<learning_state>(count);
+	learning_action* actions = arena.allocate<learning_action>(count);
+	float* scratch = arena.allocate<float>(policy.getScratchSize(count));
 
-	// b to action.
-	applyLayer(actionWeights, actionBias, b, (float*)&action, false);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		locomotions[i].getState(states[i]);
+	}
 
-	applyAction(scene, action);
+	policy.evaluate((const float*)states, (float*)actions, count, scratch);
+
+	for (uint32 i = 0; i < count; ++i)
+	{
+		locomotions[i].applyAction(scene, actions[i]);
+	}
+
+	arena.resetToMarker(marker);
 #endif
 }
 
@@ -386,12 +407,6 @@ static void getLimits(game_scene& scene, cone_twist_constraint_handle handle, fl
 
 
 
-static training_locomotion* trainingEnv = 0;
-static memory_arena stackArena;
-static game_scene trainingScene;
-static float totalReward;
-static random_number_generator rng = { (uint32)time(0) };
-
 extern "C" __declspec(dllexport) int getPhysicsStateSize() { return sizeof(learned_locomotion::learning_state) / 4; }
 extern "C" __declspec(dllexport) int getPhysicsActionSize() { return sizeof(learned_locomotion::learning_action) / 4; }
 
@@ -426,44 +441,58 @@ extern "C" __declspec(dllexport) void getPhysicsRanges(float* stateMin, float* s
 	tmpScene.clearAll();
 }
 
-extern "C" __declspec(dllexport) void resetPhysics(float* outState)
+// Everything one training environment needs. The environments share no state, so that they can be stepped on different threads.
+struct training_environment
 {
-	if (!trainingEnv)
-	{
-		trainingEnv = new training_locomotion;
-		stackArena.initialize();
-	}
+	training_environment(uint64 seed) : rng(seed) { arena.initialize(0, GB(1)); }
+
+	void reset(float* outState);
+	bool update(const float* action, float* outState, float* outReward); // Returns true, if the ragdoll has fallen.
+
+	training_locomotion locomotion;
+	game_scene scene;
+	memory_arena arena;
+	random_number_generator rng;
+	float totalReward;
+};
 
+void training_environment::reset(float* outState)
+{
 	totalReward = 0.f;
-	trainingScene.clearAll();
+	scene.clearAll();
 
 	physics_material groundMaterial = { physics_material_type_metal, 0.1f, 1.f, 4.f };
 
-	trainingScene.createEntity("Test ground")
+	scene.createEntity("Test ground")
 		.addComponent<transform_component>(vec3(0.f, -4.f, 0.f), quat(vec3(1.f, 0.f, 0.f), deg2rad(0.f)))
 		.addComponent<collider_component>(collider_component::asAABB(bounding_box::fromCenterRadius(vec3(0.f, 0.f, 0.f), vec3(20.f, 4.f, 20.f)), groundMaterial));
 
-	humanoid_ragdoll ragdoll = humanoid_ragdoll::create(trainingScene, vec3(0.f, 1.25f, 0.f));
+	humanoid_ragdoll ragdoll = humanoid_ragdoll::create(scene, vec3(0.f, 1.25f, 0.f));
+
+	locomotion.ragdoll = ragdoll;
+	locomotion.reset(scene);
 
-	trainingEnv->ragdoll = ragdoll;
-	trainingEnv->reset(trainingScene);
+	if (outState)
+	{
+		locomotion.getState(*(learned_locomotion::learning_state*)outState);
+	}
 }
 
-extern "C" __declspec(dllexport) int updatePhysics(float* action, float* outState, float* outReward)
+bool training_environment::update(const float* action, float* outState, float* outReward)
 {
-	stackArena.reset();
+	arena.reset();
 
-	trainingEnv->applyAction(trainingScene, *(learned_locomotion::learning_action*)action);
+	locomotion.applyAction(scene, *(const learned_locomotion::learning_action*)action);
 
 	if (rng.randomFloat01() < 0.02f)
 	{
 		uint32 bodyPartIndex = rng.randomUint32Between(0, learned_locomotion::NUM_BODY_PARTS - 1);
 
-		vec3 part = trainingEnv->ragdoll.bodyParts[bodyPartIndex].getComponent<transform_component>().position + vec3(0.f, 0.2f, 0.f);
+		vec3 part = locomotion.ragdoll.bodyParts[bodyPartIndex].getComponent<transform_component>().position + vec3(0.f, 0.2f, 0.f);
 		vec3 direction = normalize(vec3(rng.randomFloatBetween(-1.f, 1.f), 0.f, rng.randomFloatBetween(-1.f, 1.f)));
 		vec3 origin = part - direction * 5.f;
 
-		testPhysicsInteraction(trainingScene, ray{ origin, direction });
+		testPhysicsInteraction(scene, ray{ origin, direction });
 	}
 
 	physics_settings physicsSettings;
@@ -471,19 +500,214 @@ extern "C" __declspec(dllexport) int updatePhysics(float* action, float* outStat
 
 	const float physicsFixedTimeStep = 1.f / (float)physicsSettings.frameRate;
 	float physicsTimer = 0.f;
-	physicsStep(trainingScene, stackArena, physicsTimer, physicsSettings, physicsFixedTimeStep);
+	physicsStep(scene, arena, physicsTimer, physicsSettings, physicsFixedTimeStep);
 
-	bool failure = trainingEnv->getState(*(learned_locomotion::learning_state*)outState);
+	bool failure = locomotion.getState(*(learned_locomotion::learning_state*)outState);
 	*outReward = 0.f;
 	if (!failure)
 	{
-		*outReward = trainingEnv->getReward();
+		*outReward = locomotion.getReward();
 		totalReward += *outReward;
 	}
-	else
+	return failure;
+}
+
+static training_environment* trainingEnv = 0;
+
+extern "C" __declspec(dllexport) void resetPhysics(float* outState)
+{
+	if (!trainingEnv)
 	{
-		//std::string out = "Rew: " + std::to_string(learningEnv->totalReward) + ",  EpLen: " + std::to_string(learningEnv->episodeLength) + '\n';
-		//std::cout << out;
+		trainingEnv = new training_environment((uint64)time(0));
 	}
-	return failure;
+
+	trainingEnv->reset(outState);
+}
+
+extern "C" __declspec(dllexport) int updatePhysics(float* action, float* outState, float* outReward)
+{
+	return trainingEnv->update(action, outState, outReward);
+}
+
+
+
+
+
+// --------------------------------
+// BATCHED TRAINING
+// --------------------------------
+
+// N independent environments, which are stepped in parallel by a fixed set of worker threads. All buffers are contiguous and indexed by environment,
+// i.e. the state of environment i starts at states[i * stateSize], so that they can be wrapped by numpy arrays without copying.
+struct training_batch
+{
+	training_batch(uint32 numEnvironments, uint32 numThreads, uint64 seed);
+	~training_batch();
+
+	// Calls func(environmentIndex) for every environment and returns, once all are done. The calling thread helps out.
+	template <typename func_t>
+	void forEachEnvironment(const func_t& func);
+
+	std::vector<std::unique_ptr<training_environment>> environments;
+
+private:
+	void workerThread();
+	void processEnvironments();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	std::function<void(uint32)> task;
+	volatile uint32 nextEnvironment = 0;
+	uint32 numFinishedWorkers = 0;
+	uint32 generation = 0;
+	bool quit = false;
+};
+
+training_batch::training_batch(uint32 numEnvironments, uint32 numThreads, uint64 seed)
+{
+	for (uint32 i = 0; i < numEnvironments; ++i)
+	{
+		environments.push_back(std::make_unique<training_environment>(seed + i * 7919));
+	}
+
+	// The calling thread is one of the threads.
+	uint32 numWorkers = min(numThreads, numEnvironments);
+	numWorkers = (numWorkers > 0) ? (numWorkers - 1) : 0;
+	for (uint32 i = 0; i < numWorkers; ++i)
+	{
+		workers.emplace_back([this]() { workerThread(); });
+	}
+}
+
+training_batch::~training_batch()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void training_batch::processEnvironments()
+{
+	uint32 numEnvironments = (uint32)environments.size();
+	for (uint32 i = atomicIncrement(nextEnvironment); i < numEnvironments; i = atomicIncrement(nextEnvironment))
+	{
+		task(i);
+	}
+}
+
+void training_batch::workerThread()
+{
+	uint32 lastGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this, lastGeneration]() { return quit || generation != lastGeneration; });
+			if (quit)
+			{
+				return;
+			}
+			lastGeneration = generation;
+		}
+
+		processEnvironments();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++numFinishedWorkers;
+		}
+		doneCondition.notify_one();
+	}
+}
+
+template <typename func_t>
+void training_batch::forEachEnvironment(const func_t& func)
+{
+	task = func;
+	nextEnvironment = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		numFinishedWorkers = 0;
+		++generation;
+	}
+	wakeCondition.notify_all();
+
+	processEnvironments();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this]() { return numFinishedWorkers == (uint32)workers.size(); });
+}
+
+extern "C" __declspec(dllexport) training_batch* createPhysicsBatch(int numEnvironments, int numThreads, int seed)
+{
+	if (numThreads <= 0)
+	{
+		numThreads = (int)std::thread::hardware_concurrency();
+	}
+	return new training_batch((uint32)numEnvironments, (uint32)numThreads, (uint64)seed + 1); // The XOR shift generator must not be seeded with 0.
+}
+
+extern "C" __declspec(dllexport) void destroyPhysicsBatch(training_batch* batch)
+{
+	delete batch;
+}
+
+extern "C" __declspec(dllexport) int getPhysicsBatchSize(training_batch* batch)
+{
+	return (int)batch->environments.size();
+}
+
+// Resets all environments. outStates has numEnvironments * stateSize many elements.
+extern "C" __declspec(dllexport) void resetPhysicsBatch(training_batch* batch, float* outStates)
+{
+	uint32 stateSize = (uint32)getPhysicsStateSize();
+	batch->forEachEnvironment([batch, outStates, stateSize](uint32 i)
+	{
+		batch->environments[i]->reset(outStates + i * stateSize);
+	});
+}
+
+// Steps all environments once. Environments in which the ragdoll has fallen are reset right away, and their outStates contain the state after the reset,
+// like vectorized environments expect. If outTerminalStates is not null, it receives the state before the reset for these environments.
+// outDones has one element per environment. Returns the number of environments which were reset.
+extern "C" __declspec(dllexport) int updatePhysicsBatch(training_batch* batch, const float* actions, float* outStates, float* outRewards, int* outDones, float* outTerminalStates)
+{
+	uint32 stateSize = (uint32)getPhysicsStateSize();
+	uint32 actionSize = (uint32)getPhysicsActionSize();
+
+	batch->forEachEnvironment([=](uint32 i)
+	{
+		training_environment& env = *batch->environments[i];
+		float* state = outStates + i * stateSize;
+
+		bool done = env.update(actions + i * actionSize, state, outRewards + i);
+		outDones[i] = done;
+
+		if (done)
+		{
+			if (outTerminalStates)
+			{
+				memcpy(outTerminalStates + i * stateSize, state, sizeof(float) * stateSize);
+			}
+			env.reset(state);
+		}
+	});
+
+	uint32 numDone = 0;
+	for (uint32 i = 0; i < (uint32)batch->environments.size(); ++i)
+	{
+		numDone += (outDones[i] != 0);
+	}
+	return (int)numDone;
 }
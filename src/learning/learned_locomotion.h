@@ -9,6 +9,9 @@ struct learned_locomotion
 
 	void update(game_scene& scene);
 
+	// Evaluates the policy for all ragdolls at once, which is much faster than updating them one by one.
+	static void update(game_scene& scene, learned_locomotion* locomotions, uint32 count, memory_arena& arena);
+
 
 	static const uint32 NUM_CONE_TWIST_CONSTRAINTS =  arraysize(humanoid_ragdoll::coneTwistConstraints);
 	static const uint32 NUM_HINGE_CONSTRAINTS = arraysize(humanoid_ragdoll::hingeConstraints);
@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "policy_inference.h"
+#include "core/cpu_features.h"
+#include "core/memory.h"
+
+// Defined in policy_inference_w*.cpp.
+extern const policy_inference_kernels policyInferenceKernels4;
+extern const policy_inference_kernels policyInferenceKernels8;
+extern const policy_inference_kernels policyInferenceKernels16;
+
+const policy_inference_kernels* getPolicyInferenceKernels()
+{
+	const cpu_features& cpu = getCPUFeatures();
+
+	if (cpu.sse4_1 && cpu.avx2 && cpu.fma && cpu.avx512f && cpu.avx512dq && cpu.avx512bw && cpu.avx512vl)
+	{
+		return &policyInferenceKernels16;
+	}
+	if (cpu.sse4_1 && cpu.avx2 && cpu.fma)
+	{
+		return &policyInferenceKernels8;
+	}
+	if (cpu.sse4_1 && cpu.fma)
+	{
+		return &policyInferenceKernels4;
+	}
+	return 0;
+}
+
+// Same math as the SIMD version in policy_inference_kernels.h.
+static float fastTanh(float x)
+{
+	x = clamp(x, -4.97f, 4.97f);
+	float x2 = x * x;
+	float p = x * (135135.f + x2 * (17325.f + x2 * (378.f + x2)));
+	float q = 135135.f + x2 * (62370.f + x2 * (3150.f + x2 * 28.f));
+	return clamp(p / q, -1.f, 1.f);
+}
+
+// Fallback with a width of one, i.e. the packed weights are just the row major weights.
+static void evaluateLayerScalar(const float* packedWeights, const float* bias, uint32 inputSize, uint32 paddedOutputSize, bool activation,
+	const float* inputs, uint32 inputStride, float* outputs, uint32 outputStride, uint32 count)
+{
+	for (uint32 s = 0; s < count; ++s)
+	{
+		const float* in = inputs + s * inputStride;
+		float* out = outputs + s * outputStride;
+
+		for (uint32 y = 0; y < paddedOutputSize; ++y)
+		{
+			const float* row = packedWeights + y * inputSize;
+
+			float sum = bias[y];
+			for (uint32 x = 0; x < inputSize; ++x)
+			{
+				sum += row[x] * in[x];
+			}
+			out[y] = activation ? fastTanh(sum) : sum;
+		}
+	}
+}
+
+void policy_network::addLayer(const float* weights, const float* bias, uint32 inputSize, uint32 outputSize, bool activation)
+{
+	ASSERT(layers.empty() || layers.back().outputSize == inputSize);
+
+	if (layers.empty())
+	{
+		kernels = getPolicyInferenceKernels();
+	}
+	uint32 width = kernels ? kernels->width : 1;
+
+	policy_layer& layer = layers.emplace_back();
+	layer.inputSize = inputSize;
+	layer.outputSize = outputSize;
+	layer.paddedOutputSize = alignTo(outputSize, POLICY_MAX_SIMD_WIDTH);
+	layer.activation = activation;
+
+	// The padding outputs have zero weights and bias, so they evaluate to zero.
+	layer.bias.resize(layer.paddedOutputSize, 0.f);
+	memcpy(layer.bias.data(), bias, sizeof(float) * outputSize);
+
+	layer.packedWeights.resize(layer.paddedOutputSize * inputSize, 0.f);
+	for (uint32 y = 0; y < outputSize; ++y)
+	{
+		uint32 block = y / width;
+		uint32 lane = y % width;
+		for (uint32 x = 0; x < inputSize; ++x)
+		{
+			layer.packedWeights[(block * inputSize + x) * width + lane] = weights[y * inputSize + x];
+		}
+	}
+
+	maxPaddedOutputSize = max(maxPaddedOutputSize, layer.paddedOutputSize);
+}
+
+uint32 policy_network::getScratchSize(uint32 count) const
+{
+	return maxPaddedOutputSize * count * 2;
+}
+
+void policy_network::evaluate(const float* inputs, float* outputs, uint32 count, float* scratch) const
+{
+	auto evaluateLayer = kernels ? kernels->evaluateLayer : evaluateLayerScalar;
+
+	float* buffers[2] = { scratch, scratch + maxPaddedOutputSize * count };
+
+	const float* in = inputs;
+	uint32 inStride = getInputSize();
+
+	for (uint32 i = 0; i < (uint32)layers.size(); ++i)
+	{
+		const policy_layer& layer = layers[i];
+
+		float* out = buffers[i % 2];
+		evaluateLayer(layer.packedWeights.data(), layer.bias.data(), layer.inputSize, layer.paddedOutputSize, layer.activation,
+			in, inStride, out, layer.paddedOutputSize, count);
+
+		in = out;
+		inStride = layer.paddedOutputSize;
+	}
+
+	// Strip the padding.
+	uint32 outputSize = getOutputSize();
+	for (uint32 s = 0; s < count; ++s)
+	{
+		memcpy(outputs + s * outputSize, in + s * inStride, sizeof(float) * outputSize);
+	}
+}
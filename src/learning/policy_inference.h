@@ -0,0 +1,54 @@
+#pragma once
+
+#include "core/math.h"
+
+// Inference of small fully connected networks (like the exported locomotion policies), evaluated for one or many inputs at once.
+// The weights are packed at load time for the widest SIMD width supported by the CPU, with blocks of outputs in the vector lanes.
+// The kernels are compiled once per width (see policy_inference_w*.cpp), like the physics kernels.
+
+#define POLICY_MAX_SIMD_WIDTH 16
+
+struct policy_inference_kernels
+{
+	uint32 width;
+
+	// Computes count rows of outputs = activation(weights * inputs + bias). The outputs of each row are padded to paddedOutputSize.
+	// The packed weights consist of paddedOutputSize / width blocks, each of which stores width outputs per input.
+	void (*evaluateLayer)(const float* packedWeights, const float* bias, uint32 inputSize, uint32 paddedOutputSize, bool activation,
+		const float* inputs, uint32 inputStride, float* outputs, uint32 outputStride, uint32 count);
+};
+
+// Returns the kernels for the widest width supported by the CPU, or null, if the CPU does not support any of them.
+const policy_inference_kernels* getPolicyInferenceKernels();
+
+struct policy_network
+{
+	// Weights are row major with outputSize rows and inputSize columns, like the arrays in the exported network.h. The layers are applied in order.
+	// Hidden layers usually use the tanh activation, which is approximated.
+	void addLayer(const float* weights, const float* bias, uint32 inputSize, uint32 outputSize, bool activation);
+
+	uint32 getInputSize() const { return layers.empty() ? 0 : layers.front().inputSize; }
+	uint32 getOutputSize() const { return layers.empty() ? 0 : layers.back().outputSize; }
+
+	// Number of floats, which evaluate needs as scratch space for count inputs.
+	uint32 getScratchSize(uint32 count) const;
+
+	// Inputs and outputs are tightly packed, i.e. count * inputSize and count * outputSize many.
+	void evaluate(const float* inputs, float* outputs, uint32 count, float* scratch) const;
+
+private:
+	struct policy_layer
+	{
+		uint32 inputSize;
+		uint32 outputSize;
+		uint32 paddedOutputSize; // Multiple of POLICY_MAX_SIMD_WIDTH.
+		bool activation;
+
+		std::vector<float> packedWeights;
+		std::vector<float> bias; // paddedOutputSize many.
+	};
+
+	std::vector<policy_layer> layers;
+	const policy_inference_kernels* kernels = 0;
+	uint32 maxPaddedOutputSize = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+// Instantiates the inference kernels for one vector width. Included once by each of policy_inference_w*.cpp, which define
+// POLICY_SIMD_WIDTH and POLICY_INFERENCE_KERNELS and are compiled with the matching instruction set.
+// Everything in here ends up in an anonymous namespace, so that the different widths do not clash.
+
+#include "policy_inference.h"
+#include "core/simd.h"
+
+#if POLICY_SIMD_WIDTH == 4
+#if !defined(SIMD_SSE_2)
+#error The 4-wide kernels require SSE.
+#endif
+#elif POLICY_SIMD_WIDTH == 8
+#if !defined(SIMD_AVX_2)
+#error The 8-wide kernels must be compiled with AVX2.
+#endif
+#elif POLICY_SIMD_WIDTH == 16
+#if !defined(SIMD_AVX_512)
+#error The 16-wide kernels must be compiled with AVX-512.
+#endif
+#else
+#error Unsupported SIMD width.
+#endif
+
+static_assert(POLICY_MAX_SIMD_WIDTH % POLICY_SIMD_WIDTH == 0);
+
+namespace
+{
+	// Inline functions from shared headers (like core/math.h) would be emitted as COMDATs here, compiled with this width's instruction set,
+	// and the linker may keep this copy for the whole program. So the kernels only use the wide types, whose functions live in a namespace
+	// per instruction set (see core/simd.h), and the functions below. ASSERT and the profiling macros must not be used either.
+#if POLICY_SIMD_WIDTH == 4
+	typedef w4_float w_float;
+#elif POLICY_SIMD_WIDTH == 8
+	typedef w8_float w_float;
+#elif POLICY_SIMD_WIDTH == 16
+	typedef w16_float w_float;
+#endif
+
+	// Pade approximant, which is accurate to about 1e-4 and much cheaper than the exp based tanh.
+	static w_float fastTanh(w_float x)
+	{
+		x = clamp(x, w_float(-4.97f), w_float(4.97f));
+		w_float x2 = x * x;
+		w_float p = x * fmadd(x2, fmadd(x2, x2 + 378.f, w_float(17325.f)), w_float(135135.f));
+		w_float q = fmadd(x2, fmadd(x2, fmadd(x2, w_float(28.f), w_float(3150.f)), w_float(62370.f)), w_float(135135.f));
+		return clamp(p / q, w_float(-1.f), w_float(1.f));
+	}
+
+	// Evaluates numRows inputs together, so that each weight load is used numRows times.
+	template <uint32 numRows>
+	static void evaluateRowsSIMD(const float* packedWeights, const float* bias, uint32 inputSize, uint32 paddedOutputSize, bool activation,
+		const float* inputs, uint32 inputStride, float* outputs, uint32 outputStride)
+	{
+		for (uint32 block = 0; block < paddedOutputSize; block += POLICY_SIMD_WIDTH)
+		{
+			const float* weights = packedWeights + block * inputSize;
+
+			w_float acc[numRows];
+			for (uint32 r = 0; r < numRows; ++r)
+			{
+				acc[r] = w_float(bias + block);
+			}
+
+			for (uint32 x = 0; x < inputSize; ++x)
+			{
+				w_float w(weights + x * POLICY_SIMD_WIDTH);
+				for (uint32 r = 0; r < numRows; ++r)
+				{
+					acc[r] = fmadd(w_float(inputs[r * inputStride + x]), w, acc[r]);
+				}
+			}
+
+			for (uint32 r = 0; r < numRows; ++r)
+			{
+				w_float result = activation ? fastTanh(acc[r]) : acc[r];
+				result.store(outputs + r * outputStride + block);
+			}
+		}
+	}
+
+	static void evaluateLayerSIMD(const float* packedWeights, const float* bias, uint32 inputSize, uint32 paddedOutputSize, bool activation,
+		const float* inputs, uint32 inputStride, float* outputs, uint32 outputStride, uint32 count)
+	{
+		uint32 s = 0;
+		for (; s + 4 <= count; s += 4)
+		{
+			evaluateRowsSIMD<4>(packedWeights, bias, inputSize, paddedOutputSize, activation, inputs + s * inputStride, inputStride, outputs + s * outputStride, outputStride);
+		}
+		for (; s < count; ++s)
+		{
+			evaluateRowsSIMD<1>(packedWeights, bias, inputSize, paddedOutputSize, activation, inputs + s * inputStride, inputStride, outputs + s * outputStride, outputStride);
+		}
+	}
+}
+
+extern const policy_inference_kernels POLICY_INFERENCE_KERNELS =
+{
+	POLICY_SIMD_WIDTH,
+	evaluateLayerSIMD,
+};
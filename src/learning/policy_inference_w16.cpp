@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// Compiled with /arch:AVX512, see premake5.lua.
+#define POLICY_SIMD_WIDTH 16u
+#define POLICY_INFERENCE_KERNELS policyInferenceKernels16
+#include "policy_inference_kernels.h"
@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// Compiled with the default instruction set (SSE), see premake5.lua.
+#define POLICY_SIMD_WIDTH 4u
+#define POLICY_INFERENCE_KERNELS policyInferenceKernels4
+#include "policy_inference_kernels.h"
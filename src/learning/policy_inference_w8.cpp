@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// Compiled with /arch:AVX2, see premake5.lua.
+#define POLICY_SIMD_WIDTH 8u
+#define POLICY_INFERENCE_KERNELS policyInferenceKernels8
+#include "policy_inference_kernels.h"
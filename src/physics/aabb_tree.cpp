@@ -0,0 +1,398 @@
+#include "pch.h"
+#include "aabb_tree.h"
+#include "physics_snapshot.h"
+
+static bounding_box combine(const bounding_box& a, const bounding_box& b)
+{
+	return bounding_box::fromMinMax(min(a.minCorner, b.minCorner), max(a.maxCorner, b.maxCorner));
+}
+
+static float surfaceArea(const bounding_box& aabb)
+{
+	vec3 d = aabb.maxCorner - aabb.minCorner;
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool contains(const bounding_box& outer, const bounding_box& inner)
+{
+	return outer.minCorner.x <= inner.minCorner.x && outer.minCorner.y <= inner.minCorner.y && outer.minCorner.z <= inner.minCorner.z
+		&& outer.maxCorner.x >= inner.maxCorner.x && outer.maxCorner.y >= inner.maxCorner.y && outer.maxCorner.z >= inner.maxCorner.z;
+}
+
+int32 dynamic_aabb_tree::allocateNode()
+{
+	if (freeList == INVALID_AABB_TREE_NODE)
+	{
+		nodes.emplace_back();
+		int32 index = (int32)nodes.size() - 1;
+		nodes[index].parent = INVALID_AABB_TREE_NODE;
+		nodes[index].height = -1;
+		freeList = index;
+	}
+
+	int32 index = freeList;
+	aabb_tree_node& node = nodes[index];
+	freeList = node.parent;
+
+	node.parent = INVALID_AABB_TREE_NODE;
+	node.left = INVALID_AABB_TREE_NODE;
+	node.right = INVALID_AABB_TREE_NODE;
+	node.height = 0;
+	node.userData = 0;
+
+	return index;
+}
+
+void dynamic_aabb_tree::freeNode(int32 index)
+{
+	aabb_tree_node& node = nodes[index];
+	node.parent = freeList;
+	node.height = -1;
+	freeList = index;
+}
+
+int32 dynamic_aabb_tree::insert(const bounding_box& aabb, uint32 userData)
+{
+	int32 proxy = allocateNode();
+
+	aabb_tree_node& node = nodes[proxy];
+	node.aabb = aabb;
+	node.aabb.pad(vec3(margin));
+	node.userData = userData;
+
+	insertLeaf(proxy);
+	++numLeaves;
+
+	return proxy;
+}
+
+void dynamic_aabb_tree::remove(int32 proxy)
+{
+	ASSERT(nodes[proxy].isLeaf());
+
+	removeLeaf(proxy);
+	freeNode(proxy);
+	--numLeaves;
+}
+
+bool dynamic_aabb_tree::move(int32 proxy, const bounding_box& aabb)
+{
+	ASSERT(nodes[proxy].isLeaf());
+
+	if (contains(nodes[proxy].aabb, aabb))
+	{
+		return false;
+	}
+
+	removeLeaf(proxy);
+
+	nodes[proxy].aabb = aabb;
+	nodes[proxy].aabb.pad(vec3(margin));
+
+	insertLeaf(proxy);
+	return true;
+}
+
+void dynamic_aabb_tree::clear()
+{
+	nodes.clear();
+	root = INVALID_AABB_TREE_NODE;
+	freeList = INVALID_AABB_TREE_NODE;
+	numLeaves = 0;
+}
+
+void dynamic_aabb_tree::insertLeaf(int32 leaf)
+{
+	if (root == INVALID_AABB_TREE_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = INVALID_AABB_TREE_NODE;
+		return;
+	}
+
+	// Find the best sibling by descending the tree with the surface area heuristic.
+	bounding_box leafAABB = nodes[leaf].aabb;
+	int32 index = root;
+	while (!nodes[index].isLeaf())
+	{
+		const aabb_tree_node& node = nodes[index];
+		int32 left = node.left;
+		int32 right = node.right;
+
+		float area = surfaceArea(node.aabb);
+		float combinedArea = surfaceArea(combine(node.aabb, leafAABB));
+
+		// Cost of creating a new parent for this node and the new leaf.
+		float cost = 2.f * combinedArea;
+
+		// Minimum cost of pushing the leaf further down the tree.
+		float inheritanceCost = 2.f * (combinedArea - area);
+
+		auto descendCost = [this, &leafAABB, inheritanceCost](int32 child)
+		{
+			const aabb_tree_node& c = nodes[child];
+			float newArea = surfaceArea(combine(c.aabb, leafAABB));
+			return c.isLeaf() ? (newArea + inheritanceCost) : (newArea - surfaceArea(c.aabb) + inheritanceCost);
+		};
+
+		float costLeft = descendCost(left);
+		float costRight = descendCost(right);
+
+		if (cost < costLeft && cost < costRight)
+		{
+			break;
+		}
+
+		index = (costLeft < costRight) ? left : right;
+	}
+
+	int32 sibling = index;
+
+	// Create a new parent. This may reallocate the nodes, so don't hold references across this call.
+	int32 oldParent = nodes[sibling].parent;
+	int32 newParent = allocateNode();
+
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].aabb = combine(leafAABB, nodes[sibling].aabb);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != INVALID_AABB_TREE_NODE)
+	{
+		if (nodes[oldParent].left == sibling)
+		{
+			nodes[oldParent].left = newParent;
+		}
+		else
+		{
+			nodes[oldParent].right = newParent;
+		}
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// Walk back up the tree, fixing heights and bounds.
+	index = nodes[leaf].parent;
+	while (index != INVALID_AABB_TREE_NODE)
+	{
+		index = balance(index);
+
+		aabb_tree_node& node = nodes[index];
+		const aabb_tree_node& left = nodes[node.left];
+		const aabb_tree_node& right = nodes[node.right];
+
+		node.height = 1 + max(left.height, right.height);
+		node.aabb = combine(left.aabb, right.aabb);
+
+		index = node.parent;
+	}
+}
+
+void dynamic_aabb_tree::removeLeaf(int32 leaf)
+{
+	if (leaf == root)
+	{
+		root = INVALID_AABB_TREE_NODE;
+		return;
+	}
+
+	int32 parent = nodes[leaf].parent;
+	int32 grandParent = nodes[parent].parent;
+	int32 sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+	if (grandParent != INVALID_AABB_TREE_NODE)
+	{
+		// Destroy parent and connect sibling to grand parent.
+		if (nodes[grandParent].left == parent)
+		{
+			nodes[grandParent].left = sibling;
+		}
+		else
+		{
+			nodes[grandParent].right = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		int32 index = grandParent;
+		while (index != INVALID_AABB_TREE_NODE)
+		{
+			index = balance(index);
+
+			aabb_tree_node& node = nodes[index];
+			const aabb_tree_node& left = nodes[node.left];
+			const aabb_tree_node& right = nodes[node.right];
+
+			node.aabb = combine(left.aabb, right.aabb);
+			node.height = 1 + max(left.height, right.height);
+
+			index = node.parent;
+		}
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = INVALID_AABB_TREE_NODE;
+		freeNode(parent);
+	}
+}
+
+// Performs a left or right rotation if node a is imbalanced. Returns the new root of this subtree.
+int32 dynamic_aabb_tree::balance(int32 iA)
+{
+	ASSERT(iA != INVALID_AABB_TREE_NODE);
+
+	aabb_tree_node* A = &nodes[iA];
+	if (A->isLeaf() || A->height < 2)
+	{
+		return iA;
+	}
+
+	int32 iB = A->left;
+	int32 iC = A->right;
+	aabb_tree_node* B = &nodes[iB];
+	aabb_tree_node* C = &nodes[iC];
+
+	int32 heightDifference = C->height - B->height;
+
+	// Rotate C up.
+	if (heightDifference > 1)
+	{
+		int32 iF = C->left;
+		int32 iG = C->right;
+		aabb_tree_node* F = &nodes[iF];
+		aabb_tree_node* G = &nodes[iG];
+
+		// Swap A and C.
+		C->left = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		// A's old parent should point to C.
+		if (C->parent != INVALID_AABB_TREE_NODE)
+		{
+			if (nodes[C->parent].left == iA)
+			{
+				nodes[C->parent].left = iC;
+			}
+			else
+			{
+				ASSERT(nodes[C->parent].right == iA);
+				nodes[C->parent].right = iC;
+			}
+		}
+		else
+		{
+			root = iC;
+		}
+
+		// Rotate.
+		if (F->height > G->height)
+		{
+			C->right = iF;
+			A->right = iG;
+			G->parent = iA;
+			A->aabb = combine(B->aabb, G->aabb);
+			C->aabb = combine(A->aabb, F->aabb);
+
+			A->height = 1 + max(B->height, G->height);
+			C->height = 1 + max(A->height, F->height);
+		}
+		else
+		{
+			C->right = iG;
+			A->right = iF;
+			F->parent = iA;
+			A->aabb = combine(B->aabb, F->aabb);
+			C->aabb = combine(A->aabb, G->aabb);
+
+			A->height = 1 + max(B->height, F->height);
+			C->height = 1 + max(A->height, G->height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up.
+	if (heightDifference < -1)
+	{
+		int32 iD = B->left;
+		int32 iE = B->right;
+		aabb_tree_node* D = &nodes[iD];
+		aabb_tree_node* E = &nodes[iE];
+
+		// Swap A and B.
+		B->left = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		// A's old parent should point to B.
+		if (B->parent != INVALID_AABB_TREE_NODE)
+		{
+			if (nodes[B->parent].left == iA)
+			{
+				nodes[B->parent].left = iB;
+			}
+			else
+			{
+				ASSERT(nodes[B->parent].right == iA);
+				nodes[B->parent].right = iB;
+			}
+		}
+		else
+		{
+			root = iB;
+		}
+
+		// Rotate.
+		if (D->height > E->height)
+		{
+			B->right = iD;
+			A->left = iE;
+			E->parent = iA;
+			A->aabb = combine(C->aabb, E->aabb);
+			B->aabb = combine(A->aabb, D->aabb);
+
+			A->height = 1 + max(C->height, E->height);
+			B->height = 1 + max(A->height, D->height);
+		}
+		else
+		{
+			B->right = iE;
+			A->left = iD;
+			D->parent = iA;
+			A->aabb = combine(C->aabb, D->aabb);
+			B->aabb = combine(A->aabb, E->aabb);
+
+			A->height = 1 + max(C->height, D->height);
+			B->height = 1 + max(A->height, E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+void dynamic_aabb_tree::saveState(physics_snapshot_writer& writer) const
+{
+	writer.writeArray(nodes);
+	writer.write(root);
+	writer.write(freeList);
+	writer.write(numLeaves);
+	writer.write(margin);
+}
+
+bool dynamic_aabb_tree::restoreState(physics_snapshot_reader& reader)
+{
+	return reader.readArray(nodes)
+		&& reader.read(root)
+		&& reader.read(freeList)
+		&& reader.read(numLeaves)
+		&& reader.read(margin);
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "bounding_volumes.h"
+
+#define INVALID_AABB_TREE_NODE -1
+
+struct aabb_tree_node
+{
+	bounding_box aabb; // Fattened for leaves.
+
+	int32 parent; // Next free node, if this node is in the free list.
+	int32 left;
+	int32 right;
+
+	int32 height; // 0 for leaves, -1 for free nodes.
+
+	uint32 userData; // Only valid for leaves.
+
+	bool isLeaf() const { return left == INVALID_AABB_TREE_NODE; }
+};
+
+// Incrementally updated bounding volume hierarchy (similar to Box2D's dynamic tree).
+// Leaves store fattened AABBs, so that objects can move a little without having to be reinserted.
+// The tree is kept balanced with AVL rotations.
+struct dynamic_aabb_tree
+{
+	dynamic_aabb_tree(float margin = 0.1f) : margin(margin) {}
+
+	// Returns the proxy (leaf node index), which stays valid until the proxy is removed.
+	int32 insert(const bounding_box& aabb, uint32 userData);
+	void remove(int32 proxy);
+
+	// Only reinserts the proxy if the new bounds are not contained in the fattened bounds anymore. Returns true in that case.
+	bool move(int32 proxy, const bounding_box& aabb);
+
+	void clear();
+
+	// Calls callback(int32 proxy) for each leaf, whose fattened bounds overlap the given bounds.
+	// The callback may return false to stop the query.
+	template <typename callback_t>
+	void query(const bounding_box& aabb, callback_t callback) const;
+
+	// Calls callback(int32 proxy, float maxDistance) for each leaf, whose fattened bounds (grown by extent) are hit by the ray before maxDistance.
+	// The callback returns the new maximum distance, e.g. the distance to the closest hit so far. A negative value stops the query.
+	// The ray direction must be normalized. A non-zero extent turns this into a sweep of a box with this radius.
+	template <typename callback_t>
+	void raycast(const ray& r, float maxDistance, vec3 extent, callback_t callback) const;
+
+	const bounding_box& getFatAABB(int32 proxy) const { return nodes[proxy].aabb; }
+	uint32 getUserData(int32 proxy) const { return nodes[proxy].userData; }
+	void setUserData(int32 proxy, uint32 userData) { nodes[proxy].userData = userData; }
+
+	uint32 getNumLeaves() const { return numLeaves; }
+	uint32 getNodeCapacity() const { return (uint32)nodes.size(); } // Proxies are always smaller than this.
+	int32 getHeight() const { return (root == INVALID_AABB_TREE_NODE) ? 0 : nodes[root].height; }
+
+	// Copies the complete tree, so that the structure (and thereby the order of query results) is restored exactly.
+	void saveState(struct physics_snapshot_writer& writer) const;
+	bool restoreState(struct physics_snapshot_reader& reader);
+
+	float margin;
+
+private:
+	int32 allocateNode();
+	void freeNode(int32 node);
+
+	void insertLeaf(int32 leaf);
+	void removeLeaf(int32 leaf);
+	int32 balance(int32 node);
+
+	std::vector<aabb_tree_node> nodes;
+	int32 root = INVALID_AABB_TREE_NODE;
+	int32 freeList = INVALID_AABB_TREE_NODE;
+	uint32 numLeaves = 0;
+};
+
+template <typename callback_t>
+void dynamic_aabb_tree::query(const bounding_box& aabb, callback_t callback) const
+{
+	if (root == INVALID_AABB_TREE_NODE)
+	{
+		return;
+	}
+
+	// The tree is balanced, so this is plenty.
+	int32 stack[128];
+	uint32 stackPtr = 0;
+	stack[stackPtr++] = root;
+
+	while (stackPtr > 0)
+	{
+		int32 index = stack[--stackPtr];
+		const aabb_tree_node& node = nodes[index];
+
+		if (!aabbVsAABB(node.aabb, aabb))
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			if (!callback(index))
+			{
+				return;
+			}
+		}
+		else
+		{
+			ASSERT(stackPtr + 2 <= arraysize(stack));
+			stack[stackPtr++] = node.left;
+			stack[stackPtr++] = node.right;
+		}
+	}
+}
+
+template <typename callback_t>
+void dynamic_aabb_tree::raycast(const ray& r, float maxDistance, vec3 extent, callback_t callback) const
+{
+	if (root == INVALID_AABB_TREE_NODE)
+	{
+		return;
+	}
+
+	vec3 invDirection = vec3(1.f / r.direction.x, 1.f / r.direction.y, 1.f / r.direction.z);
+
+	auto hitsNode = [&r, &invDirection, &extent](const bounding_box& aabb, float maxDistance)
+	{
+		vec3 t0 = (aabb.minCorner - extent - r.origin) * invDirection;
+		vec3 t1 = (aabb.maxCorner + extent - r.origin) * invDirection;
+		vec3 tMin = min(t0, t1);
+		vec3 tMax = max(t0, t1);
+
+		float enter = max(max(tMin.x, tMin.y), max(tMin.z, 0.f));
+		float exit = min(min(tMax.x, tMax.y), min(tMax.z, maxDistance));
+		return enter <= exit;
+	};
+
+	int32 stack[128];
+	uint32 stackPtr = 0;
+	stack[stackPtr++] = root;
+
+	while (stackPtr > 0)
+	{
+		int32 index = stack[--stackPtr];
+		const aabb_tree_node& node = nodes[index];
+
+		if (!hitsNode(node.aabb, maxDistance))
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			maxDistance = callback(index, maxDistance);
+			if (maxDistance < 0.f)
+			{
+				return;
+			}
+		}
+		else
+		{
+			ASSERT(stackPtr + 2 <= arraysize(stack));
+			stack[stackPtr++] = node.left;
+			stack[stackPtr++] = node.right;
+		}
+	}
+}
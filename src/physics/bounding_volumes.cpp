@@ -1450,3 +1450,499 @@ bounding_hull_geometry bounding_hull_geometry::fromMesh(vec3* vertices, uint32 n
 {
 	return hullFromMesh(vertices, numVertices, triangles, numTriangles);
 }
+
+static vec3 normalizeOrZero(vec3 v)
+{
+	float l = length(v);
+	return (l > 0.f) ? (v * (1.f / l)) : vec3(0.f);
+}
+
+struct quickhull_face
+{
+	uint32 a, b, c;
+	vec3 normal;
+	float d;
+	std::vector<uint32> outside; // Points in front of this face.
+	bool alive;
+
+	float distance(vec3 p) const { return dot(normal, p) - d; }
+};
+
+static uint64 quickhullEdgeKey(uint32 from, uint32 to)
+{
+	return ((uint64)from << 32) | to;
+}
+
+// edgeToFace maps each directed edge to the face it belongs to. Entries of dead faces are only overwritten, never removed, 
+// but the twin of an edge of a live face always belongs to a live face.
+static void addQuickhullFace(std::vector<quickhull_face>& faces, std::unordered_map<uint64, uint32>& edgeToFace, const vec3* points, 
+	uint32 a, uint32 b, uint32 c, vec3 interior)
+{
+	quickhull_face face;
+	face.a = a;
+	face.b = b;
+	face.c = c;
+	face.normal = normalizeOrZero(cross(points[b] - points[a], points[c] - points[a]));
+	if (dot(face.normal, interior - points[a]) > 0.f)
+	{
+		std::swap(face.b, face.c);
+		face.normal = -face.normal;
+	}
+	face.d = dot(face.normal, points[a]);
+	face.alive = true;
+
+	uint32 index = (uint32)faces.size();
+	edgeToFace[quickhullEdgeKey(face.a, face.b)] = index;
+	edgeToFace[quickhullEdgeKey(face.b, face.c)] = index;
+	edgeToFace[quickhullEdgeKey(face.c, face.a)] = index;
+
+	faces.push_back(std::move(face));
+}
+
+static void assignToQuickhullFace(std::vector<quickhull_face>& faces, uint32 firstFace, const vec3* points, uint32 index, float tolerance)
+{
+	for (uint32 i = firstFace; i < (uint32)faces.size(); ++i)
+	{
+		if (faces[i].alive && faces[i].distance(points[index]) > tolerance)
+		{
+			faces[i].outside.push_back(index);
+			return;
+		}
+	}
+	// Inside the hull (or within the tolerance of it).
+}
+
+// Returns triangles indexing into points. Always adds the farthest point next, so if the vertex budget is hit, the result is the best greedy approximation.
+static bool quickhull(const vec3* points, uint32 numPoints, uint32 maxNumVertices, std::vector<indexed_triangle32>& outTriangles)
+{
+	outTriangles.clear();
+
+	if (numPoints < 4)
+	{
+		return false;
+	}
+
+	bounding_box aabb = bounding_box::negativeInfinity();
+	uint32 extremes[6] = {};
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		aabb.grow(points[i]);
+		for (uint32 axis = 0; axis < 3; ++axis)
+		{
+			if (points[i].data[axis] < points[extremes[axis * 2 + 0]].data[axis]) { extremes[axis * 2 + 0] = i; }
+			if (points[i].data[axis] > points[extremes[axis * 2 + 1]].data[axis]) { extremes[axis * 2 + 1] = i; }
+		}
+	}
+
+	vec3 maxAbs = max(abs(aabb.minCorner), abs(aabb.maxCorner));
+	float tolerance = 3.f * FLT_EPSILON * (maxAbs.x + maxAbs.y + maxAbs.z);
+
+
+	// Initial tetrahedron.
+	uint32 i0 = 0, i1 = 0;
+	float maxDistance = 0.f;
+	for (uint32 a = 0; a < 6; ++a)
+	{
+		for (uint32 b = a + 1; b < 6; ++b)
+		{
+			float d = squaredLength(points[extremes[a]] - points[extremes[b]]);
+			if (d > maxDistance)
+			{
+				maxDistance = d;
+				i0 = extremes[a];
+				i1 = extremes[b];
+			}
+		}
+	}
+	if (maxDistance <= tolerance * tolerance)
+	{
+		return false;
+	}
+
+	uint32 i2 = 0;
+	vec3 lineDirection = normalize(points[i1] - points[i0]);
+	maxDistance = 0.f;
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		float d = squaredLength(cross(points[i] - points[i0], lineDirection));
+		if (d > maxDistance)
+		{
+			maxDistance = d;
+			i2 = i;
+		}
+	}
+	if (maxDistance <= tolerance * tolerance)
+	{
+		return false;
+	}
+
+	uint32 i3 = 0;
+	vec3 planeNormal = normalize(cross(points[i1] - points[i0], points[i2] - points[i0]));
+	maxDistance = 0.f;
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		float d = abs(dot(points[i] - points[i0], planeNormal));
+		if (d > maxDistance)
+		{
+			maxDistance = d;
+			i3 = i;
+		}
+	}
+	if (maxDistance <= tolerance)
+	{
+		return false;
+	}
+
+	// Stays inside the hull, so all faces can be oriented against it.
+	vec3 interior = (points[i0] + points[i1] + points[i2] + points[i3]) * 0.25f;
+
+	std::vector<quickhull_face> faces;
+	std::unordered_map<uint64, uint32> edgeToFace;
+	addQuickhullFace(faces, edgeToFace, points, i0, i1, i2, interior);
+	addQuickhullFace(faces, edgeToFace, points, i0, i1, i3, interior);
+	addQuickhullFace(faces, edgeToFace, points, i0, i2, i3, interior);
+	addQuickhullFace(faces, edgeToFace, points, i1, i2, i3, interior);
+
+	for (uint32 i = 0; i < numPoints; ++i)
+	{
+		assignToQuickhullFace(faces, 0, points, i, tolerance);
+	}
+
+
+	std::vector<uint32> orphans;
+	std::vector<uint32> visibleFaces;
+	std::vector<uint64> horizon;
+
+	uint32 numHullVertices = 4;
+	while (numHullVertices < maxNumVertices)
+	{
+		uint32 eye = UINT32_MAX;
+		uint32 eyeFace = UINT32_MAX;
+		float eyeDistance = tolerance;
+		for (uint32 i = 0; i < (uint32)faces.size(); ++i)
+		{
+			const quickhull_face& face = faces[i];
+			if (!face.alive)
+			{
+				continue;
+			}
+			for (uint32 index : face.outside)
+			{
+				float d = face.distance(points[index]);
+				if (d > eyeDistance)
+				{
+					eyeDistance = d;
+					eye = index;
+					eyeFace = i;
+				}
+			}
+		}
+
+		if (eye == UINT32_MAX)
+		{
+			break;
+		}
+
+		vec3 eyePoint = points[eye];
+		uint32 numFaces = (uint32)faces.size();
+
+		// Flood fill the visible faces from the one the eye was assigned to. This keeps the visible region connected, even if the tolerance
+		// makes faces elsewhere on the hull look visible. Visible faces are marked dead right away, and a live neighbor is always part of
+		// the hull, so a dead neighbor has already been visited. Edges of visible faces, whose twin belongs to a hidden face, form the horizon.
+		visibleFaces.clear();
+		horizon.clear();
+
+		faces[eyeFace].alive = false;
+		visibleFaces.push_back(eyeFace);
+
+		for (uint32 next = 0; next < (uint32)visibleFaces.size(); ++next)
+		{
+			const quickhull_face& face = faces[visibleFaces[next]];
+			uint32 v[3] = { face.a, face.b, face.c };
+			for (uint32 e = 0; e < 3; ++e)
+			{
+				uint32 from = v[e];
+				uint32 to = v[(e + 1) % 3];
+
+				auto it = edgeToFace.find(quickhullEdgeKey(to, from));
+				if (it != edgeToFace.end())
+				{
+					quickhull_face& neighbor = faces[it->second];
+					if (!neighbor.alive)
+					{
+						continue;
+					}
+					if (neighbor.distance(eyePoint) > tolerance)
+					{
+						neighbor.alive = false;
+						visibleFaces.push_back(it->second);
+						continue;
+					}
+				}
+
+				horizon.push_back(quickhullEdgeKey(from, to));
+			}
+		}
+
+		for (uint64 edge : horizon)
+		{
+			addQuickhullFace(faces, edgeToFace, points, (uint32)(edge >> 32), (uint32)edge, eye, interior);
+		}
+
+		orphans.clear();
+		for (uint32 i : visibleFaces)
+		{
+			orphans.insert(orphans.end(), faces[i].outside.begin(), faces[i].outside.end());
+			faces[i].outside.clear();
+		}
+
+		for (uint32 index : orphans)
+		{
+			if (index != eye)
+			{
+				assignToQuickhullFace(faces, numFaces, points, index, tolerance);
+			}
+		}
+
+		++numHullVertices;
+	}
+
+	for (const quickhull_face& face : faces)
+	{
+		if (face.alive)
+		{
+			outTriangles.push_back({ face.a, face.b, face.c });
+		}
+	}
+
+	return true;
+}
+
+bounding_hull_geometry bounding_hull_geometry::fromPoints(const vec3* points, uint32 numPoints, uint32 maxNumVertices, uint32 maxNumFaces, float mergeAngle)
+{
+	// A closed triangle mesh with V vertices has 2V - 4 faces.
+	maxNumVertices = min(maxNumVertices, (maxNumFaces + 4) / 2);
+	maxNumVertices = min(maxNumVertices, (uint32)UINT16_MAX);
+	ASSERT(maxNumVertices >= 4);
+
+	float cosMergeAngle = cos(mergeAngle);
+
+	std::vector<vec3> candidates(points, points + numPoints);
+	std::vector<vec3> vertices;
+	std::vector<indexed_triangle32> triangles;
+	std::vector<uint32> remap;
+	std::vector<vec3> referenceNormals;
+	std::vector<float> minCosAngles;
+	std::vector<uint8> vertexState;
+
+	while (true)
+	{
+		if (!quickhull(candidates.data(), (uint32)candidates.size(), maxNumVertices, triangles))
+		{
+			return {};
+		}
+
+		// Compact to the vertices actually on the hull.
+		remap.assign(candidates.size(), UINT32_MAX);
+		vertices.clear();
+		for (indexed_triangle32& tri : triangles)
+		{
+			for (uint32* index : { &tri.a, &tri.b, &tri.c })
+			{
+				if (remap[*index] == UINT32_MAX)
+				{
+					remap[*index] = (uint32)vertices.size();
+					vertices.push_back(candidates[*index]);
+				}
+				*index = remap[*index];
+			}
+		}
+
+		uint32 numVertices = (uint32)vertices.size();
+
+		// Merge faces by removing vertices, around which the hull is (nearly) planar. Removing a vertex changes the faces of its neighbors,
+		// so these are only considered in the next round.
+		referenceNormals.assign(numVertices, vec3(0.f));
+		minCosAngles.assign(numVertices, 1.f);
+		for (const indexed_triangle32& tri : triangles)
+		{
+			vec3 normal = normalizeOrZero(cross(vertices[tri.b] - vertices[tri.a], vertices[tri.c] - vertices[tri.a]));
+			for (uint32 index : { tri.a, tri.b, tri.c })
+			{
+				if (referenceNormals[index] == vec3(0.f))
+				{
+					referenceNormals[index] = normal;
+				}
+				minCosAngles[index] = min(minCosAngles[index], dot(referenceNormals[index], normal));
+			}
+		}
+
+		enum { vertex_keep, vertex_remove, vertex_blocked };
+		vertexState.assign(numVertices, vertex_keep);
+
+		uint32 numRemoved = 0;
+		for (uint32 i = 0; i < numVertices && numVertices - numRemoved > 4; ++i)
+		{
+			if (vertexState[i] != vertex_keep || minCosAngles[i] < cosMergeAngle)
+			{
+				continue;
+			}
+
+			vertexState[i] = vertex_remove;
+			++numRemoved;
+
+			for (const indexed_triangle32& tri : triangles)
+			{
+				if (tri.a == i || tri.b == i || tri.c == i)
+				{
+					for (uint32 index : { tri.a, tri.b, tri.c })
+					{
+						if (vertexState[index] == vertex_keep)
+						{
+							vertexState[index] = vertex_blocked;
+						}
+					}
+				}
+			}
+		}
+
+		if (numRemoved == 0)
+		{
+			break;
+		}
+
+		candidates.clear();
+		for (uint32 i = 0; i < numVertices; ++i)
+		{
+			if (vertexState[i] != vertex_remove)
+			{
+				candidates.push_back(vertices[i]);
+			}
+		}
+	}
+
+	return hullFromMesh(vertices.data(), (uint32)vertices.size(), triangles.data(), (uint32)triangles.size());
+}
+
+struct convex_decomposition_part
+{
+	std::vector<uint32> triangles; // Into the input mesh.
+	bounding_hull_geometry hull;
+	float concavity;
+};
+
+static convex_decomposition_part createConvexDecompositionPart(std::vector<uint32>&& partTriangles, const vec3* vertices, const indexed_triangle32* triangles,
+	const vec3* centroids, uint32 maxNumVertices)
+{
+	convex_decomposition_part part;
+	part.triangles = std::move(partTriangles);
+
+	std::vector<vec3> points;
+	points.reserve(part.triangles.size() * 3);
+	for (uint32 t : part.triangles)
+	{
+		points.push_back(vertices[triangles[t].a]);
+		points.push_back(vertices[triangles[t].b]);
+		points.push_back(vertices[triangles[t].c]);
+	}
+
+	part.hull = bounding_hull_geometry::fromPoints(points.data(), (uint32)points.size(), maxNumVertices, 2 * maxNumVertices - 4);
+	part.concavity = 0.f;
+
+	if (part.hull.vertices.empty())
+	{
+		// Flat part. Nothing to split.
+		return part;
+	}
+
+	// Largest distance of the part's surface (sampled at the triangle centroids) to the surface of its hull.
+	for (uint32 t : part.triangles)
+	{
+		float distance = -FLT_MAX;
+		for (const bounding_hull_face& face : part.hull.faces)
+		{
+			vec3 normal = normalizeOrZero(face.normal);
+			distance = max(distance, dot(normal, centroids[t] - part.hull.vertices[face.a]));
+		}
+		part.concavity = max(part.concavity, -distance);
+	}
+
+	return part;
+}
+
+std::vector<bounding_hull_geometry> bounding_hull_geometry::decompose(const vec3* vertices, uint32 numVertices, const indexed_triangle32* triangles, uint32 numTriangles,
+	float maxConcavity, uint32 maxNumParts, uint32 maxNumVerticesPerPart)
+{
+	std::vector<vec3> centroids(numTriangles);
+	std::vector<uint32> allTriangles(numTriangles);
+	for (uint32 i = 0; i < numTriangles; ++i)
+	{
+		indexed_triangle32 tri = triangles[i];
+		ASSERT(tri.a < numVertices && tri.b < numVertices && tri.c < numVertices);
+		centroids[i] = (vertices[tri.a] + vertices[tri.b] + vertices[tri.c]) * (1.f / 3.f);
+		allTriangles[i] = i;
+	}
+
+	std::vector<convex_decomposition_part> parts;
+	parts.push_back(createConvexDecompositionPart(std::move(allTriangles), vertices, triangles, centroids.data(), maxNumVerticesPerPart));
+
+	while ((uint32)parts.size() < maxNumParts)
+	{
+		uint32 worst = 0;
+		for (uint32 i = 1; i < (uint32)parts.size(); ++i)
+		{
+			if (parts[i].concavity > parts[worst].concavity)
+			{
+				worst = i;
+			}
+		}
+
+		if (parts[worst].concavity <= maxConcavity)
+		{
+			break;
+		}
+
+		// Split along the longest axis of the part, through the mean of its triangle centroids.
+		const std::vector<uint32>& partTriangles = parts[worst].triangles;
+
+		bounding_box bounds = bounding_box::negativeInfinity();
+		float mean[3] = {};
+		for (uint32 t : partTriangles)
+		{
+			bounds.grow(centroids[t]);
+			for (uint32 axis = 0; axis < 3; ++axis)
+			{
+				mean[axis] += centroids[t].data[axis];
+			}
+		}
+
+		vec3 extent = bounds.maxCorner - bounds.minCorner;
+		uint32 axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+		float split = mean[axis] / (float)partTriangles.size();
+
+		std::vector<uint32> left, right;
+		for (uint32 t : partTriangles)
+		{
+			((centroids[t].data[axis] < split) ? left : right).push_back(t);
+		}
+
+		if (left.empty() || right.empty())
+		{
+			parts[worst].concavity = 0.f; // Cannot be split any further.
+			continue;
+		}
+
+		parts[worst] = createConvexDecompositionPart(std::move(left), vertices, triangles, centroids.data(), maxNumVerticesPerPart);
+		parts.push_back(createConvexDecompositionPart(std::move(right), vertices, triangles, centroids.data(), maxNumVerticesPerPart));
+	}
+
+	std::vector<bounding_hull_geometry> result;
+	for (convex_decomposition_part& part : parts)
+	{
+		if (!part.hull.vertices.empty())
+		{
+			result.push_back(std::move(part.hull));
+		}
+	}
+	return result;
+}
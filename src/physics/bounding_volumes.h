@@ -215,6 +215,16 @@ struct bounding_hull_geometry
 
 	static bounding_hull_geometry fromMesh(vec3* vertices, uint32 numVertices, indexed_triangle16* triangles, uint32 numTriangles);
 	static bounding_hull_geometry fromMesh(vec3* vertices, uint32 numVertices, indexed_triangle32* triangles, uint32 numTriangles);
+
+	// Convex hull of an arbitrary point cloud (quickhull). If the exact hull exceeds the vertex or (triangular) face budget, it is approximated
+	// by greedily adding the farthest points. Vertices, whose adjacent faces are coplanar up to mergeAngle, are removed, which merges these faces.
+	// Returns an empty geometry for degenerate (flat) input.
+	static bounding_hull_geometry fromPoints(const vec3* points, uint32 numPoints, uint32 maxNumVertices = 32, uint32 maxNumFaces = 60, float mergeAngle = deg2rad(3.f));
+
+	// Approximate convex decomposition of a (possibly concave) mesh. The mesh is split recursively, until the surface of each part is closer than
+	// maxConcavity to its hull or maxNumParts is reached. Each part can then be attached as a separate hull collider to the same rigid body.
+	static std::vector<bounding_hull_geometry> decompose(const vec3* vertices, uint32 numVertices, const indexed_triangle32* triangles, uint32 numTriangles,
+		float maxConcavity, uint32 maxNumParts = 16, uint32 maxNumVerticesPerPart = 32);
 };
 
 // MUST be convex.
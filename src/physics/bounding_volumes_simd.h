@@ -134,3 +134,51 @@ inline simd_t closestPoint_SegmentSegment(const wN_line_segment<simd_t>& l1, con
 	return squaredLength(c1 - c2);
 }
 
+
+// Same as the scalar version, but all Voronoi regions are evaluated and the first matching one is selected per lane.
+template <typename simd_t>
+inline wN_vec3<simd_t> closestPoint_PointTriangle(const wN_vec3<simd_t>& p, const wN_vec3<simd_t>& a, const wN_vec3<simd_t>& b, const wN_vec3<simd_t>& c)
+{
+	wN_vec3<simd_t> ab = b - a;
+	wN_vec3<simd_t> ac = c - a;
+	wN_vec3<simd_t> ap = p - a;
+	simd_t d1 = dot(ab, ap);
+	simd_t d2 = dot(ac, ap);
+
+	wN_vec3<simd_t> bp = p - b;
+	simd_t d3 = dot(ab, bp);
+	simd_t d4 = dot(ac, bp);
+
+	wN_vec3<simd_t> cp = p - c;
+	simd_t d5 = dot(ab, cp);
+	simd_t d6 = dot(ac, cp);
+
+	simd_t vc = d1 * d4 - d3 * d2;
+	simd_t vb = d5 * d2 - d1 * d6;
+	simd_t va = d3 * d6 - d5 * d4;
+
+	// Face region.
+	simd_t denom = 1.f / (va + vb + vc);
+	wN_vec3<simd_t> result = a + ab * (vb * denom) + ac * (vc * denom);
+
+	// Regions with higher priority in the scalar version are applied later, so that they override the previous ones.
+	auto inBC = (va <= 0.f) & (d4 - d3 >= 0.f) & (d5 - d6 >= 0.f);
+	result = ifThen(inBC, b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))), result);
+
+	auto inAC = (vb <= 0.f) & (d2 >= 0.f) & (d6 <= 0.f);
+	result = ifThen(inAC, a + ac * (d2 / (d2 - d6)), result);
+
+	auto inC = (d6 >= 0.f) & (d5 <= d6);
+	result = ifThen(inC, c, result);
+
+	auto inAB = (vc <= 0.f) & (d1 >= 0.f) & (d3 <= 0.f);
+	result = ifThen(inAB, a + ab * (d1 / (d1 - d3)), result);
+
+	auto inB = (d3 >= 0.f) & (d4 <= d3);
+	result = ifThen(inB, b, result);
+
+	auto inA = (d1 <= 0.f) & (d2 <= 0.f);
+	result = ifThen(inA, a, result);
+
+	return result;
+}
@@ -1,8 +1,11 @@
 #include "pch.h"
 #include "cloth.h"
 #include "physics.h"
+#include "physics_simd.h"
 #include "core/random.h"
 #include "core/cpu_profiling.h"
+#include "physics_snapshot.h"
+#include "terrain/heightmap_collider.h"
 
 cloth_component::cloth_component(float width, float height, uint32 gridSizeX, uint32 gridSizeY, float totalMass, float stiffness, float damping, float gravityFactor)
 	: gridSizeX(gridSizeX), gridSizeY(gridSizeY), width(width), height(height)
@@ -16,13 +19,12 @@ cloth_component::cloth_component(float width, float height, uint32 gridSizeX, ui
 
 	float invMassPerParticle = numParticles / totalMass;
 
-	positions.reserve(numParticles);
-	prevPositions.reserve(numParticles);
-	invMasses.reserve(numParticles);
-	velocities.resize(numParticles, vec3(0.f));
-	forceAccumulators.resize(numParticles, vec3(0.f));
-
-	random_number_generator rng = { 1578123 };
+	// One more for the dummy particle.
+	positions.resize(numParticles + 1);
+	prevPositions.resize(numParticles + 1);
+	velocities.resize(numParticles + 1);
+	forceAccumulators.resize(numParticles + 1);
+	invMasses.resize(numParticles + 1, 0.f);
 
 	for (uint32 y = 0; y < gridSizeY; ++y)
 	{
@@ -33,13 +35,33 @@ cloth_component::cloth_component(float width, float height, uint32 gridSizeX, ui
 			float relX = x / (float)(gridSizeX - 1);
 			float relY = y / (float)(gridSizeY - 1);
 			
+			uint32 index = y * gridSizeX + x;
+
 			vec3 position = getParticlePosition(relX, relY);
-			positions.push_back(position);
-			prevPositions.push_back(position);
-			invMasses.push_back(invMass);
+			positions.set(index, position);
+			prevPositions.set(index, position);
+			invMasses[index] = invMass;
 		}
 	}
 
+	buildConstraints();
+
+	oldTotalMass = totalMass;
+	oldStiffness = stiffness;
+	oldStretchCompliance = stretchCompliance;
+	oldBendCompliance = bendCompliance;
+}
+
+struct cloth_constraint
+{
+	uint32 a, b;
+	uint8 bend;
+};
+
+void cloth_component::buildConstraints()
+{
+	std::vector<cloth_constraint> constraints;
+
 	for (uint32 y = 0; y < gridSizeY; ++y)
 	{
 		for (uint32 x = 0; x < gridSizeX; ++x)
@@ -49,34 +71,94 @@ cloth_component::cloth_component(float width, float height, uint32 gridSizeX, ui
 			// Stretch constraints: direct right and bottom neighbor.
 			if (x < gridSizeX - 1)
 			{
-				addConstraint(index, index + 1);
+				constraints.push_back({ index, index + 1, 0 });
 			}
 			if (y < gridSizeY - 1)
 			{
-				addConstraint(index, index + gridSizeX);
+				constraints.push_back({ index, index + gridSizeX, 0 });
 			}
 
 			// Shear constraints: direct diagonal neighbor.
 			if (x < gridSizeX - 1 && y < gridSizeY - 1)
 			{
-				addConstraint(index, index + gridSizeX + 1);
-				addConstraint(index + gridSizeX, index + 1);
+				constraints.push_back({ index, index + gridSizeX + 1, 0 });
+				constraints.push_back({ index + gridSizeX, index + 1, 0 });
 			}
 
 			// Bend constraints: neighbor right and bottom two places away.
 			if (x < gridSizeX - 2)
 			{
-				addConstraint(index, index + 2);
+				constraints.push_back({ index, index + 2, 1 });
 			}
 			if (y < gridSizeY - 2)
 			{
-				addConstraint(index, index + gridSizeX * 2);
+				constraints.push_back({ index, index + gridSizeX * 2, 1 });
 			}
 		}
 	}
 
-	oldTotalMass = totalMass;
-	oldStiffness = stiffness;
+	// Greedy coloring. Each particle remembers the colors of its constraints. On the grid, this ends up with around a dozen colors.
+	uint32 numParticles = gridSizeX * gridSizeY;
+	std::vector<uint64> particleColors(numParticles, 0);
+	std::vector<std::vector<cloth_constraint>> colors;
+
+	for (cloth_constraint c : constraints)
+	{
+		uint64 used = particleColors[c.a] | particleColors[c.b];
+		uint32 color = 0;
+		while (used & (1ull << color))
+		{
+			++color;
+		}
+		ASSERT(color < 64);
+
+		if (color == (uint32)colors.size())
+		{
+			colors.emplace_back();
+		}
+		colors[color].push_back(c);
+
+		particleColors[c.a] |= 1ull << color;
+		particleColors[c.b] |= 1ull << color;
+	}
+
+	uint32 numConstraints = 0;
+	for (const auto& color : colors)
+	{
+		numConstraints += alignTo((uint32)color.size(), CLOTH_CONSTRAINT_BATCH_SIZE);
+	}
+
+	int32 dummy = (int32)numParticles;
+
+	constraintA.assign(numConstraints, dummy);
+	constraintB.assign(numConstraints, dummy);
+	restDistances.assign(numConstraints, 0.f);
+	inverseMassSums.assign(numConstraints, 0.f);
+	bendConstraints.assign(numConstraints, 0);
+	compliances.assign(numConstraints, 0.f);
+	lambdas.assign(numConstraints, 0.f);
+	colorOffsets.clear();
+
+	uint32 offset = 0;
+	for (const auto& color : colors)
+	{
+		colorOffsets.push_back(offset);
+		for (uint32 i = 0; i < (uint32)color.size(); ++i)
+		{
+			cloth_constraint c = color[i];
+			constraintA[offset + i] = (int32)c.a;
+			constraintB[offset + i] = (int32)c.b;
+			restDistances[offset + i] = length(positions.get(c.a) - positions.get(c.b));
+			inverseMassSums[offset + i] = (invMasses[c.a] + invMasses[c.b]) / stiffness;
+			bendConstraints[offset + i] = c.bend;
+			compliances[offset + i] = c.bend ? bendCompliance : stretchCompliance;
+		}
+		offset += alignTo((uint32)color.size(), CLOTH_CONSTRAINT_BATCH_SIZE);
+	}
+	colorOffsets.push_back(offset);
+
+	gradients.resize(numConstraints);
+	inverseScaledGradientsSquared.resize(numConstraints);
 }
 
 void cloth_component::setWorldPositionOfFixedVertices(const trs& transform, bool moveRigid)
@@ -86,14 +168,14 @@ void cloth_component::setWorldPositionOfFixedVertices(const trs& transform, bool
 		vec3 pivot;
 		if (gridSizeX % 2 == 1)
 		{
-			pivot = positions[gridSizeX / 2];
+			pivot = positions.get(gridSizeX / 2);
 		}
 		else
 		{
-			pivot = (positions[gridSizeX / 2] + positions[gridSizeX / 2 - 1]) * 0.5f;
+			pivot = (positions.get(gridSizeX / 2) + positions.get(gridSizeX / 2 - 1)) * 0.5f;
 		}
 
-		vec3 currentAxis = normalize(positions[gridSizeX - 1] - positions[0]);
+		vec3 currentAxis = normalize(positions.get(gridSizeX - 1) - positions.get(0));
 		vec3 newAxis = normalize(transformPosition(transform, getParticlePosition(1.f, 0.f)) - transformPosition(transform, getParticlePosition(0.f, 0.f)));
 
 		vec3 newPivot = transformPosition(transform, getParticlePosition(0.5f, 0.f));
@@ -105,8 +187,8 @@ void cloth_component::setWorldPositionOfFixedVertices(const trs& transform, bool
 		{
 			for (uint32 x = 0; x < gridSizeX; ++x)
 			{
-				vec3& position = positions[y * gridSizeX + x];
-				position = deltaRotation * (position - pivot) + newPivot;
+				uint32 index = y * gridSizeX + x;
+				positions.set(index, deltaRotation * (positions.get(index) - pivot) + newPivot);
 			}
 		}
 	}
@@ -117,7 +199,7 @@ void cloth_component::setWorldPositionOfFixedVertices(const trs& transform, bool
 		float relX = x / (float)(gridSizeX - 1);
 		float relY = 0.f;
 		vec3 localPosition = getParticlePosition(relX, relY);
-		positions[x] = transformPosition(transform, localPosition);
+		positions.set(x, transformPosition(transform, localPosition));
 	}
 }
 
@@ -145,206 +227,658 @@ void cloth_component::applyWindForce(vec3 force)
 			uint32 blIndex = tlIndex + gridSizeX;
 			uint32 brIndex = blIndex + 1;
 
-			vec3& tlForce = forceAccumulators[tlIndex];
-			vec3& trForce = forceAccumulators[trIndex];
-			vec3& blForce = forceAccumulators[blIndex];
-			vec3& brForce = forceAccumulators[brIndex];
+			vec3 tl = positions.get(tlIndex);
+			vec3 tr = positions.get(trIndex);
+			vec3 bl = positions.get(blIndex);
+			vec3 br = positions.get(brIndex);
 
 			{
-				vec3 normal = calculateNormal(positions[tlIndex], positions[blIndex], positions[trIndex]);
+				vec3 normal = calculateNormal(tl, bl, tr);
 				vec3 forceInNormalDir = normal * dot(normalize(normal), force);
 				forceInNormalDir *= 1.f / 3.f;
-				tlForce += forceInNormalDir;
-				trForce += forceInNormalDir;
-				blForce += forceInNormalDir;
+				forceAccumulators.add(tlIndex, forceInNormalDir);
+				forceAccumulators.add(trIndex, forceInNormalDir);
+				forceAccumulators.add(blIndex, forceInNormalDir);
 			}
 
 			{
-				vec3 normal = calculateNormal(positions[brIndex], positions[trIndex], positions[blIndex]);
+				vec3 normal = calculateNormal(br, tr, bl);
 				vec3 forceInNormalDir = normal * dot(normalize(normal), force);
 				forceInNormalDir *= 1.f / 3.f;
-				brForce += forceInNormalDir;
-				trForce += forceInNormalDir;
-				blForce += forceInNormalDir;
+				forceAccumulators.add(brIndex, forceInNormalDir);
+				forceAccumulators.add(trIndex, forceInNormalDir);
+				forceAccumulators.add(blIndex, forceInNormalDir);
 			}
 		}
 	}
 }
 
-struct cloth_constraint_temp
+cloth_solver_data cloth_component::getSolverData()
 {
-	vec3 gradient;
-	float inverseScaledGradientSquared;
-};
+	cloth_solver_data data;
+	data.positions[0] = positions.x.data();
+	data.positions[1] = positions.y.data();
+	data.positions[2] = positions.z.data();
+	data.velocities[0] = velocities.x.data();
+	data.velocities[1] = velocities.y.data();
+	data.velocities[2] = velocities.z.data();
+	data.invMasses = invMasses.data();
+	data.constraintA = constraintA.data();
+	data.constraintB = constraintB.data();
+	data.restDistances = restDistances.data();
+	data.inverseMassSums = inverseMassSums.data();
+	data.gradients[0] = gradients.x.data();
+	data.gradients[1] = gradients.y.data();
+	data.gradients[2] = gradients.z.data();
+	data.inverseScaledGradientsSquared = inverseScaledGradientsSquared.data();
+	data.compliances = compliances.data();
+	data.lambdas = lambdas.data();
+	data.complianceScale = 0.f;
+	data.colorOffsets = colorOffsets.data();
+	data.numColors = (uint32)colorOffsets.size() - 1;
+	return data;
+}
 
-void cloth_component::simulate(uint32 velocityIterations, uint32 positionIterations, uint32 driftIterations, float dt)
+static void solveClothVelocities(const cloth_solver_data& data)
 {
-	CPU_PROFILE_BLOCK("Simulate cloth");
+	uint32 numConstraints = data.colorOffsets[data.numColors];
+	for (uint32 i = 0; i < numConstraints; ++i)
+	{
+		uint32 a = data.constraintA[i];
+		uint32 b = data.constraintB[i];
+
+		vec3 gradient(data.gradients[0][i], data.gradients[1][i], data.gradients[2][i]);
+
+		vec3 velocityA(data.velocities[0][a], data.velocities[1][a], data.velocities[2][a]);
+		vec3 velocityB(data.velocities[0][b], data.velocities[1][b], data.velocities[2][b]);
+
+		float j = -dot(gradient, velocityA - velocityB) * data.inverseScaledGradientsSquared[i];
+		velocityA += gradient * (j * data.invMasses[a]);
+		velocityB -= gradient * (j * data.invMasses[b]);
 
-	if (totalMass != oldTotalMass || stiffness != oldStiffness)
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			data.velocities[k][a] = velocityA.data[k];
+			data.velocities[k][b] = velocityB.data[k];
+		}
+	}
+}
+
+static void solveClothPositions(const cloth_solver_data& data)
+{
+	uint32 numConstraints = data.colorOffsets[data.numColors];
+	for (uint32 i = 0; i < numConstraints; ++i)
+	{
+		float inverseMassSum = data.inverseMassSums[i];
+		if (inverseMassSum > 0.f)
+		{
+			uint32 a = data.constraintA[i];
+			uint32 b = data.constraintB[i];
+
+			vec3 positionA(data.positions[0][a], data.positions[1][a], data.positions[2][a]);
+			vec3 positionB(data.positions[0][b], data.positions[1][b], data.positions[2][b]);
+
+			vec3 delta = positionB - positionA;
+			float len = squaredLength(delta);
+
+			float sqRestDistance = data.restDistances[i] * data.restDistances[i];
+			if (sqRestDistance + len > 1e-5f)
+			{
+				float k = ((sqRestDistance - len) / (inverseMassSum * (sqRestDistance + len)));
+				positionA -= delta * (k * data.invMasses[a]);
+				positionB += delta * (k * data.invMasses[b]);
+
+				for (uint32 c = 0; c < 3; ++c)
+				{
+					data.positions[c][a] = positionA.data[c];
+					data.positions[c][b] = positionB.data[c];
+				}
+			}
+		}
+	}
+}
+
+static void solveClothPositionsXPBD(const cloth_solver_data& data)
+{
+	uint32 numConstraints = data.colorOffsets[data.numColors];
+	for (uint32 i = 0; i < numConstraints; ++i)
+	{
+		uint32 a = data.constraintA[i];
+		uint32 b = data.constraintB[i];
+
+		float invMassA = data.invMasses[a];
+		float invMassB = data.invMasses[b];
+		float inverseMassSum = invMassA + invMassB;
+
+		vec3 positionA(data.positions[0][a], data.positions[1][a], data.positions[2][a]);
+		vec3 positionB(data.positions[0][b], data.positions[1][b], data.positions[2][b]);
+
+		vec3 delta = positionA - positionB;
+		float len = length(delta);
+
+		if (inverseMassSum > 0.f && len > 1e-6f)
+		{
+			float alpha = data.compliances[i] * data.complianceScale;
+			float C = len - data.restDistances[i];
+			float deltaLambda = (-C - alpha * data.lambdas[i]) / (inverseMassSum + alpha);
+			data.lambdas[i] += deltaLambda;
+
+			vec3 n = delta / len;
+			positionA += n * (deltaLambda * invMassA);
+			positionB -= n * (deltaLambda * invMassB);
+
+			for (uint32 c = 0; c < 3; ++c)
+			{
+				data.positions[c][a] = positionA.data[c];
+				data.positions[c][b] = positionB.data[c];
+			}
+		}
+	}
+}
+
+void cloth_component::updateProperties()
+{
+	if (totalMass != oldTotalMass || stiffness != oldStiffness || stretchCompliance != oldStretchCompliance || bendCompliance != oldBendCompliance)
 	{
 		recalculateProperties();
 
 		oldTotalMass = totalMass;
 		oldStiffness = stiffness;
+		oldStretchCompliance = stretchCompliance;
+		oldBendCompliance = bendCompliance;
 	}
+}
 
-
+// The per-particle loops are simple enough to be auto-vectorized on the SoA layout.
+void cloth_component::integrate(float dt)
+{
 	float gravityVelocity = GRAVITY * dt * gravityFactor;
 	uint32 numParticles = gridSizeX * gridSizeY;
 
 	for (uint32 i = 0; i < numParticles; ++i)
 	{
-		vec3& position = positions[i];
-		vec3& prevPosition = prevPositions[i];
 		float invMass = invMasses[i];
-		vec3& velocity = velocities[i];
-		vec3& force = forceAccumulators[i];
 
 		if (invMass > 0.f)
 		{
-			velocity.y += gravityVelocity;
+			velocities.y[i] += gravityVelocity;
 		}
 
-		velocity += force * (invMass * dt);
+		velocities.x[i] += forceAccumulators.x[i] * (invMass * dt);
+		velocities.y[i] += forceAccumulators.y[i] * (invMass * dt);
+		velocities.z[i] += forceAccumulators.z[i] * (invMass * dt);
+
+		prevPositions.x[i] = positions.x[i];
+		prevPositions.y[i] = positions.y[i];
+		prevPositions.z[i] = positions.z[i];
+
+		positions.x[i] += velocities.x[i] * dt;
+		positions.y[i] += velocities.y[i] * dt;
+		positions.z[i] += velocities.z[i] * dt;
+	}
+}
+
+void cloth_component::updateVelocities(float invDt)
+{
+	uint32 numParticles = gridSizeX * gridSizeY;
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		velocities.x[i] = (positions.x[i] - prevPositions.x[i]) * invDt;
+		velocities.y[i] = (positions.y[i] - prevPositions.y[i]) * invDt;
+		velocities.z[i] = (positions.z[i] - prevPositions.z[i]) * invDt;
+	}
+}
 
-		prevPosition = position;
-		position += velocity * dt;
-		force = vec3(0.f);
+void cloth_component::dampVelocities(float dt)
+{
+	float dampingFactor = 1.f / (1.f + dt * damping);
+	uint32 numParticles = gridSizeX * gridSizeY;
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		velocities.x[i] *= dampingFactor;
+		velocities.y[i] *= dampingFactor;
+		velocities.z[i] *= dampingFactor;
 	}
 
+	std::fill(forceAccumulators.x.begin(), forceAccumulators.x.end(), 0.f);
+	std::fill(forceAccumulators.y.begin(), forceAccumulators.y.end(), 0.f);
+	std::fill(forceAccumulators.z.begin(), forceAccumulators.z.end(), 0.f);
+}
+
+void cloth_component::simulate(uint32 velocityIterations, uint32 positionIterations, uint32 driftIterations, float dt, 
+	const cloth_collision_context* collision, const physics_simd_kernels* simd)
+{
+	CPU_PROFILE_BLOCK("Simulate cloth");
+
+	updateProperties();
+
+	auto solveVelocities = simd ? simd->solveClothVelocities : solveClothVelocities;
+	auto solvePositions = simd ? simd->solveClothPositions : solveClothPositions;
+
+	cloth_solver_data data = getSolverData();
+
+	uint32 numParticles = gridSizeX * gridSizeY;
+
+	integrate(dt);
+
 	float invDt = (dt > 1e-5f) ? (1.f / dt) : 1.f;
 	
 	// Solve velocities.
 	if (velocityIterations > 0)
 	{
-		std::vector<cloth_constraint_temp> constraintsTemp;
-		constraintsTemp.reserve(constraints.size());
-
-		for (cloth_constraint& c : constraints)
+		uint32 numConstraints = (uint32)constraintA.size();
+		for (uint32 i = 0; i < numConstraints; ++i)
 		{
-			vec3 prevPositionA = prevPositions[c.a];
-			vec3 prevPositionB = prevPositions[c.b];
+			uint32 a = constraintA[i];
+			uint32 b = constraintB[i];
 
-			cloth_constraint_temp temp;
-			temp.gradient = prevPositionB - prevPositionA;
-			temp.inverseScaledGradientSquared = (c.inverseMassSum == 0.f) ? 0.f : (1.f / (squaredLength(temp.gradient) * c.inverseMassSum));
-			constraintsTemp.push_back(temp);
+			vec3 gradient = prevPositions.get(b) - prevPositions.get(a);
+			gradients.set(i, gradient);
+			inverseScaledGradientsSquared[i] = (inverseMassSums[i] == 0.f) ? 0.f : (1.f / (squaredLength(gradient) * inverseMassSums[i]));
 		}
 
-
 		for (uint32 it = 0; it < velocityIterations; ++it)
 		{
-			solveVelocities(constraintsTemp);
+			solveVelocities(data);
 		}
 
 		for (uint32 i = 0; i < numParticles; ++i)
 		{
-			positions[i] = prevPositions[i] + velocities[i] * dt;
+			positions.x[i] = prevPositions.x[i] + velocities.x[i] * dt;
+			positions.y[i] = prevPositions.y[i] + velocities.y[i] * dt;
+			positions.z[i] = prevPositions.z[i] + velocities.z[i] * dt;
 		}
 	}
 
 	// Solve positions.
-	if (positionIterations > 0)
+	for (uint32 it = 0; it < positionIterations; ++it)
+	{
+		solvePositions(data);
+	}
+
+	// Collisions are resolved after the constraints, so that the particles end up outside.
+	if (collision)
 	{
-		for (uint32 it = 0; it < positionIterations; ++it)
+		solveCollisions(*collision);
+	}
+	if (selfCollision)
+	{
+		solveSelfCollisions();
+	}
+
+	if (positionIterations > 0 || collision || selfCollision)
+	{
+		updateVelocities(invDt);
+	}
+
+	// Solve drift.
+	if (driftIterations > 0)
+	{
+		prevPositions.x = positions.x;
+		prevPositions.y = positions.y;
+		prevPositions.z = positions.z;
+
+		for (uint32 it = 0; it < driftIterations; ++it)
 		{
-			solvePositions();
+			solvePositions(data);
 		}
 
 		for (uint32 i = 0; i < numParticles; ++i)
 		{
-			velocities[i] = (positions[i] - prevPositions[i]) * invDt;
+			velocities.x[i] += (positions.x[i] - prevPositions.x[i]) * invDt;
+			velocities.y[i] += (positions.y[i] - prevPositions.y[i]) * invDt;
+			velocities.z[i] += (positions.z[i] - prevPositions.z[i]) * invDt;
 		}
 	}
 
-	// Solve drift.
-	if (driftIterations > 0)
+	dampVelocities(dt);
+}
+
+void cloth_component::simulateXPBD(uint32 numSubsteps, uint32 iterationsPerSubstep, float dt, 
+	const cloth_collision_context* collision, const physics_simd_kernels* simd)
+{
+	CPU_PROFILE_BLOCK("Simulate cloth (XPBD)");
+
+	updateProperties();
+
+	auto solvePositions = simd ? simd->solveClothPositionsXPBD : solveClothPositionsXPBD;
+
+	numSubsteps = max(numSubsteps, 1u);
+	float substepDt = dt / numSubsteps;
+	float invSubstepDt = (substepDt > 1e-7f) ? (1.f / substepDt) : 1.f;
+
+	cloth_solver_data data = getSolverData();
+	data.complianceScale = invSubstepDt * invSubstepDt;
+
+	for (uint32 substep = 0; substep < numSubsteps; ++substep)
 	{
-		for (uint32 i = 0; i < numParticles; ++i)
+		integrate(substepDt);
+
+		// The Lagrange multipliers are accumulated over the iterations of one substep only.
+		std::fill(lambdas.begin(), lambdas.end(), 0.f);
+		for (uint32 it = 0; it < iterationsPerSubstep; ++it)
 		{
-			prevPositions[i] = positions[i];
+			solvePositions(data);
 		}
 
-		for (uint32 it = 0; it < driftIterations; ++it)
+		if (collision)
 		{
-			solvePositions();
+			solveCollisions(*collision);
 		}
-
-		for (uint32 i = 0; i < numParticles; ++i)
+		if (selfCollision)
 		{
-			velocities[i] += (positions[i] - prevPositions[i]) * invDt;
+			solveSelfCollisions();
 		}
+
+		updateVelocities(invSubstepDt);
 	}
 
-	// Damping.
-	float dampingFactor = 1.f / (1.f + dt * damping);
-	for (uint32 i = 0; i < numParticles; ++i)
+	dampVelocities(dt);
+}
+
+static bool pushOutOfSphere(vec3& p, vec3 center, float radius)
+{
+	vec3 d = p - center;
+	float sqDistance = squaredLength(d);
+	if (sqDistance >= radius * radius)
 	{
-		velocities[i] *= dampingFactor;
+		return false;
 	}
+
+	float distance = sqrt(sqDistance);
+	vec3 n = (distance > 1e-6f) ? (d / distance) : vec3(0.f, 1.f, 0.f);
+	p = center + n * radius;
+	return true;
 }
 
-void cloth_component::solveVelocities(const std::vector<cloth_constraint_temp>& constraintsTemp)
+// Pushes the point out through the closest face.
+static bool pushOutOfBox(vec3& p, vec3 center, vec3 radius)
 {
-	for (uint32 i = 0; i < (uint32)constraints.size(); ++i)
+	vec3 d = p - center;
+	vec3 penetration = radius - abs(d);
+	if (penetration.x <= 0.f || penetration.y <= 0.f || penetration.z <= 0.f)
 	{
-		cloth_constraint& c = constraints[i];
-		const cloth_constraint_temp& temp = constraintsTemp[i];
-		float j = -dot(temp.gradient, velocities[c.a] - velocities[c.b]) * temp.inverseScaledGradientSquared;
-		velocities[c.a] += temp.gradient * (j * invMasses[c.a]);
-		velocities[c.b] -= temp.gradient * (j * invMasses[c.b]);
+		return false;
 	}
+
+	uint32 axis = (penetration.x < penetration.y) ? ((penetration.x < penetration.z) ? 0 : 2) : ((penetration.y < penetration.z) ? 1 : 2);
+	p.data[axis] = center.data[axis] + ((d.data[axis] < 0.f) ? -radius.data[axis] : radius.data[axis]);
+	return true;
 }
 
-void cloth_component::solvePositions()
+void cloth_component::solveCollisions(const cloth_collision_context& collision)
 {
-	for (cloth_constraint& c : constraints)
+	CPU_PROFILE_BLOCK("Cloth collisions");
+
+	uint32 numParticles = gridSizeX * gridSizeY;
+
+	bounding_box clothAABB = bounding_box::negativeInfinity();
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		clothAABB.grow(positions.get(i));
+	}
+	clothAABB.pad(vec3(thickness));
+
+	candidateColliders.clear();
+	for (uint32 i = 0; i < collision.numColliders; ++i)
 	{
-		if (c.inverseMassSum > 0.f)
+		const collider_union& collider = collision.colliders[i];
+		if (collider.objectType != physics_object_type_rigid_body && collider.objectType != physics_object_type_static_collider)
 		{
-			vec3 delta = positions[c.b] - positions[c.a];
-			float len = squaredLength(delta);
+			continue;
+		}
+		if (collider.type == collider_type_cylinder || collider.type == collider_type_hull)
+		{
+			continue;
+		}
+		if (aabbVsAABB(collision.aabbs[i], clothAABB))
+		{
+			candidateColliders.push_back(i);
+		}
+	}
 
-			float sqRestDistance = c.restDistance * c.restDistance;
-			if (sqRestDistance + len > 1e-5f)
+	if (candidateColliders.empty() && collision.numHeightmaps == 0)
+	{
+		return;
+	}
+
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		if (invMasses[i] == 0.f)
+		{
+			continue;
+		}
+
+		vec3 p = positions.get(i);
+		bool moved = false;
+
+		for (uint32 colliderIndex : candidateColliders)
+		{
+			const collider_union& collider = collision.colliders[colliderIndex];
+			switch (collider.type)
+			{
+				case collider_type_sphere:
+				{
+					moved |= pushOutOfSphere(p, collider.sphere.center, collider.sphere.radius + thickness);
+				} break;
+				case collider_type_capsule:
+				{
+					vec3 closestPoint = closestPoint_PointSegment(p, line_segment{ collider.capsule.positionA, collider.capsule.positionB });
+					moved |= pushOutOfSphere(p, closestPoint, collider.capsule.radius + thickness);
+				} break;
+				case collider_type_aabb:
+				{
+					moved |= pushOutOfBox(p, collider.aabb.getCenter(), collider.aabb.getRadius() + thickness);
+				} break;
+				case collider_type_obb:
+				{
+					const bounding_oriented_box& obb = collider.obb;
+					vec3 local = conjugate(obb.rotation) * (p - obb.center);
+					if (pushOutOfBox(local, vec3(0.f), obb.radius + thickness))
+					{
+						p = obb.rotation * local + obb.center;
+						moved = true;
+					}
+				} break;
+			}
+		}
+
+		// Like the hull vs heightmap test, this only pushes the particles up.
+		for (uint32 h = 0; h < collision.numHeightmaps; ++h)
+		{
+			float height = collision.heightmaps[h]->getHeightAt(vec2(p.x, p.z)) + thickness;
+			if (p.y < height)
 			{
-				float k = ((sqRestDistance - len) / (c.inverseMassSum * (sqRestDistance + len)));
-				positions[c.a] -= delta * (k * invMasses[c.a]);
-				positions[c.b] += delta * (k * invMasses[c.b]);
+				p.y = height;
+				moved = true;
 			}
 		}
+
+		if (moved)
+		{
+			positions.set(i, p);
+		}
 	}
 }
 
-void cloth_component::addConstraint(uint32 indexA, uint32 indexB)
+static uint32 getSelfCollisionHash(int32 x, int32 y, int32 z, uint32 tableSize)
+{
+	uint32 hash = ((uint32)x * 92837111u) ^ ((uint32)y * 689287499u) ^ ((uint32)z * 283923481u);
+	return hash % tableSize;
+}
+
+void cloth_component::solveSelfCollisions()
 {
-	constraints.push_back(cloth_constraint
-		{ 
-			indexA, 
-			indexB, 
-			length(positions[indexA] - positions[indexB]),
-			(invMasses[indexA] + invMasses[indexB]) / stiffness,
-		});
+	CPU_PROFILE_BLOCK("Cloth self collisions");
+
+	uint32 numParticles = gridSizeX * gridSizeY;
+
+	// The cell size equals the collision distance, so only the 27 surrounding cells have to be searched.
+	// The table has twice as many cells as there are particles, so building and querying it stays linear in the number of particles.
+	uint32 tableSize = numParticles * 2;
+	float invCellSize = 1.f / selfCollisionDistance;
+
+	hashCellOffsets.assign(tableSize + 1, 0);
+	hashParticles.resize(numParticles);
+
+	auto getCell = [this, invCellSize](uint32 i, int32& x, int32& y, int32& z)
+	{
+		x = (int32)floor(positions.x[i] * invCellSize);
+		y = (int32)floor(positions.y[i] * invCellSize);
+		z = (int32)floor(positions.z[i] * invCellSize);
+	};
+
+	// Counting sort of the particles by cell. Afterwards, hashCellOffsets[h] is the first particle in cell h.
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		int32 x, y, z;
+		getCell(i, x, y, z);
+		++hashCellOffsets[getSelfCollisionHash(x, y, z, tableSize)];
+	}
+	for (uint32 h = 1; h < tableSize; ++h)
+	{
+		hashCellOffsets[h] += hashCellOffsets[h - 1];
+	}
+	hashCellOffsets[tableSize] = numParticles;
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		int32 x, y, z;
+		getCell(i, x, y, z);
+		hashParticles[--hashCellOffsets[getSelfCollisionHash(x, y, z, tableSize)]] = i;
+	}
+
+	float minDistance = selfCollisionDistance;
+
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		int32 cellX, cellY, cellZ;
+		getCell(i, cellX, cellY, cellZ);
+
+		int32 gridX = (int32)(i % gridSizeX);
+		int32 gridY = (int32)(i / gridSizeX);
+
+		for (int32 z = cellZ - 1; z <= cellZ + 1; ++z)
+		{
+			for (int32 y = cellY - 1; y <= cellY + 1; ++y)
+			{
+				for (int32 x = cellX - 1; x <= cellX + 1; ++x)
+				{
+					uint32 hash = getSelfCollisionHash(x, y, z, tableSize);
+					for (uint32 k = hashCellOffsets[hash]; k < hashCellOffsets[hash + 1]; ++k)
+					{
+						uint32 j = hashParticles[k];
+
+						// Each pair once. Direct neighbors on the grid are handled by the constraints.
+						if (j <= i)
+						{
+							continue;
+						}
+						int32 otherGridX = (int32)(j % gridSizeX);
+						int32 otherGridY = (int32)(j / gridSizeX);
+						if (abs(gridX - otherGridX) <= 1 && abs(gridY - otherGridY) <= 1)
+						{
+							continue;
+						}
+
+						float invMassSum = invMasses[i] + invMasses[j];
+						if (invMassSum == 0.f)
+						{
+							continue;
+						}
+
+						vec3 delta = positions.get(j) - positions.get(i);
+						float sqDistance = squaredLength(delta);
+						if (sqDistance >= minDistance * minDistance || sqDistance < 1e-12f)
+						{
+							continue;
+						}
+
+						float distance = sqrt(sqDistance);
+						vec3 correction = delta * ((minDistance - distance) / (distance * invMassSum));
+						positions.add(i, -correction * invMasses[i]);
+						positions.add(j, correction * invMasses[j]);
+					}
+				}
+			}
+		}
+	}
 }
 
 void cloth_component::recalculateProperties()
 {
 	uint32 numParticles = gridSizeX * gridSizeY;
 	float invMassPerParticle = numParticles / totalMass;
-	for (float& invMass : invMasses)
+	for (uint32 i = 0; i < numParticles; ++i)
 	{
-		invMass = (invMass != 0.f) ? invMassPerParticle : 0.f;
+		invMasses[i] = (invMasses[i] != 0.f) ? invMassPerParticle : 0.f;
 	}
 
 	stiffness = clamp(stiffness, 0.01f, 1.f);
 	float invStiffness = 1.f / stiffness;
-	for (cloth_constraint& c : constraints)
+	for (uint32 i = 0; i < (uint32)constraintA.size(); ++i)
 	{
-		c.inverseMassSum = (invMasses[c.a] + invMasses[c.b]) * invStiffness;
+		inverseMassSums[i] = (invMasses[constraintA[i]] + invMasses[constraintB[i]]) * invStiffness;
+		compliances[i] = bendConstraints[i] ? bendCompliance : stretchCompliance;
 	}
 }
 
+static void writeVec3Array(physics_snapshot_writer& writer, const cloth_vec3_array& a)
+{
+	writer.writeArray(a.x);
+	writer.writeArray(a.y);
+	writer.writeArray(a.z);
+}
+
+static bool readVec3Array(physics_snapshot_reader& reader, cloth_vec3_array& a)
+{
+	return reader.readArray(a.x.data(), (uint32)a.x.size())
+		&& reader.readArray(a.y.data(), (uint32)a.y.size())
+		&& reader.readArray(a.z.data(), (uint32)a.z.size());
+}
+
+void cloth_component::saveState(physics_snapshot_writer& writer) const
+{
+	writer.write(totalMass);
+	writer.write(gravityFactor);
+	writer.write(damping);
+	writer.write(stiffness);
+	writer.write(oldTotalMass);
+	writer.write(oldStiffness);
+	writer.write(stretchCompliance);
+	writer.write(bendCompliance);
+	writer.write(oldStretchCompliance);
+	writer.write(oldBendCompliance);
+
+	writeVec3Array(writer, positions);
+	writeVec3Array(writer, prevPositions);
+	writeVec3Array(writer, velocities);
+	writeVec3Array(writer, forceAccumulators);
+	writer.writeArray(invMasses);
+	writer.writeArray(inverseMassSums);
+	writer.writeArray(compliances);
+}
+
+bool cloth_component::restoreState(physics_snapshot_reader& reader)
+{
+	return reader.read(totalMass)
+		&& reader.read(gravityFactor)
+		&& reader.read(damping)
+		&& reader.read(stiffness)
+		&& reader.read(oldTotalMass)
+		&& reader.read(oldStiffness)
+		&& reader.read(stretchCompliance)
+		&& reader.read(bendCompliance)
+		&& reader.read(oldStretchCompliance)
+		&& reader.read(oldBendCompliance)
+		&& readVec3Array(reader, positions)
+		&& readVec3Array(reader, prevPositions)
+		&& readVec3Array(reader, velocities)
+		&& readVec3Array(reader, forceAccumulators)
+		&& reader.readArray(invMasses.data(), (uint32)invMasses.size())
+		&& reader.readArray(inverseMassSums.data(), (uint32)inverseMassSums.size())
+		&& reader.readArray(compliances.data(), (uint32)compliances.size());
+}
+
 
 
 
@@ -360,7 +894,11 @@ std::tuple<dx_vertex_buffer_group_view, dx_vertex_buffer_group_view, dx_index_bu
 	uint32 numTriangles = (cloth.gridSizeX - 1) * (cloth.gridSizeY - 1) * 2;
 
 	auto [positionVertexBuffer, positionPtr] = dxContext.createDynamicVertexBuffer(sizeof(vec3), numVertices);
-	memcpy(positionPtr, cloth.positions.data(), numVertices * sizeof(vec3));
+	vec3* positions = (vec3*)positionPtr;
+	for (uint32 i = 0; i < numVertices; ++i)
+	{
+		positions[i] = cloth.positions.get(i);
+	}
 
 	dx_vertex_buffer_group_view vb = skinCloth(positionVertexBuffer, cloth.gridSizeX, cloth.gridSizeY);
 	submesh_info sm;
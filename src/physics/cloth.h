@@ -2,6 +2,69 @@
 
 #include "bounding_volumes.h"
 
+struct physics_simd_kernels;
+struct collider_union;
+struct heightmap_collider_component;
+
+// World space colliders, out of which the particles are pushed after the constraint solve. Built once per step and shared by all cloths.
+// Only spheres, capsules, boxes and heightmaps are supported. Triggers and force fields should not be passed here.
+struct cloth_collision_context
+{
+	const collider_union* colliders;
+	const bounding_box* aabbs;
+	uint32 numColliders;
+
+	const heightmap_collider_component* const* heightmaps;
+	uint32 numHeightmaps;
+};
+
+// Structure-of-arrays storage of per-particle vectors, so that the constraint solver can load and store them per component.
+struct cloth_vec3_array
+{
+	std::vector<float> x, y, z;
+
+	void resize(uint32 count, vec3 value = vec3(0.f))
+	{
+		x.resize(count, value.x);
+		y.resize(count, value.y);
+		z.resize(count, value.z);
+	}
+
+	vec3 get(uint32 i) const { return vec3(x[i], y[i], z[i]); }
+	void set(uint32 i, vec3 v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+	void add(uint32 i, vec3 v) { x[i] += v.x; y[i] += v.y; z[i] += v.z; }
+};
+
+// The constraints are sorted into colors, whose constraints share no particles. Each color is padded to a multiple of this with 
+// constraints on the dummy particle, which is stored after the real ones and has zero inverse mass. This way the SIMD kernels 
+// can solve a whole register of constraints at once, with any of the supported widths.
+#define CLOTH_CONSTRAINT_BATCH_SIZE 16
+
+// Raw view of a cloth's arrays, which is passed to the solver kernels (scalar in cloth.cpp, SIMD in cloth_simd.h).
+struct cloth_solver_data
+{
+	float* positions[3];
+	float* velocities[3];
+	const float* invMasses;
+
+	int32* constraintA;
+	int32* constraintB;
+	const float* restDistances;
+	const float* inverseMassSums;
+
+	// Only used by the velocity solver. Computed from the positions at the beginning of the step.
+	const float* gradients[3];
+	const float* inverseScaledGradientsSquared;
+
+	// Only used by the XPBD solver. The compliances are scaled by complianceScale (the inverse squared substep length).
+	const float* compliances;
+	float* lambdas;
+	float complianceScale;
+
+	const uint32* colorOffsets; // numColors + 1 many.
+	uint32 numColors;
+};
+
 struct cloth_component
 {
 	cloth_component() {}
@@ -15,7 +78,22 @@ struct cloth_component
 
 	void setWorldPositionOfFixedVertices(const trs& transform, bool moveRigid = false);
 	void applyWindForce(vec3 force);
-	void simulate(uint32 velocityIterations, uint32 positionIterations, uint32 driftIterations, float dt);
+
+	// Uses the scalar solver, if simd is null. Skips collisions, if collision is null. Different cloths can be simulated in parallel.
+	// The resulting stiffness depends on the iteration counts and the timestep.
+	void simulate(uint32 velocityIterations, uint32 positionIterations, uint32 driftIterations, float dt, 
+		const cloth_collision_context* collision = 0, const physics_simd_kernels* simd = 0);
+
+	// Compliance-based (XPBD) version, which splits the timestep into substeps with a few position iterations each. The stiffness only depends
+	// on the compliances below, and not on the iteration counts or the timestep. One iteration per substep usually works best.
+	void simulateXPBD(uint32 numSubsteps, uint32 iterationsPerSubstep, float dt,
+		const cloth_collision_context* collision = 0, const physics_simd_kernels* simd = 0);
+
+	// Particle and constraint state for physics snapshots. Restoring fails if the number of particles or constraints does not match.
+	void saveState(struct physics_snapshot_writer& writer) const;
+	bool restoreState(struct physics_snapshot_reader& reader);
+
+	uint32 getNumConstraints() const { return (uint32)constraintA.size(); }
 
 	float totalMass;
 	float gravityFactor;
@@ -25,32 +103,65 @@ struct cloth_component
 	uint32 gridSizeX, gridSizeY;
 	float width, height;
 
+	float thickness = 0.02f; // Distance, which the particles keep to colliders.
+
+	// Inverse stiffness in meters per newton, only used by the XPBD solver. Zero is infinitely stiff.
+	// The stretch compliance is used for the stretch and shear constraints, the bend compliance for the constraints which skip a particle.
+	float stretchCompliance = 1e-7f;
+	float bendCompliance = 1e-4f;
+
+	// Particles which are not direct neighbors on the grid keep this distance to each other. Should be smaller than the grid spacing.
+	bool selfCollision = false;
+	float selfCollisionDistance = 0.02f;
+
 private:
 	float oldTotalMass;
 	float oldStiffness;
+	float oldStretchCompliance;
+	float oldBendCompliance;
 
 	void recalculateProperties();
 
-	struct cloth_constraint
-	{
-		uint32 a, b;
-		float restDistance;
-		float inverseMassSum;
-	};
-
-	std::vector<vec3> positions;
-	std::vector<vec3> prevPositions;
-	std::vector<vec3> velocities;
-	std::vector<vec3> forceAccumulators;
+	// Per particle, plus the dummy particle at the end.
+	cloth_vec3_array positions;
+	cloth_vec3_array prevPositions;
+	cloth_vec3_array velocities;
+	cloth_vec3_array forceAccumulators;
 	std::vector<float> invMasses;
-	std::vector<cloth_constraint> constraints;
 
-	void solveVelocities(const std::vector<struct cloth_constraint_temp>& constraintsTemp);
-	void solvePositions();
+	// Per constraint, sorted by color.
+	std::vector<int32> constraintA;
+	std::vector<int32> constraintB;
+	std::vector<float> restDistances;
+	std::vector<float> inverseMassSums;
+	std::vector<uint8> bendConstraints; // 1 for bend constraints, 0 otherwise.
+	std::vector<float> compliances;
+	std::vector<float> lambdas;
+	std::vector<uint32> colorOffsets;
+
+	// Scratch space for the velocity solver.
+	cloth_vec3_array gradients;
+	std::vector<float> inverseScaledGradientsSquared;
+
+	// Spatial hash for the self collisions, rebuilt every step. Particles are sorted by hash cell, so the table has one offset per cell.
+	std::vector<uint32> hashCellOffsets;
+	std::vector<uint32> hashParticles;
+
+	std::vector<uint32> candidateColliders;
+
+	cloth_solver_data getSolverData();
 
 	vec3 getParticlePosition(float relX, float relY);
 
-	void addConstraint(uint32 a, uint32 b);
+	void buildConstraints();
+
+	void solveCollisions(const cloth_collision_context& collision);
+	void solveSelfCollisions();
+
+	void integrate(float dt);
+	void updateVelocities(float invDt);
+	void dampVelocities(float dt);
+	void updateProperties();
 
 	friend struct cloth_render_component;
 };
@@ -0,0 +1,123 @@
+#pragma once
+
+// SIMD cloth constraint solver. Only included by physics_simd_kernels.h, which defines the wide types for the current width.
+// These are the wide versions of the scalar solvers in cloth.cpp. The constraints of one color share no particles, so
+// the particles can be gathered and scattered without conflicts. The padding constraints all write the unchanged dummy particle.
+
+static_assert(CLOTH_CONSTRAINT_BATCH_SIZE % PHYSICS_SIMD_WIDTH == 0);
+
+static void solveClothVelocitiesSIMD(const cloth_solver_data& data)
+{
+	for (uint32 color = 0; color < data.numColors; ++color)
+	{
+		for (uint32 i = data.colorOffsets[color]; i < data.colorOffsets[color + 1]; i += PHYSICS_SIMD_WIDTH)
+		{
+			w_int a(data.constraintA + i);
+			w_int b(data.constraintB + i);
+
+			w_vec3 gradient(w_float(data.gradients[0] + i), w_float(data.gradients[1] + i), w_float(data.gradients[2] + i));
+
+			w_vec3 velocityA(w_float(data.velocities[0], a.i), w_float(data.velocities[1], a.i), w_float(data.velocities[2], a.i));
+			w_vec3 velocityB(w_float(data.velocities[0], b.i), w_float(data.velocities[1], b.i), w_float(data.velocities[2], b.i));
+
+			w_float invMassA(data.invMasses, a.i);
+			w_float invMassB(data.invMasses, b.i);
+
+			w_float j = -dot(gradient, velocityA - velocityB) * w_float(data.inverseScaledGradientsSquared + i);
+			velocityA += gradient * (j * invMassA);
+			velocityB -= gradient * (j * invMassB);
+
+			velocityA.x.scatter(data.velocities[0], a.i);
+			velocityA.y.scatter(data.velocities[1], a.i);
+			velocityA.z.scatter(data.velocities[2], a.i);
+			velocityB.x.scatter(data.velocities[0], b.i);
+			velocityB.y.scatter(data.velocities[1], b.i);
+			velocityB.z.scatter(data.velocities[2], b.i);
+		}
+	}
+}
+
+static void solveClothPositionsSIMD(const cloth_solver_data& data)
+{
+	for (uint32 color = 0; color < data.numColors; ++color)
+	{
+		for (uint32 i = data.colorOffsets[color]; i < data.colorOffsets[color + 1]; i += PHYSICS_SIMD_WIDTH)
+		{
+			w_int a(data.constraintA + i);
+			w_int b(data.constraintB + i);
+
+			w_vec3 positionA(w_float(data.positions[0], a.i), w_float(data.positions[1], a.i), w_float(data.positions[2], a.i));
+			w_vec3 positionB(w_float(data.positions[0], b.i), w_float(data.positions[1], b.i), w_float(data.positions[2], b.i));
+
+			w_float invMassA(data.invMasses, a.i);
+			w_float invMassB(data.invMasses, b.i);
+
+			w_float inverseMassSum(data.inverseMassSums + i);
+			w_float restDistance(data.restDistances + i);
+
+			w_vec3 delta = positionB - positionA;
+			w_float len = squaredLength(delta);
+
+			w_float sqRestDistance = restDistance * restDistance;
+			w_float denominator = inverseMassSum * (sqRestDistance + len);
+
+			// Masks the padding and locked constraints, as well as the degenerate ones, like the branches in the scalar version.
+			auto valid = (inverseMassSum > 0.f) & (sqRestDistance + len > 1e-5f);
+			w_float k = ifThen(valid, (sqRestDistance - len) / ifThen(valid, denominator, w_float(1.f)), w_float::zero());
+
+			positionA -= delta * (k * invMassA);
+			positionB += delta * (k * invMassB);
+
+			positionA.x.scatter(data.positions[0], a.i);
+			positionA.y.scatter(data.positions[1], a.i);
+			positionA.z.scatter(data.positions[2], a.i);
+			positionB.x.scatter(data.positions[0], b.i);
+			positionB.y.scatter(data.positions[1], b.i);
+			positionB.z.scatter(data.positions[2], b.i);
+		}
+	}
+}
+
+static void solveClothPositionsXPBDSIMD(const cloth_solver_data& data)
+{
+	w_float complianceScale = data.complianceScale;
+
+	for (uint32 color = 0; color < data.numColors; ++color)
+	{
+		for (uint32 i = data.colorOffsets[color]; i < data.colorOffsets[color + 1]; i += PHYSICS_SIMD_WIDTH)
+		{
+			w_int a(data.constraintA + i);
+			w_int b(data.constraintB + i);
+
+			w_vec3 positionA(w_float(data.positions[0], a.i), w_float(data.positions[1], a.i), w_float(data.positions[2], a.i));
+			w_vec3 positionB(w_float(data.positions[0], b.i), w_float(data.positions[1], b.i), w_float(data.positions[2], b.i));
+
+			w_float invMassA(data.invMasses, a.i);
+			w_float invMassB(data.invMasses, b.i);
+			w_float inverseMassSum = invMassA + invMassB;
+
+			w_vec3 delta = positionA - positionB;
+			w_float len = sqrt(squaredLength(delta));
+
+			// Masks the padding and locked constraints, as well as the degenerate ones.
+			auto valid = (inverseMassSum > 0.f) & (len > 1e-6f);
+
+			w_float alpha = w_float(data.compliances + i) * complianceScale;
+			w_float lambda(data.lambdas + i);
+			w_float C = len - w_float(data.restDistances + i);
+			w_float deltaLambda = ifThen(valid, (-C - alpha * lambda) / (inverseMassSum + alpha), w_float::zero());
+			(lambda + deltaLambda).store(data.lambdas + i);
+
+			w_vec3 n = delta * ifThen(valid, 1.f / len, w_float::zero());
+			positionA += n * (deltaLambda * invMassA);
+			positionB -= n * (deltaLambda * invMassB);
+
+			positionA.x.scatter(data.positions[0], a.i);
+			positionA.y.scatter(data.positions[1], a.i);
+			positionA.z.scatter(data.positions[2], a.i);
+			positionB.x.scatter(data.positions[0], b.i);
+			positionB.y.scatter(data.positions[1], b.i);
+			positionB.z.scatter(data.positions[2], b.i);
+		}
+	}
+}
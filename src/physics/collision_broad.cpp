@@ -3,19 +3,13 @@
 #include "scene/scene.h"
 #include "physics.h"
 #include "core/cpu_profiling.h"
+#include "core/timer.h"
+#include "core/random.h"
 
-#include "bounding_volumes_simd.h"
+#include "physics_simd.h"
+#include "physics_snapshot.h"
 
-struct sap_endpoint
-{
-	float value;
-	entity_handle entity = entt::null;
-	bool start;
-	uint16 colliderIndex; // Set each frame.
-
-	sap_endpoint(entity_handle entity, bool start) : entity(entity), start(start) { }
-	sap_endpoint(const sap_endpoint&) = default;
-};
+#include <unordered_map>
 
 struct sap_context
 {
@@ -23,23 +17,154 @@ struct sap_context
 	uint32 sortingAxis = 0;
 };
 
+#define AABB_TREE_MARGIN 0.1f
+
+struct aabb_tree_context
+{
+	dynamic_aabb_tree tree = dynamic_aabb_tree(AABB_TREE_MARGIN);
+};
+
+static uint32 getPairKeySlot(uint64 key, uint32 mask)
+{
+	return (uint32)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+uint32 pair_key_set::find(uint64 key) const
+{
+	if (keys.empty())
+	{
+		return UINT32_MAX;
+	}
+
+	uint32 mask = (uint32)keys.size() - 1;
+	for (uint32 slot = getPairKeySlot(key, mask); keys[slot]; slot = (slot + 1) & mask)
+	{
+		if (keys[slot] == key)
+		{
+			return slot;
+		}
+	}
+	return UINT32_MAX;
+}
+
+void pair_key_set::insert(uint64 key)
+{
+	if ((numPairs + 1) * 2 > (uint32)keys.size())
+	{
+		rehash(max((uint32)keys.size() * 2, 64u));
+	}
+
+	uint32 mask = (uint32)keys.size() - 1;
+	uint32 slot = getPairKeySlot(key, mask);
+	while (keys[slot])
+	{
+		slot = (slot + 1) & mask;
+	}
+	keys[slot] = key;
+	lastSeen[slot] = frame;
+	++numPairs;
+}
+
+// Backward shift deletion, so that no tombstones are needed.
+void pair_key_set::removeAt(uint32 slot)
+{
+	uint32 mask = (uint32)keys.size() - 1;
+	uint32 hole = slot;
+	for (uint32 i = (slot + 1) & mask; keys[i]; i = (i + 1) & mask)
+	{
+		uint32 home = getPairKeySlot(keys[i], mask);
+		if (((i - home) & mask) >= ((i - hole) & mask))
+		{
+			keys[hole] = keys[i];
+			lastSeen[hole] = lastSeen[i];
+			hole = i;
+		}
+	}
+	keys[hole] = 0;
+	--numPairs;
+}
+
+void pair_key_set::rehash(uint32 capacity)
+{
+	std::vector<uint64> oldKeys = std::move(keys);
+	std::vector<uint32> oldLastSeen = std::move(lastSeen);
+	keys.assign(capacity, 0);
+	lastSeen.assign(capacity, frame);
+	numPairs = 0;
+
+	for (uint32 i = 0; i < (uint32)oldKeys.size(); ++i)
+	{
+		if (oldKeys[i])
+		{
+			insert(oldKeys[i]);
+			lastSeen[find(oldKeys[i])] = oldLastSeen[i];
+		}
+	}
+}
+
+void pair_key_set::clear()
+{
+	keys.clear();
+	lastSeen.clear();
+	numPairs = 0;
+}
+
+std::vector<uint64> pair_key_set::getPairs() const
+{
+	std::vector<uint64> result;
+	result.reserve(numPairs);
+	for (uint64 key : keys)
+	{
+		if (key)
+		{
+			result.push_back(key);
+		}
+	}
+	return result;
+}
+
+// Overlapping pairs, which the broad phase did not test, because neither collider is awake. Each pair is stored with the island which fell
+// asleep last of its two colliders, since the pair can't change before that island wakes up. Sleep islands are numbered in the order in which
+// they fall asleep.
+struct sleeping_island_pairs
+{
+	std::vector<uint64> keys;
+	uint32 lastAsleep = 0; // Frame in which the island was last asleep.
+	bool collected = false;
+};
+
+// Keys of all overlapping pairs from the last frame. Only updated with the added and removed pairs of each frame.
+struct broadphase_pair_context : pair_key_set
+{
+	std::unordered_map<uint32, sleeping_island_pairs> sleepingIslands;
+
+	void clear()
+	{
+		pair_key_set::clear();
+		sleepingIslands.clear();
+	}
+};
+
 
 void addColliderToBroadphase(scene_entity entity)
 {
 	sap_context& context = createOrGetContextVariable<sap_context>(*entity.registry);
 
+	// Colliders are referenced by physics_index during the physics step. Define PHYSICS_32_BIT_INDICES for more colliders.
+	ASSERT(context.endpoints.size() / 2 < MAX_PHYSICS_INDEX_COUNT);
+
 	sap_endpoint_indirection_component endpointIndirection;
 
-	endpointIndirection.startEndpoint = (uint16)context.endpoints.size();
+	endpointIndirection.startEndpoint = (uint32)context.endpoints.size();
 	context.endpoints.emplace_back(entity.handle, true);
 
-	endpointIndirection.endEndpoint = (uint16)context.endpoints.size();
+	endpointIndirection.endEndpoint = (uint32)context.endpoints.size();
 	context.endpoints.emplace_back(entity.handle, false);
 
 	entity.addComponent<sap_endpoint_indirection_component>(endpointIndirection);
 }
 
-static void removeEndpoint(uint16 endpointIndex, entt::registry& registry, sap_context& context)
+static void removeEndpoint(uint32 endpointIndex, entt::registry& registry, sap_context& context)
 {
 	sap_endpoint last = context.endpoints.back();
 	context.endpoints[endpointIndex] = last;
@@ -68,6 +193,11 @@ void removeColliderFromBroadphase(scene_entity entity)
 	removeEndpoint(endpointIndirection.startEndpoint, *entity.registry, context);
 	removeEndpoint(endpointIndirection.endEndpoint, *entity.registry, context);
 
+	if (endpointIndirection.treeProxy != INVALID_AABB_TREE_NODE)
+	{
+		getContextVariable<aabb_tree_context>(*entity.registry).tree.remove(endpointIndirection.treeProxy);
+	}
+
 	if (entity.hasComponent<sap_endpoint_indirection_component>())
 	{
 		entity.removeComponent<sap_endpoint_indirection_component>();
@@ -82,206 +212,403 @@ void clearBroadphase(game_scene& scene)
 		context->endpoints.clear();
 		context->sortingAxis = 0;
 	}
+	if (aabb_tree_context* context = c.find<aabb_tree_context>())
+	{
+		context->tree.clear();
+	}
+	if (broadphase_pair_context* context = c.find<broadphase_pair_context>())
+	{
+		context->clear();
+	}
 }
 
-static uint32 determineOverlapsScalar(const sap_endpoint* endpoints, uint32 numEndpoints, const bounding_box* worldSpaceAABBs, uint32 numColliders, memory_arena& arena,
-	collider_pair* outCollisions)
+void saveBroadphaseState(game_scene& scene, physics_snapshot_writer& writer)
 {
-	CPU_PROFILE_BLOCK("Determine overlaps");
+	sap_context& sap = scene.createOrGetContextVariable<sap_context>();
+	writer.writeArray(sap.endpoints);
+	writer.write(sap.sortingAxis);
 
-	uint32 numCollisions = 0;
+	scene.createOrGetContextVariable<aabb_tree_context>().tree.saveState(writer);
 
-#define CACHE_AABBS 1
+	writer.writeArray(scene.createOrGetContextVariable<broadphase_pair_context>().getPairs());
+}
 
+bool restoreBroadphaseState(game_scene& scene, physics_snapshot_reader& reader)
+{
+	// The endpoints are not default constructible, but their number is fixed by the number of colliders anyway.
+	sap_context& sap = scene.createOrGetContextVariable<sap_context>();
+	if (!reader.readArray(sap.endpoints.data(), (uint32)sap.endpoints.size()) || !reader.read(sap.sortingAxis))
+	{
+		return false;
+	}
 
-	uint32 activeListCapacity = numColliders; // Conservative estimate.
+	std::vector<uint64> pairs;
+	if (!scene.createOrGetContextVariable<aabb_tree_context>().tree.restoreState(reader) || !reader.readArray(pairs))
+	{
+		return false;
+	}
 
-	uint32 numActive = 0;
-	uint16* activeList = arena.allocate<uint16>(activeListCapacity);
+	broadphase_pair_context& context = scene.createOrGetContextVariable<broadphase_pair_context>();
+	context.clear();
+	for (uint64 key : pairs)
+	{
+		context.insert(key);
+	}
+	return true;
+}
 
-#if CACHE_AABBS
-	bounding_box* activeBBs = arena.allocate<bounding_box>(activeListCapacity);
-#endif
+static broadphase_pair getPairFromKey(uint64 key)
+{
+	return { (entity_handle)(uint32)(key >> 32), (entity_handle)(uint32)key };
+}
 
-	uint16* positionInActiveList = arena.allocate<uint16>(numColliders);
+bool containsBroadphasePair(const broadphase_pair* pairs, uint32 numPairs, entity_handle a, entity_handle b)
+{
+	uint64 key = getPairKey(a, b);
+	const broadphase_pair* end = pairs + numPairs;
+	const broadphase_pair* it = std::lower_bound(pairs, end, key, [](broadphase_pair p, uint64 key) { return getPairKey(p.a, p.b) < key; });
+	return it != end && getPairKey(it->a, it->b) == key;
+}
 
-	uint32 maxNumActive = 0;
+static physics_index getColliderIndex(game_scene& scene, entity_handle colliderEntityHandle, uint32 numColliders)
+{
+	scene_entity colliderEntity = { colliderEntityHandle, scene };
+	if (!colliderEntity.valid() || !colliderEntity.hasComponent<collider_component>())
+	{
+		return INVALID_PHYSICS_INDEX;
+	}
+	return (physics_index)(numColliders - 1 - colliderEntity.getComponentIndex<collider_component>());
+}
 
-	for (uint32 i = 0; i < numEndpoints; ++i)
+// Untested pairs belong to the island of the two colliders, which fell asleep last. Static colliders have no island.
+static uint32 getOwningSleepIsland(broadphase_collider_state stateA, uint32 islandA, broadphase_collider_state stateB, uint32 islandB)
+{
+	if (stateA != broadphase_collider_sleeping)
 	{
-		sap_endpoint ep = endpoints[i];
-		if (ep.start)
-		{
-			const bounding_box& a = worldSpaceAABBs[ep.colliderIndex];
+		return islandB;
+	}
+	if (stateB != broadphase_collider_sleeping)
+	{
+		return islandA;
+	}
+	return max(islandA, islandB);
+}
 
-			for (uint32 active = 0; active < numActive; ++active)
-			{
-#if CACHE_AABBS
-				const bounding_box& b = activeBBs[active];
-#else
-				const bounding_box& b = worldSpaceAABBs[activeList[active]];
-#endif
+struct sleeping_collider
+{
+	entity_handle entity;
+	physics_index index;
+};
 
-				if (aabbVsAABB(a, b))
-				{
-					outCollisions[numCollisions++] = { ep.colliderIndex, activeList[active] };
-				}
-			}
+static physics_index findSleepingCollider(const sleeping_collider* colliders, uint32 numColliders, entity_handle entity)
+{
+	const sleeping_collider* end = colliders + numColliders;
+	const sleeping_collider* it = std::lower_bound(colliders, end, entity, [](sleeping_collider c, entity_handle e) { return (uint32)c.entity < (uint32)e; });
+	return (it != end && it->entity == entity) ? it->index : INVALID_PHYSICS_INDEX;
+}
 
-			ASSERT(ep.colliderIndex < numColliders);
-			positionInActiveList[ep.colliderIndex] = numActive;
+// Collects the untested pairs of the islands, which fell asleep since the last frame (or of all islands, after a snapshot was restored). 
+// Their colliders were awake in the last frame, so all their overlaps are in the set.
+static void collectSleepingIslandPairs(game_scene& scene, broadphase_pair_context& context, const physics_index* newlySleepingColliders, uint32 numNewlySleepingColliders,
+	const broadphase_collider_state* colliderStates, const uint32* colliderSleepIslands, uint32 numColliders, memory_arena& arena)
+{
+	CPU_PROFILE_BLOCK("Collect sleeping island pairs");
 
-#if CACHE_AABBS
-			activeBBs[numActive] = worldSpaceAABBs[ep.colliderIndex];
-#endif
+	sleeping_collider* sleepingColliders = arena.allocate<sleeping_collider>(numNewlySleepingColliders);
+	for (uint32 i = 0; i < numNewlySleepingColliders; ++i)
+	{
+		physics_index index = newlySleepingColliders[i];
+		sleepingColliders[i] = { scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - index).handle, index };
+	}
+	std::sort(sleepingColliders, sleepingColliders + numNewlySleepingColliders, [](sleeping_collider a, sleeping_collider b) { return (uint32)a.entity < (uint32)b.entity; });
+
+	for (uint64 key : context.keys)
+	{
+		if (!key)
+		{
+			continue;
+		}
 
-			activeList[numActive++] = ep.colliderIndex;
+		broadphase_pair pair = getPairFromKey(key);
+		physics_index a = findSleepingCollider(sleepingColliders, numNewlySleepingColliders, pair.a);
+		physics_index b = findSleepingCollider(sleepingColliders, numNewlySleepingColliders, pair.b);
+		if (a == INVALID_PHYSICS_INDEX && b == INVALID_PHYSICS_INDEX)
+		{
+			continue;
+		}
 
-			maxNumActive = max(maxNumActive, numActive);
+		// Only the other collider needs a lookup.
+		a = (a != INVALID_PHYSICS_INDEX) ? a : getColliderIndex(scene, pair.a, numColliders);
+		b = (b != INVALID_PHYSICS_INDEX) ? b : getColliderIndex(scene, pair.b, numColliders);
+		if (a == INVALID_PHYSICS_INDEX || b == INVALID_PHYSICS_INDEX || broadphaseTestsPair(colliderStates[a], colliderStates[b]))
+		{
+			continue;
 		}
-		else
+
+		sleeping_island_pairs& island = context.sleepingIslands[getOwningSleepIsland(colliderStates[a], colliderSleepIslands[a], colliderStates[b], colliderSleepIslands[b])];
+		if (!island.collected)
 		{
-			uint16 pos = positionInActiveList[ep.colliderIndex];
+			island.keys.push_back(key);
+		}
+	}
 
-			--numActive;
+	for (auto& [islandIndex, island] : context.sleepingIslands)
+	{
+		island.collected = true;
+	}
+}
 
-			uint16 lastColliderInActiveList = activeList[numActive];
-			positionInActiveList[lastColliderInActiveList] = pos;
+// Appends last frame's overlaps, which the broad phase did not test this frame, because neither collider is awake. Only the pairs of the sleeping
+// islands are walked. Pairs which are tested again or now belong to another island are dropped from the island.
+static void carryOverUntestedPairs(game_scene& scene, broadphase_pair_context& context, arena_array<collider_pair>& overlaps, const broadphase_collider_state* colliderStates, 
+	const uint32* colliderSleepIslands, uint32 numColliders, memory_arena& arena)
+{
+	CPU_PROFILE_BLOCK("Carry over sleeping pairs");
 
-			activeList[pos] = activeList[numActive];
+	physics_index* newlySleepingColliders = arena.allocate<physics_index>(numColliders);
+	uint32 numNewlySleepingColliders = 0;
 
-#if CACHE_AABBS
-			activeBBs[pos] = activeBBs[numActive];
-#endif
+	uint32 lastIslandIndex = INVALID_SLEEP_ISLAND;
+	sleeping_island_pairs* lastIsland = 0;
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		if (colliderStates[i] != broadphase_collider_sleeping)
+		{
+			continue;
+		}
+
+		// The colliders of a body are mostly next to each other.
+		if (colliderSleepIslands[i] != lastIslandIndex)
+		{
+			lastIslandIndex = colliderSleepIslands[i];
+			lastIsland = &context.sleepingIslands[lastIslandIndex];
+			lastIsland->lastAsleep = context.frame;
+		}
+
+		if (!lastIsland->collected)
+		{
+			newlySleepingColliders[numNewlySleepingColliders++] = (physics_index)i;
 		}
 	}
 
-	ASSERT(numActive == 0);
+	// Islands which woke up are tested again.
+	for (auto it = context.sleepingIslands.begin(); it != context.sleepingIslands.end(); )
+	{
+		it = (it->second.lastAsleep != context.frame) ? context.sleepingIslands.erase(it) : std::next(it);
+	}
 
-	CPU_PROFILE_STAT("Max num active in SAP", maxNumActive);
+	if (numNewlySleepingColliders)
+	{
+		collectSleepingIslandPairs(scene, context, newlySleepingColliders, numNewlySleepingColliders, colliderStates, colliderSleepIslands, numColliders, arena);
+	}
 
-	return numCollisions;
+	uint32 numCarriedOver = 0;
+	for (auto& [islandIndex, island] : context.sleepingIslands)
+	{
+		uint32 numKept = 0;
+		for (uint64 key : island.keys)
+		{
+			broadphase_pair pair = getPairFromKey(key);
+			physics_index a = getColliderIndex(scene, pair.a, numColliders);
+			physics_index b = getColliderIndex(scene, pair.b, numColliders);
 
-#undef CACHE_AABBS
+			if (a != INVALID_PHYSICS_INDEX && b != INVALID_PHYSICS_INDEX && !broadphaseTestsPair(colliderStates[a], colliderStates[b])
+				&& getOwningSleepIsland(colliderStates[a], colliderSleepIslands[a], colliderStates[b], colliderSleepIslands[b]) == islandIndex)
+			{
+				overlaps.push({ a, b });
+				island.keys[numKept++] = key;
+			}
+		}
+		island.keys.resize(numKept);
+		numCarriedOver += numKept;
+	}
+
+	CPU_PROFILE_STAT("Broadphase carried over pairs", numCarriedOver);
+	CPU_PROFILE_STAT("Broadphase sleeping islands", (uint32)context.sleepingIslands.size());
 }
 
-static uint32 determineOverlapsSIMD(const sap_endpoint* endpoints, uint32 numEndpoints, const bounding_box* worldSpaceAABBs, uint32 numColliders, memory_arena& arena,
-	collider_pair* outCollisions)
+// Looks up this frame's overlaps in the set from the last frame. Only the added and removed pairs are inserted into or removed from the set, 
+// so the full set never needs to be sorted.
+static void updatePairDeltas(game_scene& scene, arena_array<collider_pair>& overlaps, const broadphase_collider_state* colliderStates, const uint32* colliderSleepIslands, 
+	uint32 numColliders, memory_arena& arena, broadphase_pair_deltas& outDeltas)
 {
-	CPU_PROFILE_BLOCK("Determine overlaps SIMD");
+	CPU_PROFILE_BLOCK("Broadphase pair deltas");
 
-#define COLLISION_SIMD_WIDTH 8u
+	broadphase_pair_context& context = scene.createOrGetContextVariable<broadphase_pair_context>();
+	uint32 frame = ++context.frame;
 
-#if COLLISION_SIMD_WIDTH == 4
-	typedef w4_float w_float;
-	typedef w4_int w_int;
-#elif COLLISION_SIMD_WIDTH == 8 && defined(SIMD_AVX_2)
-	typedef w8_float w_float;
-	typedef w8_int w_int;
-#endif
+	if (colliderStates)
+	{
+		carryOverUntestedPairs(scene, context, overlaps, colliderStates, colliderSleepIslands, numColliders, arena);
+	}
+	else
+	{
+		context.sleepingIslands.clear();
+	}
+
+	uint64* addedKeys = arena.allocate<uint64>(overlaps.count);
+	uint64* removedKeys = arena.allocate<uint64>(context.numPairs);
+	uint32 numAdded = 0;
+	uint32 numRemoved = 0;
+
+	for (uint32 i = 0; i < overlaps.count; ++i)
+	{
+		collider_pair overlap = overlaps.data[i];
+		entity_handle a = scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - overlap.colliderA).handle;
+		entity_handle b = scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - overlap.colliderB).handle;
+		uint64 key = getPairKey(a, b);
 
-	typedef wN_vec2<w_float> w_vec2;
-	typedef wN_vec3<w_float> w_vec3;
-	typedef wN_vec4<w_float> w_vec4;
-	typedef wN_quat<w_float> w_quat;
-	typedef wN_mat2<w_float> w_mat2;
-	typedef wN_mat3<w_float> w_mat3;
+		uint32 slot = context.find(key);
+		if (slot != UINT32_MAX)
+		{
+			context.lastSeen[slot] = frame;
+		}
+		else
+		{
+			addedKeys[numAdded++] = key;
+		}
+	}
 
-	typedef wN_bounding_box<w_float> w_bounding_box;
+	for (uint32 slot = 0; slot < (uint32)context.keys.size(); ++slot)
+	{
+		if (context.keys[slot] && context.lastSeen[slot] != frame)
+		{
+			removedKeys[numRemoved++] = context.keys[slot];
+		}
+	}
 
-	struct soa_bounding_box
+	for (uint32 i = 0; i < numRemoved; ++i)
 	{
-		float minX[COLLISION_SIMD_WIDTH];
-		float minY[COLLISION_SIMD_WIDTH];
-		float minZ[COLLISION_SIMD_WIDTH];
-		float maxX[COLLISION_SIMD_WIDTH];
-		float maxY[COLLISION_SIMD_WIDTH];
-		float maxZ[COLLISION_SIMD_WIDTH];
-	};
+		context.removeAt(context.find(removedKeys[i]));
+	}
+	for (uint32 i = 0; i < numAdded; ++i)
+	{
+		context.insert(addedKeys[i]);
+	}
 
-	uint32 numCollisions = 0;
+	// Only the deltas are sorted, for the binary searches in containsBroadphasePair.
+	std::sort(addedKeys, addedKeys + numAdded);
+	std::sort(removedKeys, removedKeys + numRemoved);
 
+	outDeltas.added = arena.allocate<broadphase_pair>(numAdded);
+	outDeltas.removed = arena.allocate<broadphase_pair>(numRemoved);
+	outDeltas.numAdded = numAdded;
+	outDeltas.numRemoved = numRemoved;
 
-	uint32 activeListCapacity = alignTo(numColliders, COLLISION_SIMD_WIDTH); // Conservative estimate.
+	for (uint32 i = 0; i < numAdded; ++i)
+	{
+		outDeltas.added[i] = getPairFromKey(addedKeys[i]);
+	}
+	for (uint32 i = 0; i < numRemoved; ++i)
+	{
+		outDeltas.removed[i] = getPairFromKey(removedKeys[i]);
+	}
 
-	uint32 numActive = 0;
-	uint16* activeList = arena.allocate<uint16>(activeListCapacity);
+	CPU_PROFILE_STAT("Broadphase added pairs", outDeltas.numAdded);
+	CPU_PROFILE_STAT("Broadphase removed pairs", outDeltas.numRemoved);
+}
 
-	soa_bounding_box* activeBBs = arena.allocate<soa_bounding_box>(activeListCapacity / COLLISION_SIMD_WIDTH);
+static void determineOverlapsScalar(const sap_endpoint* endpoints, uint32 numEndpoints, const bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, 
+	uint32 numColliders, memory_arena& arena, arena_array<collider_pair>& outCollisions)
+{
+	CPU_PROFILE_BLOCK("Determine overlaps");
 
-	uint16* positionInActiveList = arena.allocate<uint16>(numColliders);
+#define CACHE_AABBS 1
 
+	// One active list per collider state, so that sleeping colliders skip the lists they are not tested against as a whole.
+	struct active_list
+	{
+		uint32 count;
+		physics_index* colliders;
+#if CACHE_AABBS
+		bounding_box* bbs;
+#endif
+	};
+
+	uint32 activeListCapacities[3] = { numColliders, 0, 0 }; // Conservative estimate.
+	if (colliderStates)
+	{
+		activeListCapacities[broadphase_collider_awake] = 0;
+		for (uint32 i = 0; i < numColliders; ++i)
+		{
+			++activeListCapacities[colliderStates[i]];
+		}
+	}
+
+	active_list activeLists[3];
+	for (uint32 l = 0; l < 3; ++l)
+	{
+		activeLists[l].count = 0;
+		activeLists[l].colliders = arena.allocate<physics_index>(activeListCapacities[l]);
+#if CACHE_AABBS
+		activeLists[l].bbs = arena.allocate<bounding_box>(activeListCapacities[l]);
+#endif
+	}
+
+	physics_index* positionInActiveList = arena.allocate<physics_index>(numColliders);
+
+	uint32 numActive = 0;
 	uint32 maxNumActive = 0;
 
 	for (uint32 i = 0; i < numEndpoints; ++i)
 	{
 		sap_endpoint ep = endpoints[i];
+		broadphase_collider_state state = colliderStates ? colliderStates[ep.colliderIndex] : broadphase_collider_awake;
+		active_list& ownList = activeLists[state];
+
 		if (ep.start)
 		{
 			const bounding_box& a = worldSpaceAABBs[ep.colliderIndex];
 
-			w_bounding_box wA = { w_vec3(a.minCorner.x, a.minCorner.y, a.minCorner.z), w_vec3(a.maxCorner.x, a.maxCorner.y, a.maxCorner.z) };
-			uint32 count = bucketize(numActive, COLLISION_SIMD_WIDTH);
-
-			for (uint32 active = 0; active < count; ++active)
+			for (uint32 l = 0; l < 3; ++l)
 			{
-				const soa_bounding_box& soaBB = activeBBs[active];
-				const w_bounding_box& wB = { w_vec3(soaBB.minX, soaBB.minY, soaBB.minZ), w_vec3(soaBB.maxX, soaBB.maxY, soaBB.maxZ) };
-
-				uint32 numValidLanes = clamp(numActive - active * COLLISION_SIMD_WIDTH, 0u, COLLISION_SIMD_WIDTH);
-				uint32 validLanesMask = (1 << numValidLanes) - 1;
-
-				auto overlap = aabbVsAABB(wA, wB);
-				int32 mask = toBitMask(overlap) & validLanesMask;
+				const active_list& list = activeLists[l];
+				if (!broadphaseTestsPair(state, (broadphase_collider_state)l))
+				{
+					continue;
+				}
 
-				for (uint32 k = 0; k < COLLISION_SIMD_WIDTH; ++k)
+				for (uint32 active = 0; active < list.count; ++active)
 				{
-					if (mask & (1 << k))
+#if CACHE_AABBS
+					const bounding_box& b = list.bbs[active];
+#else
+					const bounding_box& b = worldSpaceAABBs[list.colliders[active]];
+#endif
+
+					if (aabbVsAABB(a, b))
 					{
-						outCollisions[numCollisions++] = { ep.colliderIndex, activeList[active * COLLISION_SIMD_WIDTH + k] };
+						outCollisions.push({ ep.colliderIndex, list.colliders[active] });
 					}
 				}
 			}
 
 			ASSERT(ep.colliderIndex < numColliders);
-			positionInActiveList[ep.colliderIndex] = numActive;
-
-			soa_bounding_box& outBB = activeBBs[numActive / COLLISION_SIMD_WIDTH];
-			uint32 outBBSlot = numActive % COLLISION_SIMD_WIDTH;
-			outBB.minX[outBBSlot] = a.minCorner.x;
-			outBB.minY[outBBSlot] = a.minCorner.y;
-			outBB.minZ[outBBSlot] = a.minCorner.z;
-			outBB.maxX[outBBSlot] = a.maxCorner.x;
-			outBB.maxY[outBBSlot] = a.maxCorner.y;
-			outBB.maxZ[outBBSlot] = a.maxCorner.z;
+			positionInActiveList[ep.colliderIndex] = ownList.count;
 
+#if CACHE_AABBS
+			ownList.bbs[ownList.count] = worldSpaceAABBs[ep.colliderIndex];
+#endif
 
-			activeList[numActive++] = ep.colliderIndex;
+			ownList.colliders[ownList.count++] = ep.colliderIndex;
 
-			maxNumActive = max(maxNumActive, numActive);
+			maxNumActive = max(maxNumActive, ++numActive);
 		}
 		else
 		{
-			uint16 pos = positionInActiveList[ep.colliderIndex];
+			physics_index pos = positionInActiveList[ep.colliderIndex];
 
+			--ownList.count;
 			--numActive;
 
-			uint16 lastColliderInActiveList = activeList[numActive];
+			physics_index lastColliderInActiveList = ownList.colliders[ownList.count];
 			positionInActiveList[lastColliderInActiveList] = pos;
 
-			activeList[pos] = activeList[numActive];
+			ownList.colliders[pos] = ownList.colliders[ownList.count];
 
-			soa_bounding_box& outBB = activeBBs[pos / COLLISION_SIMD_WIDTH];
-			uint32 outBBSlot = pos % COLLISION_SIMD_WIDTH;
-			const soa_bounding_box& fromBB = activeBBs[numActive / COLLISION_SIMD_WIDTH];
-			uint32 fromBBSlot = numActive % COLLISION_SIMD_WIDTH;
-
-			outBB.minX[outBBSlot] = fromBB.minX[fromBBSlot];
-			outBB.minY[outBBSlot] = fromBB.minY[fromBBSlot];
-			outBB.minZ[outBBSlot] = fromBB.minZ[fromBBSlot];
-			outBB.maxX[outBBSlot] = fromBB.maxX[fromBBSlot];
-			outBB.maxY[outBBSlot] = fromBB.maxY[fromBBSlot];
-			outBB.maxZ[outBBSlot] = fromBB.maxZ[fromBBSlot];
+#if CACHE_AABBS
+			ownList.bbs[pos] = ownList.bbs[ownList.count];
+#endif
 		}
 	}
 
@@ -289,18 +616,19 @@ static uint32 determineOverlapsSIMD(const sap_endpoint* endpoints, uint32 numEnd
 
 	CPU_PROFILE_STAT("Max num active in SAP", maxNumActive);
 
-	return numCollisions;
-
-#undef COLLISION_SIMD_WIDTH
+#undef CACHE_AABBS
 }
 
-uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena& arena, collider_pair* outCollisions, bool simd)
+uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, const uint32* colliderSleepIslands, memory_arena& arena, 
+	arena_array<collider_pair>& outCollisions, broadphase_pair_deltas& outDeltas, const physics_simd_kernels* simd)
 {
 	CPU_PROFILE_BLOCK("Broad phase");
 
+	outCollisions.count = 0;
 	uint32 numColliders = scene.numberOfComponentsOfType<collider_component>();
 	if (numColliders == 0)
 	{
+		updatePairDeltas(scene, outCollisions, 0, 0, 0, arena, outDeltas);
 		return 0;
 	}
 
@@ -311,15 +639,13 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 
 	ASSERT(numEndpoints == endpoints.size());
 
-	uint32 numCollisions = 0;
-
 #if 0
 	// Disable broadphase.
 
-	uint16 collider0Index = 0;
+	physics_index collider0Index = 0;
 	for (auto [entityHandle0, collider0] : scene.view<collider_component>().each())
 	{
-		uint16 collider1Index = 0;
+		physics_index collider1Index = 0;
 		for (auto [entityHandle1, collider1] : scene.view<collider_component>().each())
 		{
 			if (entityHandle0 == entityHandle1)
@@ -328,14 +654,14 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 			}
 			if (collider0.parentEntity != collider1.parentEntity)
 			{
-				outCollisions[numCollisions++] = { collider0Index, collider1Index };
+				outCollisions.push({ collider0Index, collider1Index });
 			}
 
 			++collider1Index;
 		}
 		++collider0Index;
 	}
-	return numCollisions;
+	return outCollisions.count;
 
 #endif
 
@@ -351,14 +677,14 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 
 		// Index of each collider in the scene. 
 		// We iterate over the endpoint indirections, which are sorted the exact same way as the colliders.
-		uint16 index = 0;
+		physics_index index = 0;
 
 		for (auto [entityHandle, indirection] : scene.view<sap_endpoint_indirection_component>().each())
 		{
 			const bounding_box& aabb = worldSpaceAABBs[index];
 
-			uint16 start = indirection.startEndpoint;
-			uint16 end = indirection.endEndpoint;
+			uint32 start = indirection.startEndpoint;
+			uint32 end = indirection.endEndpoint;
 
 			float lo = aabb.minCorner.data[sortingAxis];
 			float hi = aabb.maxCorner.data[sortingAxis];
@@ -407,15 +733,28 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 
 	if (simd)
 	{
-		numCollisions = determineOverlapsSIMD(endpoints.data(), numEndpoints, worldSpaceAABBs, numColliders, arena, outCollisions);
+		simd->determineOverlaps(endpoints.data(), numEndpoints, worldSpaceAABBs, colliderStates, numColliders, arena, outCollisions);
 	}
 	else
 	{
-		numCollisions = determineOverlapsScalar(endpoints.data(), numEndpoints, worldSpaceAABBs, numColliders, arena, outCollisions);
+		determineOverlapsScalar(endpoints.data(), numEndpoints, worldSpaceAABBs, colliderStates, numColliders, arena, outCollisions);
 	}
 
-	
-	arena.resetToMarker(marker);
+
+	uint8* tempMemoryStart = arena.base() + marker.before;
+	if ((uint8*)outCollisions.data >= tempMemoryStart)
+	{
+		// The output has outgrown its initial capacity and now lives behind the temporary memory. Move it down, so that we can free the temporaries.
+		collider_pair* dest = (collider_pair*)alignTo(tempMemoryStart, alignof(collider_pair));
+		memmove(dest, outCollisions.data, sizeof(collider_pair) * outCollisions.count);
+		outCollisions.data = dest;
+		outCollisions.capacity = outCollisions.count;
+		arena.setCurrentTo(dest + outCollisions.count);
+	}
+	else
+	{
+		arena.resetToMarker(marker);
+	}
 
 
 	// Fix up indirections.
@@ -443,5 +782,323 @@ uint32 broadphase(game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena
 	vec3 variance = s2 - s * s / (float)numColliders;
 	context.sortingAxis = (variance.x > variance.y) ? ((variance.x > variance.z) ? 0 : 2) : ((variance.y > variance.z) ? 1 : 2);
 
-	return numCollisions;
+	updatePairDeltas(scene, outCollisions, colliderStates, colliderSleepIslands, numColliders, arena, outDeltas);
+
+	CPU_PROFILE_STAT("Broadphase overlaps", outCollisions.count);
+
+	return outCollisions.count;
+}
+
+void updateAABBTree(game_scene& scene, const bounding_box* worldSpaceAABBs)
+{
+	CPU_PROFILE_BLOCK("Update AABB tree");
+
+	dynamic_aabb_tree& tree = scene.createOrGetContextVariable<aabb_tree_context>().tree;
+
+	uint32 numReinserted = 0;
+
+	// Index of each collider in the scene. 
+	// We iterate over the endpoint indirections, which are sorted the exact same way as the colliders.
+	physics_index index = 0;
+
+	for (auto [entityHandle, indirection] : scene.view<sap_endpoint_indirection_component>().each())
+	{
+		const bounding_box& aabb = worldSpaceAABBs[index];
+
+		if (indirection.treeProxy == INVALID_AABB_TREE_NODE)
+		{
+			indirection.treeProxy = tree.insert(aabb, (uint32)entityHandle);
+			++numReinserted;
+		}
+		else
+		{
+			numReinserted += tree.move(indirection.treeProxy, aabb);
+		}
+
+		++index;
+	}
+
+	CPU_PROFILE_STAT("AABB tree reinserted proxies", numReinserted);
+	CPU_PROFILE_STAT("AABB tree height", tree.getHeight());
+}
+
+const dynamic_aabb_tree& getAABBTree(game_scene& scene)
+{
+	return scene.createOrGetContextVariable<aabb_tree_context>().tree;
+}
+
+uint32 aabbTreeBroadphase(game_scene& scene, const bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, const uint32* colliderSleepIslands, memory_arena& arena, 
+	arena_array<collider_pair>& outCollisions, broadphase_pair_deltas& outDeltas)
+{
+	CPU_PROFILE_BLOCK("Broad phase AABB tree");
+
+	outCollisions.count = 0;
+
+	uint32 numColliders = scene.numberOfComponentsOfType<collider_component>();
+	if (numColliders == 0)
+	{
+		updatePairDeltas(scene, outCollisions, 0, 0, 0, arena, outDeltas);
+		return 0;
+	}
+
+	updateAABBTree(scene, worldSpaceAABBs);
+
+	const dynamic_aabb_tree& tree = getAABBTree(scene);
+
+	// The tree stores the collider entities, since they don't change when other colliders are added or removed.
+	// Here we need the collider indices of this frame.
+	physics_index* proxyToColliderIndex = arena.allocate<physics_index>(tree.getNodeCapacity());
+	{
+		physics_index index = 0;
+		for (auto [entityHandle, indirection] : scene.view<sap_endpoint_indirection_component>().each())
+		{
+			proxyToColliderIndex[indirection.treeProxy] = index++;
+		}
+	}
+
+	{
+		CPU_PROFILE_BLOCK("Query AABB tree");
+
+		for (physics_index i = 0; i < (physics_index)numColliders; ++i)
+		{
+			broadphase_collider_state state = colliderStates ? colliderStates[i] : broadphase_collider_awake;
+			if (state == broadphase_collider_sleeping)
+			{
+				// Found from the other side, if at all.
+				continue;
+			}
+
+			const bounding_box& aabb = worldSpaceAABBs[i];
+			tree.query(aabb, [&outCollisions, proxyToColliderIndex, worldSpaceAABBs, colliderStates, &aabb, i, state](int32 proxy)
+			{
+				physics_index other = proxyToColliderIndex[proxy];
+				broadphase_collider_state otherState = colliderStates ? colliderStates[other] : broadphase_collider_awake;
+
+				// Each pair is found from both sides (except for sleeping colliders, which don't query), so only report it once. 
+				// The tree stores fattened bounds, so we have to test against the actual bounds here.
+				if ((other < i || otherState == broadphase_collider_sleeping) && broadphaseTestsPair(state, otherState) && aabbVsAABB(aabb, worldSpaceAABBs[other]))
+				{
+					outCollisions.push({ i, other });
+				}
+				return true;
+			});
+		}
+	}
+
+	updatePairDeltas(scene, outCollisions, colliderStates, colliderSleepIslands, numColliders, arena, outDeltas);
+
+	CPU_PROFILE_STAT("Broadphase overlaps", outCollisions.count);
+
+	return outCollisions.count;
+}
+
+
+
+// Benchmark.
+
+static uint32 getSortingAxis(const bounding_box* aabbs, uint32 numColliders)
+{
+	vec3 s(0.f, 0.f, 0.f);
+	vec3 s2(0.f, 0.f, 0.f);
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		vec3 center = aabbs[i].getCenter();
+		s += center;
+		s2 += center * center;
+	}
+
+	vec3 variance = s2 - s * s / (float)numColliders;
+	return (variance.x > variance.y) ? ((variance.x > variance.z) ? 0 : 2) : ((variance.y > variance.z) ? 1 : 2);
+}
+
+enum benchmark_distribution
+{
+	benchmark_distribution_clustered,
+	benchmark_distribution_spread_out,
+	benchmark_distribution_axis_aligned,
+
+	benchmark_distribution_count,
+};
+
+static const char* benchmarkDistributionNames[] =
+{
+	"Clustered",
+	"Spread out",
+	"Axis aligned",
+};
+
+static void generateBenchmarkAABBs(benchmark_distribution distribution, bounding_box* outAABBs, uint32 numColliders, random_number_generator& rng)
+{
+	const uint32 numClusters = 32;
+	vec3 clusterCenters[numClusters];
+	for (uint32 i = 0; i < numClusters; ++i)
+	{
+		clusterCenters[i] = vec3(rng.randomFloatBetween(-500.f, 500.f), rng.randomFloatBetween(0.f, 50.f), rng.randomFloatBetween(-500.f, 500.f));
+	}
+
+	for (uint32 i = 0; i < numColliders; ++i)
+	{
+		vec3 center;
+		vec3 radius = vec3(rng.randomFloatBetween(0.25f, 1.f), rng.randomFloatBetween(0.25f, 1.f), rng.randomFloatBetween(0.25f, 1.f));
+
+		switch (distribution)
+		{
+			case benchmark_distribution_clustered:
+			{
+				// Sum of two uniform numbers gives a denser core.
+				center = clusterCenters[i % numClusters] + rng.randomVec3Between(-10.f, 10.f) + rng.randomVec3Between(-10.f, 10.f);
+			} break;
+			case benchmark_distribution_spread_out:
+			{
+				center = vec3(rng.randomFloatBetween(-1000.f, 1000.f), rng.randomFloatBetween(0.f, 100.f), rng.randomFloatBetween(-1000.f, 1000.f));
+			} break;
+			case benchmark_distribution_axis_aligned:
+			{
+				// Two long streets of parked vehicles, one along x and one along z. 
+				// Whichever axis the sweep and prune sorts on, all vehicles of the other street overlap on that axis.
+				float t = (float)(i / 2) * 2.5f - (float)numColliders * 0.625f;
+				radius = vec3(1.f, 0.8f, 2.2f);
+				if (i % 2 == 0)
+				{
+					center = vec3(t, radius.y, 0.f);
+					radius = vec3(radius.z, radius.y, radius.x);
+				}
+				else
+				{
+					center = vec3(20.f, radius.y, t);
+				}
+			} break;
+		}
+
+		outAABBs[i] = bounding_box::fromCenterRadius(center, radius);
+	}
+}
+
+uint32 benchmarkBroadphase(broadphase_benchmark_result* outResults, uint32 numColliders, uint32 numFrames)
+{
+	ASSERT(numColliders < MAX_PHYSICS_INDEX_COUNT);
+
+	memory_arena arena;
+	arena.initialize();
+
+	random_number_generator rng = { 61923 };
+
+	bounding_box* aabbs = arena.allocate<bounding_box>(numColliders);
+
+	const physics_simd_kernels* simd = getPhysicsSIMDKernels();
+
+	for (uint32 d = 0; d < benchmark_distribution_count; ++d)
+	{
+		generateBenchmarkAABBs((benchmark_distribution)d, aabbs, numColliders, rng);
+
+		std::vector<sap_endpoint> endpoints;
+		endpoints.reserve(numColliders * 2);
+		for (uint32 i = 0; i < numColliders; ++i)
+		{
+			endpoints.emplace_back(entt::null, true);
+			endpoints.back().colliderIndex = (physics_index)i;
+			endpoints.emplace_back(entt::null, false);
+			endpoints.back().colliderIndex = (physics_index)i;
+		}
+
+		dynamic_aabb_tree tree(AABB_TREE_MARGIN);
+		std::vector<int32> proxies(numColliders);
+		for (uint32 i = 0; i < numColliders; ++i)
+		{
+			proxies[i] = tree.insert(aabbs[i], i);
+		}
+
+		uint64 sapTicks = 0;
+		uint64 treeTicks = 0;
+		uint32 numOverlaps = 0;
+
+		for (uint32 frame = 0; frame < numFrames; ++frame)
+		{
+			// Move a tenth of the objects a little bit each frame.
+			for (uint32 i = frame % 10; i < numColliders; i += 10)
+			{
+				vec3 offset = rng.randomVec3Between(-0.05f, 0.05f);
+				aabbs[i].minCorner += offset;
+				aabbs[i].maxCorner += offset;
+			}
+
+			memory_marker marker = arena.getMarker();
+
+			// Sweep and prune. Same steps as in the broadphase above, minus the entity bookkeeping.
+			uint64 start = getTimestamp();
+
+			uint32 sortingAxis = getSortingAxis(aabbs, numColliders);
+			for (sap_endpoint& ep : endpoints)
+			{
+				const bounding_box& aabb = aabbs[ep.colliderIndex];
+				ep.value = ep.start ? aabb.minCorner.data[sortingAxis] : aabb.maxCorner.data[sortingAxis];
+			}
+
+			for (uint32 i = 1; i < (uint32)endpoints.size(); ++i)
+			{
+				sap_endpoint key = endpoints[i];
+				uint32 j = i - 1;
+
+				while (j != UINT32_MAX && endpoints[j].value > key.value)
+				{
+					endpoints[j + 1] = endpoints[j];
+					j = j - 1;
+				}
+				endpoints[j + 1] = key;
+			}
+
+			arena_array<collider_pair> sapOverlaps(arena, numColliders);
+			if (simd)
+			{
+				simd->determineOverlaps(endpoints.data(), (uint32)endpoints.size(), aabbs, 0, numColliders, arena, sapOverlaps);
+			}
+			else
+			{
+				determineOverlapsScalar(endpoints.data(), (uint32)endpoints.size(), aabbs, 0, numColliders, arena, sapOverlaps);
+			}
+
+			uint64 end = getTimestamp();
+			sapTicks += end - start;
+
+
+			// AABB tree.
+			start = getTimestamp();
+
+			for (uint32 i = 0; i < numColliders; ++i)
+			{
+				tree.move(proxies[i], aabbs[i]);
+			}
+
+			arena_array<collider_pair> treeOverlaps(arena, numColliders);
+			for (uint32 i = 0; i < numColliders; ++i)
+			{
+				const bounding_box& aabb = aabbs[i];
+				tree.query(aabb, [&tree, &treeOverlaps, aabbs, &aabb, i](int32 proxy)
+				{
+					uint32 other = tree.getUserData(proxy);
+					if (other < i && aabbVsAABB(aabb, aabbs[other]))
+					{
+						treeOverlaps.push({ (physics_index)i, (physics_index)other });
+					}
+					return true;
+				});
+			}
+
+			end = getTimestamp();
+			treeTicks += end - start;
+
+			ASSERT(sapOverlaps.count == treeOverlaps.count);
+			numOverlaps = treeOverlaps.count;
+
+			arena.resetToMarker(marker);
+		}
+
+		broadphase_benchmark_result& result = outResults[d];
+		result.distribution = benchmarkDistributionNames[d];
+		result.numOverlaps = numOverlaps;
+		result.sapMilliseconds = getMilliseconds(0, sapTicks) / numFrames;
+		result.aabbTreeMilliseconds = getMilliseconds(0, treeTicks) / numFrames;
+	}
+
+	return benchmark_distribution_count;
 }
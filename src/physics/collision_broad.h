@@ -3,16 +3,107 @@
 #include "bounding_volumes.h"
 #include "scene/scene.h"
 #include "core/memory.h"
+#include "physics_index.h"
+#include "aabb_tree.h"
 
 
 struct collider_pair
 {
 	// Indices of the colliders in the scene.
-	uint16 colliderA;
-	uint16 colliderB;
+	physics_index colliderA;
+	physics_index colliderB;
 };
 
-uint32 broadphase(struct game_scene& scene, bounding_box* worldSpaceAABBs, memory_arena& arena, collider_pair* outOverlaps, bool simd);
+// Overlapping colliders, identified by their entities, since the collider indices change when colliders are added or removed.
+struct broadphase_pair
+{
+	entity_handle a; // a < b.
+	entity_handle b;
+};
+
+// Identifies a pair of colliders across frames. The order of a and b does not matter.
+static uint64 getPairKey(entity_handle a, entity_handle b)
+{
+	uint64 x = (uint64)(uint32)a;
+	uint64 y = (uint64)(uint32)b;
+	return (x < y) ? ((x << 32) | y) : ((y << 32) | x);
+}
+
+// Set of pair keys, which is updated with the changes of each frame instead of being rebuilt. This is an open addressing hash set with linear 
+// probing. Empty slots are 0, which is never a valid key, since a collider doesn't pair with itself.
+struct pair_key_set
+{
+	std::vector<uint64> keys;
+	std::vector<uint32> lastSeen; // Frame in which the pair in each slot was last seen.
+	uint32 numPairs = 0;
+	uint32 frame = 0;
+
+	uint32 find(uint64 key) const; // Returns the slot of the key, or UINT32_MAX.
+	void insert(uint64 key); // The key must not be in the set yet.
+	void removeAt(uint32 slot);
+	void clear();
+
+	std::vector<uint64> getPairs() const;
+
+private:
+	void rehash(uint32 capacity);
+};
+
+// Changes to the set of overlapping pairs since the last frame. Both arrays are sorted and allocated from the arena.
+// Removed pairs may reference colliders, which have been deleted in the meantime.
+struct broadphase_pair_deltas
+{
+	broadphase_pair* added;
+	broadphase_pair* removed;
+	uint32 numAdded;
+	uint32 numRemoved;
+};
+
+// Colliders of sleeping bodies don't move, so they are neither tested against each other nor against static colliders. These pairs can't have
+// changed since the last frame and are carried over from there instead. Sleeping colliders are still tested against all awake ones, so that
+// they can be woken up. The carried over pairs are kept per sleep island, so only the pairs of sleeping colliders are walked each frame.
+enum broadphase_collider_state : uint8
+{
+	broadphase_collider_awake,		// Rigid bodies, triggers and force fields.
+	broadphase_collider_static,		// Colliders without a rigid body.
+	broadphase_collider_sleeping,
+};
+
+static bool broadphaseTestsPair(broadphase_collider_state a, broadphase_collider_state b)
+{
+	return a == broadphase_collider_awake || b == broadphase_collider_awake || (a == broadphase_collider_static && b == broadphase_collider_static);
+}
+
+// Overlaps are appended to outOverlaps, which grows as needed. Returns the number of overlaps.
+// If colliderStates is null, all colliders are treated as awake. Otherwise colliderSleepIslands holds the sleep island of each sleeping collider.
+uint32 broadphase(struct game_scene& scene, bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, const uint32* colliderSleepIslands, memory_arena& arena, 
+	arena_array<collider_pair>& outOverlaps, broadphase_pair_deltas& outDeltas, const struct physics_simd_kernels* simd); // Uses the scalar sweep and prune, if simd is null.
+
+// Alternative to the sweep and prune above, which does not degrade when many colliders overlap on the sorting axis.
+// Only colliders which left their fattened bounds are reinserted into the tree.
+uint32 aabbTreeBroadphase(struct game_scene& scene, const bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, const uint32* colliderSleepIslands, memory_arena& arena, 
+	arena_array<collider_pair>& outOverlaps, broadphase_pair_deltas& outDeltas);
+
+// Moves the colliders' proxies in the AABB tree. The tree is used by the AABB tree broadphase and by the scene queries, so the physics step
+// keeps it up to date with either broadphase. The leaves store the collider entities.
+void updateAABBTree(struct game_scene& scene, const bounding_box* worldSpaceAABBs);
+const dynamic_aabb_tree& getAABBTree(struct game_scene& scene);
+
+// Binary search in one of the sorted delta arrays. The order of a and b does not matter.
+bool containsBroadphasePair(const broadphase_pair* pairs, uint32 numPairs, entity_handle a, entity_handle b);
+
+
+struct broadphase_benchmark_result
+{
+	const char* distribution;
+	uint32 numOverlaps;
+	float sapMilliseconds;			// Average per frame.
+	float aabbTreeMilliseconds;		// Average per frame.
+};
+
+// Runs the sweep and prune (SIMD, if the CPU supports it) and the AABB tree on synthetic scenes (clustered, spread out and aligned along two axes).
+// Returns the number of results written.
+uint32 benchmarkBroadphase(broadphase_benchmark_result* outResults, uint32 numColliders = 10000, uint32 numFrames = 60);
 
 
 
@@ -22,6 +113,20 @@ uint32 broadphase(struct game_scene& scene, bounding_box* worldSpaceAABBs, memor
 // Internal.
 struct sap_endpoint_indirection_component
 {
-	uint16 startEndpoint;
-	uint16 endEndpoint;
+	// There are two endpoints per collider, so these don't fit into 16 bit, even if the collider indices do.
+	uint32 startEndpoint;
+	uint32 endEndpoint;
+
+	int32 treeProxy = INVALID_AABB_TREE_NODE; // Leaf in the AABB tree. Inserted in the first physics step after the collider is added.
+};
+
+struct sap_endpoint
+{
+	float value;
+	entity_handle entity = entt::null;
+	bool start;
+	physics_index colliderIndex; // Set each frame.
+
+	sap_endpoint(entity_handle entity, bool start) : entity(entity), start(start) { }
+	sap_endpoint(const sap_endpoint&) = default;
 };
@@ -0,0 +1,156 @@
+#pragma once
+
+// SIMD sweep and prune. Only included by physics_simd_kernels.h, which defines the wide types for the current width.
+
+#define COLLISION_SIMD_WIDTH PHYSICS_SIMD_WIDTH
+
+static void determineOverlapsSIMD(const sap_endpoint* endpoints, uint32 numEndpoints, const bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, 
+	uint32 numColliders, memory_arena& arena, arena_array<collider_pair>& outCollisions)
+{
+	CPU_PROFILE_BLOCK("Determine overlaps SIMD");
+
+	struct soa_bounding_box
+	{
+		float minX[COLLISION_SIMD_WIDTH];
+		float minY[COLLISION_SIMD_WIDTH];
+		float minZ[COLLISION_SIMD_WIDTH];
+		float maxX[COLLISION_SIMD_WIDTH];
+		float maxY[COLLISION_SIMD_WIDTH];
+		float maxZ[COLLISION_SIMD_WIDTH];
+	};
+
+	// One active list per collider state, as in the scalar version.
+	struct active_list
+	{
+		uint32 count;
+		physics_index* colliders;
+		soa_bounding_box* bbs;
+	};
+
+	uint32 activeListCapacities[3] = { numColliders, 0, 0 }; // Conservative estimate.
+	if (colliderStates)
+	{
+		activeListCapacities[broadphase_collider_awake] = 0;
+		for (uint32 i = 0; i < numColliders; ++i)
+		{
+			++activeListCapacities[colliderStates[i]];
+		}
+	}
+
+	active_list activeLists[3];
+	for (uint32 l = 0; l < 3; ++l)
+	{
+		uint32 capacity = alignTo(activeListCapacities[l], COLLISION_SIMD_WIDTH);
+		activeLists[l].count = 0;
+		activeLists[l].colliders = allocateArray<physics_index>(arena, capacity);
+		activeLists[l].bbs = allocateArray<soa_bounding_box>(arena, capacity / COLLISION_SIMD_WIDTH);
+	}
+
+	physics_index* positionInActiveList = allocateArray<physics_index>(arena, numColliders);
+
+	// Overlaps are collected here and appended to the output in chunks (see physics_simd_kernels.h).
+	collider_pair pairBuffer[256];
+	uint32 numBufferedPairs = 0;
+
+	uint32 numActive = 0;
+	uint32 maxNumActive = 0;
+
+	for (uint32 i = 0; i < numEndpoints; ++i)
+	{
+		sap_endpoint ep = endpoints[i];
+		broadphase_collider_state state = colliderStates ? colliderStates[ep.colliderIndex] : broadphase_collider_awake;
+		active_list& ownList = activeLists[state];
+
+		if (ep.start)
+		{
+			const bounding_box& a = worldSpaceAABBs[ep.colliderIndex];
+
+			w_bounding_box wA = { w_vec3(a.minCorner.x, a.minCorner.y, a.minCorner.z), w_vec3(a.maxCorner.x, a.maxCorner.y, a.maxCorner.z) };
+
+			for (uint32 l = 0; l < 3; ++l)
+			{
+				const active_list& list = activeLists[l];
+				if (!broadphaseTestsPair(state, (broadphase_collider_state)l))
+				{
+					continue;
+				}
+
+				uint32 count = bucketize(list.count, COLLISION_SIMD_WIDTH);
+
+				for (uint32 active = 0; active < count; ++active)
+				{
+					const soa_bounding_box& soaBB = list.bbs[active];
+					const w_bounding_box& wB = { w_vec3(soaBB.minX, soaBB.minY, soaBB.minZ), w_vec3(soaBB.maxX, soaBB.maxY, soaBB.maxZ) };
+
+					uint32 numValidLanes = minUint32(list.count - active * COLLISION_SIMD_WIDTH, COLLISION_SIMD_WIDTH);
+					uint32 validLanesMask = (1 << numValidLanes) - 1;
+
+					auto overlap = aabbVsAABB(wA, wB);
+					int32 mask = toBitMask(overlap) & validLanesMask;
+
+					for (uint32 k = 0; k < COLLISION_SIMD_WIDTH; ++k)
+					{
+						if (mask & (1 << k))
+						{
+							pairBuffer[numBufferedPairs++] = { ep.colliderIndex, list.colliders[active * COLLISION_SIMD_WIDTH + k] };
+							if (numBufferedPairs == arraysize(pairBuffer))
+							{
+								pushColliderPairs(outCollisions, pairBuffer, numBufferedPairs);
+								numBufferedPairs = 0;
+							}
+						}
+					}
+				}
+			}
+
+			ASSERT(ep.colliderIndex < numColliders);
+			positionInActiveList[ep.colliderIndex] = ownList.count;
+
+			soa_bounding_box& outBB = ownList.bbs[ownList.count / COLLISION_SIMD_WIDTH];
+			uint32 outBBSlot = ownList.count % COLLISION_SIMD_WIDTH;
+			outBB.minX[outBBSlot] = a.minCorner.x;
+			outBB.minY[outBBSlot] = a.minCorner.y;
+			outBB.minZ[outBBSlot] = a.minCorner.z;
+			outBB.maxX[outBBSlot] = a.maxCorner.x;
+			outBB.maxY[outBBSlot] = a.maxCorner.y;
+			outBB.maxZ[outBBSlot] = a.maxCorner.z;
+
+
+			ownList.colliders[ownList.count++] = ep.colliderIndex;
+
+			maxNumActive = maxUint32(maxNumActive, ++numActive);
+		}
+		else
+		{
+			physics_index pos = positionInActiveList[ep.colliderIndex];
+
+			--ownList.count;
+			--numActive;
+
+			physics_index lastColliderInActiveList = ownList.colliders[ownList.count];
+			positionInActiveList[lastColliderInActiveList] = pos;
+
+			ownList.colliders[pos] = ownList.colliders[ownList.count];
+
+			soa_bounding_box& outBB = ownList.bbs[pos / COLLISION_SIMD_WIDTH];
+			uint32 outBBSlot = pos % COLLISION_SIMD_WIDTH;
+			const soa_bounding_box& fromBB = ownList.bbs[ownList.count / COLLISION_SIMD_WIDTH];
+			uint32 fromBBSlot = ownList.count % COLLISION_SIMD_WIDTH;
+
+			outBB.minX[outBBSlot] = fromBB.minX[fromBBSlot];
+			outBB.minY[outBBSlot] = fromBB.minY[fromBBSlot];
+			outBB.minZ[outBBSlot] = fromBB.minZ[fromBBSlot];
+			outBB.maxX[outBBSlot] = fromBB.maxX[fromBBSlot];
+			outBB.maxY[outBBSlot] = fromBB.maxY[fromBBSlot];
+			outBB.maxZ[outBBSlot] = fromBB.maxZ[fromBBSlot];
+		}
+	}
+
+	ASSERT(numActive == 0);
+
+	pushColliderPairs(outCollisions, pairBuffer, numBufferedPairs);
+
+	CPU_PROFILE_STAT("Max num active in SAP", maxNumActive);
+}
+
+#undef COLLISION_SIMD_WIDTH
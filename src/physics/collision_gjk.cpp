@@ -211,3 +211,189 @@ gjk_internal_success updateGJKSimplex(gjk_simplex& s, const gjk_support_point& a
 	return gjk_unexpected_error;
 }
 
+
+// The following closest point computations follow Real-Time Collision Detection (Ericson), with the query point at the origin.
+
+static vec3 closestOnSegment(const gjk_support_point& a, const gjk_support_point& b, gjk_distance_simplex& out)
+{
+	vec3 ab = b.minkowski - a.minkowski;
+	float t = dot(-a.minkowski, ab) / max(dot(ab, ab), 1e-12f);
+
+	if (t <= 0.f)
+	{
+		out.points[0] = a; out.weights[0] = 1.f;
+		out.numPoints = 1;
+		return a.minkowski;
+	}
+	if (t >= 1.f)
+	{
+		out.points[0] = b; out.weights[0] = 1.f;
+		out.numPoints = 1;
+		return b.minkowski;
+	}
+
+	out.points[0] = a; out.weights[0] = 1.f - t;
+	out.points[1] = b; out.weights[1] = t;
+	out.numPoints = 2;
+	return a.minkowski + t * ab;
+}
+
+static vec3 closestOnTriangle(const gjk_support_point& a, const gjk_support_point& b, const gjk_support_point& c, gjk_distance_simplex& out)
+{
+	vec3 ab = b.minkowski - a.minkowski;
+	vec3 ac = c.minkowski - a.minkowski;
+
+	vec3 ap = -a.minkowski;
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if (d1 <= 0.f && d2 <= 0.f)
+	{
+		out.points[0] = a; out.weights[0] = 1.f;
+		out.numPoints = 1;
+		return a.minkowski;
+	}
+
+	vec3 bp = -b.minkowski;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if (d3 >= 0.f && d4 <= d3)
+	{
+		out.points[0] = b; out.weights[0] = 1.f;
+		out.numPoints = 1;
+		return b.minkowski;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+	{
+		float v = d1 / (d1 - d3);
+		out.points[0] = a; out.weights[0] = 1.f - v;
+		out.points[1] = b; out.weights[1] = v;
+		out.numPoints = 2;
+		return a.minkowski + v * ab;
+	}
+
+	vec3 cp = -c.minkowski;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if (d6 >= 0.f && d5 <= d6)
+	{
+		out.points[0] = c; out.weights[0] = 1.f;
+		out.numPoints = 1;
+		return c.minkowski;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+	{
+		float w = d2 / (d2 - d6);
+		out.points[0] = a; out.weights[0] = 1.f - w;
+		out.points[1] = c; out.weights[1] = w;
+		out.numPoints = 2;
+		return a.minkowski + w * ac;
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+	{
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		out.points[0] = b; out.weights[0] = 1.f - w;
+		out.points[1] = c; out.weights[1] = w;
+		out.numPoints = 2;
+		return b.minkowski + w * (c.minkowski - b.minkowski);
+	}
+
+	float denom = 1.f / (va + vb + vc);
+	float v = vb * denom;
+	float w = vc * denom;
+	out.points[0] = a; out.weights[0] = 1.f - v - w;
+	out.points[1] = b; out.weights[1] = v;
+	out.points[2] = c; out.weights[2] = w;
+	out.numPoints = 3;
+	return a.minkowski + ab * v + ac * w;
+}
+
+// Returns true if the origin and d are on different sides of the plane through a, b and c. 
+// Degenerate (flat) tetrahedra count as outside, so that the closest point is still found on the faces.
+static bool originOutsideOfPlane(vec3 a, vec3 b, vec3 c, vec3 d)
+{
+	vec3 n = cross(b - a, c - a);
+	float signOrigin = dot(-a, n);
+	float signD = dot(d - a, n);
+	return signOrigin * signD < 0.f || abs(signD) < 1e-9f;
+}
+
+bool reduceGJKDistanceSimplex(gjk_distance_simplex& s, vec3& outClosest)
+{
+	gjk_distance_simplex in = s;
+
+	switch (in.numPoints)
+	{
+		case 1:
+		{
+			s.weights[0] = 1.f;
+			outClosest = in.points[0].minkowski;
+		} break;
+
+		case 2:
+		{
+			outClosest = closestOnSegment(in.points[0], in.points[1], s);
+		} break;
+
+		case 3:
+		{
+			outClosest = closestOnTriangle(in.points[0], in.points[1], in.points[2], s);
+		} break;
+
+		case 4:
+		{
+			const gjk_support_point& a = in.points[0];
+			const gjk_support_point& b = in.points[1];
+			const gjk_support_point& c = in.points[2];
+			const gjk_support_point& d = in.points[3];
+
+			const gjk_support_point* faces[4][3] =
+			{
+				{ &a, &b, &c },
+				{ &a, &c, &d },
+				{ &a, &d, &b },
+				{ &b, &d, &c },
+			};
+			const gjk_support_point* opposite[4] = { &d, &b, &c, &a };
+
+			float bestDistance = FLT_MAX;
+			bool outside = false;
+
+			for (uint32 i = 0; i < 4; ++i)
+			{
+				const gjk_support_point& p0 = *faces[i][0];
+				const gjk_support_point& p1 = *faces[i][1];
+				const gjk_support_point& p2 = *faces[i][2];
+
+				if (originOutsideOfPlane(p0.minkowski, p1.minkowski, p2.minkowski, opposite[i]->minkowski))
+				{
+					outside = true;
+
+					gjk_distance_simplex candidate;
+					vec3 q = closestOnTriangle(p0, p1, p2, candidate);
+					float distance = squaredLength(q);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						outClosest = q;
+						s = candidate;
+					}
+				}
+			}
+
+			if (!outside)
+			{
+				return false;
+			}
+		} break;
+
+		default: ASSERT(false); break;
+	}
+
+	return true;
+}
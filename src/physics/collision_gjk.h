@@ -180,19 +180,21 @@ enum gjk_internal_success
 	gjk_unexpected_error, // Happens very very seldom. I don't know the reason yet, but instead of asserting we return this. I figure it's better than crashing.
 };
 
+// If the shapes are separated, outSeparatingAxis (if set) receives a direction along which they are. Passing this back in as the initial direction
+// rejects shapes which are still separated along it after a single support query.
 template <typename shapeA_t, typename shapeB_t>
-static bool gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB, gjk_simplex& outSimplex)
+static bool gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB, gjk_simplex& outSimplex, 
+	vec3 dir = vec3(1.f, 0.1f, -0.2f), vec3* outSeparatingAxis = 0)
 {
 	// http://www.dyn4j.org/2010/04/gjk-gilbert-johnson-keerthi/
 
 	gjk_internal_success updateGJKSimplex(gjk_simplex& s, const gjk_support_point& a, vec3& dir);
 
-	vec3 dir(1.f, 0.1f, -0.2f); // Arbitrary.
-
 	// First point.
 	outSimplex.c = support(shapeA, shapeB, dir);
 	if (dot(outSimplex.c.minkowski, dir) < 0.f)
 	{
+		if (outSeparatingAxis) { *outSeparatingAxis = dir; }
 		return false;
 	}
 
@@ -201,6 +203,7 @@ static bool gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB,
 	outSimplex.b = support(shapeA, shapeB, dir);
 	if (dot(outSimplex.b.minkowski, dir) < 0.f)
 	{
+		if (outSeparatingAxis) { *outSeparatingAxis = dir; }
 		return false;
 	}
 
@@ -217,6 +220,7 @@ static bool gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB,
 		gjk_support_point a = support(shapeA, shapeB, dir);
 		if (dot(a.minkowski, dir) < 0.f)
 		{
+			if (outSeparatingAxis) { *outSeparatingAxis = dir; }
 			return false;
 		}
 
@@ -238,3 +242,73 @@ static bool gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB,
 }
 
 
+
+
+
+struct gjk_distance_simplex
+{
+	gjk_support_point points[4];
+	float weights[4]; // Barycentric coordinates of the point closest to the origin.
+	uint32 numPoints = 0;
+};
+
+// Reduces the simplex to the smallest sub-simplex which contains the point closest to the origin and returns that point.
+// Returns false if the origin lies inside the simplex.
+bool reduceGJKDistanceSimplex(gjk_distance_simplex& s, vec3& outClosest);
+
+// Computes the closest points between two convex shapes. Returns false if the shapes intersect, in which case the points are not valid.
+template <typename shapeA_t, typename shapeB_t>
+static bool gjkDistance(const shapeA_t& shapeA, const shapeB_t& shapeB, vec3& outPointA, vec3& outPointB)
+{
+	gjk_distance_simplex s;
+	s.points[0] = support(shapeA, shapeB, vec3(1.f, 0.f, 0.f)); // Arbitrary.
+	s.weights[0] = 1.f;
+	s.numPoints = 1;
+
+	vec3 v = s.points[0].minkowski;
+
+	for (uint32 iteration = 0; iteration < 32; ++iteration)
+	{
+		float vv = dot(v, v);
+		if (vv < 1e-10f)
+		{
+			return false;
+		}
+
+		gjk_support_point w = support(shapeA, shapeB, -v);
+
+		// Stop if the new point does not get us closer to the origin.
+		if (vv - dot(v, w.minkowski) <= 1e-6f * vv)
+		{
+			break;
+		}
+
+		gjk_distance_simplex previous = s;
+
+		s.points[s.numPoints++] = w;
+		vec3 newV;
+		if (!reduceGJKDistanceSimplex(s, newV))
+		{
+			return false;
+		}
+
+		// Numerical issues can make the simplex cycle. Keep the last result in that case.
+		if (dot(newV, newV) >= vv * (1.f - 1e-6f))
+		{
+			s = previous;
+			break;
+		}
+
+		v = newV;
+	}
+
+	outPointA = vec3(0.f);
+	outPointB = vec3(0.f);
+	for (uint32 i = 0; i < s.numPoints; ++i)
+	{
+		outPointA += s.weights[i] * s.points[i].shapeAPoint;
+		outPointB += s.weights[i] * s.points[i].shapeBPoint;
+	}
+
+	return true;
+}
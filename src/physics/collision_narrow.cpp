@@ -7,32 +7,11 @@
 #include "collision_sat.h"
 #include "core/cpu_profiling.h"
 
-#include "bounding_volumes_simd.h"
-
-#define COLLISION_SIMD_WIDTH 8u
-
-
-#if COLLISION_SIMD_WIDTH == 4
-typedef w4_float w_float;
-typedef w4_int w_int;
-#elif COLLISION_SIMD_WIDTH == 8 && defined(SIMD_AVX_2)
-typedef w8_float w_float;
-typedef w8_int w_int;
+#ifdef PHYSICS_USE_JOB_SYSTEM
+#include "core/job_system.h"
 #endif
 
-typedef wN_vec2<w_float> w_vec2;
-typedef wN_vec3<w_float> w_vec3;
-typedef wN_vec4<w_float> w_vec4;
-typedef wN_quat<w_float> w_quat;
-typedef wN_mat2<w_float> w_mat2;
-typedef wN_mat3<w_float> w_mat3;
-
-typedef wN_bounding_sphere<w_float> w_bounding_sphere;
-typedef wN_bounding_capsule<w_float> w_bounding_capsule;
-typedef wN_bounding_cylinder<w_float> w_bounding_cylinder;
-typedef wN_bounding_box<w_float> w_bounding_box;
-typedef wN_bounding_oriented_box<w_float> w_bounding_oriented_box;
-typedef wN_line_segment<w_float> w_line_segment;
+#include "physics_simd.h"
 
 
 
@@ -1176,8 +1155,11 @@ static bool intersection(const bounding_box& a, const bounding_hull& h, contact_
 }
 
 // OBB tests.
-static bool intersection(const bounding_oriented_box& a, const bounding_oriented_box& b, contact_manifold& outContact)
+// The SAT axes are numbered 0-2 for a's faces, 3-5 for b's faces and 6 + 3 * i + j for a's edge i crossed with b's edge j.
+static bool intersection(const bounding_oriented_box& a, const bounding_oriented_box& b, contact_manifold& outContact, uint32& outSeparatingAxis)
 {
+	outSeparatingAxis = UINT32_MAX;
+
 	union obb_axes
 	{
 		struct
@@ -1239,7 +1221,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		rb = dot(row(absR, i), b.radius);
 		float d = t.data[i];
 		float penetration = ra + rb - abs(d);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = i; return false; }
 		if (penetration < minPenetration)
 		{
 			minPenetration = penetration;
@@ -1254,7 +1236,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		rb = b.radius.data[i];
 		float d = dot(col(r, i), t);
 		float penetration = ra + rb - abs(d);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 3 + i; return false; }
 		if (penetration < minPenetration)
 		{
 			minPenetration = penetration;
@@ -1276,7 +1258,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.y * absR.m20 + a.radius.z * absR.m10;
 		rb = b.radius.y * absR.m02 + b.radius.z * absR.m01;
 		penetration = ra + rb - abs(t.z * r.m10 - t.y * r.m20);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 6; return false; }
 		normal = vec3(0.f, -r.m20, r.m10);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1291,7 +1273,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.y * absR.m21 + a.radius.z * absR.m11;
 		rb = b.radius.x * absR.m02 + b.radius.z * absR.m00;
 		penetration = ra + rb - abs(t.z * r.m11 - t.y * r.m21);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 7; return false; }
 		normal = vec3(0.f, -r.m21, r.m11);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1306,7 +1288,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.y * absR.m22 + a.radius.z * absR.m12;
 		rb = b.radius.x * absR.m01 + b.radius.y * absR.m00;
 		penetration = ra + rb - abs(t.z * r.m12 - t.y * r.m22);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 8; return false; }
 		normal = vec3(0.f, -r.m22, r.m12);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1321,7 +1303,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.x * absR.m20 + a.radius.z * absR.m00;
 		rb = b.radius.y * absR.m12 + b.radius.z * absR.m11;
 		penetration = ra + rb - abs(t.x * r.m20 - t.z * r.m00);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 9; return false; }
 		normal = vec3(r.m20, 0.f, -r.m00);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1336,7 +1318,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.x * absR.m21 + a.radius.z * absR.m01;
 		rb = b.radius.x * absR.m12 + b.radius.z * absR.m10;
 		penetration = ra + rb - abs(t.x * r.m21 - t.z * r.m01);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 10; return false; }
 		normal = vec3(r.m21, 0.f, -r.m01);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1351,7 +1333,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.x * absR.m22 + a.radius.z * absR.m02;
 		rb = b.radius.x * absR.m11 + b.radius.y * absR.m10;
 		penetration = ra + rb - abs(t.x * r.m22 - t.z * r.m02);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 11; return false; }
 		normal = vec3(r.m22, 0.f, -r.m02);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1366,7 +1348,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.x * absR.m10 + a.radius.y * absR.m00;
 		rb = b.radius.y * absR.m22 + b.radius.z * absR.m21;
 		penetration = ra + rb - abs(t.y * r.m00 - t.x * r.m10);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 12; return false; }
 		normal = vec3(-r.m10, r.m00, 0.f);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1381,7 +1363,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.x * absR.m11 + a.radius.y * absR.m01;
 		rb = b.radius.x * absR.m22 + b.radius.z * absR.m20;
 		penetration = ra + rb - abs(t.y * r.m01 - t.x * r.m11);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 13; return false; }
 		normal = vec3(-r.m11, r.m01, 0.f);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1396,7 +1378,7 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 		ra = a.radius.x * absR.m12 + a.radius.y * absR.m02;
 		rb = b.radius.x * absR.m21 + b.radius.y * absR.m20;
 		penetration = ra + rb - abs(t.y * r.m02 - t.x * r.m12);
-		if (penetration < 0.f) { return false; }
+		if (penetration < 0.f) { outSeparatingAxis = 14; return false; }
 		normal = vec3(-r.m12, r.m02, 0.f);
 		l = 1.f / length(normal);
 		penetration *= l;
@@ -1526,6 +1508,61 @@ static bool intersection(const bounding_oriented_box& a, const bounding_oriented
 	return true;
 }
 
+static bool intersection(const bounding_oriented_box& a, const bounding_oriented_box& b, contact_manifold& outContact)
+{
+	uint32 separatingAxis;
+	return intersection(a, b, outContact, separatingAxis);
+}
+
+static float element(const mat3& m, uint32 r, uint32 c)
+{
+	return row(m, r).data[c];
+}
+
+// Single axis of the SAT above, with the same numbering.
+static bool obbsSeparatedOnAxis(const bounding_oriented_box& a, const bounding_oriented_box& b, uint32 axis)
+{
+	mat3 r = quaternionToMat3(conjugate(a.rotation) * b.rotation);
+	vec3 t = conjugate(a.rotation) * (b.center - a.center);
+
+	mat3 absR;
+	for (uint32 i = 0; i < 9; ++i)
+	{
+		absR.m[i] = abs(r.m[i]) + EPSILON;
+	}
+
+	if (axis < 3)
+	{
+		return abs(t.data[axis]) > a.radius.data[axis] + dot(row(absR, axis), b.radius);
+	}
+	if (axis < 6)
+	{
+		uint32 i = axis - 3;
+		return abs(dot(col(r, i), t)) > dot(col(absR, i), a.radius) + b.radius.data[i];
+	}
+
+	uint32 i = (axis - 6) / 3;
+	uint32 j = (axis - 6) % 3;
+	uint32 i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+	uint32 j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+
+	float ra = a.radius.data[i1] * element(absR, i2, j) + a.radius.data[i2] * element(absR, i1, j);
+	float rb = b.radius.data[j1] * element(absR, i, j2) + b.radius.data[j2] * element(absR, i, j1);
+	float d = t.data[i2] * element(r, i1, j) - t.data[i1] * element(r, i2, j);
+	return abs(d) > ra + rb;
+}
+
+// inOutSeparation holds last frame's separating axis on input and this frame's on output.
+static bool intersection(const bounding_oriented_box& a, const bounding_oriented_box& b, contact_manifold& outContact, separating_axis_cache_entry& inOutSeparation)
+{
+	if (inOutSeparation.satAxis != UINT32_MAX && obbsSeparatedOnAxis(a, b, inOutSeparation.satAxis))
+	{
+		return false;
+	}
+
+	return intersection(a, b, outContact, inOutSeparation.satAxis);
+}
+
 static bool intersection(const bounding_oriented_box& o, const bounding_hull& h, contact_manifold& outContact)
 {
 	// TODO: Handle multiple-contact-points case.
@@ -1555,15 +1592,19 @@ static bool intersection(const bounding_oriented_box& o, const bounding_hull& h,
 }
 
 // Hull tests.
-static bool intersection(const bounding_hull& a, const bounding_hull& b, contact_manifold& outContact)
+// inOutSeparation holds last frame's separating axis on input and this frame's on output.
+static bool intersection(const bounding_hull& a, const bounding_hull& b, contact_manifold& outContact, separating_axis_cache_entry& inOutSeparation)
 {
 	// TODO: Handle multiple-contact-points case.
 
 	hull_support_fn hullSupport1{ a };
 	hull_support_fn hullSupport2{ b };
 
+	vec3 initialDirection = (inOutSeparation.axis != vec3(0.f)) ? inOutSeparation.axis : vec3(1.f, 0.1f, -0.2f);
+	inOutSeparation.axis = vec3(0.f);
+
 	gjk_simplex gjkSimplex;
-	if (!gjkIntersectionTest(hullSupport1, hullSupport2, gjkSimplex))
+	if (!gjkIntersectionTest(hullSupport1, hullSupport2, gjkSimplex, initialDirection, &inOutSeparation.axis))
 	{
 		return false;
 	}
@@ -1583,9 +1624,11 @@ static bool intersection(const bounding_hull& a, const bounding_hull& b, contact
 	return true;
 }
 
-
-
-
+static bool intersection(const bounding_hull& a, const bounding_hull& b, contact_manifold& outContact)
+{
+	separating_axis_cache_entry separation = { 0, vec3(0.f), UINT32_MAX };
+	return intersection(a, b, outContact, separation);
+}
 
 
 
@@ -1691,75 +1734,6 @@ static bool overlapCheck(const collider_union* worldSpaceColliders, collider_pai
 
 
 
-
-
-
-
-
-
-template <typename collider_t>
-static collider_t loadBoundingVolumeSIMD(const collider_union* worldSpaceColliders, uint16* indices) { static_assert(false); }
-
-template <>
-static w_bounding_sphere loadBoundingVolumeSIMD<w_bounding_sphere>(const collider_union* worldSpaceColliders, uint16* indices)
-{
-	w_bounding_sphere result;
-	load4((float*)&worldSpaceColliders->sphere, indices, sizeof(collider_union),
-		result.center.x, result.center.y, result.center.z, result.radius);
-	return result;
-}
-
-template <>
-static w_bounding_capsule loadBoundingVolumeSIMD<w_bounding_capsule>(const collider_union* worldSpaceColliders, uint16* indices)
-{
-	w_bounding_capsule result;
-	w_float dummy;
-	load8((float*)&worldSpaceColliders->capsule, indices, sizeof(collider_union),
-		result.positionA.x, result.positionA.y, result.positionA.z,
-		result.positionB.x, result.positionB.y, result.positionB.z,
-		result.radius, dummy);
-	return result;
-}
-
-template <>
-static w_bounding_cylinder loadBoundingVolumeSIMD<w_bounding_cylinder>(const collider_union* worldSpaceColliders, uint16* indices)
-{
-	w_bounding_cylinder result;
-	w_float dummy;
-	load8((float*)&worldSpaceColliders->cylinder, indices, sizeof(collider_union),
-		result.positionA.x, result.positionA.y, result.positionA.z,
-		result.positionB.x, result.positionB.y, result.positionB.z,
-		result.radius, dummy);
-	return result;
-}
-
-template <>
-static w_bounding_box loadBoundingVolumeSIMD<w_bounding_box>(const collider_union* worldSpaceColliders, uint16* indices)
-{
-	w_bounding_box result;
-	w_float dummy0, dummy1;
-	load8((float*)&worldSpaceColliders->aabb, indices, sizeof(collider_union),
-		result.minCorner.x, result.minCorner.y, result.minCorner.z,
-		result.maxCorner.x, result.maxCorner.y, result.maxCorner.z,
-		dummy0, dummy1);
-	return result;
-}
-
-template <>
-static w_bounding_oriented_box loadBoundingVolumeSIMD<w_bounding_oriented_box>(const collider_union* worldSpaceColliders, uint16* indices)
-{
-	w_bounding_oriented_box result;
-	w_float dummy0, dummy1;
-	load8(&worldSpaceColliders->obb.rotation.x, indices, sizeof(collider_union),
-		result.rotation.x, result.rotation.y, result.rotation.z, result.rotation.w,
-		result.center.x, result.center.y, result.center.z,
-		result.radius.x);
-	load4(&worldSpaceColliders->obb.radius.y, indices, sizeof(collider_union),
-		result.radius.y, result.radius.z,
-		dummy0, dummy1);
-	return result;
-}
-
 template <typename collider_t> static const collider_t& loadBoundingVolumeScalar(const collider_union* worldSpaceColliders, uint32 index) { static_assert(false); }
 template <> static const bounding_sphere& loadBoundingVolumeScalar<bounding_sphere>(const collider_union* worldSpaceColliders, uint32 index) { return worldSpaceColliders[index].sphere; }
 template <> static const bounding_capsule& loadBoundingVolumeScalar<bounding_capsule>(const collider_union* worldSpaceColliders, uint32 index) { return worldSpaceColliders[index].capsule; }
@@ -1769,464 +1743,16 @@ template <> static const bounding_oriented_box& loadBoundingVolumeScalar<boundin
 template <> static const bounding_hull& loadBoundingVolumeScalar<bounding_hull>(const collider_union* worldSpaceColliders, uint32 index) { return worldSpaceColliders[index].hull; }
 
 
-struct w_collision_contact
-{
-	w_vec3 point;
-	w_float penetrationDepth;
-	w_vec3 normal;
-	uint32 mask;
-};
-
-
-// Sphere tests.
-static uint32 intersectionSIMD(const w_bounding_sphere& s1, const w_bounding_sphere& s2, w_collision_contact* outContacts)
-{
-	w_vec3 n = s2.center - s1.center;
-	w_float radiusSum = s2.radius + s1.radius;
-	w_float sqDistance = squaredLength(n);
-
-	auto intersects = (sqDistance <= radiusSum * radiusSum);
-	
-	uint32 mask = toBitMask(intersects);
-
-	if (anyTrue(mask))
-	{
-		auto degenerate = (sqDistance == 0.f);
-		w_float distance = ifThen(degenerate, 0.f, sqrt(sqDistance));
-		w_vec3 collisionNormal = ifThen(degenerate, w_vec3(0.f, 1.f, 0.f), n / distance);
-
-		w_float penetrationDepth = radiusSum - distance; // Flipped to change sign.
-		w_vec3 point = w_float(0.5f) * (s1.center + s1.radius * collisionNormal + s2.center - s2.radius * collisionNormal);
-
-		outContacts[0].point = point;
-		outContacts[0].penetrationDepth = penetrationDepth;
-		outContacts[0].normal = collisionNormal;
-		outContacts[0].mask = mask;
-
-		return 1;
-	}
-
-	return 0;
-}
-
-static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_capsule& c, w_collision_contact* outContacts)
-{
-	w_vec3 closestPoint = closestPoint_PointSegment(s.center, w_line_segment{ c.positionA, c.positionB });
-	return intersectionSIMD(s, w_bounding_sphere{ closestPoint, c.radius }, outContacts);
-}
-
-static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_cylinder& c, w_collision_contact* outContacts)
-{
-	w_vec3 ab = c.positionB - c.positionA;
-	w_float t = dot(s.center - c.positionA, ab) / squaredLength(ab);
-
-	auto tSaturated = t >= 0.f & t <= 1.f;
-
-	int32 tSaturatedMask = toBitMask(tSaturated);
-
-	uint32 sphereSphereTest = 0;
-	if (anyTrue(tSaturatedMask))
-	{
-		sphereSphereTest = intersectionSIMD(s, w_bounding_sphere{ lerp(c.positionA, c.positionB, t), c.radius }, outContacts);
-
-		if (allTrue(tSaturated))
-		{
-			return sphereSphereTest;
-		}
-	}
-
-
-
-	w_vec3 p = ifThen(t <= 0.f, c.positionA, c.positionB);
-	w_vec3 up = ifThen(t <= 0.f, -ab, ab);
-
-	w_vec3 projectedDirToCenter = normalize(cross(cross(up, s.center - p), up));
-	w_vec3 endA = p + projectedDirToCenter * c.radius;
-	w_vec3 endB = p - projectedDirToCenter * c.radius;
-
-	w_vec3 closestToSphere = closestPoint_PointSegment(s.center, w_line_segment{ endA, endB });
-	w_vec3 normal = closestToSphere - s.center; // From sphere to cylinder.
-	w_float sqDistance = squaredLength(normal);
-
-	auto intersects = (sqDistance <= s.radius * s.radius);
-
-	uint32 mask = toBitMask(intersects);
-
-	if (mask)
-	{
-		auto degenerate = sqDistance == 0.f;
-
-		w_float distance = ifThen(degenerate, 0.f, sqrt(sqDistance));
-		normal = ifThen(degenerate, -normalize(up), normal / distance);
-		
-		w_float penetrationDepth = s.radius - distance;
-		w_vec3 point = closestToSphere + 0.5f * penetrationDepth * normal;
-
-		if (anyTrue(tSaturatedMask))
-		{
-			point = ifThen(tSaturated, outContacts[0].point, point);
-			penetrationDepth = ifThen(tSaturated, outContacts[0].penetrationDepth, penetrationDepth);
-			normal = ifThen(tSaturated, outContacts[0].normal, normal);
-
-			mask |= tSaturatedMask;
-		}
-
-		outContacts[0].point = point;
-		outContacts[0].penetrationDepth = penetrationDepth;
-		outContacts[0].normal = normal;
-		outContacts[0].mask = mask;
-		
-		return 1;
-	}
-
-	return sphereSphereTest;
-}
-
-static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_box& a, w_collision_contact* outContacts)
-{
-	w_vec3 p = closestPoint_PointAABB(s.center, a);
-	w_vec3 n = p - s.center;
-	w_float sqDistance = squaredLength(n);
-
-	auto intersects = sqDistance <= s.radius * s.radius;
-
-	uint32 mask = toBitMask(intersects);
-
-	if (anyTrue(mask))
-	{
-		auto valid = (sqDistance > 0.f);
-		w_float dist = ifThen(valid, sqrt(sqDistance), 0.f);
-		n = ifThen(valid, n / dist, w_vec3(0.f, 1.f, 0.f));
-
-		outContacts[0].point = w_float(0.5f) * (p + s.center + n * s.radius);
-		outContacts[0].penetrationDepth = s.radius - dist; // Flipped to change sign.
-		outContacts[0].normal = n;
-		outContacts[0].mask = mask;
-
-		return 1;
-	}
-	return 0;
-}
-
-static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_oriented_box& o, w_collision_contact* outContacts)
-{
-	w_bounding_box aabb = w_bounding_box::fromCenterRadius(o.center, o.radius);
-	w_bounding_sphere s_ = {
-		conjugate(o.rotation) * (s.center - o.center) + o.center,
-		s.radius };
-
-	uint32 result = intersectionSIMD(s_, aabb, outContacts);
-
-	if (result)
-	{
-		outContacts[0].normal = o.rotation * outContacts[0].normal;
-		outContacts[0].point = o.rotation * (outContacts[0].point - o.center) + o.center;
-		return 1;
-	}
-	return 0;
-}
-
-// Capsule tests.
-static uint32 intersectionSIMD(const w_bounding_capsule& a, const w_bounding_capsule& b, w_collision_contact* outContacts)
-{
-	w_vec3 aDir = a.positionB - a.positionA;
-	w_vec3 bDir = normalize(b.positionB - b.positionA);
-
-	w_float aDirLength = length(aDir);
-	aDir *= 1.f / aDirLength;
-
-	w_float alignment = dot(aDir, bDir);
-
-	auto valid = (abs(alignment) <= 0.99f);
-
-	uint32 result = 0;
-
-	int32 validMask = toBitMask(valid);
-
-	if (anyTrue(validMask))
-	{
-		w_vec3 closestPoint1, closestPoint2;
-		closestPoint_SegmentSegment(w_line_segment{ a.positionA, a.positionB }, w_line_segment{ b.positionA, b.positionB }, closestPoint1, closestPoint2);
-		result = intersectionSIMD(w_bounding_sphere{ closestPoint1, a.radius }, w_bounding_sphere{ closestPoint2, b.radius }, outContacts);
-
-		if (allTrue(valid))
-		{
-			return result;
-		}
-	}
-
-	// Parallel case.
-
-	w_vec3 pAa = a.positionA;
-	w_vec3 pAb = a.positionB;
-	w_vec3 pBa = b.positionA;
-	w_vec3 pBb = b.positionB;
-
-	auto swap = alignment < 0.f;
-	
-	if (anyTrue(swap))
-	{
-		w_vec3 tmp = pBa;
-		pBa = ifThen(swap, pBb, pBa);
-		pBb = ifThen(swap, tmp, pBb);
-	}
-
-	w_vec3 referencePoint = a.positionA;
-
-	w_float a0 = 0.f;
-	w_float a1 = aDirLength;
-
-	w_float b0 = dot(aDir, pBa - referencePoint);
-	w_float b1 = dot(aDir, pBb - referencePoint);
-
-	w_float left = maximum(a0, b0);
-	w_float right = minimum(a1, b1);
-
-	auto endToEnd = right < left;
-	if (anyTrue(endToEnd))
-	{
-		auto mask = a0 > b1;
-		w_vec3 refA = ifThen(mask, pAa, pAb);
-		w_vec3 refB = ifThen(mask, pBb, pBa);
-
-		w_collision_contact contact;
-		uint32 endToEndTest = intersectionSIMD(w_bounding_sphere{ refA, a.radius }, w_bounding_sphere{ refB, b.radius }, &contact);
-
-		if (endToEndTest)
-		{
-			outContacts[0].point = ifThen(valid, outContacts[0].point, contact.point);
-			outContacts[0].penetrationDepth = ifThen(valid, outContacts[0].penetrationDepth, contact.penetrationDepth);
-			outContacts[0].normal = ifThen(valid, outContacts[0].normal, contact.normal);
-			outContacts[0].mask |= contact.mask;
-			valid |= mask;
-		}
-
-		result = max(endToEndTest, result);
-
-		if (allTrue(valid))
-		{
-			return result;
-		}
-	}
-
-	w_vec3 contactA0 = referencePoint + left * aDir;
-	w_vec3 contactA1 = referencePoint + right * aDir;
-
-	w_vec3 contactB0 = closestPoint_PointSegment(contactA0, w_line_segment{ pBa, pBb });
-	w_vec3 contactB1 = contactB0 + (right - left) * aDir;
-
-	w_vec3 normal = contactB0 - contactA0;
-	w_float d = length(normal);
-
-	auto degenerate = (d < EPSILON);
-
-	d = ifThen(degenerate, 0.f, d);
-	normal = ifThen(degenerate, w_vec3(0.f, 1.f, 0.f), normal / d);
-
-	w_float radiusSum = a.radius + b.radius;
-
-	w_float penetration = radiusSum - d;
-	auto collision = (penetration >= 0.f);
-
-	int32 mask = toBitMask(collision);
-
-	if (!mask)
-	{
-		return result;
-	}
-
-	w_vec3 point0 = (contactA0 + contactB0) * w_float(0.5f);
-	w_float penetration0 = penetration;
-	w_vec3 normal0 = normal;
-	int32 mask0 = mask;
-
-	if (anyTrue(validMask))
-	{
-		point0 = ifThen(valid, outContacts[0].point, point0);
-		penetration0 = ifThen(valid, outContacts[0].penetrationDepth, penetration0);
-		normal0 = ifThen(valid, outContacts[0].normal, normal0);
-
-		mask0 |= validMask;
-	}
-
-	outContacts[0].point = point0;
-	outContacts[0].penetrationDepth = penetration0;
-	outContacts[0].normal = normal0;
-	outContacts[0].mask = mask0;
-
-	outContacts[1].point = (contactA1 + contactB1) * w_float(0.5f);
-	outContacts[1].penetrationDepth = penetration;
-	outContacts[1].normal = normal;
-	outContacts[1].mask = mask;
-
-	return 2;
-}
-
-
-
-
-
-
-
-
-
-template <typename collider_a, typename collider_b, typename = void>
-struct simd_intersection_available : std::false_type {};
-
-template <typename collider_a, typename collider_b>
-struct simd_intersection_available<collider_a, collider_b,
-	std::void_t<decltype(intersectionSIMD(std::declval<const collider_a&>(), std::declval<const collider_b&>())) >> : std::true_type {};
-
-template <typename collider_t> struct scalar_to_wide { using type = void; };
-template <> struct scalar_to_wide<bounding_sphere> { using type = w_bounding_sphere; };
-template <> struct scalar_to_wide<bounding_capsule> { using type = w_bounding_capsule; };
-template <> struct scalar_to_wide<bounding_cylinder> { using type = w_bounding_cylinder; };
-template <> struct scalar_to_wide<bounding_box> { using type = w_bounding_box; };
-template <> struct scalar_to_wide<bounding_oriented_box> { using type = w_bounding_oriented_box; };
-
-
-struct collision_write_context
-{
-	collision_contact* outContacts;
-	constraint_body_pair* outBodyPairs;
-
-	collider_pair* outColliderPairs;
-	uint8* outContactCountPerCollision;
-
-	uint32 numContacts;
-	uint32 numCollisions;
-
-	std::pair<collision_contact&, constraint_body_pair&> pushContact()
-	{
-		std::pair<collision_contact&, constraint_body_pair&> result = { outContacts[numContacts], outBodyPairs[numContacts] };
-		++numContacts;
-		return result;
-	}
-
-	void pushCollision(uint16 colliderA, uint16 colliderB, uint32 numContacts)
-	{
-		outColliderPairs[numCollisions] = { colliderA, colliderB };
-		outContactCountPerCollision[numCollisions] = (uint8)numContacts;
-		++numCollisions;
-	}
-};
-
-static void writeWideContact(const collider_union* worldSpaceColliders, const w_collision_contact* wideContacts, uint32 numWideContacts,
-	uint16* aIndices, uint16* bIndices, uint32 numValidLanes,
-	collision_write_context& writeContext)
-{
-	if (numWideContacts > 0)
-	{
-		uint32 validLanesMask = (1 << numValidLanes) - 1;
-
-		w_float restitutionA, frictionA, densityA;
-		w_float restitutionB, frictionB, densityB;
-		w_float rbA, rbB;
-
-		load4(&worldSpaceColliders->material.restitution, aIndices, sizeof(collider_union),
-			restitutionA, frictionA, densityA, rbA);
-		load4(&worldSpaceColliders->material.restitution, bIndices, sizeof(collider_union),
-			restitutionB, frictionB, densityB, rbB);
-
-		w_float friction = clamp01(sqrt(frictionA * frictionB));
-		w_float restitution = clamp01(maximum(restitutionA, restitutionB));
-
-		w_float friction_restitution = reinterpret((convert(friction * 0xFFFF) << 16) | convert(restitution * 0xFFFF));
-
-		rbA >>= 16;
-		rbB >>= 16;
-		w_int bodyPairs = reinterpret((rbB << 16) | rbA);
-
-
-		uint32 numContactsPerLane[COLLISION_SIMD_WIDTH] = {};
-		for (uint32 j = 0; j < numWideContacts; ++j)
-		{
-			uint32 mask = wideContacts[j].mask;
-			ASSERT(mask != 0);
-
-			mask &= validLanesMask;
-
-			for (uint32 k = 0; k < numValidLanes; ++k)
-			{
-				if (mask & (1 << k))
-				{
-					++numContactsPerLane[k];
-				}
-			}
-		}
-		uint32 offsetPerLane[COLLISION_SIMD_WIDTH];
-		exclusivePrefixSum(numContactsPerLane, offsetPerLane, numValidLanes);
-
-		for (uint32 k = 0; k < numValidLanes; ++k)
-		{
-			if (numContactsPerLane[k] > 0)
-			{
-				writeContext.pushCollision(aIndices[k], bIndices[k], numContactsPerLane[k]);
-			}
-		}
-
-		for (uint32 j = 0; j < numWideContacts; ++j)
-		{
-			const w_collision_contact& c = wideContacts[j];
-
-			uint32 mask = c.mask;
-			ASSERT(mask != 0);
-
-			mask &= validLanesMask;
-
-			if (mask)
-			{
-				w_float v[] =
-				{
-					c.point.x,
-					c.point.y,
-					c.point.z,
-					c.penetrationDepth,
-					c.normal.x,
-					c.normal.y,
-					c.normal.z,
-					friction_restitution,
-				};
-
-#if COLLISION_SIMD_WIDTH == 4
-				transpose(v[0], v[1], v[2], v[3]);
-				transpose(v[4], v[5], v[6], v[7]);
-#elif COLLISION_SIMD_WIDTH == 8
-				transpose(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
-#endif
-
-				for (uint32 k = 0; k < numValidLanes; ++k)
-				{
-					if (mask & (1 << k))
-					{
-						uint32 offset = offsetPerLane[k];
-
-						auto& [outContact, outBodyPair] = writeContext.pushContact();
-
-						v[k].store((float*)&outContact);
-#if COLLISION_SIMD_WIDTH == 4
-						v[k + 4].store((float*)&outContact + 4);
-#endif
-
-						*(int*)&outBodyPair = bodyPairs[k];
-						
-						++offsetPerLane[k];
-					}
-				}
-			}
-		}
-	}
-}
 
 static void writeScalarContact(const collider_union* worldSpaceColliders, const contact_manifold& contact,
-	uint16 aIndex, uint16 bIndex,
+	physics_index aIndex, physics_index bIndex,
 	collision_write_context& writeContext)
 {
 	const collider_union* colliderA = worldSpaceColliders + aIndex;
 	const collider_union* colliderB = worldSpaceColliders + bIndex;
 
-	uint16 rbA = colliderA->objectIndex;
-	uint16 rbB = colliderB->objectIndex;
+	physics_index rbA = colliderA->objectIndex;
+	physics_index rbB = colliderB->objectIndex;
 
 	physics_material propsA = colliderA->material;
 	physics_material propsB = colliderB->material;
@@ -2253,38 +1779,39 @@ static void writeScalarContact(const collider_union* worldSpaceColliders, const
 }
 
 template <typename collider_a, typename collider_b>
-static void collisionSIMD(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs,
+static void collisionScalar(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs,
 	collision_write_context& writeContext)
 {
-	for (uint32 i = 0; i < numColliderPairs; i += COLLISION_SIMD_WIDTH)
+	for (uint32 i = 0; i < numColliderPairs; ++i)
 	{
-		uint32 numValidLanes = clamp(numColliderPairs - i, 0u, COLLISION_SIMD_WIDTH);
+		collider_pair pair = colliderPairs[i];
+
+		const collider_a& bvA = loadBoundingVolumeScalar<collider_a>(worldSpaceColliders, pair.colliderA);
+		const collider_b& bvB = loadBoundingVolumeScalar<collider_b>(worldSpaceColliders, pair.colliderB);
 
-		uint16 aIndices[COLLISION_SIMD_WIDTH] = {};
-		uint16 bIndices[COLLISION_SIMD_WIDTH] = {};
+		contact_manifold contact;
 
-		// TODO: This could be done with SIMD.
-		for (uint32 j = 0; j < numValidLanes; ++j)
+		if (intersection(bvA, bvB, contact))
 		{
-			collider_pair pair = colliderPairs[i + j];
-			aIndices[j] = pair.colliderA;
-			bIndices[j] = pair.colliderB;
+			writeScalarContact(worldSpaceColliders, contact, pair.colliderA, pair.colliderB, writeContext);
 		}
-
-		collider_a bvA = loadBoundingVolumeSIMD<collider_a>(worldSpaceColliders, aIndices);
-		collider_b bvB = loadBoundingVolumeSIMD<collider_b>(worldSpaceColliders, bIndices);
-
-		w_collision_contact wideContacts[4];
-		uint32 numWideContacts = intersectionSIMD(bvA, bvB, wideContacts);
-
-		writeWideContact(worldSpaceColliders, wideContacts, numWideContacts, aIndices, bIndices, numValidLanes, writeContext);
 	}
 }
 
+// Same as above, but first tests the axis which separated the pair last frame. See separating_axis_cache.
 template <typename collider_a, typename collider_b>
-static void collisionScalar(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs,
+static void collisionScalarCoherent(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs,
 	collision_write_context& writeContext)
 {
+	const separating_axis_cache* cache = writeContext.separatingAxisCache;
+	if (!cache)
+	{
+		collisionScalar<collider_a, collider_b>(worldSpaceColliders, colliderPairs, numColliderPairs, writeContext);
+		return;
+	}
+
+	const separating_axis_cache_entry* entriesEnd = cache->entries + cache->numEntries;
+
 	for (uint32 i = 0; i < numColliderPairs; ++i)
 	{
 		collider_pair pair = colliderPairs[i];
@@ -2292,36 +1819,124 @@ static void collisionScalar(const collider_union* worldSpaceColliders, collider_
 		const collider_a& bvA = loadBoundingVolumeScalar<collider_a>(worldSpaceColliders, pair.colliderA);
 		const collider_b& bvB = loadBoundingVolumeScalar<collider_b>(worldSpaceColliders, pair.colliderB);
 
+		uint64 key = getPairKey(cache->colliderEntities[pair.colliderA], cache->colliderEntities[pair.colliderB]);
+
+		separating_axis_cache_entry separation = { key, vec3(0.f), UINT32_MAX };
+
+		const separating_axis_cache_entry* it = std::lower_bound(cache->entries, entriesEnd, key, 
+			[](const separating_axis_cache_entry& e, uint64 key) { return e.pairKey < key; });
+		if (it != entriesEnd && it->pairKey == key)
+		{
+			separation = *it;
+		}
+
 		contact_manifold contact;
 
-		if (intersection(bvA, bvB, contact))
+		if (intersection(bvA, bvB, contact, separation))
 		{
 			writeScalarContact(worldSpaceColliders, contact, pair.colliderA, pair.colliderB, writeContext);
 		}
+		else if (separation.axis != vec3(0.f) || separation.satAxis != UINT32_MAX)
+		{
+			writeContext.outSeparatingAxes[writeContext.numSeparatingAxes++] = separation;
+		}
 	}
 }
 
-template <typename collider_a, typename collider_b>
-static void collision(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs, 
-	collision_write_context& writeContext, bool simd)
+// Indexed by the collider types. The first type is always the smaller one. The SIMD kernels have their own table.
+static const collision_func collisionFunctions[collider_type_count][collider_type_count] =
+{
+	{ collisionScalar<bounding_sphere, bounding_sphere>, collisionScalar<bounding_sphere, bounding_capsule>, collisionScalar<bounding_sphere, bounding_cylinder>, 
+		collisionScalar<bounding_sphere, bounding_box>, collisionScalar<bounding_sphere, bounding_oriented_box>, collisionScalar<bounding_sphere, bounding_hull> },
+	{ 0, collisionScalar<bounding_capsule, bounding_capsule>, collisionScalar<bounding_capsule, bounding_cylinder>, 
+		collisionScalar<bounding_capsule, bounding_box>, collisionScalar<bounding_capsule, bounding_oriented_box>, collisionScalar<bounding_capsule, bounding_hull> },
+	{ 0, 0, collisionScalar<bounding_cylinder, bounding_cylinder>, 
+		collisionScalar<bounding_cylinder, bounding_box>, collisionScalar<bounding_cylinder, bounding_oriented_box>, collisionScalar<bounding_cylinder, bounding_hull> },
+	{ 0, 0, 0, collisionScalar<bounding_box, bounding_box>, collisionScalar<bounding_box, bounding_oriented_box>, collisionScalar<bounding_box, bounding_hull> },
+	{ 0, 0, 0, 0, collisionScalarCoherent<bounding_oriented_box, bounding_oriented_box>, collisionScalar<bounding_oriented_box, bounding_hull> },
+	{ 0, 0, 0, 0, 0, collisionScalarCoherent<bounding_hull, bounding_hull> },
+};
+
+// The SIMD kernels don't use the separating axis cache. While it is enabled, these pairs always run the scalar coherent test above, 
+// so that the cached axes are tested first and this frame's separating axes are recorded for the next one.
+static bool usesSeparatingAxisCache(uint32 typeA, uint32 typeB)
 {
-	if (simd)
+	return typeA == typeB && (typeA == collider_type_obb || typeA == collider_type_hull);
+}
+
+// The narrow phase is split into chunks of at most this many pairs, which are processed in parallel.
+// This is a multiple of the SIMD width, so that the pairs end up in the same lanes as without chunking.
+#define NARROWPHASE_CHUNK_SIZE 128u
+static_assert(NARROWPHASE_CHUNK_SIZE % PHYSICS_MAX_SIMD_WIDTH == 0);
+
+// Both the scalar and the SIMD collision functions produce at most this many contacts per pair.
+#define MAX_CONTACTS_PER_COLLISION 4
+
+struct narrowphase_output
+{
+	collision_contact* contacts;
+	constraint_body_pair* bodyPairs;
+	collider_pair* colliderPairs;
+	uint8* contactCountPerCollision;
+	non_collision_interaction* nonCollisionInteractions;
+	separating_axis_cache* separatingAxisCache;
+};
+
+struct narrowphase_chunk
+{
+	collision_func function; // Null for overlap checks (triggers, force fields).
+	collider_pair* pairs;
+	uint32 numPairs;
+
+	// Index of the first pair in all collision or overlap checks. Each chunk writes its results to its own range in the output arrays, 
+	// starting at this index (times MAX_CONTACTS_PER_COLLISION for the contacts). This way no synchronization is needed.
+	uint32 firstPair;
+
+	uint32 numCollisions; // Number of non-collision interactions for overlap checks.
+	uint32 numContacts;
+	uint32 numSeparatingAxes;
+};
+
+static void executeNarrowphaseChunk(const collider_union* worldSpaceColliders, narrowphase_chunk& chunk, const narrowphase_output& output)
+{
+	if (chunk.function)
 	{
-		using wide_collider_a = scalar_to_wide<collider_a>::type;
-		using wide_collider_b = scalar_to_wide<collider_b>::type;
+		collision_write_context writeContext;
+		writeContext.numCollisions = 0;
+		writeContext.numContacts = 0;
+		writeContext.outContacts = output.contacts + chunk.firstPair * MAX_CONTACTS_PER_COLLISION;
+		writeContext.outBodyPairs = output.bodyPairs + chunk.firstPair * MAX_CONTACTS_PER_COLLISION;
+		writeContext.outColliderPairs = output.colliderPairs + chunk.firstPair;
+		writeContext.outContactCountPerCollision = output.contactCountPerCollision + chunk.firstPair;
+		writeContext.separatingAxisCache = output.separatingAxisCache;
+		writeContext.outSeparatingAxes = output.separatingAxisCache ? output.separatingAxisCache->outEntries + chunk.firstPair : 0;
+		writeContext.numSeparatingAxes = 0;
 
-		if constexpr (simd_intersection_available<wide_collider_a, wide_collider_b>::value)
-		{
-			collisionSIMD<wide_collider_a, wide_collider_b>(worldSpaceColliders, colliderPairs, numColliderPairs, writeContext);
-		}
-		else
-		{
-			collisionScalar<collider_a, collider_b>(worldSpaceColliders, colliderPairs, numColliderPairs, writeContext);
-		}
+		chunk.function(worldSpaceColliders, chunk.pairs, chunk.numPairs, writeContext);
+
+		ASSERT(writeContext.numContacts <= chunk.numPairs * MAX_CONTACTS_PER_COLLISION);
+
+		chunk.numCollisions = writeContext.numCollisions;
+		chunk.numContacts = writeContext.numContacts;
+		chunk.numSeparatingAxes = writeContext.numSeparatingAxes;
 	}
 	else
 	{
-		collisionScalar<collider_a, collider_b>(worldSpaceColliders, colliderPairs, numColliderPairs, writeContext);
+		non_collision_interaction* outNonCollisionInteractions = output.nonCollisionInteractions + chunk.firstPair;
+		uint32 numNonCollisionInteractions = 0;
+
+		for (uint32 i = 0; i < chunk.numPairs; ++i)
+		{
+			non_collision_interaction interaction;
+			if (overlapCheck(worldSpaceColliders, chunk.pairs[i], interaction))
+			{
+				outNonCollisionInteractions[numNonCollisionInteractions++] = interaction;
+			}
+		}
+
+		chunk.numCollisions = numNonCollisionInteractions;
+		chunk.numContacts = 0;
+		chunk.numSeparatingAxes = 0;
 	}
 }
 
@@ -2329,7 +1944,8 @@ narrowphase_result narrowphase(const collider_union* worldSpaceColliders, collid
 	collision_contact* outContacts, constraint_body_pair* outBodyPairs, 
 	collider_pair* outColliderPairs, uint8* outContactCountPerCollision,
 	non_collision_interaction* outNonCollisionInteractions,
-	bool simd)
+	separating_axis_cache* separatingAxisCache,
+	const physics_simd_kernels* simd)
 {
 	CPU_PROFILE_BLOCK("Narrow phase");
 
@@ -2454,152 +2070,158 @@ narrowphase_result narrowphase(const collider_union* worldSpaceColliders, collid
 
 
 
-	// Collision checks.
-
-
-	// SPHERE.
-
-	collision_write_context writeContext;
-	writeContext.numCollisions = 0;
-	writeContext.numContacts = 0;
-	writeContext.outContacts = outContacts;
-	writeContext.outBodyPairs = outBodyPairs;
-	writeContext.outColliderPairs = outColliderPairs;
-	writeContext.outContactCountPerCollision = outContactCountPerCollision;
+	// Split the checks into chunks.
 
+	uint32 maxNumChunks = 0;
+	for (uint32 i = 0; i < collider_type_count; ++i)
 	{
-		CPU_PROFILE_BLOCK("Check for collisions");
-
-		collision<bounding_sphere, bounding_sphere>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_sphere][collider_type_sphere], collisionCountMatrix[collider_type_sphere][collider_type_sphere],
-			writeContext, simd);
-
-		collision<bounding_sphere, bounding_capsule>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_sphere][collider_type_capsule], collisionCountMatrix[collider_type_sphere][collider_type_capsule],
-			writeContext, simd);
-
-		collision<bounding_sphere, bounding_cylinder>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_sphere][collider_type_cylinder], collisionCountMatrix[collider_type_sphere][collider_type_cylinder],
-			writeContext, simd);
-
-		collision<bounding_sphere, bounding_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_sphere][collider_type_aabb], collisionCountMatrix[collider_type_sphere][collider_type_aabb],
-			writeContext, simd);
-
-		collision<bounding_sphere, bounding_oriented_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_sphere][collider_type_obb], collisionCountMatrix[collider_type_sphere][collider_type_obb],
-			writeContext, simd);
-
-		collision<bounding_sphere, bounding_hull>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_sphere][collider_type_hull], collisionCountMatrix[collider_type_sphere][collider_type_hull],
-			writeContext, simd);
-
-
-		// CAPSULE.
-
-		collision<bounding_capsule, bounding_capsule>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_capsule][collider_type_capsule], collisionCountMatrix[collider_type_capsule][collider_type_capsule],
-			writeContext, simd);
-
-		collision<bounding_capsule, bounding_cylinder>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_capsule][collider_type_cylinder], collisionCountMatrix[collider_type_capsule][collider_type_cylinder],
-			writeContext, simd);
-
-		collision<bounding_capsule, bounding_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_capsule][collider_type_aabb], collisionCountMatrix[collider_type_capsule][collider_type_aabb],
-			writeContext, simd);
-
-		collision<bounding_capsule, bounding_oriented_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_capsule][collider_type_obb], collisionCountMatrix[collider_type_capsule][collider_type_obb],
-			writeContext, simd);
-
-		collision<bounding_capsule, bounding_hull>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_capsule][collider_type_hull], collisionCountMatrix[collider_type_capsule][collider_type_hull],
-			writeContext, simd);
-
-
-		// CYLINDER.
+		for (uint32 j = i; j < collider_type_count; ++j)
+		{
+			maxNumChunks += bucketize(collisionCountMatrix[i][j], NARROWPHASE_CHUNK_SIZE);
+		}
+	}
+	maxNumChunks += bucketize(numIntersectionChecks, NARROWPHASE_CHUNK_SIZE);
 
-		collision<bounding_cylinder, bounding_cylinder>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_cylinder][collider_type_cylinder], collisionCountMatrix[collider_type_cylinder][collider_type_cylinder],
-			writeContext, simd);
+	narrowphase_chunk* chunks = arena.allocate<narrowphase_chunk>(maxNumChunks);
+	uint32 numChunks = 0;
 
-		collision<bounding_cylinder, bounding_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_cylinder][collider_type_aabb], collisionCountMatrix[collider_type_cylinder][collider_type_aabb],
-			writeContext, simd);
+	uint32 firstPair = 0;
+	for (uint32 i = 0; i < collider_type_count; ++i)
+	{
+		for (uint32 j = i; j < collider_type_count; ++j)
+		{
+			collider_pair* pairs = collisionPairMatrix[i][j];
+			uint32 count = collisionCountMatrix[i][j];
 
-		collision<bounding_cylinder, bounding_oriented_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_cylinder][collider_type_obb], collisionCountMatrix[collider_type_cylinder][collider_type_obb],
-			writeContext, simd);
+			bool useSIMD = simd && simd->collisionFunctions[i][j] && !(separatingAxisCache && usesSeparatingAxisCache(i, j));
+			collision_func function = useSIMD ? simd->collisionFunctions[i][j] : collisionFunctions[i][j];
 
-		collision<bounding_cylinder, bounding_hull>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_cylinder][collider_type_hull], collisionCountMatrix[collider_type_cylinder][collider_type_hull],
-			writeContext, simd);
+			for (uint32 k = 0; k < count; k += NARROWPHASE_CHUNK_SIZE)
+			{
+				narrowphase_chunk& chunk = chunks[numChunks++];
+				chunk.function = function;
+				chunk.pairs = pairs + k;
+				chunk.numPairs = min(count - k, NARROWPHASE_CHUNK_SIZE);
+				chunk.firstPair = firstPair + k;
+			}
 
+			firstPair += count;
+		}
+	}
 
-		// AABB.
+	// The overlap checks don't care about the collider types, so all buckets can be chunked together.
+	for (uint32 k = 0; k < numIntersectionChecks; k += NARROWPHASE_CHUNK_SIZE)
+	{
+		narrowphase_chunk& chunk = chunks[numChunks++];
+		chunk.function = 0;
+		chunk.pairs = intersectionPairMatrix[0][0] + k;
+		chunk.numPairs = min(numIntersectionChecks - k, NARROWPHASE_CHUNK_SIZE);
+		chunk.firstPair = k;
+	}
 
-		collision<bounding_box, bounding_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_aabb][collider_type_aabb], collisionCountMatrix[collider_type_aabb][collider_type_aabb],
-			writeContext, simd);
+	CPU_PROFILE_STAT("Narrowphase chunks", numChunks);
 
-		collision<bounding_box, bounding_oriented_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_aabb][collider_type_obb], collisionCountMatrix[collider_type_aabb][collider_type_obb],
-			writeContext, simd);
 
-		collision<bounding_box, bounding_hull>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_aabb][collider_type_hull], collisionCountMatrix[collider_type_aabb][collider_type_hull],
-			writeContext, simd);
+	narrowphase_output output = { outContacts, outBodyPairs, outColliderPairs, outContactCountPerCollision, outNonCollisionInteractions, separatingAxisCache };
 
+	{
+		CPU_PROFILE_BLOCK("Check for collisions and overlaps");
 
-		// OBB.
+#ifdef PHYSICS_USE_JOB_SYSTEM
+		if (numChunks > 1)
+		{
+			struct narrowphase_job_data
+			{
+				const collider_union* worldSpaceColliders;
+				const narrowphase_output* output;
+				narrowphase_chunk* chunks;
+				uint32 numChunks;
+			};
 
-		collision<bounding_oriented_box, bounding_oriented_box>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_obb][collider_type_obb], collisionCountMatrix[collider_type_obb][collider_type_obb],
-			writeContext, simd);
+			narrowphase_job_data data = { worldSpaceColliders, &output, chunks, numChunks };
 
-		collision<bounding_oriented_box, bounding_hull>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_obb][collider_type_hull], collisionCountMatrix[collider_type_obb][collider_type_hull],
-			writeContext, simd);
+			job_handle parentJob = highPriorityJobQueue.createJob<narrowphase_job_data>([](narrowphase_job_data& data, job_handle parent)
+			{
+				for (uint32 i = 0; i < data.numChunks; ++i)
+				{
+					struct narrowphase_chunk_job_data
+					{
+						const collider_union* worldSpaceColliders;
+						const narrowphase_output* output;
+						narrowphase_chunk* chunk;
+					};
 
+					narrowphase_chunk_job_data chunkData = { data.worldSpaceColliders, data.output, &data.chunks[i] };
 
-		// HULL.
+					highPriorityJobQueue.createJob<narrowphase_chunk_job_data>([](narrowphase_chunk_job_data& data, job_handle)
+					{
+						executeNarrowphaseChunk(data.worldSpaceColliders, *data.chunk, *data.output);
+					}, chunkData, parent).submitNow();
+				}
+			}, data);
 
-		collision<bounding_hull, bounding_hull>(worldSpaceColliders,
-			collisionPairMatrix[collider_type_hull][collider_type_hull], collisionCountMatrix[collider_type_hull][collider_type_hull],
-			writeContext, simd);
+			parentJob.submitNow();
+			parentJob.waitForCompletion();
+		}
+		else
+#endif
+		{
+			for (uint32 i = 0; i < numChunks; ++i)
+			{
+				executeNarrowphaseChunk(worldSpaceColliders, chunks[i], output);
+			}
+		}
 	}
 
+	uint32 numCollisions = 0;
+	uint32 numContacts = 0;
+	uint32 numSeparatingAxes = 0;
+
 	{
-		CPU_PROFILE_BLOCK("Check for overlaps");
+		CPU_PROFILE_BLOCK("Merge chunk results");
 
-		for (uint32 i = 0; i < collider_type_count; ++i)
+		// Move the results of all chunks to the front of the output arrays. We go in chunk order, so the result is the same as with a single pass.
+		// Each chunk's results start at or after the end of the already merged results, so nothing gets overwritten.
+		for (uint32 i = 0; i < numChunks; ++i)
 		{
-			for (uint32 j = i; j < collider_type_count; ++j)
+			const narrowphase_chunk& chunk = chunks[i];
+			if (chunk.function)
 			{
-				uint32 count = intersectionCountMatrix[i][j];
-				collider_pair* pairs = intersectionPairMatrix[i][j];
+				memmove(outContacts + numContacts, outContacts + chunk.firstPair * MAX_CONTACTS_PER_COLLISION, sizeof(collision_contact) * chunk.numContacts);
+				memmove(outBodyPairs + numContacts, outBodyPairs + chunk.firstPair * MAX_CONTACTS_PER_COLLISION, sizeof(constraint_body_pair) * chunk.numContacts);
+				memmove(outColliderPairs + numCollisions, outColliderPairs + chunk.firstPair, sizeof(collider_pair) * chunk.numCollisions);
+				memmove(outContactCountPerCollision + numCollisions, outContactCountPerCollision + chunk.firstPair, sizeof(uint8) * chunk.numCollisions);
 
-				for (uint32 k = 0; k < count; ++k)
+				if (separatingAxisCache)
 				{
-					non_collision_interaction interaction;
-					if (overlapCheck(worldSpaceColliders, pairs[k], interaction))
-					{
-						outNonCollisionInteractions[numNonCollisionInteractions++] = interaction;
-					}
+					memmove(separatingAxisCache->outEntries + numSeparatingAxes, separatingAxisCache->outEntries + chunk.firstPair, 
+						sizeof(separating_axis_cache_entry) * chunk.numSeparatingAxes);
 				}
+
+				numContacts += chunk.numContacts;
+				numCollisions += chunk.numCollisions;
+				numSeparatingAxes += chunk.numSeparatingAxes;
+			}
+			else
+			{
+				memmove(outNonCollisionInteractions + numNonCollisionInteractions, outNonCollisionInteractions + chunk.firstPair, 
+					sizeof(non_collision_interaction) * chunk.numCollisions);
+
+				numNonCollisionInteractions += chunk.numCollisions;
 			}
 		}
 	}
 
 
-	// TODO: Write valid collision pairs and numCollisions.
-
+	if (separatingAxisCache)
+	{
+		separatingAxisCache->numOutEntries = numSeparatingAxes;
+	}
 
 	arena.resetToMarker(marker);
 
 
-	return narrowphase_result{ writeContext.numCollisions, writeContext.numContacts, numNonCollisionInteractions };
+	return narrowphase_result{ numCollisions, numContacts, numNonCollisionInteractions };
 }
 
 
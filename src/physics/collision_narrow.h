@@ -2,14 +2,15 @@
 
 #include "core/math.h"
 #include "physics.h"
+#include "collision_broad.h"
 
 struct collider_union;
-struct collider_pair;
+struct physics_simd_kernels;
 
 struct non_collision_interaction
 {
-	uint16 rigidBodyIndex;
-	uint16 otherIndex;
+	physics_index rigidBodyIndex;
+	physics_index otherIndex;
 	physics_object_type otherType;
 };
 
@@ -20,10 +21,68 @@ struct narrowphase_result
 	uint32 numNonCollisionInteractions;		// Number of interactions between RBs and triggers, force fields etc.
 };
 
+struct separating_axis_cache_entry
+{
+	uint64 pairKey;		// See getPairKey.
+	vec3 axis;			// Hull vs hull: World space direction, along which GJK found the pair to be separated. Zero if none.
+	uint32 satAxis;		// OBB vs OBB: Index of the separating SAT axis. UINT32_MAX if none.
+};
+
+// Temporal coherence for the OBB vs OBB (SAT) and hull vs hull (GJK) tests. The axis which separated a pair in the last frame is tested first,
+// so pairs which overlap in the broad phase but stay apart (e.g. in piles of debris) are rejected after a single axis test.
+// Pairs which do collide still run the full test.
+struct separating_axis_cache
+{
+	const entity_handle* colliderEntities;				// Indexed by collider.
+
+	const separating_axis_cache_entry* entries;			// Last frame's separated pairs, sorted by key.
+	uint32 numEntries;
+
+	separating_axis_cache_entry* outEntries;			// This frame's separated pairs (unsorted). Must have space for one entry per collider pair.
+	uint32 numOutEntries;								// Set by the narrow phase.
+};
+
 // outColliderPairs may be the same as colliderPairs
 narrowphase_result narrowphase(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numCollisionPairs, memory_arena& arena,
 	collision_contact* outContacts, constraint_body_pair* outBodyPairs, // result.numContacts many.
 	collider_pair* outColliderPairs, uint8* outContactCountPerCollision, // result.numCollisions many.
 	non_collision_interaction* outNonCollisionInteractions,			// result.numNonCollisionInteractions many.
-	bool simd);
+	separating_axis_cache* separatingAxisCache,								// Optional.
+	const physics_simd_kernels* simd);														// Uses the scalar tests only, if null.
+
+
+
+
+// Internal.
+
+struct collision_write_context
+{
+	collision_contact* outContacts;
+	constraint_body_pair* outBodyPairs;
+
+	collider_pair* outColliderPairs;
+	uint8* outContactCountPerCollision;
+
+	uint32 numContacts;
+	uint32 numCollisions;
+
+	const separating_axis_cache* separatingAxisCache; // Null, if temporal coherence is disabled.
+	separating_axis_cache_entry* outSeparatingAxes;
+	uint32 numSeparatingAxes;
+
+	std::pair<collision_contact&, constraint_body_pair&> pushContact()
+	{
+		std::pair<collision_contact&, constraint_body_pair&> result = { outContacts[numContacts], outBodyPairs[numContacts] };
+		++numContacts;
+		return result;
+	}
+
+	void pushCollision(physics_index colliderA, physics_index colliderB, uint32 numContacts)
+	{
+		outColliderPairs[numCollisions] = { colliderA, colliderB };
+		outContactCountPerCollision[numCollisions] = (uint8)numContacts;
+		++numCollisions;
+	}
+};
 
+typedef void (*collision_func)(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs, collision_write_context& writeContext);
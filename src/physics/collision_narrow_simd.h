@@ -0,0 +1,570 @@
+#pragma once
+
+// SIMD narrow phase. Only included by physics_simd_kernels.h, which defines the wide types for the current width.
+
+#define COLLISION_SIMD_WIDTH PHYSICS_SIMD_WIDTH
+
+template <typename collider_t>
+static collider_t loadBoundingVolumeSIMD(const collider_union* worldSpaceColliders, const physics_index* indices) { static_assert(false); }
+
+template <>
+static w_bounding_sphere loadBoundingVolumeSIMD<w_bounding_sphere>(const collider_union* worldSpaceColliders, const physics_index* indices)
+{
+	w_bounding_sphere result;
+	load4((float*)&worldSpaceColliders->sphere, indices, sizeof(collider_union),
+		result.center.x, result.center.y, result.center.z, result.radius);
+	return result;
+}
+
+template <>
+static w_bounding_capsule loadBoundingVolumeSIMD<w_bounding_capsule>(const collider_union* worldSpaceColliders, const physics_index* indices)
+{
+	w_bounding_capsule result;
+	w_float dummy;
+	load8((float*)&worldSpaceColliders->capsule, indices, sizeof(collider_union),
+		result.positionA.x, result.positionA.y, result.positionA.z,
+		result.positionB.x, result.positionB.y, result.positionB.z,
+		result.radius, dummy);
+	return result;
+}
+
+template <>
+static w_bounding_cylinder loadBoundingVolumeSIMD<w_bounding_cylinder>(const collider_union* worldSpaceColliders, const physics_index* indices)
+{
+	w_bounding_cylinder result;
+	w_float dummy;
+	load8((float*)&worldSpaceColliders->cylinder, indices, sizeof(collider_union),
+		result.positionA.x, result.positionA.y, result.positionA.z,
+		result.positionB.x, result.positionB.y, result.positionB.z,
+		result.radius, dummy);
+	return result;
+}
+
+template <>
+static w_bounding_box loadBoundingVolumeSIMD<w_bounding_box>(const collider_union* worldSpaceColliders, const physics_index* indices)
+{
+	w_bounding_box result;
+	w_float dummy0, dummy1;
+	load8((float*)&worldSpaceColliders->aabb, indices, sizeof(collider_union),
+		result.minCorner.x, result.minCorner.y, result.minCorner.z,
+		result.maxCorner.x, result.maxCorner.y, result.maxCorner.z,
+		dummy0, dummy1);
+	return result;
+}
+
+template <>
+static w_bounding_oriented_box loadBoundingVolumeSIMD<w_bounding_oriented_box>(const collider_union* worldSpaceColliders, const physics_index* indices)
+{
+	w_bounding_oriented_box result;
+	w_float dummy0, dummy1;
+	load8(&worldSpaceColliders->obb.rotation.x, indices, sizeof(collider_union),
+		result.rotation.x, result.rotation.y, result.rotation.z, result.rotation.w,
+		result.center.x, result.center.y, result.center.z,
+		result.radius.x);
+	load4(&worldSpaceColliders->obb.radius.y, indices, sizeof(collider_union),
+		result.radius.y, result.radius.z,
+		dummy0, dummy1);
+	return result;
+}
+
+
+struct w_collision_contact
+{
+	w_vec3 point;
+	w_float penetrationDepth;
+	w_vec3 normal;
+	uint32 mask;
+};
+
+
+// Sphere tests.
+static uint32 intersectionSIMD(const w_bounding_sphere& s1, const w_bounding_sphere& s2, w_collision_contact* outContacts)
+{
+	w_vec3 n = s2.center - s1.center;
+	w_float radiusSum = s2.radius + s1.radius;
+	w_float sqDistance = squaredLength(n);
+
+	auto intersects = (sqDistance <= radiusSum * radiusSum);
+	
+	uint32 mask = toBitMask(intersects);
+
+	if (anyTrue(mask))
+	{
+		auto degenerate = (sqDistance == 0.f);
+		w_float distance = ifThen(degenerate, 0.f, sqrt(sqDistance));
+		w_vec3 collisionNormal = ifThen(degenerate, w_vec3(0.f, 1.f, 0.f), n / distance);
+
+		w_float penetrationDepth = radiusSum - distance; // Flipped to change sign.
+		w_vec3 point = w_float(0.5f) * (s1.center + s1.radius * collisionNormal + s2.center - s2.radius * collisionNormal);
+
+		outContacts[0].point = point;
+		outContacts[0].penetrationDepth = penetrationDepth;
+		outContacts[0].normal = collisionNormal;
+		outContacts[0].mask = mask;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_capsule& c, w_collision_contact* outContacts)
+{
+	w_vec3 closestPoint = closestPoint_PointSegment(s.center, w_line_segment{ c.positionA, c.positionB });
+	return intersectionSIMD(s, w_bounding_sphere{ closestPoint, c.radius }, outContacts);
+}
+
+static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_cylinder& c, w_collision_contact* outContacts)
+{
+	w_vec3 ab = c.positionB - c.positionA;
+	w_float t = dot(s.center - c.positionA, ab) / squaredLength(ab);
+
+	auto tSaturated = t >= 0.f & t <= 1.f;
+
+	int32 tSaturatedMask = toBitMask(tSaturated);
+
+	uint32 sphereSphereTest = 0;
+	if (anyTrue(tSaturatedMask))
+	{
+		sphereSphereTest = intersectionSIMD(s, w_bounding_sphere{ lerp(c.positionA, c.positionB, t), c.radius }, outContacts);
+
+		if (tSaturatedMask == (1 << COLLISION_SIMD_WIDTH) - 1) // All true.
+		{
+			return sphereSphereTest;
+		}
+	}
+
+
+
+	w_vec3 p = ifThen(t <= 0.f, c.positionA, c.positionB);
+	w_vec3 up = ifThen(t <= 0.f, -ab, ab);
+
+	w_vec3 projectedDirToCenter = normalize(cross(cross(up, s.center - p), up));
+	w_vec3 endA = p + projectedDirToCenter * c.radius;
+	w_vec3 endB = p - projectedDirToCenter * c.radius;
+
+	w_vec3 closestToSphere = closestPoint_PointSegment(s.center, w_line_segment{ endA, endB });
+	w_vec3 normal = closestToSphere - s.center; // From sphere to cylinder.
+	w_float sqDistance = squaredLength(normal);
+
+	auto intersects = (sqDistance <= s.radius * s.radius);
+
+	uint32 mask = toBitMask(intersects);
+
+	if (mask)
+	{
+		auto degenerate = sqDistance == 0.f;
+
+		w_float distance = ifThen(degenerate, 0.f, sqrt(sqDistance));
+		normal = ifThen(degenerate, -normalize(up), normal / distance);
+		
+		w_float penetrationDepth = s.radius - distance;
+		w_vec3 point = closestToSphere + 0.5f * penetrationDepth * normal;
+
+		if (anyTrue(tSaturatedMask))
+		{
+			point = ifThen(tSaturated, outContacts[0].point, point);
+			penetrationDepth = ifThen(tSaturated, outContacts[0].penetrationDepth, penetrationDepth);
+			normal = ifThen(tSaturated, outContacts[0].normal, normal);
+
+			mask |= tSaturatedMask;
+		}
+
+		outContacts[0].point = point;
+		outContacts[0].penetrationDepth = penetrationDepth;
+		outContacts[0].normal = normal;
+		outContacts[0].mask = mask;
+		
+		return 1;
+	}
+
+	return sphereSphereTest;
+}
+
+static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_box& a, w_collision_contact* outContacts)
+{
+	w_vec3 p = closestPoint_PointAABB(s.center, a);
+	w_vec3 n = p - s.center;
+	w_float sqDistance = squaredLength(n);
+
+	auto intersects = sqDistance <= s.radius * s.radius;
+
+	uint32 mask = toBitMask(intersects);
+
+	if (anyTrue(mask))
+	{
+		auto valid = (sqDistance > 0.f);
+		w_float dist = ifThen(valid, sqrt(sqDistance), 0.f);
+		n = ifThen(valid, n / dist, w_vec3(0.f, 1.f, 0.f));
+
+		outContacts[0].point = w_float(0.5f) * (p + s.center + n * s.radius);
+		outContacts[0].penetrationDepth = s.radius - dist; // Flipped to change sign.
+		outContacts[0].normal = n;
+		outContacts[0].mask = mask;
+
+		return 1;
+	}
+	return 0;
+}
+
+static uint32 intersectionSIMD(const w_bounding_sphere& s, const w_bounding_oriented_box& o, w_collision_contact* outContacts)
+{
+	w_bounding_box aabb = w_bounding_box::fromCenterRadius(o.center, o.radius);
+	w_bounding_sphere s_ = {
+		conjugate(o.rotation) * (s.center - o.center) + o.center,
+		s.radius };
+
+	uint32 result = intersectionSIMD(s_, aabb, outContacts);
+
+	if (result)
+	{
+		outContacts[0].normal = o.rotation * outContacts[0].normal;
+		outContacts[0].point = o.rotation * (outContacts[0].point - o.center) + o.center;
+		return 1;
+	}
+	return 0;
+}
+
+// Capsule tests.
+static uint32 intersectionSIMD(const w_bounding_capsule& a, const w_bounding_capsule& b, w_collision_contact* outContacts)
+{
+	w_vec3 aDir = a.positionB - a.positionA;
+	w_vec3 bDir = normalize(b.positionB - b.positionA);
+
+	w_float aDirLength = length(aDir);
+	aDir *= 1.f / aDirLength;
+
+	w_float alignment = dot(aDir, bDir);
+
+	auto valid = (abs(alignment) <= 0.99f);
+
+	uint32 result = 0;
+
+	int32 validMask = toBitMask(valid);
+
+	if (anyTrue(validMask))
+	{
+		w_vec3 closestPoint1, closestPoint2;
+		closestPoint_SegmentSegment(w_line_segment{ a.positionA, a.positionB }, w_line_segment{ b.positionA, b.positionB }, closestPoint1, closestPoint2);
+		result = intersectionSIMD(w_bounding_sphere{ closestPoint1, a.radius }, w_bounding_sphere{ closestPoint2, b.radius }, outContacts);
+
+		if (allTrue(valid))
+		{
+			return result;
+		}
+	}
+
+	// Parallel case.
+
+	w_vec3 pAa = a.positionA;
+	w_vec3 pAb = a.positionB;
+	w_vec3 pBa = b.positionA;
+	w_vec3 pBb = b.positionB;
+
+	auto swap = alignment < 0.f;
+	
+	if (anyTrue(swap))
+	{
+		w_vec3 tmp = pBa;
+		pBa = ifThen(swap, pBb, pBa);
+		pBb = ifThen(swap, tmp, pBb);
+	}
+
+	w_vec3 referencePoint = a.positionA;
+
+	w_float a0 = 0.f;
+	w_float a1 = aDirLength;
+
+	w_float b0 = dot(aDir, pBa - referencePoint);
+	w_float b1 = dot(aDir, pBb - referencePoint);
+
+	w_float left = maximum(a0, b0);
+	w_float right = minimum(a1, b1);
+
+	auto endToEnd = right < left;
+	if (anyTrue(endToEnd))
+	{
+		auto mask = a0 > b1;
+		w_vec3 refA = ifThen(mask, pAa, pAb);
+		w_vec3 refB = ifThen(mask, pBb, pBa);
+
+		w_collision_contact contact;
+		uint32 endToEndTest = intersectionSIMD(w_bounding_sphere{ refA, a.radius }, w_bounding_sphere{ refB, b.radius }, &contact);
+
+		if (endToEndTest)
+		{
+			outContacts[0].point = ifThen(valid, outContacts[0].point, contact.point);
+			outContacts[0].penetrationDepth = ifThen(valid, outContacts[0].penetrationDepth, contact.penetrationDepth);
+			outContacts[0].normal = ifThen(valid, outContacts[0].normal, contact.normal);
+			outContacts[0].mask |= contact.mask;
+			valid |= mask;
+		}
+
+		result = maxUint32(endToEndTest, result);
+
+		if (allTrue(valid))
+		{
+			return result;
+		}
+	}
+
+	w_vec3 contactA0 = referencePoint + left * aDir;
+	w_vec3 contactA1 = referencePoint + right * aDir;
+
+	w_vec3 contactB0 = closestPoint_PointSegment(contactA0, w_line_segment{ pBa, pBb });
+	w_vec3 contactB1 = contactB0 + (right - left) * aDir;
+
+	w_vec3 normal = contactB0 - contactA0;
+	w_float d = length(normal);
+
+	auto degenerate = (d < EPSILON);
+
+	d = ifThen(degenerate, 0.f, d);
+	normal = ifThen(degenerate, w_vec3(0.f, 1.f, 0.f), normal / d);
+
+	w_float radiusSum = a.radius + b.radius;
+
+	w_float penetration = radiusSum - d;
+	auto collision = (penetration >= 0.f);
+
+	int32 mask = toBitMask(collision);
+
+	if (!mask)
+	{
+		return result;
+	}
+
+	w_vec3 point0 = (contactA0 + contactB0) * w_float(0.5f);
+	w_float penetration0 = penetration;
+	w_vec3 normal0 = normal;
+	int32 mask0 = mask;
+
+	if (anyTrue(validMask))
+	{
+		point0 = ifThen(valid, outContacts[0].point, point0);
+		penetration0 = ifThen(valid, outContacts[0].penetrationDepth, penetration0);
+		normal0 = ifThen(valid, outContacts[0].normal, normal0);
+
+		mask0 |= validMask;
+	}
+
+	outContacts[0].point = point0;
+	outContacts[0].penetrationDepth = penetration0;
+	outContacts[0].normal = normal0;
+	outContacts[0].mask = mask0;
+
+	outContacts[1].point = (contactA1 + contactB1) * w_float(0.5f);
+	outContacts[1].penetrationDepth = penetration;
+	outContacts[1].normal = normal;
+	outContacts[1].mask = mask;
+
+	return 2;
+}
+
+
+
+
+template <typename collider_a, typename collider_b, typename = void>
+struct simd_intersection_available : std::false_type {};
+
+template <typename collider_a, typename collider_b>
+struct simd_intersection_available<collider_a, collider_b,
+	std::void_t<decltype(intersectionSIMD(std::declval<const collider_a&>(), std::declval<const collider_b&>())) >> : std::true_type {};
+
+template <typename collider_t> struct scalar_to_wide { using type = void; };
+template <> struct scalar_to_wide<bounding_sphere> { using type = w_bounding_sphere; };
+template <> struct scalar_to_wide<bounding_capsule> { using type = w_bounding_capsule; };
+template <> struct scalar_to_wide<bounding_cylinder> { using type = w_bounding_cylinder; };
+template <> struct scalar_to_wide<bounding_box> { using type = w_bounding_box; };
+template <> struct scalar_to_wide<bounding_oriented_box> { using type = w_bounding_oriented_box; };
+
+
+static void writeWideContact(const collider_union* worldSpaceColliders, const w_collision_contact* wideContacts, uint32 numWideContacts,
+	const physics_index* aIndices, const physics_index* bIndices, uint32 numValidLanes,
+	collision_write_context& writeContext)
+{
+	if (numWideContacts > 0)
+	{
+		uint32 validLanesMask = (1 << numValidLanes) - 1;
+
+		w_float restitutionA, frictionA, densityA;
+		w_float restitutionB, frictionB, densityB;
+		w_float rbA, rbB;
+
+		load4(&worldSpaceColliders->material.restitution, aIndices, sizeof(collider_union),
+			restitutionA, frictionA, densityA, rbA);
+		load4(&worldSpaceColliders->material.restitution, bIndices, sizeof(collider_union),
+			restitutionB, frictionB, densityB, rbB);
+
+#if PHYSICS_32_BIT_INDICES
+		// The rigid body indices are not part of the dword after the material anymore, so we read them per lane.
+		constraint_body_pair bodyPairs[COLLISION_SIMD_WIDTH];
+		for (uint32 k = 0; k < numValidLanes; ++k)
+		{
+			bodyPairs[k] = { worldSpaceColliders[aIndices[k]].objectIndex, worldSpaceColliders[bIndices[k]].objectIndex };
+		}
+#endif
+
+		w_float friction = clamp01(sqrt(frictionA * frictionB));
+		w_float restitution = clamp01(maximum(restitutionA, restitutionB));
+
+		w_float friction_restitution = reinterpret((convert(friction * 0xFFFF) << 16) | convert(restitution * 0xFFFF));
+
+#if !PHYSICS_32_BIT_INDICES
+		// The 16 bit rigid body index is stored in the upper half of the dword after the material.
+		rbA >>= 16;
+		rbB >>= 16;
+		w_int bodyPairs = reinterpret((rbB << 16) | rbA);
+#endif
+
+
+		uint32 numContactsPerLane[COLLISION_SIMD_WIDTH] = {};
+		for (uint32 j = 0; j < numWideContacts; ++j)
+		{
+			uint32 mask = wideContacts[j].mask;
+			ASSERT(mask != 0);
+
+			mask &= validLanesMask;
+
+			for (uint32 k = 0; k < numValidLanes; ++k)
+			{
+				if (mask & (1 << k))
+				{
+					++numContactsPerLane[k];
+				}
+			}
+		}
+		uint32 offsetPerLane[COLLISION_SIMD_WIDTH];
+		exclusivePrefixSumUint32(numContactsPerLane, offsetPerLane, numValidLanes);
+
+		for (uint32 k = 0; k < numValidLanes; ++k)
+		{
+			if (numContactsPerLane[k] > 0)
+			{
+				// Written directly instead of through collision_write_context::pushCollision (see physics_simd_kernels.h).
+				writeContext.outColliderPairs[writeContext.numCollisions] = { aIndices[k], bIndices[k] };
+				writeContext.outContactCountPerCollision[writeContext.numCollisions] = (uint8)numContactsPerLane[k];
+				++writeContext.numCollisions;
+			}
+		}
+
+		for (uint32 j = 0; j < numWideContacts; ++j)
+		{
+			const w_collision_contact& c = wideContacts[j];
+
+			uint32 mask = c.mask;
+			ASSERT(mask != 0);
+
+			mask &= validLanesMask;
+
+			if (mask)
+			{
+				w_float v[] =
+				{
+					c.point.x,
+					c.point.y,
+					c.point.z,
+					c.penetrationDepth,
+					c.normal.x,
+					c.normal.y,
+					c.normal.z,
+					friction_restitution,
+				};
+
+#if COLLISION_SIMD_WIDTH == 4
+				transpose(v[0], v[1], v[2], v[3]);
+				transpose(v[4], v[5], v[6], v[7]);
+#elif COLLISION_SIMD_WIDTH == 8
+				transpose(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+#else
+				// No 8x16 transpose. The contacts are copied lane by lane instead.
+				alignas(64) float lanes[arraysize(v)][COLLISION_SIMD_WIDTH];
+				for (uint32 l = 0; l < arraysize(v); ++l)
+				{
+					v[l].store(lanes[l]);
+				}
+#endif
+
+				for (uint32 k = 0; k < numValidLanes; ++k)
+				{
+					if (mask & (1 << k))
+					{
+						uint32 offset = offsetPerLane[k];
+
+						collision_contact& outContact = writeContext.outContacts[writeContext.numContacts];
+						constraint_body_pair& outBodyPair = writeContext.outBodyPairs[writeContext.numContacts];
+						++writeContext.numContacts;
+
+#if COLLISION_SIMD_WIDTH == 4
+						v[k].store((float*)&outContact);
+						v[k + 4].store((float*)&outContact + 4);
+#elif COLLISION_SIMD_WIDTH == 8
+						v[k].store((float*)&outContact);
+#else
+						for (uint32 l = 0; l < arraysize(v); ++l)
+						{
+							((float*)&outContact)[l] = lanes[l][k];
+						}
+#endif
+
+#if PHYSICS_32_BIT_INDICES
+						outBodyPair = bodyPairs[k];
+#else
+						*(int*)&outBodyPair = bodyPairs[k];
+#endif
+						
+						++offsetPerLane[k];
+					}
+				}
+			}
+		}
+	}
+}
+
+template <typename collider_a, typename collider_b>
+static void collisionSIMD(const collider_union* worldSpaceColliders, collider_pair* colliderPairs, uint32 numColliderPairs,
+	collision_write_context& writeContext)
+{
+	for (uint32 i = 0; i < numColliderPairs; i += COLLISION_SIMD_WIDTH)
+	{
+		uint32 numValidLanes = minUint32(numColliderPairs - i, COLLISION_SIMD_WIDTH);
+
+		physics_index aIndices[COLLISION_SIMD_WIDTH] = {};
+		physics_index bIndices[COLLISION_SIMD_WIDTH] = {};
+
+		// TODO: This could be done with SIMD.
+		for (uint32 j = 0; j < numValidLanes; ++j)
+		{
+			collider_pair pair = colliderPairs[i + j];
+			aIndices[j] = pair.colliderA;
+			bIndices[j] = pair.colliderB;
+		}
+
+		collider_a bvA = loadBoundingVolumeSIMD<collider_a>(worldSpaceColliders, aIndices);
+		collider_b bvB = loadBoundingVolumeSIMD<collider_b>(worldSpaceColliders, bIndices);
+
+		w_collision_contact wideContacts[4];
+		uint32 numWideContacts = intersectionSIMD(bvA, bvB, wideContacts);
+
+		writeWideContact(worldSpaceColliders, wideContacts, numWideContacts, aIndices, bIndices, numValidLanes, writeContext);
+	}
+}
+
+// Returns 0 if there is no SIMD intersection test for this pair of collider types.
+template <typename collider_a, typename collider_b>
+static constexpr collision_func getSIMDCollisionFunction()
+{
+	using wide_collider_a = typename scalar_to_wide<collider_a>::type;
+	using wide_collider_b = typename scalar_to_wide<collider_b>::type;
+
+	if constexpr (simd_intersection_available<wide_collider_a, wide_collider_b>::value)
+	{
+		return collisionSIMD<wide_collider_a, wide_collider_b>;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+#undef COLLISION_SIMD_WIDTH
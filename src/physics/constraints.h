@@ -3,13 +3,24 @@
 #include "core/math.h"
 #include "core/memory.h"
 #include "scene/scene.h"
+#include "physics_index.h"
 
 
 
 struct rigid_body_global_state;
 struct collision_contact;
+struct physics_simd_kernels;
 
-#define CONSTRAINT_SIMD_WIDTH 8
+// Used by both the scalar and the SIMD solvers.
+#define DISTANCE_CONSTRAINT_BETA 0.1f
+#define BALL_CONSTRAINT_BETA 0.1f
+#define SLIDER_CONSTRAINT_BETA 0.1f
+#define HINGE_ROTATION_CONSTRAINT_BETA 0.3f
+#define HINGE_LIMIT_CONSTRAINT_BETA 0.1f
+#define TWIST_LIMIT_CONSTRAINT_BETA 0.1f
+#define SLIDER_LIMIT_CONSTRAINT_BETA 0.1f
+
+#define DT_THRESHOLD 1e-5f
 
 enum constraint_type
 {
@@ -27,14 +38,15 @@ enum constraint_type
 	constraint_type_count,
 };
 
-#define INVALID_CONSTRAINT_EDGE UINT16_MAX
+// Constraint edges are indexed with 32 bits, since there are two per constraint.
+#define INVALID_CONSTRAINT_EDGE UINT32_MAX
 
 struct constraint_edge
 {
 	entity_handle constraintEntity;
 	constraint_type type;
-	uint16 prevConstraintEdge;
-	uint16 nextConstraintEdge;
+	uint32 prevConstraintEdge;
+	uint32 nextConstraintEdge;
 };
 
 
@@ -52,7 +64,7 @@ static const char* constraintMotorTypeNames[] =
 
 struct constraint_body_pair
 {
-	uint16 rbA, rbB;
+	physics_index rbA, rbB;
 };
 
 
@@ -60,8 +72,8 @@ struct constraint_entity_reference_component
 {
 	entity_handle entityA = entt::null;
 	entity_handle entityB = entt::null;
-	uint16 edgeA = INVALID_CONSTRAINT_EDGE;
-	uint16 edgeB = INVALID_CONSTRAINT_EDGE;
+	uint32 edgeA = INVALID_CONSTRAINT_EDGE;
+	uint32 edgeB = INVALID_CONSTRAINT_EDGE;
 };
 
 
@@ -81,8 +93,8 @@ struct distance_constraint
 
 struct distance_constraint_update
 {
-	uint16 rigidBodyIndexA;
-	uint16 rigidBodyIndexB;
+	physics_index rigidBodyIndexA;
+	physics_index rigidBodyIndexB;
 
 	vec3 relGlobalAnchorA;
 	vec3 relGlobalAnchorB;
@@ -101,28 +113,6 @@ struct distance_constraint_solver
 	uint32 count;
 };
 
-struct simd_distance_constraint_batch
-{
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-
-	float relGlobalAnchorA[3][CONSTRAINT_SIMD_WIDTH];
-	float relGlobalAnchorB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float impulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float impulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float u[3][CONSTRAINT_SIMD_WIDTH];
-	float bias[CONSTRAINT_SIMD_WIDTH];
-	float effectiveMass[CONSTRAINT_SIMD_WIDTH];
-};
-
-struct simd_distance_constraint_solver
-{
-	simd_distance_constraint_batch* batches;
-	uint32 numBatches;
-};
-
 
 // Ball constraint.
 
@@ -136,8 +126,8 @@ struct ball_constraint
 
 struct ball_constraint_update
 {
-	uint16 rigidBodyIndexA;
-	uint16 rigidBodyIndexB;
+	physics_index rigidBodyIndexA;
+	physics_index rigidBodyIndexB;
 	vec3 relGlobalAnchorA;
 	vec3 relGlobalAnchorB;
 
@@ -151,24 +141,6 @@ struct ball_constraint_solver
 	uint32 count;
 };
 
-struct simd_ball_constraint_batch
-{
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-
-	float relGlobalAnchorA[3][CONSTRAINT_SIMD_WIDTH];
-	float relGlobalAnchorB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float bias[3][CONSTRAINT_SIMD_WIDTH];
-	float invEffectiveMass[9][CONSTRAINT_SIMD_WIDTH];
-};
-
-struct simd_ball_constraint_solver
-{
-	simd_ball_constraint_batch* batches;
-	uint32 numBatches;
-};
-
 
 // Fixed constraint.
 
@@ -184,8 +156,8 @@ struct fixed_constraint
 
 struct fixed_constraint_update
 {
-	uint16 rigidBodyIndexA;
-	uint16 rigidBodyIndexB;
+	physics_index rigidBodyIndexA;
+	physics_index rigidBodyIndexB;
 	vec3 relGlobalAnchorA;
 	vec3 relGlobalAnchorB;
 
@@ -202,27 +174,6 @@ struct fixed_constraint_solver
 	uint32 count;
 };
 
-struct simd_fixed_constraint_batch
-{
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-
-	float relGlobalAnchorA[3][CONSTRAINT_SIMD_WIDTH];
-	float relGlobalAnchorB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float translationBias[3][CONSTRAINT_SIMD_WIDTH];
-	float invEffectiveTranslationMass[9][CONSTRAINT_SIMD_WIDTH];
-
-	float rotationBias[3][CONSTRAINT_SIMD_WIDTH];
-	float invEffectiveRotationMass[9][CONSTRAINT_SIMD_WIDTH];
-};
-
-struct simd_fixed_constraint_solver
-{
-	simd_fixed_constraint_batch* batches;
-	uint32 numBatches;
-};
-
 
 // Hinge constraint.
 
@@ -258,8 +209,8 @@ struct hinge_constraint
 
 struct hinge_constraint_update
 {
-	uint16 rigidBodyIndexA;
-	uint16 rigidBodyIndexB;
+	physics_index rigidBodyIndexA;
+	physics_index rigidBodyIndexB;
 
 	vec3 relGlobalAnchorA;
 	vec3 relGlobalAnchorB;
@@ -298,48 +249,6 @@ struct hinge_constraint_solver
 	uint32 count;
 };
 
-struct simd_hinge_constraint_batch
-{
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-
-	float relGlobalAnchorA[3][CONSTRAINT_SIMD_WIDTH];
-	float relGlobalAnchorB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float translationBias[3][CONSTRAINT_SIMD_WIDTH];
-	float invEffectiveTranslationMass[9][CONSTRAINT_SIMD_WIDTH];
-
-
-	float rotationBias[2][CONSTRAINT_SIMD_WIDTH];
-	float invEffectiveRotationMass[4][CONSTRAINT_SIMD_WIDTH];
-	float bxa[3][CONSTRAINT_SIMD_WIDTH];
-	float cxa[3][CONSTRAINT_SIMD_WIDTH];
-
-	bool solveLimit;
-	bool solveMotor;
-
-	float globalRotationAxis[3][CONSTRAINT_SIMD_WIDTH];
-	float effectiveLimitAxialMass[CONSTRAINT_SIMD_WIDTH];
-	float effectiveMotorAxialMass[CONSTRAINT_SIMD_WIDTH];
-
-	float limitImpulse[CONSTRAINT_SIMD_WIDTH];
-	float limitBias[CONSTRAINT_SIMD_WIDTH];
-	float limitSign[CONSTRAINT_SIMD_WIDTH];
-
-	float motorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float maxMotorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float motorVelocity[CONSTRAINT_SIMD_WIDTH];
-
-	float motorAndLimitImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float motorAndLimitImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-};
-
-struct simd_hinge_constraint_solver
-{
-	simd_hinge_constraint_batch* batches;
-	uint32 numBatches;
-};
-
 
 // Cone-twist constraint.
 
@@ -381,8 +290,8 @@ struct cone_twist_constraint
 
 struct cone_twist_constraint_update
 {
-	uint16 rigidBodyIndexA;
-	uint16 rigidBodyIndexB;
+	physics_index rigidBodyIndexA;
+	physics_index rigidBodyIndexB;
 	vec3 relGlobalAnchorA;
 	vec3 relGlobalAnchorB;
 
@@ -432,65 +341,6 @@ struct cone_twist_constraint_solver
 	uint32 count;
 };
 
-struct simd_cone_twist_constraint_batch
-{
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-
-	float relGlobalAnchorA[3][CONSTRAINT_SIMD_WIDTH];
-	float relGlobalAnchorB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float bias[3][CONSTRAINT_SIMD_WIDTH];
-	float invEffectiveMass[9][CONSTRAINT_SIMD_WIDTH];
-
-	bool solveSwingLimit;
-	bool solveTwistLimit;
-	bool solveSwingMotor;
-	bool solveTwistMotor;
-
-	// Limits.
-	float globalSwingAxis[3][CONSTRAINT_SIMD_WIDTH];
-	float swingImpulse[CONSTRAINT_SIMD_WIDTH];
-	float effectiveSwingLimitMass[CONSTRAINT_SIMD_WIDTH];
-	float swingLimitBias[CONSTRAINT_SIMD_WIDTH];
-
-	float swingLimitImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float swingLimitImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-
-
-	float globalTwistAxis[3][CONSTRAINT_SIMD_WIDTH];
-	float twistImpulse[CONSTRAINT_SIMD_WIDTH];
-	float twistLimitSign[CONSTRAINT_SIMD_WIDTH];
-	float effectiveTwistLimitMass[CONSTRAINT_SIMD_WIDTH];
-	float twistLimitBias[CONSTRAINT_SIMD_WIDTH];
-
-
-
-	// Motors.
-	float swingMotorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float maxSwingMotorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float swingMotorVelocity[CONSTRAINT_SIMD_WIDTH];
-	float globalSwingMotorAxis[3][CONSTRAINT_SIMD_WIDTH];
-	float effectiveSwingMotorMass[CONSTRAINT_SIMD_WIDTH];
-
-	float swingMotorImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float swingMotorImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float twistMotorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float maxTwistMotorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float twistMotorVelocity[CONSTRAINT_SIMD_WIDTH];
-	float effectiveTwistMotorMass[CONSTRAINT_SIMD_WIDTH];
-
-	float twistMotorAndLimitImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float twistMotorAndLimitImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-};
-
-struct simd_cone_twist_constraint_solver
-{
-	simd_cone_twist_constraint_batch* batches;
-	uint32 numBatches;
-};
-
 
 // Slider constraint
 
@@ -521,8 +371,8 @@ struct slider_constraint
 
 struct slider_constraint_update
 {
-	uint16 rigidBodyIndexA;
-	uint16 rigidBodyIndexB;
+	physics_index rigidBodyIndexA;
+	physics_index rigidBodyIndexB;
 
 	vec3 rAuxt;
 	vec3 rAuxb;
@@ -563,55 +413,17 @@ struct slider_constraint_solver
 	uint32 count;
 };
 
-struct simd_slider_constraint_batch
-{
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-
-	float rAuxt[3][CONSTRAINT_SIMD_WIDTH];
-	float rAuxb[3][CONSTRAINT_SIMD_WIDTH];
-	float rBxt[3][CONSTRAINT_SIMD_WIDTH];
-	float rBxb[3][CONSTRAINT_SIMD_WIDTH];
-
-	float tangent[3][CONSTRAINT_SIMD_WIDTH];
-	float bitangent[3][CONSTRAINT_SIMD_WIDTH];
-
-	float invEffectiveTranslationMass[4][CONSTRAINT_SIMD_WIDTH];
-	float translationBias[2][CONSTRAINT_SIMD_WIDTH];
 
-	float invEffectiveRotationMass[9][CONSTRAINT_SIMD_WIDTH];
-	float rotationBias[3][CONSTRAINT_SIMD_WIDTH];
-
-	float globalSliderAxis[3][CONSTRAINT_SIMD_WIDTH];
-
-	bool solveLimit;
-	bool solveMotor;
-
-	float effectiveAxialMass[CONSTRAINT_SIMD_WIDTH];
-	float limitBias[CONSTRAINT_SIMD_WIDTH];
-	float limitImpulse[CONSTRAINT_SIMD_WIDTH];
-	float limitSign[CONSTRAINT_SIMD_WIDTH];
-	float rAuxs[3][CONSTRAINT_SIMD_WIDTH];
-	float rBxs[3][CONSTRAINT_SIMD_WIDTH];
-
-	float limitImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float limitImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float motorVelocity[CONSTRAINT_SIMD_WIDTH];
-	float motorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float maxMotorImpulse[CONSTRAINT_SIMD_WIDTH];
-	float effectiveMotorMass[CONSTRAINT_SIMD_WIDTH];
-};
+// Collision constraint.
 
-struct simd_slider_constraint_solver
+// Accumulated impulse of a contact. This is cached across frames to warm start the solver.
+struct contact_impulse
 {
-	simd_slider_constraint_batch* batches;
-	uint32 numBatches;
+	// Don't change the order here. The SIMD code loads this as 4 floats.
+	float impulseInNormalDir;
+	vec3 impulseInTangentPlane; // World space.
 };
 
-
-// Collision constraint.
-
 struct collision_constraint
 {
 	vec3 relGlobalAnchorA;
@@ -627,6 +439,7 @@ struct collision_constraint
 	float impulseInTangentDir;
 	float effectiveMassInNormalDir;
 	float effectiveMassInTangentDir;
+	float normalVelocity; // Relative velocity along the normal at initialization.
 	float bias;
 };
 
@@ -638,86 +451,73 @@ struct collision_constraint_solver
 	uint32 count;
 };
 
-struct simd_collision_constraint_batch
-{
-	float relGlobalAnchorA[3][CONSTRAINT_SIMD_WIDTH];
-	float relGlobalAnchorB[3][CONSTRAINT_SIMD_WIDTH];
-	float normal[3][CONSTRAINT_SIMD_WIDTH];
-	float tangent[3][CONSTRAINT_SIMD_WIDTH];
-
-	float normalImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float tangentImpulseToAngularVelocityA[3][CONSTRAINT_SIMD_WIDTH];
-	float normalImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-	float tangentImpulseToAngularVelocityB[3][CONSTRAINT_SIMD_WIDTH];
-
-	float effectiveMassInNormalDir[CONSTRAINT_SIMD_WIDTH];
-	float effectiveMassInTangentDir[CONSTRAINT_SIMD_WIDTH];
-	float friction[CONSTRAINT_SIMD_WIDTH];
-	float impulseInNormalDir[CONSTRAINT_SIMD_WIDTH];
-	float impulseInTangentDir[CONSTRAINT_SIMD_WIDTH];
-	float bias[CONSTRAINT_SIMD_WIDTH];
-
-	uint16 rbAIndices[CONSTRAINT_SIMD_WIDTH];
-	uint16 rbBIndices[CONSTRAINT_SIMD_WIDTH];
-};
-
-struct simd_collision_constraint_solver
-{
-	simd_collision_constraint_batch* batches;
-	uint32 numBatches;
-};
-
 
 
 
+// The relinearize functions recompute the anchors, axes, effective masses and position errors of initialized constraints from the current 
+// body poses. The sub-stepped solver calls them before every substep but the first.
 distance_constraint_solver initializeDistanceVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const distance_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+void relinearizeDistanceVelocityConstraints(distance_constraint_solver constraints, const rigid_body_global_state* rbs, const distance_constraint* input, const constraint_body_pair* bodyPairs, float dt);
 void solveDistanceVelocityConstraints(distance_constraint_solver constraints, rigid_body_global_state* rbs);
 
 ball_constraint_solver initializeBallVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const ball_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+void relinearizeBallVelocityConstraints(ball_constraint_solver constraints, const rigid_body_global_state* rbs, const ball_constraint* input, const constraint_body_pair* bodyPairs, float dt);
 void solveBallVelocityConstraints(ball_constraint_solver constraints, rigid_body_global_state* rbs);
 
 fixed_constraint_solver initializeFixedVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const fixed_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+void relinearizeFixedVelocityConstraints(fixed_constraint_solver constraints, const rigid_body_global_state* rbs, const fixed_constraint* input, const constraint_body_pair* bodyPairs, float dt);
 void solveFixedVelocityConstraints(fixed_constraint_solver constraints, rigid_body_global_state* rbs);
 
 hinge_constraint_solver initializeHingeVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const hinge_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+void relinearizeHingeVelocityConstraints(hinge_constraint_solver constraints, const rigid_body_global_state* rbs, const hinge_constraint* input, const constraint_body_pair* bodyPairs, float dt);
 void solveHingeVelocityConstraints(hinge_constraint_solver constraints, rigid_body_global_state* rbs);
 
 cone_twist_constraint_solver initializeConeTwistVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const cone_twist_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+void relinearizeConeTwistVelocityConstraints(cone_twist_constraint_solver constraints, const rigid_body_global_state* rbs, const cone_twist_constraint* input, const constraint_body_pair* bodyPairs, float dt);
 void solveConeTwistVelocityConstraints(cone_twist_constraint_solver constraints, rigid_body_global_state* rbs);
 
 slider_constraint_solver initializeSliderVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const slider_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+void relinearizeSliderVelocityConstraints(slider_constraint_solver constraints, const rigid_body_global_state* rbs, const slider_constraint* input, const constraint_body_pair* bodyPairs, float dt);
 void solveSliderVelocityConstraints(slider_constraint_solver constraints, rigid_body_global_state* rbs);
 
-collision_constraint_solver initializeCollisionVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const collision_contact* contacts, const constraint_body_pair* bodyPairs, uint32 numContacts, float dt);
+// Initial impulses may be null, in which case the solver starts from zero.
+collision_constraint_solver initializeCollisionVelocityConstraints(memory_arena& arena, const rigid_body_global_state* rbs, const collision_contact* contacts, const contact_impulse* initialImpulses, const constraint_body_pair* bodyPairs, uint32 numContacts, float dt);
+// Recomputes the bias from the current penetration of the contacts, which the solver was initialized with. Used by the sub-stepped solver.
+void updateCollisionVelocityConstraintBias(collision_constraint_solver constraints, float dt);
+void warmStartCollisionVelocityConstraints(collision_constraint_solver constraints, rigid_body_global_state* rbs);
 void solveCollisionVelocityConstraints(collision_constraint_solver constraints, rigid_body_global_state* rbs);
+void getCollisionImpulses(collision_constraint_solver constraints, contact_impulse* outImpulses);
 
 
 
 
-// SIMD.
-
-simd_distance_constraint_solver initializeDistanceVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const distance_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
-void solveDistanceVelocityConstraintsSIMD(simd_distance_constraint_solver constraints, rigid_body_global_state* rbs);
-
-simd_ball_constraint_solver initializeBallVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const ball_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
-void solveBallVelocityConstraintsSIMD(simd_ball_constraint_solver constraints, rigid_body_global_state* rbs);
+// SIMD. The layout of the batches depends on the SIMD width, which is selected at runtime. The functions operating on them
+// are part of the SIMD kernels (see physics_simd.h and constraints_simd.h).
 
-simd_fixed_constraint_solver initializeFixedVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const fixed_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
-void solveFixedVelocityConstraintsSIMD(simd_fixed_constraint_solver constraints, rigid_body_global_state* rbs);
-
-simd_hinge_constraint_solver initializeHingeVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const hinge_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
-void solveHingeVelocityConstraintsSIMD(simd_hinge_constraint_solver constraints, rigid_body_global_state* rbs);
+struct simd_constraint_solver
+{
+	void* batches;
+	uint32 numBatches;
+	uint32 batchSize;
 
-simd_cone_twist_constraint_solver initializeConeTwistVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const cone_twist_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
-void solveConeTwistVelocityConstraintsSIMD(simd_cone_twist_constraint_solver constraints, rigid_body_global_state* rbs);
+	// The batches are sorted by color. Batches of the same color share no dynamic body and can be solved in parallel.
+	// colorOffsets has numColors + 1 entries. The batches after the last offset didn't fit into any color and are solved sequentially.
+	uint32* colorOffsets;
+	uint32 numColors;
 
-simd_slider_constraint_solver initializeSliderVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const slider_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
-void solveSliderVelocityConstraintsSIMD(simd_slider_constraint_solver constraints, rigid_body_global_state* rbs);
+	// Index of the constraint in each lane of each batch (the SIMD width of the kernels per batch). Needed to relinearize the batches.
+	const uint32* constraintIndices;
+};
 
-simd_collision_constraint_solver initializeCollisionVelocityConstraintsSIMD(memory_arena& arena, const rigid_body_global_state* rbs, const collision_contact* contacts, const constraint_body_pair* bodyPairs, uint32 numContacts, uint16 dummyRigidBodyIndex, float dt);
-void solveCollisionVelocityConstraintsSIMD(simd_collision_constraint_solver constraints, rigid_body_global_state* rbs);
 
 
+template <typename constraint_t>
+struct constraint_solver_input
+{
+	constraint_t* constraints;
+	constraint_body_pair* bodyPairs;
+	uint32 count;
+};
 
 struct constraint_solver
 {
@@ -729,35 +529,95 @@ struct constraint_solver
 		cone_twist_constraint* coneTwistConstraints, constraint_body_pair* coneTwistConstraintBodyPairs, uint32 numConeTwistConstraints,
 		slider_constraint* sliderConstraints, constraint_body_pair* sliderConstraintBodyPairs, uint32 numSliderConstraints,
 		collision_contact* contacts, constraint_body_pair* collisionBodyPairs, uint32 numContacts, 
-		uint32 dummyRigidBodyIndex,	bool simd, float dt);
+		uint32 dummyRigidBodyIndex,	const physics_simd_kernels* simd, float dt, const contact_impulse* initialContactImpulses = 0); // Uses the scalar solvers, if simd is null.
+
+	// Distributes the large colors of the SIMD solver over the job system. This is off after initialization. Only turn it on if the 
+	// solver is not itself called from a job.
+	void setParallelColors(bool parallelColors);
 
 	void solveOneIteration();
 
+	// Sub-stepped mode (TGS-style). Instead of solving all iterations with the constraints linearized at the start of the step, the step is split 
+	// into numSubsteps substeps. The constraints are initialized and colored once. Each substep solves them once and integrates the poses of the 
+	// first numBodies bodies (the dummy must not be one of them). Before every substep but the first, the joints are relinearized at the 
+	// integrated poses. The contacts are not re-detected. Instead their penetration is updated from the movement of the bodies since the start 
+	// of the step, the contact bias is refreshed from it, and the contact impulses carry over from the previous substep.
+	// Call solveSubstep numSubsteps times instead of solveOneIteration. The inputs and the arena passed to initializeSubsteps must stay valid until then.
+	void initializeSubsteps(memory_arena& arena, rigid_body_global_state* rbs, uint32 numBodies,
+		distance_constraint* distanceConstraints, constraint_body_pair* distanceConstraintBodyPairs, uint32 numDistanceConstraints,
+		ball_constraint* ballConstraints, constraint_body_pair* ballConstraintBodyPairs, uint32 numBallConstraints,
+		fixed_constraint* fixedConstraints, constraint_body_pair* fixedConstraintBodyPairs, uint32 numFixedConstraints,
+		hinge_constraint* hingeConstraints, constraint_body_pair* hingeConstraintBodyPairs, uint32 numHingeConstraints,
+		cone_twist_constraint* coneTwistConstraints, constraint_body_pair* coneTwistConstraintBodyPairs, uint32 numConeTwistConstraints,
+		slider_constraint* sliderConstraints, constraint_body_pair* sliderConstraintBodyPairs, uint32 numSliderConstraints,
+		collision_contact* contacts, constraint_body_pair* collisionBodyPairs, uint32 numContacts, 
+		uint32 dummyRigidBodyIndex,	const physics_simd_kernels* simd, float dt, uint32 numSubsteps, const contact_impulse* initialContactImpulses = 0);
+
+	void solveSubstep();
+
+	// Writes the accumulated impulse of each contact. Call this after solving. In sub-stepped mode, this covers all substeps.
+	void getContactImpulses(contact_impulse* outImpulses);
+
 private:
 
+	void setInput(rigid_body_global_state* rbs,
+		distance_constraint* distanceConstraints, constraint_body_pair* distanceConstraintBodyPairs, uint32 numDistanceConstraints,
+		ball_constraint* ballConstraints, constraint_body_pair* ballConstraintBodyPairs, uint32 numBallConstraints,
+		fixed_constraint* fixedConstraints, constraint_body_pair* fixedConstraintBodyPairs, uint32 numFixedConstraints,
+		hinge_constraint* hingeConstraints, constraint_body_pair* hingeConstraintBodyPairs, uint32 numHingeConstraints,
+		cone_twist_constraint* coneTwistConstraints, constraint_body_pair* coneTwistConstraintBodyPairs, uint32 numConeTwistConstraints,
+		slider_constraint* sliderConstraints, constraint_body_pair* sliderConstraintBodyPairs, uint32 numSliderConstraints,
+		collision_contact* contacts, constraint_body_pair* collisionBodyPairs, uint32 numContacts,
+		uint32 dummyRigidBodyIndex, const physics_simd_kernels* simd);
+
+	// Initializes all constraints from the stored input and the current body states.
+	void initializeConstraints(memory_arena& arena, const collision_contact* contacts, float dt, float collisionDt, const contact_impulse* initialContactImpulses);
+
+	void relinearizeSubstepJoints();
+	void updateSubstepContacts();
+	void integrateSubstepPoses();
+
 	rigid_body_global_state* rbs;
-	bool simd;
+	const physics_simd_kernels* simd;
+	uint32 dummyRigidBodyIndex;
+	bool parallelColors;
+
+	constraint_solver_input<distance_constraint> distanceInput;
+	constraint_solver_input<ball_constraint> ballInput;
+	constraint_solver_input<fixed_constraint> fixedInput;
+	constraint_solver_input<hinge_constraint> hingeInput;
+	constraint_solver_input<cone_twist_constraint> coneTwistInput;
+	constraint_solver_input<slider_constraint> sliderInput;
+	constraint_solver_input<collision_contact> collisionInput;
+
+	// Sub-stepped mode only.
+	uint32 numSubsteps; // 0 if not sub-stepped.
+	uint32 currentSubstep;
+	uint32 numBodies;
+	float substepDt;
+	rigid_body_global_state* initialRBs;			// Body states at the start of the step.
+	collision_contact* substepContacts;				// Contacts moved along with the bodies.
 
 	distance_constraint_solver distanceConstraintSolver;
-	simd_distance_constraint_solver distanceConstraintSolverSIMD;
+	simd_constraint_solver distanceConstraintSolverSIMD;
 
 	ball_constraint_solver ballConstraintSolver;
-	simd_ball_constraint_solver ballConstraintSolverSIMD;
+	simd_constraint_solver ballConstraintSolverSIMD;
 
 	fixed_constraint_solver fixedConstraintSolver;
-	simd_fixed_constraint_solver fixedConstraintSolverSIMD;
+	simd_constraint_solver fixedConstraintSolverSIMD;
 
 	hinge_constraint_solver hingeConstraintSolver;
-	simd_hinge_constraint_solver hingeConstraintSolverSIMD;
+	simd_constraint_solver hingeConstraintSolverSIMD;
 
 	cone_twist_constraint_solver coneTwistConstraintSolver;
-	simd_cone_twist_constraint_solver coneTwistConstraintSolverSIMD;
+	simd_constraint_solver coneTwistConstraintSolverSIMD;
 
 	slider_constraint_solver sliderConstraintSolver;
-	simd_slider_constraint_solver sliderConstraintSolverSIMD;
+	simd_constraint_solver sliderConstraintSolverSIMD;
 
 	collision_constraint_solver collisionConstraintSolver;
-	simd_collision_constraint_solver collisionConstraintSolverSIMD;
+	simd_constraint_solver collisionConstraintSolverSIMD;
 };
 
 
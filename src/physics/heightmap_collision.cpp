@@ -2,6 +2,11 @@
 #include "heightmap_collision.h"
 #include "core/cpu_profiling.h"
 #include "collision_gjk.h"
+#include "physics_simd.h"
+
+#ifdef PHYSICS_USE_JOB_SYSTEM
+#include "core/job_system.h"
+#endif
 
 static void getAABBIncidentEdge(vec3 aabbRadius, vec3 normal, vec3& outA, vec3& outB)
 {
@@ -419,29 +424,289 @@ static uint32 collideAABBvsTriangle(vec3 center, vec3 radius, vec3 a, vec3 b, ve
 	return 1;
 }
 
-static uint32 intersection(const bounding_sphere& s, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
+static void projectHull(const bounding_hull_geometry& geometry, vec3 axis, float& outMin, float& outMax)
+{
+	outMin = FLT_MAX;
+	outMax = -FLT_MAX;
+	for (vec3 v : geometry.vertices)
+	{
+		float d = dot(axis, v);
+		outMin = min(outMin, d);
+		outMax = max(outMax, d);
+	}
+}
+
+// A hull edge and a triangle edge only form a face of the Minkowski difference, if their arcs on the Gauss map intersect. a and b are the normals 
+// of the faces adjacent to the hull edge. c and d span the negated arc of the triangle edge. See Gregorius, The Separating Axis Test between Convex 
+// Polyhedra (GDC 2013).
+static bool isMinkowskiFace(vec3 a, vec3 b, vec3 bxa, vec3 c, vec3 d, vec3 dxc)
+{
+	float cba = dot(c, bxa);
+	float dba = dot(d, bxa);
+	float adc = dot(a, dxc);
+	float bdc = dot(b, dxc);
+	return cba * dba < 0.f && adc * bdc < 0.f && cba * bdc > 0.f;
+}
+
+// Separating axis test in the local space of the hull. The axes are the face normals of the hull and the triangle and the cross products of their edges.
+// Like the tests above, this produces one contact per triangle, with the normal pointing from the hull to the triangle.
+// The axes are oriented from the hull to the triangle, so along the hull faces and the edge pairs only the supporting vertices need to be projected.
+// Only the triangle normal needs a full projection of the hull.
+static uint32 collideHullVsTriangle(const bounding_hull_geometry& geometry, vec3 a, vec3 b, vec3 c, collision_contact* outContacts)
+{
+	vec3 tri[3] = { a, b, c };
+
+	float minPenetration = FLT_MAX;
+	vec3 minNormal;
+
+	enum intersection_category
+	{
+		category_hull_face,
+		category_triangle_face,
+		category_edges,
+	};
+
+	intersection_category category = category_triangle_face;
+	uint32 minHullEdge = 0;
+	uint32 minTriangleEdge = 0;
+
+	// Returns false, if the axis separates the shapes.
+	auto testAxis = [&](vec3 axis, float penetration, intersection_category axisCategory, uint32 hullEdge, uint32 triangleEdge)
+	{
+		if (penetration < 0.f)
+		{
+			return false;
+		}
+
+		if (penetration < minPenetration)
+		{
+			minPenetration = penetration;
+			minNormal = axis;
+			category = axisCategory;
+			minHullEdge = hullEdge;
+			minTriangleEdge = triangleEdge;
+		}
+		return true;
+	};
+
+	auto projectTriangleMin = [&](vec3 axis)
+	{
+		return min(dot(axis, a), min(dot(axis, b), dot(axis, c)));
+	};
+
+	// The triangle has no volume, so it is tested in both directions.
+	vec3 triNormal = normalize(cross(b - a, c - a));
+	{
+		float hullMin, hullMax;
+		projectHull(geometry, triNormal, hullMin, hullMax);
+
+		float triD = dot(triNormal, a);
+		if (!testAxis(triNormal, hullMax - triD, category_triangle_face, 0, 0)
+			|| !testAxis(-triNormal, triD - hullMin, category_triangle_face, 0, 0))
+		{
+			return 0;
+		}
+	}
+
+	for (const bounding_hull_face& face : geometry.faces)
+	{
+		float hullMax = dot(face.normal, geometry.vertices[face.a]);
+		if (!testAxis(face.normal, hullMax - projectTriangleMin(face.normal), category_hull_face, 0, 0))
+		{
+			return 0;
+		}
+	}
+
+	// The arc of each triangle edge on the Gauss map goes from the triangle normal over the outward edge normal to the negated triangle normal.
+	// It is split into two arcs at the edge normal. Both are negated for the Minkowski difference.
+	vec3 triEdges[3];
+	vec3 triEdgeNormals[3];
+	for (uint32 j = 0; j < 3; ++j)
+	{
+		triEdges[j] = tri[(j + 1) % 3] - tri[j];
+		triEdgeNormals[j] = normalize(cross(triEdges[j], triNormal));
+	}
+
+	for (uint32 i = 0; i < (uint32)geometry.edges.size(); ++i)
+	{
+		const bounding_hull_edge& edge = geometry.edges[i];
+		vec3 hullEdgeStart = geometry.vertices[edge.from];
+		vec3 hullEdge = geometry.vertices[edge.to] - hullEdgeStart;
+
+		vec3 normalA = geometry.faces[edge.faceA].normal;
+		vec3 normalB = geometry.faces[edge.faceB].normal;
+		vec3 bxa = cross(normalB, normalA);
+
+		for (uint32 j = 0; j < 3; ++j)
+		{
+			vec3 m = triEdgeNormals[j];
+			if (!isMinkowskiFace(normalA, normalB, bxa, -triNormal, -m, cross(-m, -triNormal))
+				&& !isMinkowskiFace(normalA, normalB, bxa, -m, triNormal, cross(triNormal, -m)))
+			{
+				continue;
+			}
+
+			vec3 axis = cross(hullEdge, triEdges[j]);
+			float l = length(axis);
+			if (l < 1e-6f)
+			{
+				continue; // Parallel edges. Covered by the face axes.
+			}
+
+			axis *= 1.f / l;
+			if (dot(axis, normalA + normalB) < 0.f)
+			{
+				axis = -axis;
+			}
+
+			// The edges are the supporting features of both shapes along the axis.
+			if (!testAxis(axis, dot(axis, hullEdgeStart - tri[j]), category_edges, i, j))
+			{
+				return 0;
+			}
+		}
+	}
+
+
+	vec3 point;
+	if (category == category_edges)
+	{
+		// Parallel edges of the hull give the same axis. Use the one, which is farthest towards the triangle.
+		vec3 edgeDirection = normalize(geometry.vertices[geometry.edges[minHullEdge].to] - geometry.vertices[geometry.edges[minHullEdge].from]);
+		float maxD = -FLT_MAX;
+		for (uint32 i = 0; i < (uint32)geometry.edges.size(); ++i)
+		{
+			vec3 from = geometry.vertices[geometry.edges[i].from];
+			vec3 to = geometry.vertices[geometry.edges[i].to];
+			float d = dot(minNormal, from + to);
+			if (abs(dot(normalize(to - from), edgeDirection)) > 0.999f && d > maxD)
+			{
+				maxD = d;
+				minHullEdge = i;
+			}
+		}
+
+		const bounding_hull_edge& edge = geometry.edges[minHullEdge];
+
+		vec3 pa, pb;
+		closestPoint_SegmentSegment(line_segment{ geometry.vertices[edge.from], geometry.vertices[edge.to] },
+			line_segment{ tri[minTriangleEdge], tri[(minTriangleEdge + 1) % 3] }, pa, pb);
+
+		point = (pa + pb) * 0.5f;
+	}
+	else if (category == category_hull_face)
+	{
+		float da = dot(minNormal, a);
+		float db = dot(minNormal, b);
+		float dc = dot(minNormal, c);
+
+		vec3 p = (da < db) ? (da < dc) ? a : c : (db < dc) ? b : c;
+		point = p + minNormal * (minPenetration * 0.5f);
+	}
+	else
+	{
+		vec3 p = geometry.vertices[0];
+		float maxD = dot(minNormal, p);
+		for (vec3 v : geometry.vertices)
+		{
+			float d = dot(minNormal, v);
+			if (d > maxD)
+			{
+				maxD = d;
+				p = v;
+			}
+		}
+
+		point = p - minNormal * (minPenetration * 0.5f);
+	}
+
+	ASSERT(minPenetration >= 0.f);
+
+
+	collision_contact& contact = outContacts[0];
+	contact.point = point;
+	contact.normal = minNormal;
+	contact.penetrationDepth = minPenetration;
+
+	return 1;
+}
+
+// A single collider keeps at most this many triangle contacts (plus the lowest point contact below), so that the contact count fits into 8 bits.
+// If more triangles are hit, the deepest contacts are kept.
+#define MAX_NUM_TRIANGLE_CONTACTS_PER_COLLIDER 254
+
+struct triangle_contact_buffer
+{
+	collision_contact* contacts;
+	uint32 count = 0;
+
+	triangle_contact_buffer(collision_contact* contacts) : contacts(contacts) {}
+
+	void add(const collision_contact& contact)
+	{
+		if (count < MAX_NUM_TRIANGLE_CONTACTS_PER_COLLIDER)
+		{
+			contacts[count++] = contact;
+			return;
+		}
+
+		uint32 shallowest = 0;
+		for (uint32 i = 1; i < count; ++i)
+		{
+			if (contacts[i].penetrationDepth < contacts[shallowest].penetrationDepth)
+			{
+				shallowest = i;
+			}
+		}
+
+		if (contact.penetrationDepth > contacts[shallowest].penetrationDepth)
+		{
+			contacts[shallowest] = contact;
+		}
+	}
+};
+
+template <typename callback_func>
+static void iterateTriangles(const heightmap_collider_component& heightmap, const bounding_box& aabb, memory_arena& arena, const callback_func& func)
+{
+	heightmap.iterateTrianglesInVolume(aabb, arena, func);
+}
+
+template <typename callback_func>
+static void iterateTriangles(const mesh_collider_component& mesh, const bounding_box& aabb, memory_arena& arena, const callback_func& func)
+{
+	mesh.iterateTrianglesInVolume(aabb, func);
+}
+
+template <typename triangle_source_t>
+static uint32 intersection(const bounding_sphere& s, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
 	collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
+	triangle_contact_buffer contacts(outContacts);
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [s, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	iterateTriangles(source, aabb, arena, [s, &contacts](vec3 a, vec3 b, vec3 c)
 	{
-		numContacts += collideSphereVsTriangle(s.center, s.radius, a, b, c, outContacts + numContacts);
+		collision_contact contact;
+		if (collideSphereVsTriangle(s.center, s.radius, a, b, c, &contact))
+		{
+			contacts.add(contact);
+		}
 	});
 
 	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
 
-	return numContacts;
+	return contacts.count;
 }
 
-static uint32 intersection(const bounding_capsule& capsule, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
+template <typename triangle_source_t>
+static uint32 intersection(const bounding_capsule& capsule, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
 	collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
+	triangle_contact_buffer contacts(outContacts);
 
 	ray r = { capsule.positionA, normalize(capsule.positionB - capsule.positionA) };
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [r, capsule, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	iterateTriangles(source, aabb, arena, [r, capsule, &contacts](vec3 a, vec3 b, vec3 c)
 	{
 		vec3 triNormal = normalize(cross(b - a, c - a));
 		float d = -dot(triNormal, a);
@@ -455,48 +720,64 @@ static uint32 intersection(const bounding_capsule& capsule, const bounding_box&
 
 		vec3 reference = closestPoint_PointSegment(closest, { capsule.positionA, capsule.positionB });
 
-		numContacts += collideSphereVsTriangle(reference, capsule.radius, a, b, c, outContacts + numContacts);
+		collision_contact contact;
+		if (collideSphereVsTriangle(reference, capsule.radius, a, b, c, &contact))
+		{
+			contacts.add(contact);
+		}
 	});
 
 	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
 
-	return numContacts;
+	return contacts.count;
 }
 
-static uint32 intersection(const bounding_box& box, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
+template <typename triangle_source_t>
+static uint32 intersection(const bounding_box& box, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
 	collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
+	triangle_contact_buffer contacts(outContacts);
 
 	vec3 center = box.getCenter();
 	vec3 radius = box.getRadius();
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [center, radius, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	iterateTriangles(source, aabb, arena, [center, radius, &contacts](vec3 a, vec3 b, vec3 c)
 	{
-		numContacts += collideAABBvsTriangle(center, radius, a, b, c, outContacts + numContacts);
+		collision_contact contact;
+		if (collideAABBvsTriangle(center, radius, a, b, c, &contact))
+		{
+			contacts.add(contact);
+		}
 	});
 
 	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
 
-	return numContacts;
+	return contacts.count;
 }
 
-static uint32 intersection(const bounding_oriented_box& obb, const bounding_box& aabb, const heightmap_collider_component& heightmap, memory_arena& arena,
+template <typename triangle_source_t>
+static uint32 intersection(const bounding_oriented_box& obb, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
 	collision_contact* outContacts)
 {
-	uint32 numContacts = 0;
+	triangle_contact_buffer contacts(outContacts);
 
-	heightmap.iterateTrianglesInVolume(aabb, arena, [obb, outContacts, &numContacts](vec3 a, vec3 b, vec3 c)
+	iterateTriangles(source, aabb, arena, [obb, &contacts](vec3 a, vec3 b, vec3 c)
 	{
 		a = conjugate(obb.rotation) * (a - obb.center);
 		b = conjugate(obb.rotation) * (b - obb.center);
 		c = conjugate(obb.rotation) * (c - obb.center);
 
-		numContacts += collideAABBvsTriangle(vec3(0.f, 0.f, 0.f), obb.radius, a, b, c, outContacts + numContacts);
+		collision_contact contact;
+		if (collideAABBvsTriangle(vec3(0.f, 0.f, 0.f), obb.radius, a, b, c, &contact))
+		{
+			contacts.add(contact);
+		}
 	});
 
 	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
 
+	uint32 numContacts = contacts.count;
+
 	for (uint32 i = 0; i < numContacts; ++i)
 	{
 		outContacts[i].normal = obb.rotation * outContacts[i].normal;
@@ -506,17 +787,201 @@ static uint32 intersection(const bounding_oriented_box& obb, const bounding_box&
 	return numContacts;
 }
 
-narrowphase_result heightmapCollision(const heightmap_collider_component& heightmap, 
-	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders, 
-	collision_contact* outContacts, constraint_body_pair* outBodyPairs, collider_pair* outColliderPairs, uint8* outContactCountPerCollision, 
-	memory_arena& arena, uint16 dummyRigidBodyIndex)
+// Batched versions of the tests above. The candidate triangles are collected in batches and then tested with the SIMD kernels.
+// Whole cells are still rejected by the min/max pyramid of the heightmap (or the BVH of a mesh) before any of their triangles are generated.
+
+static_assert(HEIGHTMAP_TRIANGLE_BATCH_SIZE % PHYSICS_MAX_SIMD_WIDTH == 0);
+
+// Transform is applied to each triangle before it is added to the batch.
+template <typename triangle_source_t, typename transform_func, typename test_func>
+static uint32 collideTriangleBatches(const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
+	collision_contact* outContacts, const transform_func& transform, const test_func& test)
 {
-	CPU_PROFILE_BLOCK("Heightmap collisions");
+	heightmap_triangle_batch batch;
+	batch.count = 0;
+
+	triangle_contact_buffer contacts(outContacts);
+	collision_contact batchContacts[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
 
+	auto flush = [&]()
+	{
+		// Pad to the SIMD width with copies of the first triangle, so that the kernels never load uninitialized values.
+		for (uint32 i = batch.count; i < alignTo(batch.count, PHYSICS_MAX_SIMD_WIDTH); ++i)
+		{
+			batch.ax[i] = batch.ax[0]; batch.ay[i] = batch.ay[0]; batch.az[i] = batch.az[0];
+			batch.bx[i] = batch.bx[0]; batch.by[i] = batch.by[0]; batch.bz[i] = batch.bz[0];
+			batch.cx[i] = batch.cx[0]; batch.cy[i] = batch.cy[0]; batch.cz[i] = batch.cz[0];
+		}
+
+		uint32 numBatchContacts = test(batch, batchContacts);
+		for (uint32 i = 0; i < numBatchContacts; ++i)
+		{
+			contacts.add(batchContacts[i]);
+		}
+		batch.count = 0;
+	};
+
+	iterateTriangles(source, aabb, arena, [&](vec3 a, vec3 b, vec3 c)
+	{
+		transform(a, b, c);
+
+		uint32 i = batch.count++;
+		batch.ax[i] = a.x; batch.ay[i] = a.y; batch.az[i] = a.z;
+		batch.bx[i] = b.x; batch.by[i] = b.y; batch.bz[i] = b.z;
+		batch.cx[i] = c.x; batch.cy[i] = c.y; batch.cz[i] = c.z;
+
+		if (batch.count == HEIGHTMAP_TRIANGLE_BATCH_SIZE)
+		{
+			flush();
+		}
+	});
+
+	if (batch.count > 0)
+	{
+		flush();
+	}
+
+	return contacts.count;
+}
+
+static void noTransform(vec3& a, vec3& b, vec3& c) {}
+
+template <typename triangle_source_t>
+static uint32 intersectionSIMD(const bounding_sphere& s, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
+	const physics_simd_kernels* simd, collision_contact* outContacts)
+{
+	return collideTriangleBatches(aabb, source, arena, outContacts, noTransform, [s, simd](const heightmap_triangle_batch& batch, collision_contact* outContacts)
+	{
+		return simd->collideSphereVsTriangles(s, batch, outContacts);
+	});
+}
+
+template <typename triangle_source_t>
+static uint32 intersectionSIMD(const bounding_capsule& capsule, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
+	const physics_simd_kernels* simd, collision_contact* outContacts)
+{
+	return collideTriangleBatches(aabb, source, arena, outContacts, noTransform, [capsule, simd](const heightmap_triangle_batch& batch, collision_contact* outContacts)
+	{
+		return simd->collideCapsuleVsTriangles(capsule, batch, outContacts);
+	});
+}
+
+template <typename triangle_source_t>
+static uint32 intersectionSIMD(const bounding_box& box, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
+	const physics_simd_kernels* simd, collision_contact* outContacts)
+{
+	vec3 center = box.getCenter();
+	vec3 radius = box.getRadius();
+
+	return collideTriangleBatches(aabb, source, arena, outContacts, noTransform, [center, radius, simd](const heightmap_triangle_batch& batch, collision_contact* outContacts)
+	{
+		return simd->collideAABBVsTriangles(center, radius, batch, outContacts);
+	});
+}
+
+template <typename triangle_source_t>
+static uint32 intersectionSIMD(const bounding_oriented_box& obb, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
+	const physics_simd_kernels* simd, collision_contact* outContacts)
+{
+	quat invRotation = conjugate(obb.rotation);
+	vec3 radius = obb.radius;
+
+	// The triangles are transformed into the local space of the box, where it is an AABB.
+	uint32 numContacts = collideTriangleBatches(aabb, source, arena, outContacts, 
+		[&obb, invRotation](vec3& a, vec3& b, vec3& c)
+		{
+			a = invRotation * (a - obb.center);
+			b = invRotation * (b - obb.center);
+			c = invRotation * (c - obb.center);
+		},
+		[radius, simd](const heightmap_triangle_batch& batch, collision_contact* outContacts)
+		{
+			return simd->collideAABBVsTriangles(vec3(0.f, 0.f, 0.f), radius, batch, outContacts);
+		});
+
+	for (uint32 i = 0; i < numContacts; ++i)
+	{
+		outContacts[i].normal = obb.rotation * outContacts[i].normal;
+		outContacts[i].point = obb.rotation * outContacts[i].point + obb.center;
+	}
+
+	return numContacts;
+}
+
+template <typename triangle_source_t>
+static uint32 intersection(const bounding_hull& hull, const bounding_box& aabb, const triangle_source_t& source, memory_arena& arena,
+	collision_contact* outContacts)
+{
+	triangle_contact_buffer contacts(outContacts);
+
+	const bounding_hull_geometry& geometry = *hull.geometryPtr;
+	quat invRotation = conjugate(hull.rotation);
+
+	iterateTriangles(source, aabb, arena, [&geometry, &hull, invRotation, &contacts](vec3 a, vec3 b, vec3 c)
+	{
+		a = invRotation * (a - hull.position);
+		b = invRotation * (b - hull.position);
+		c = invRotation * (c - hull.position);
+
+		collision_contact contact;
+		if (collideHullVsTriangle(geometry, a, b, c, &contact))
+		{
+			contacts.add(contact);
+		}
+	});
+
+	// TODO: De-duplicate contacts (for if we hit triangle edges or vertices).
+
+	uint32 numContacts = contacts.count;
+
+	for (uint32 i = 0; i < numContacts; ++i)
+	{
+		outContacts[i].normal = hull.rotation * outContacts[i].normal;
+		outContacts[i].point = hull.rotation * outContacts[i].point + hull.position;
+	}
+
+	return numContacts;
+}
+
+static uint32 intersection(const bounding_hull& hull, const heightmap_collider_component& heightmap, collision_contact* outContacts)
+{
+	// Only the vertices are tested against the height field, which is cheaper than the triangle test for meshes above and good enough for small debris.
+	const uint32 maxNumContacts = 16;
+
+	uint32 numContacts = 0;
+
+	for (vec3 v : hull.geometryPtr->vertices)
+	{
+		vec3 p = hull.rotation * v + hull.position;
+		float height = heightmap.getHeightAt(vec2(p.x, p.z));
+		if (p.y < height)
+		{
+			collision_contact& contact = outContacts[numContacts++];
+			contact.normal = vec3(0.f, -1.f, 0.f);
+			contact.point = p;
+			contact.penetrationDepth = height - p.y;
+
+			if (numContacts == maxNumContacts)
+			{
+				break;
+			}
+		}
+	}
+
+	return numContacts;
+}
+
+template <typename triangle_source_t>
+static narrowphase_result triangleCollisionRange(const triangle_source_t& source, physics_index staticColliderIndex,
+	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 firstCollider, uint32 endCollider, 
+	arena_array<collision_contact>& outContacts, arena_array<constraint_body_pair>& outBodyPairs,
+	arena_array<collider_pair>& outColliderPairs, arena_array<uint8>& outContactCountPerCollision,
+	memory_arena& arena, physics_index dummyRigidBodyIndex, const bool* rbSleeping, const physics_simd_kernels* simd)
+{
 	uint32 totalNumContacts = 0;
 	uint32 totalNumCollisions = 0;
 
-	for (uint32 i = 0; i < numColliders; ++i)
+	for (uint32 i = firstCollider; i < endCollider; ++i)
 	{
 		const collider_union& collider = worldSpaceColliders[i];
 
@@ -525,57 +990,94 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 			continue;
 		}
 
+		if (rbSleeping && rbSleeping[collider.objectIndex])
+		{
+			continue;
+		}
+
 
 		bounding_box aabb = worldSpaceAABBs[i];
-		aabb.maxCorner.y += 10.f;
+		if constexpr (std::is_same_v<triangle_source_t, heightmap_collider_component>)
+		{
+			aabb.maxCorner.y += 10.f;
+		}
 
 		uint32 numContacts = 0;
 
-		collision_contact* contactPtr = outContacts + totalNumContacts;
+		// Make room for the maximum number of contacts of a collider, before the intersection tests allocate their temporary memory.
+		const uint32 maxNumContacts = MAX_NUM_TRIANGLE_CONTACTS_PER_COLLIDER + 1;
+		outContacts.reserve(outContacts.count + maxNumContacts);
+		outBodyPairs.reserve(outBodyPairs.count + maxNumContacts);
+
+		collision_contact* contactPtr = outContacts.data + outContacts.count;
 
 
 		vec3 lowestPoint;
+		bool testLowestPoint = true;
 
 		switch (collider.type)
 		{
 			case collider_type_sphere:
 			{
-				numContacts = intersection(collider.sphere, aabb, heightmap, arena, contactPtr);
+				numContacts = simd ? intersectionSIMD(collider.sphere, aabb, source, arena, simd, contactPtr) : intersection(collider.sphere, aabb, source, arena, contactPtr);
 				lowestPoint = sphere_support_fn{ collider.sphere }(vec3(0.f, -1.f, 0.f));
 			} break;
 			case collider_type_capsule:
 			{
-				numContacts = intersection(collider.capsule, aabb, heightmap, arena, contactPtr);
+				numContacts = simd ? intersectionSIMD(collider.capsule, aabb, source, arena, simd, contactPtr) : intersection(collider.capsule, aabb, source, arena, contactPtr);
 				lowestPoint = capsule_support_fn{ collider.capsule }(vec3(0.f, -1.f, 0.f));
 			} break;
 			case collider_type_aabb:
 			{
-				numContacts = intersection(collider.aabb, aabb, heightmap, arena, contactPtr);
+				numContacts = simd ? intersectionSIMD(collider.aabb, aabb, source, arena, simd, contactPtr) : intersection(collider.aabb, aabb, source, arena, contactPtr);
 				lowestPoint = aabb_support_fn{ collider.aabb }(vec3(0.f, -1.f, 0.f));
 			} break;
 			case collider_type_obb:
 			{
-				numContacts = intersection(collider.obb, aabb, heightmap, arena, contactPtr);
+				numContacts = simd ? intersectionSIMD(collider.obb, aabb, source, arena, simd, contactPtr) : intersection(collider.obb, aabb, source, arena, contactPtr);
 				lowestPoint = obb_support_fn{ collider.obb }(vec3(0.f, -1.f, 0.f));
 			} break;
+			case collider_type_hull:
+			{
+				if constexpr (std::is_same_v<triangle_source_t, heightmap_collider_component>)
+				{
+					numContacts = intersection(collider.hull, source, contactPtr);
+					testLowestPoint = false; // The lowest vertex is already tested.
+				}
+				else
+				{
+					numContacts = intersection(collider.hull, aabb, source, arena, contactPtr);
+				}
+			} break;
+			default:
+			{
+				testLowestPoint = false;
+			} break;
 		}
 
-		float heightAtLowestPoint = heightmap.getHeightAt(vec2(lowestPoint.x, lowestPoint.z));
-		if (lowestPoint.y < heightAtLowestPoint)
+		// Catches colliders, which already tunneled below the heightmap surface. Meshes have no inside, which could be tested like this.
+		if constexpr (std::is_same_v<triangle_source_t, heightmap_collider_component>)
 		{
-			collision_contact& contact = contactPtr[numContacts++];
-			contact.normal = vec3(0.f, -1.f, 0.f);
-			contact.point = lowestPoint;
-			contact.penetrationDepth = heightAtLowestPoint - lowestPoint.y;
+			if (testLowestPoint)
+			{
+				float heightAtLowestPoint = source.getHeightAt(vec2(lowestPoint.x, lowestPoint.z));
+				if (lowestPoint.y < heightAtLowestPoint)
+				{
+					collision_contact& contact = contactPtr[numContacts++];
+					contact.normal = vec3(0.f, -1.f, 0.f);
+					contact.point = lowestPoint;
+					contact.penetrationDepth = heightAtLowestPoint - lowestPoint.y;
+				}
+			}
 		}
 
 
 		if (numContacts > 0)
 		{
-			constraint_body_pair* bodyPairPtr = outBodyPairs + totalNumContacts;
+			constraint_body_pair* bodyPairPtr = outBodyPairs.data + outBodyPairs.count;
 
-			float friction = clamp01(sqrt(collider.material.friction * heightmap.material.friction));
-			float restitution = clamp01(max(collider.material.restitution, heightmap.material.restitution));
+			float friction = clamp01(sqrt(collider.material.friction * source.material.friction));
+			float restitution = clamp01(max(collider.material.restitution, source.material.restitution));
 
 			uint32 friction_restitution = ((uint32)(friction * 0xFFFF) << 16) | (uint32)(restitution * 0xFFFF);
 
@@ -585,9 +1087,10 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 				bodyPairPtr[j] = { collider.objectIndex, dummyRigidBodyIndex };
 			}
 
-			ASSERT(numContacts < 256);
-			outContactCountPerCollision[totalNumCollisions] = (uint8)numContacts;
-			outColliderPairs[totalNumCollisions++] = { (uint16)i, UINT16_MAX };
+			ASSERT(numContacts <= maxNumContacts);
+			outContactCountPerCollision.push((uint8)numContacts);
+			outColliderPairs.push({ (physics_index)i, staticColliderIndex });
+			++totalNumCollisions;
 		}
 
 #if 0
@@ -611,8 +1114,177 @@ narrowphase_result heightmapCollision(const heightmap_collider_component& height
 		}
 #endif
 
+		outContacts.count += numContacts;
+		outBodyPairs.count += numContacts;
 		totalNumContacts += numContacts;
 	}
 
 	return narrowphase_result{ totalNumCollisions, totalNumContacts, 0 };
 }
+
+#ifdef PHYSICS_USE_JOB_SYSTEM
+
+#define MIN_NUM_COLLIDERS_PER_HEIGHTMAP_JOB 64
+
+struct heightmap_job
+{
+	memory_arena* arena;
+	uint32 firstCollider;
+	uint32 endCollider;
+
+	collision_contact* contacts;
+	constraint_body_pair* bodyPairs;
+	collider_pair* colliderPairs;
+	uint8* contactCountPerCollision;
+	narrowphase_result result;
+};
+
+#endif
+
+template <typename triangle_source_t>
+static narrowphase_result triangleCollision(const triangle_source_t& source, physics_index staticColliderIndex,
+	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders, 
+	arena_array<collision_contact>& outContacts, arena_array<constraint_body_pair>& outBodyPairs,
+	arena_array<collider_pair>& outColliderPairs, arena_array<uint8>& outContactCountPerCollision,
+	memory_arena& arena, physics_index dummyRigidBodyIndex, const bool* rbSleeping, const physics_simd_kernels* simd, heightmap_job_context* jobContext)
+{
+#ifdef PHYSICS_USE_JOB_SYSTEM
+	uint32 numJobs = min(numColliders / MIN_NUM_COLLIDERS_PER_HEIGHTMAP_JOB, (uint32)MAX_NUM_HEIGHTMAP_JOBS);
+	if (jobContext && numJobs > 1)
+	{
+		// The intersection tests need temporary memory, and the results are collected before they are merged into the output.
+		// Memory arenas are not thread safe, so each job gets its own.
+		if (!jobContext->arenas)
+		{
+			jobContext->arenas = std::make_unique<memory_arena[]>(MAX_NUM_HEIGHTMAP_JOBS);
+		}
+
+		heightmap_job jobs[MAX_NUM_HEIGHTMAP_JOBS];
+
+		uint32 collidersPerJob = bucketize(numColliders, numJobs);
+		for (uint32 i = 0; i < numJobs; ++i)
+		{
+			memory_arena& jobArena = jobContext->arenas[i];
+			if (!jobArena.base())
+			{
+				jobArena.initialize(0, GB(1));
+			}
+			jobArena.reset();
+
+			jobs[i].arena = &jobArena;
+			jobs[i].firstCollider = i * collidersPerJob;
+			jobs[i].endCollider = min(jobs[i].firstCollider + collidersPerJob, numColliders);
+		}
+
+		struct heightmap_job_data
+		{
+			const triangle_source_t* source;
+			const collider_union* worldSpaceColliders;
+			const bounding_box* worldSpaceAABBs;
+			const bool* rbSleeping;
+			const physics_simd_kernels* simd;
+			heightmap_job* jobs;
+			uint32 numJobs;
+			physics_index dummyRigidBodyIndex;
+			physics_index staticColliderIndex;
+		};
+
+		heightmap_job_data data = { &source, worldSpaceColliders, worldSpaceAABBs, rbSleeping, simd, jobs, numJobs, dummyRigidBodyIndex, staticColliderIndex };
+
+		job_handle parentJob = highPriorityJobQueue.createJob<heightmap_job_data>([](heightmap_job_data& data, job_handle parent)
+		{
+			for (uint32 i = 0; i < data.numJobs; ++i)
+			{
+				struct heightmap_range_job_data
+				{
+					heightmap_job_data* data;
+					heightmap_job* job;
+				};
+
+				heightmap_range_job_data rangeData = { &data, &data.jobs[i] };
+
+				highPriorityJobQueue.createJob<heightmap_range_job_data>([](heightmap_range_job_data& rangeData, job_handle)
+				{
+					const heightmap_job_data& data = *rangeData.data;
+					heightmap_job& job = *rangeData.job;
+					memory_arena& arena = *job.arena;
+
+					arena_array<collision_contact> contacts(arena);
+					arena_array<constraint_body_pair> bodyPairs(arena);
+					arena_array<collider_pair> colliderPairs(arena);
+					arena_array<uint8> contactCountPerCollision(arena);
+
+					job.result = triangleCollisionRange(*data.source, data.staticColliderIndex, data.worldSpaceColliders, data.worldSpaceAABBs, job.firstCollider, job.endCollider,
+						contacts, bodyPairs, colliderPairs, contactCountPerCollision, arena, data.dummyRigidBodyIndex, data.rbSleeping, data.simd);
+
+					job.contacts = contacts.data;
+					job.bodyPairs = bodyPairs.data;
+					job.colliderPairs = colliderPairs.data;
+					job.contactCountPerCollision = contactCountPerCollision.data;
+				}, rangeData, parent).submitNow();
+			}
+		}, data);
+
+		parentJob.submitNow();
+		parentJob.waitForCompletion();
+
+		// Append the results in job order, so that the output does not depend on the scheduling.
+		narrowphase_result result = { 0, 0, 0 };
+		for (uint32 i = 0; i < numJobs; ++i)
+		{
+			const heightmap_job& job = jobs[i];
+
+			outContacts.reserve(outContacts.count + job.result.numContacts);
+			outBodyPairs.reserve(outBodyPairs.count + job.result.numContacts);
+			outColliderPairs.reserve(outColliderPairs.count + job.result.numCollisions);
+			outContactCountPerCollision.reserve(outContactCountPerCollision.count + job.result.numCollisions);
+
+			memcpy(outContacts.end(), job.contacts, sizeof(collision_contact) * job.result.numContacts);
+			memcpy(outBodyPairs.end(), job.bodyPairs, sizeof(constraint_body_pair) * job.result.numContacts);
+			memcpy(outColliderPairs.end(), job.colliderPairs, sizeof(collider_pair) * job.result.numCollisions);
+			memcpy(outContactCountPerCollision.end(), job.contactCountPerCollision, sizeof(uint8) * job.result.numCollisions);
+
+			outContacts.count += job.result.numContacts;
+			outBodyPairs.count += job.result.numContacts;
+			outColliderPairs.count += job.result.numCollisions;
+			outContactCountPerCollision.count += job.result.numCollisions;
+
+			result.numCollisions += job.result.numCollisions;
+			result.numContacts += job.result.numContacts;
+		}
+
+		return result;
+	}
+#endif
+
+	return triangleCollisionRange(source, staticColliderIndex, worldSpaceColliders, worldSpaceAABBs, 0, numColliders,
+		outContacts, outBodyPairs, outColliderPairs, outContactCountPerCollision, arena, dummyRigidBodyIndex, rbSleeping, simd);
+}
+
+narrowphase_result heightmapCollision(const heightmap_collider_component& heightmap, physics_index staticColliderIndex,
+	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders, 
+	arena_array<collision_contact>& outContacts, arena_array<constraint_body_pair>& outBodyPairs,
+	arena_array<collider_pair>& outColliderPairs, arena_array<uint8>& outContactCountPerCollision,
+	memory_arena& arena, physics_index dummyRigidBodyIndex, const bool* rbSleeping, const physics_simd_kernels* simd, heightmap_job_context* jobContext)
+{
+	CPU_PROFILE_BLOCK("Heightmap collisions");
+
+	ASSERT(staticColliderIndex >= numColliders);
+
+	return triangleCollision(heightmap, staticColliderIndex, worldSpaceColliders, worldSpaceAABBs, numColliders,
+		outContacts, outBodyPairs, outColliderPairs, outContactCountPerCollision, arena, dummyRigidBodyIndex, rbSleeping, simd, jobContext);
+}
+
+narrowphase_result meshCollision(const mesh_collider_component& mesh, physics_index staticColliderIndex,
+	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders, 
+	arena_array<collision_contact>& outContacts, arena_array<constraint_body_pair>& outBodyPairs,
+	arena_array<collider_pair>& outColliderPairs, arena_array<uint8>& outContactCountPerCollision,
+	memory_arena& arena, physics_index dummyRigidBodyIndex, const bool* rbSleeping, const physics_simd_kernels* simd, heightmap_job_context* jobContext)
+{
+	CPU_PROFILE_BLOCK("Mesh collisions");
+
+	ASSERT(staticColliderIndex >= numColliders);
+
+	return triangleCollision(mesh, staticColliderIndex, worldSpaceColliders, worldSpaceAABBs, numColliders,
+		outContacts, outBodyPairs, outColliderPairs, outContactCountPerCollision, arena, dummyRigidBodyIndex, rbSleeping, simd, jobContext);
+}
@@ -3,11 +3,53 @@
 #include "collision_narrow.h"
 #include "collision_broad.h"
 #include "terrain/heightmap_collider.h"
+#include "mesh_collider.h"
 
+struct physics_simd_kernels;
 
-narrowphase_result heightmapCollision(const heightmap_collider_component& heightmap, 
+// Many colliders are split into at most this many ranges, which are tested against the heightmap or mesh in parallel.
+#define MAX_NUM_HEIGHTMAP_JOBS 8
+
+// Temporary memory of the parallel tests, one arena per job. Scenes may be stepped in parallel (e.g. batched environments),
+// so each scene keeps its own as a context variable.
+struct heightmap_job_context
+{
+	std::unique_ptr<memory_arena[]> arenas; // MAX_NUM_HEIGHTMAP_JOBS many. Allocated on first use.
+};
+
+// The pairs of the collisions are written as { collider, staticColliderIndex }. The index must be at least numColliders, so that it cannot be
+// confused with a collider, and should be unique per heightmap, so that contact caching can tell the heightmaps apart.
+narrowphase_result heightmapCollision(const heightmap_collider_component& heightmap, physics_index staticColliderIndex,
+	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders,
+	arena_array<collision_contact>& outContacts, arena_array<constraint_body_pair>& outBodyPairs, // result.numContacts many are appended.
+	arena_array<collider_pair>& outColliderPairs, arena_array<uint8>& outContactCountPerCollision, // result.numCollisions many are appended.
+	memory_arena& arena, physics_index dummyRigidBodyIndex, const bool* rbSleeping = 0, // Colliders of sleeping rigid bodies are skipped.
+	const physics_simd_kernels* simd = 0, // Uses the scalar triangle tests, if simd is null.
+	heightmap_job_context* jobContext = 0); // Runs on the calling thread only, if null.
+
+// Same as above, with the triangles of a static mesh collider. Heightmaps and meshes share the range of static collider indices.
+narrowphase_result meshCollision(const mesh_collider_component& mesh, physics_index staticColliderIndex,
 	const collider_union* worldSpaceColliders, const bounding_box* worldSpaceAABBs, uint32 numColliders,
-	collision_contact* outContacts, constraint_body_pair* outBodyPairs, // result.numContacts many.
-	collider_pair* outColliderPairs, uint8* outContactCountPerCollision, // result.numCollisions many.
-	memory_arena& arena, uint16 dummyRigidBodyIndex);
+	arena_array<collision_contact>& outContacts, arena_array<constraint_body_pair>& outBodyPairs,
+	arena_array<collider_pair>& outColliderPairs, arena_array<uint8>& outContactCountPerCollision,
+	memory_arena& arena, physics_index dummyRigidBodyIndex, const bool* rbSleeping = 0,
+	const physics_simd_kernels* simd = 0, heightmap_job_context* jobContext = 0);
+
+
+// Candidate triangles of one collider, collected from the heightmap or mesh in SoA layout for the SIMD triangle tests (see physics_simd.h).
+// The arrays are padded to a multiple of the SIMD width with copies of the first triangle. The padding lanes are ignored.
+#define HEIGHTMAP_TRIANGLE_BATCH_SIZE 64
 
+struct heightmap_triangle_batch
+{
+	alignas(64) float ax[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float ay[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float az[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float bx[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float by[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float bz[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float cx[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float cy[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	alignas(64) float cz[HEIGHTMAP_TRIANGLE_BATCH_SIZE];
+	uint32 count;
+};
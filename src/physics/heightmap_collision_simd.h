@@ -0,0 +1,286 @@
+#pragma once
+
+// SIMD triangle tests for heightmap collisions. Only included by physics_simd_kernels.h, which defines the wide types for the current width.
+// These are the wide versions of the scalar tests in heightmap_collision.cpp and produce at most one contact per triangle.
+
+static_assert(HEIGHTMAP_TRIANGLE_BATCH_SIZE % PHYSICS_SIMD_WIDTH == 0);
+
+static void loadTrianglesSIMD(const heightmap_triangle_batch& triangles, uint32 offset, w_vec3& a, w_vec3& b, w_vec3& c)
+{
+	a = w_vec3(w_float(triangles.ax + offset), w_float(triangles.ay + offset), w_float(triangles.az + offset));
+	b = w_vec3(w_float(triangles.bx + offset), w_float(triangles.by + offset), w_float(triangles.bz + offset));
+	c = w_vec3(w_float(triangles.cx + offset), w_float(triangles.cy + offset), w_float(triangles.cz + offset));
+}
+
+static uint32 getValidTriangleLanes(const heightmap_triangle_batch& triangles, uint32 offset)
+{
+	uint32 numValidLanes = minUint32(triangles.count - offset, PHYSICS_SIMD_WIDTH);
+	return (1u << numValidLanes) - 1;
+}
+
+static uint32 writeTriangleContactsSIMD(const w_vec3& point, const w_float& penetrationDepth, const w_vec3& normal, uint32 mask, collision_contact* outContacts)
+{
+	alignas(64) float lanes[7][PHYSICS_SIMD_WIDTH];
+	point.x.store(lanes[0]);
+	point.y.store(lanes[1]);
+	point.z.store(lanes[2]);
+	penetrationDepth.store(lanes[3]);
+	normal.x.store(lanes[4]);
+	normal.y.store(lanes[5]);
+	normal.z.store(lanes[6]);
+
+	uint32 numContacts = 0;
+	for (uint32 k = 0; k < PHYSICS_SIMD_WIDTH; ++k)
+	{
+		if (mask & (1 << k))
+		{
+			collision_contact& contact = outContacts[numContacts++];
+			contact.point.x = lanes[0][k];
+			contact.point.y = lanes[1][k];
+			contact.point.z = lanes[2][k];
+			contact.penetrationDepth = lanes[3][k];
+			contact.normal.x = lanes[4][k];
+			contact.normal.y = lanes[5][k];
+			contact.normal.z = lanes[6][k];
+		}
+	}
+	return numContacts;
+}
+
+static uint32 collideSphereVsTrianglesSIMD(const w_vec3& center, const w_float& radius, const w_vec3& a, const w_vec3& b, const w_vec3& c,
+	uint32 validLanes, collision_contact* outContacts)
+{
+	w_vec3 closestPoint = closestPoint_PointTriangle(center, a, b, c);
+	w_vec3 n = closestPoint - center;
+	w_float sqDistance = squaredLength(n);
+
+	uint32 mask = toBitMask(sqDistance <= radius * radius) & validLanes;
+	if (!mask)
+	{
+		return 0;
+	}
+
+	auto degenerate = (sqDistance == 0.f);
+	w_float distance = ifThen(degenerate, w_float::zero(), sqrt(sqDistance));
+	n = ifThen(degenerate, -noz(cross(b - a, c - a)), n / distance);
+
+	return writeTriangleContactsSIMD(closestPoint, radius - distance, n, mask, outContacts);
+}
+
+static uint32 collideSphereVsTrianglesSIMD(const bounding_sphere& sphere, const heightmap_triangle_batch& triangles, collision_contact* outContacts)
+{
+	w_vec3 center(sphere.center.x, sphere.center.y, sphere.center.z);
+	w_float radius = sphere.radius;
+
+	uint32 numContacts = 0;
+	for (uint32 i = 0; i < triangles.count; i += PHYSICS_SIMD_WIDTH)
+	{
+		w_vec3 a, b, c;
+		loadTrianglesSIMD(triangles, i, a, b, c);
+
+		numContacts += collideSphereVsTrianglesSIMD(center, radius, a, b, c, getValidTriangleLanes(triangles, i), outContacts + numContacts);
+	}
+	return numContacts;
+}
+
+static uint32 collideCapsuleVsTrianglesSIMD(const bounding_capsule& capsule, const heightmap_triangle_batch& triangles, collision_contact* outContacts)
+{
+	w_vec3 origin(capsule.positionA.x, capsule.positionA.y, capsule.positionA.z);
+	w_line_segment segment = { origin, w_vec3(capsule.positionB.x, capsule.positionB.y, capsule.positionB.z) };
+	w_vec3 d = (segment.b - origin) / length(segment.b - origin);
+	w_float radius = capsule.radius;
+
+	uint32 numContacts = 0;
+	for (uint32 i = 0; i < triangles.count; i += PHYSICS_SIMD_WIDTH)
+	{
+		w_vec3 a, b, c;
+		loadTrianglesSIMD(triangles, i, a, b, c);
+
+		// Intersect the capsule axis with the triangle plane and use the point on the axis closest to the triangle as the sphere center.
+		w_vec3 triNormal = noz(cross(b - a, c - a));
+		w_float ndotd = dot(d, triNormal);
+		w_float t = dot(a - origin, triNormal) / ndotd;
+		t = ifThen(abs(ndotd) < EPSILON, w_float::zero(), t); // Parallel to the plane.
+
+		w_vec3 trace = origin + t * d;
+		w_vec3 closest = closestPoint_PointTriangle(trace, a, b, c);
+		w_vec3 reference = closestPoint_PointSegment(closest, segment);
+
+		numContacts += collideSphereVsTrianglesSIMD(reference, radius, a, b, c, getValidTriangleLanes(triangles, i), outContacts + numContacts);
+	}
+	return numContacts;
+}
+
+enum triangle_sat_category
+{
+	triangle_sat_category_edge0,
+	triangle_sat_category_edge1,
+	triangle_sat_category_edge2,
+
+	triangle_sat_category_box_face,
+	triangle_sat_category_triangle_face,
+};
+
+struct triangle_sat_state
+{
+	w_float minPenetration;
+	w_vec3 minNormal;
+	w_float category;
+	uint32 separated;
+};
+
+static void testTriangleSATAxisSIMD(triangle_sat_state& state, const w_float& penetration, const w_vec3& normal, triangle_sat_category category)
+{
+	state.separated |= toBitMask(penetration < 0.f);
+
+	auto smaller = penetration < state.minPenetration;
+	state.minPenetration = ifThen(smaller, penetration, state.minPenetration);
+	state.minNormal = ifThen(smaller, normal, state.minNormal);
+	state.category = ifThen(smaller, w_float((float)category), state.category);
+}
+
+// Axis edge x triangle edge. The unnormalized axis is (0, -f.z, f.y) etc. Parallel edges produce a zero axis, which is skipped.
+static void testTriangleEdgeAxisSIMD(triangle_sat_state& state, const w_float& p0, const w_float& p1, const w_float& r, const w_vec3& axis, triangle_sat_category category)
+{
+	w_float penetration = r - maximum(-maximum(p0, p1), minimum(p0, p1));
+	w_float l = length(axis);
+	auto valid = l > EPSILON;
+
+	state.separated |= toBitMask(valid & (penetration < 0.f));
+
+	w_float invL = 1.f / ifThen(valid, l, w_float(1.f));
+	penetration *= invL;
+
+	auto smaller = valid & (penetration < state.minPenetration);
+	state.minPenetration = ifThen(smaller, penetration, state.minPenetration);
+	state.minNormal = ifThen(smaller, axis * invL, state.minNormal);
+	state.category = ifThen(smaller, w_float((float)category), state.category);
+}
+
+static uint32 collideAABBVsTrianglesSIMD(vec3 center, vec3 radius, const heightmap_triangle_batch& triangles, collision_contact* outContacts)
+{
+	w_vec3 wideCenter(center.x, center.y, center.z);
+	w_vec3 r(radius.x, radius.y, radius.z);
+
+	uint32 numContacts = 0;
+	for (uint32 i = 0; i < triangles.count; i += PHYSICS_SIMD_WIDTH)
+	{
+		uint32 validLanes = getValidTriangleLanes(triangles, i);
+
+		w_vec3 a, b, c;
+		loadTrianglesSIMD(triangles, i, a, b, c);
+		a = a - wideCenter;
+		b = b - wideCenter;
+		c = c - wideCenter;
+
+		w_vec3 f0 = b - a;
+		w_vec3 f1 = c - b;
+		w_vec3 f2 = a - c;
+
+		triangle_sat_state state;
+		state.minPenetration = FLT_MAX;
+		state.minNormal = w_vec3::zero();
+		state.category = w_float::zero();
+		state.separated = 0;
+
+		// The cheap axes come first, since most candidate triangles are already separated by them. See collideAABBvsTriangle for details.
+		w_vec3 triNormal = noz(cross(f0, f1));
+		w_float triD = dot(triNormal, a);
+		testTriangleSATAxisSIMD(state, dot(r, abs(triNormal)) - abs(triD), triNormal, triangle_sat_category_triangle_face);
+
+		testTriangleSATAxisSIMD(state, maximum(a.x, maximum(b.x, c.x)) + r.x, w_vec3(-1.f, 0.f, 0.f), triangle_sat_category_box_face);
+		testTriangleSATAxisSIMD(state, r.x - minimum(a.x, minimum(b.x, c.x)), w_vec3(1.f, 0.f, 0.f), triangle_sat_category_box_face);
+		testTriangleSATAxisSIMD(state, maximum(a.y, maximum(b.y, c.y)) + r.y, w_vec3(0.f, -1.f, 0.f), triangle_sat_category_box_face);
+		testTriangleSATAxisSIMD(state, r.y - minimum(a.y, minimum(b.y, c.y)), w_vec3(0.f, 1.f, 0.f), triangle_sat_category_box_face);
+		testTriangleSATAxisSIMD(state, maximum(a.z, maximum(b.z, c.z)) + r.z, w_vec3(0.f, 0.f, -1.f), triangle_sat_category_box_face);
+		testTriangleSATAxisSIMD(state, r.z - minimum(a.z, minimum(b.z, c.z)), w_vec3(0.f, 0.f, 1.f), triangle_sat_category_box_face);
+
+		if ((validLanes & ~state.separated) == 0)
+		{
+			continue;
+		}
+
+		w_float zero = w_float::zero();
+
+		// X axis x edges.
+		testTriangleEdgeAxisSIMD(state, a.z * f0.y - a.y * f0.z, c.z * f0.y - c.y * f0.z, r.y * abs(f0.z) + r.z * abs(f0.y), w_vec3(zero, -f0.z, f0.y), triangle_sat_category_edge0);
+		testTriangleEdgeAxisSIMD(state, a.z * f1.y - a.y * f1.z, b.z * f1.y - b.y * f1.z, r.y * abs(f1.z) + r.z * abs(f1.y), w_vec3(zero, -f1.z, f1.y), triangle_sat_category_edge1);
+		testTriangleEdgeAxisSIMD(state, a.z * f2.y - a.y * f2.z, b.z * f2.y - b.y * f2.z, r.y * abs(f2.z) + r.z * abs(f2.y), w_vec3(zero, -f2.z, f2.y), triangle_sat_category_edge2);
+
+		// Y axis x edges.
+		testTriangleEdgeAxisSIMD(state, a.x * f0.z - a.z * f0.x, c.x * f0.z - c.z * f0.x, r.x * abs(f0.z) + r.z * abs(f0.x), w_vec3(f0.z, zero, -f0.x), triangle_sat_category_edge0);
+		testTriangleEdgeAxisSIMD(state, a.x * f1.z - a.z * f1.x, b.x * f1.z - b.z * f1.x, r.x * abs(f1.z) + r.z * abs(f1.x), w_vec3(f1.z, zero, -f1.x), triangle_sat_category_edge1);
+		testTriangleEdgeAxisSIMD(state, a.x * f2.z - a.z * f2.x, b.x * f2.z - b.z * f2.x, r.x * abs(f2.z) + r.z * abs(f2.x), w_vec3(f2.z, zero, -f2.x), triangle_sat_category_edge2);
+
+		// Z axis x edges.
+		testTriangleEdgeAxisSIMD(state, a.y * f0.x - a.x * f0.y, c.y * f0.x - c.x * f0.y, r.x * abs(f0.y) + r.y * abs(f0.x), w_vec3(-f0.y, f0.x, zero), triangle_sat_category_edge0);
+		testTriangleEdgeAxisSIMD(state, a.y * f1.x - a.x * f1.y, b.y * f1.x - b.x * f1.y, r.x * abs(f1.y) + r.y * abs(f1.x), w_vec3(-f1.y, f1.x, zero), triangle_sat_category_edge1);
+		testTriangleEdgeAxisSIMD(state, a.y * f2.x - a.x * f2.y, b.y * f2.x - b.x * f2.y, r.x * abs(f2.y) + r.y * abs(f2.x), w_vec3(-f2.y, f2.x, zero), triangle_sat_category_edge2);
+
+		uint32 mask = validLanes & ~state.separated;
+		if (!mask)
+		{
+			continue;
+		}
+
+		w_float penetration = state.minPenetration;
+		w_vec3 normal = state.minNormal;
+		w_float category = state.category;
+
+		w_vec3 triCenter = (a + b + c) * w_float(1.f / 3.f);
+		normal = ifThen(dot(normal, triCenter) < 0.f, -normal, normal);
+
+		w_vec3 signs(
+			ifThen(normal.x < 0.f, w_float(-1.f), w_float(1.f)),
+			ifThen(normal.y < 0.f, w_float(-1.f), w_float(1.f)),
+			ifThen(normal.z < 0.f, w_float(-1.f), w_float(1.f)));
+
+
+		// Edge vs edge. See getAABBIncidentEdge.
+		w_vec3 edgePoint;
+		{
+			w_vec3 p = abs(normal);
+
+			w_vec3 boxA = r;
+			w_vec3 flipZ(r.x, r.y, -r.z);
+			w_vec3 flipY(r.x, -r.y, r.z);
+			w_vec3 flipX(-r.x, r.y, r.z);
+			w_vec3 boxB = ifThen(p.x > p.y, ifThen(p.y > p.z, flipZ, flipY), ifThen(p.x > p.z, flipZ, flipX));
+
+			boxA = boxA * signs;
+			boxB = boxB * signs;
+
+			auto isEdge0 = (category == (float)triangle_sat_category_edge0);
+			auto isEdge1 = (category == (float)triangle_sat_category_edge1);
+			w_vec3 triA = ifThen(isEdge0, a, ifThen(isEdge1, b, c));
+			w_vec3 triB = ifThen(isEdge0, b, ifThen(isEdge1, c, a));
+
+			w_vec3 pa, pb;
+			closestPoint_SegmentSegment(w_line_segment{ boxA, boxB }, w_line_segment{ triA, triB }, pa, pb);
+
+			edgePoint = (pa + pb) * w_float(0.5f);
+		}
+
+		// Box face. The deepest triangle vertex, moved halfway out.
+		w_vec3 boxFacePoint;
+		{
+			w_float da = dot(normal, a);
+			w_float db = dot(normal, b);
+			w_float dc = dot(normal, c);
+
+			w_vec3 p = ifThen(da < db, ifThen(da < dc, a, c), ifThen(db < dc, b, c));
+			boxFacePoint = p + normal * (penetration * 0.5f);
+		}
+
+		// Triangle face. The deepest box corner, moved halfway out.
+		w_vec3 triangleFacePoint = r * signs - normal * (penetration * 0.5f);
+
+		w_vec3 point = ifThen(category < (float)triangle_sat_category_box_face, edgePoint,
+			ifThen(category == (float)triangle_sat_category_box_face, boxFacePoint, triangleFacePoint));
+
+		point = point + wideCenter;
+
+		numContacts += writeTriangleContactsSIMD(point, penetration, normal, mask, outContacts + numContacts);
+	}
+	return numContacts;
+}
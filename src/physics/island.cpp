@@ -1,19 +1,25 @@
 #include "pch.h"
 #include "island.h"
+#include "rigid_body.h"
 #include "core/cpu_profiling.h"
 
-void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 numBodyPairs, uint32 numRigidBodies, uint16 dummyRigidBodyIndex, const constraint_offsets& offsets)
+island_description buildIslands(memory_arena& arena, const constraint_body_pair* bodyPairs, uint32 numBodyPairs,
+	const rigid_body_global_state* rbs, uint32 numRigidBodies, physics_index dummyRigidBodyIndex)
 {
 	CPU_PROFILE_BLOCK("Build islands");
 
 	uint32 islandCapacity = numBodyPairs;
-	uint16* allIslands = arena.allocate<uint16>(islandCapacity);
+	uint32* allIslands = arena.allocate<uint32>(islandCapacity);
+	uint32* islandOffsets = arena.allocate<uint32>(numRigidBodies + 1);
+	physics_index* allIslandBodies = arena.allocate<physics_index>(numRigidBodies);
+	uint32* islandBodyOffsets = arena.allocate<uint32>(numRigidBodies + 1);
 
 	memory_marker marker = arena.getMarker();
 
 	uint32 count = numRigidBodies + 1; // 1 for the dummy.
 
-	uint16* numConstraintsPerBody = arena.allocate<uint16>(count, true);
+	// The per-body counts and offsets are bounded by the number of body pairs, not by the number of bodies.
+	uint32* numConstraintsPerBody = arena.allocate<uint32>(count, true);
 
 	for (uint32 i = 0; i < numBodyPairs; ++i)
 	{
@@ -22,9 +28,9 @@ void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 n
 		++numConstraintsPerBody[pair.rbB];
 	}
 
-	uint16* offsetToFirstConstraintPerBody = arena.allocate<uint16>(count);
+	uint32* offsetToFirstConstraintPerBody = arena.allocate<uint32>(count);
 
-	uint16 currentOffset = 0;
+	uint32 currentOffset = 0;
 	for (uint32 i = 0; i < count; ++i)
 	{
 		offsetToFirstConstraintPerBody[i] = currentOffset;
@@ -33,39 +39,51 @@ void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 n
 
 	struct body_pair_reference
 	{
-		uint16 otherBody;
-		uint16 pairIndex;
+		physics_index otherBody;
+		uint32 pairIndex;
 	};
 
 	body_pair_reference* pairReferences = arena.allocate<body_pair_reference>(numBodyPairs * 2);
-	uint16* counter = arena.allocate<uint16>(count);
-	memcpy(counter, offsetToFirstConstraintPerBody, sizeof(uint16) * count);
+	uint32* counter = arena.allocate<uint32>(count);
+	memcpy(counter, offsetToFirstConstraintPerBody, sizeof(uint32) * count);
 
 	for (uint32 i = 0; i < numBodyPairs; ++i)
 	{
 		constraint_body_pair pair = bodyPairs[i];
-		pairReferences[counter[pair.rbA]++] = { pair.rbB, (uint16)i };
-		pairReferences[counter[pair.rbB]++] = { pair.rbA, (uint16)i };
+		pairReferences[counter[pair.rbA]++] = { pair.rbB, i };
+		pairReferences[counter[pair.rbB]++] = { pair.rbA, i };
 	}
 
 
-	uint16* rbStack = arena.allocate<uint16>(count);
+	// Static and kinematic bodies behave like the dummy. They are not affected by the solver, so we don't grow islands over them.
+	bool* isStatic = arena.allocate<bool>(count);
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		isStatic[i] = (rbs[i].invMass == 0.f);
+	}
+	isStatic[dummyRigidBodyIndex] = true;
+
+
+	physics_index* rbStack = arena.allocate<physics_index>(count);
 	uint32 stackPtr;
 
 	bool* alreadyVisited = arena.allocate<bool>(count, true);
 	bool* alreadyOnStack = arena.allocate<bool>(count, true);
 
 	uint32 islandPtr = 0;
+	uint32 islandBodyPtr = 0;
+	uint32 numIslands = 0;
 
-	for (uint16 rbIndexOuter = 0; rbIndexOuter < (uint16)numRigidBodies; ++rbIndexOuter)
+	for (physics_index rbIndexOuter = 0; rbIndexOuter < (physics_index)numRigidBodies; ++rbIndexOuter)
 	{
-		if (alreadyVisited[rbIndexOuter] || rbIndexOuter == dummyRigidBodyIndex)
+		if (alreadyVisited[rbIndexOuter] || isStatic[rbIndexOuter])
 		{
 			continue;
 		}
 
 		// Reset island.
 		uint32 islandStart = islandPtr;
+		uint32 islandBodyStart = islandBodyPtr;
 
 		rbStack[0] = rbIndexOuter;
 		alreadyOnStack[rbIndexOuter] = true;
@@ -75,12 +93,14 @@ void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 n
 
 		while (stackPtr != 0)
 		{
-			uint16 rbIndex = rbStack[--stackPtr];
+			physics_index rbIndex = rbStack[--stackPtr];
 
-			ASSERT(rbIndex != dummyRigidBodyIndex);
+			ASSERT(!isStatic[rbIndex]);
 			ASSERT(!alreadyVisited[rbIndex]);
 			alreadyVisited[rbIndex] = true;
 
+			allIslandBodies[islandBodyPtr++] = rbIndex;
+
 
 			// Push connected bodies.
 			uint32 startIndex = offsetToFirstConstraintPerBody[rbIndex];
@@ -88,8 +108,8 @@ void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 n
 			for (uint32 i = startIndex; i < startIndex + count; ++i)
 			{
 				body_pair_reference ref = pairReferences[i];
-				uint16 other = ref.otherBody;
-				if (!alreadyOnStack[other] && other != dummyRigidBodyIndex) // Don't push dummy to stack. We don't want to grow islands over the dummy.
+				physics_index other = ref.otherBody;
+				if (!alreadyOnStack[other] && !isStatic[other]) // Don't push static bodies to stack. We don't want to grow islands over them.
 				{
 					alreadyOnStack[other] = true;
 					rbStack[stackPtr++] = other;
@@ -109,21 +129,42 @@ void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 n
 		uint32 islandSize = islandPtr - islandStart;
 		if (islandSize > 0)
 		{
-			uint16* islandPairs = allIslands + islandStart;
+			uint32* islandPairs = allIslands + islandStart;
 			std::sort(islandPairs, islandPairs + islandSize);
 
+			// Sort bodies as well, so that the order within an island does not depend on the traversal.
+			physics_index* islandBodies = allIslandBodies + islandBodyStart;
+			std::sort(islandBodies, islandBodies + (islandBodyPtr - islandBodyStart));
 
+			islandOffsets[numIslands] = islandStart;
+			islandBodyOffsets[numIslands] = islandBodyStart;
+			++numIslands;
+		}
+		else
+		{
+			// Body without constraints. Nothing to solve here.
+			islandBodyPtr = islandBodyStart;
 		}
 	}
 
+	islandOffsets[numIslands] = islandPtr;
+	islandBodyOffsets[numIslands] = islandBodyPtr;
+
 
 #if 0
-	ASSERT(islandPtr == islandCapacity);
 	for (uint32 i = 0; i < numRigidBodies; ++i)
 	{
-		ASSERT(alreadyVisited[i]);
+		ASSERT(alreadyVisited[i] || isStatic[i]);
 	}
 #endif
 
 	arena.resetToMarker(marker);
+
+	island_description result;
+	result.allIslands = allIslands;
+	result.islandOffsets = islandOffsets;
+	result.allIslandBodies = allIslandBodies;
+	result.islandBodyOffsets = islandBodyOffsets;
+	result.numIslands = numIslands;
+	return result;
 }
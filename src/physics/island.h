@@ -2,10 +2,28 @@
 
 #include "constraints.h"
 
+struct rigid_body_global_state;
+
 struct constraint_offsets
 {
 	// Must be in order.
 	uint32 constraintOffsets[constraint_type_count];
 };
 
-void buildIslands(memory_arena& arena, constraint_body_pair* bodyPairs, uint32 numBodyPairs, uint32 numRigidBodies, uint16 dummyRigidBodyIndex, const constraint_offsets& offsets);
+struct island_description
+{
+	// Indices into the body pair array passed to buildIslands. Sorted within each island.
+	// The number of body pairs includes all contacts, so these are 32 bit even if the body indices are not.
+	uint32* allIslands;
+	uint32* islandOffsets;		// numIslands + 1 many. Island i covers allIslands[islandOffsets[i]] to allIslands[islandOffsets[i + 1]].
+
+	// Dynamic rigid bodies of each island. Static and kinematic bodies (and the dummy) are not part of any island,
+	// since we don't want to grow islands over them. They may therefore be referenced by constraints of multiple islands.
+	physics_index* allIslandBodies;
+	uint32* islandBodyOffsets;	// numIslands + 1 many.
+
+	uint32 numIslands;
+};
+
+island_description buildIslands(memory_arena& arena, const constraint_body_pair* bodyPairs, uint32 numBodyPairs,
+	const rigid_body_global_state* rbs, uint32 numRigidBodies, physics_index dummyRigidBodyIndex);
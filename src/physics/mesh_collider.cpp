@@ -0,0 +1,179 @@
+#include "pch.h"
+#include "mesh_collider.h"
+
+#ifndef PHYSICS_ONLY
+#include "asset/model_asset.h"
+#endif
+
+struct mesh_collider_build_triangle
+{
+	bounding_box aabb;
+	vec3 center;
+	uint32 index;
+};
+
+void mesh_collider_geometry::quantize(const bounding_box& box, uint16* outMin, uint16* outMax) const
+{
+	vec3 quantizedMin = (box.minCorner - aabb.minCorner) * quantizationScale;
+	vec3 quantizedMax = (box.maxCorner - aabb.minCorner) * quantizationScale;
+
+	for (uint32 i = 0; i < 3; ++i)
+	{
+		outMin[i] = (uint16)clamp(floor(quantizedMin.data[i]), 0.f, (float)UINT16_MAX);
+		outMax[i] = (uint16)clamp(ceil(quantizedMax.data[i]), 0.f, (float)UINT16_MAX);
+	}
+}
+
+// Median split along the longest axis of the triangle centers. This keeps the tree balanced, so the recursion depth is logarithmic.
+void mesh_collider_geometry::buildNodes(mesh_collider_build_triangle* buildTriangles, uint32 first, uint32 count)
+{
+	bounding_box bounds = bounding_box::negativeInfinity();
+	bounding_box centerBounds = bounding_box::negativeInfinity();
+	for (uint32 i = first; i < first + count; ++i)
+	{
+		bounds.grow(buildTriangles[i].aabb.minCorner);
+		bounds.grow(buildTriangles[i].aabb.maxCorner);
+		centerBounds.grow(buildTriangles[i].center);
+	}
+
+	// Children are pushed while building, so only access the node by index.
+	uint32 nodeIndex = (uint32)nodes.size();
+	nodes.emplace_back();
+	quantize(bounds, nodes[nodeIndex].quantizedMin, nodes[nodeIndex].quantizedMax);
+
+	if (count <= MESH_COLLIDER_MAX_TRIANGLES_PER_LEAF)
+	{
+		nodes[nodeIndex].offset = first;
+		nodes[nodeIndex].numTriangles = count;
+		return;
+	}
+
+	vec3 extent = centerBounds.maxCorner - centerBounds.minCorner;
+	uint32 axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+	uint32 half = count / 2;
+	std::nth_element(buildTriangles + first, buildTriangles + first + half, buildTriangles + first + count,
+		[axis](const mesh_collider_build_triangle& a, const mesh_collider_build_triangle& b)
+		{
+			return a.center.data[axis] < b.center.data[axis];
+		});
+
+	buildNodes(buildTriangles, first, half);
+	buildNodes(buildTriangles, first + half, count - half);
+
+	nodes[nodeIndex].offset = (uint32)nodes.size();
+	nodes[nodeIndex].numTriangles = 0;
+}
+
+ref<mesh_collider_geometry> mesh_collider_geometry::fromTriangles(const vec3* positions, uint32 numVertices, const indexed_triangle32* triangles, uint32 numTriangles, float scale)
+{
+	// The escape indices of the inner nodes go up to the number of nodes, which is less than 2 * numTriangles.
+	ASSERT((uint64)numTriangles * 2 < (1ull << 29));
+
+	ref<mesh_collider_geometry> result = make_ref<mesh_collider_geometry>();
+
+	result->vertices.resize(numVertices);
+	result->aabb = bounding_box::negativeInfinity();
+	for (uint32 i = 0; i < numVertices; ++i)
+	{
+		result->vertices[i] = positions[i] * scale;
+		result->aabb.grow(result->vertices[i]);
+	}
+
+	std::vector<mesh_collider_build_triangle> buildTriangles;
+	buildTriangles.reserve(numTriangles);
+	for (uint32 i = 0; i < numTriangles; ++i)
+	{
+		indexed_triangle32 tri = triangles[i];
+		ASSERT(tri.a < numVertices && tri.b < numVertices && tri.c < numVertices);
+
+		vec3 a = result->vertices[tri.a];
+		vec3 b = result->vertices[tri.b];
+		vec3 c = result->vertices[tri.c];
+
+		if (squaredLength(cross(b - a, c - a)) < 1e-12f)
+		{
+			continue;
+		}
+
+		mesh_collider_build_triangle& buildTriangle = buildTriangles.emplace_back();
+		buildTriangle.aabb = bounding_box::negativeInfinity();
+		buildTriangle.aabb.grow(a);
+		buildTriangle.aabb.grow(b);
+		buildTriangle.aabb.grow(c);
+		buildTriangle.center = (a + b + c) * (1.f / 3.f);
+		buildTriangle.index = i;
+	}
+
+	if (buildTriangles.empty())
+	{
+		return result;
+	}
+
+	vec3 extent = result->aabb.maxCorner - result->aabb.minCorner;
+	result->quantizationScale = vec3((float)UINT16_MAX) / max(extent, vec3(1e-6f));
+
+	result->nodes.reserve(2 * buildTriangles.size() / MESH_COLLIDER_MAX_TRIANGLES_PER_LEAF + 1);
+	result->buildNodes(buildTriangles.data(), 0, (uint32)buildTriangles.size());
+
+	result->triangles.resize(buildTriangles.size());
+	for (uint32 i = 0; i < (uint32)buildTriangles.size(); ++i)
+	{
+		result->triangles[i] = triangles[buildTriangles[i].index];
+	}
+
+	return result;
+}
+
+#ifndef PHYSICS_ONLY
+
+ref<mesh_collider_geometry> mesh_collider_geometry::fromSubmeshes(const std::vector<submesh_asset>& submeshes, float scale)
+{
+	std::vector<vec3> positions;
+	std::vector<indexed_triangle32> triangles;
+
+	for (const submesh_asset& sub : submeshes)
+	{
+		uint32 baseVertex = (uint32)positions.size();
+		positions.insert(positions.end(), sub.positions.begin(), sub.positions.end());
+
+		for (indexed_triangle16 tri : sub.triangles)
+		{
+			triangles.push_back({ baseVertex + tri.a, baseVertex + tri.b, baseVertex + tri.c });
+		}
+	}
+
+	return fromTriangles(positions.data(), (uint32)positions.size(), triangles.data(), (uint32)triangles.size(), scale);
+}
+
+ref<mesh_collider_geometry> loadMeshColliderGeometry(const fs::path& meshFilepath, float scale)
+{
+	model_asset asset = load3DModelFromFile(meshFilepath);
+
+	std::vector<submesh_asset> submeshes;
+	for (mesh_asset& mesh : asset.meshes)
+	{
+		for (submesh_asset& sub : mesh.submeshes)
+		{
+			submeshes.push_back(std::move(sub));
+		}
+	}
+
+	ref<mesh_collider_geometry> geometry = mesh_collider_geometry::fromSubmeshes(submeshes, scale);
+	return geometry->triangles.empty() ? 0 : geometry;
+}
+
+#endif
+
+mesh_collider_component::mesh_collider_component(ref<mesh_collider_geometry> geometry, quat rotation, vec3 position, physics_material material)
+	: geometry(geometry), material(material)
+{
+	setTransform(rotation, position);
+}
+
+void mesh_collider_component::setTransform(quat rotation, vec3 position)
+{
+	this->rotation = rotation;
+	this->position = position;
+	worldSpaceAABB = geometry ? geometry->aabb.transformToAABB(rotation, position) : bounding_box::negativeInfinity();
+}
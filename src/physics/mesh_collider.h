@@ -0,0 +1,151 @@
+#pragma once
+
+#include "core/math.h"
+#include "bounding_volumes.h"
+#include "physics.h"
+
+// Static triangle mesh collider for level geometry. Like heightmaps, mesh colliders are not part of the broadphase. Each collider queries
+// the triangles in its AABB from a quantized BVH and is tested against them with the heightmap triangle tests (see heightmap_collision.cpp).
+// One mesh can replace hundreds of static boxes or hulls in the broadphase.
+// Like heightmaps, they are tested by the scene queries (and therefore by the continuous collision detection). Snapshots save their transforms.
+
+struct mesh_collider_bvh_node
+{
+	// Relative to the AABB of the mesh. Rounded outwards, so that the nodes are conservative.
+	uint16 quantizedMin[3];
+	uint16 quantizedMax[3];
+
+	// The nodes are stored in depth-first order, so the left child of an inner node directly follows it.
+	// Leaves store their first triangle. Inner nodes store the index of the node after their subtree, where the traversal continues if the node is missed.
+	uint32 offset : 29;
+	uint32 numTriangles : 3; // 0 for inner nodes.
+};
+
+static_assert(sizeof(mesh_collider_bvh_node) == 16);
+
+#define MESH_COLLIDER_MAX_TRIANGLES_PER_LEAF 4
+
+struct mesh_collider_geometry
+{
+	// The scale is baked into the vertices. Degenerate triangles are removed.
+	static ref<mesh_collider_geometry> fromTriangles(const vec3* positions, uint32 numVertices, const indexed_triangle32* triangles, uint32 numTriangles, float scale = 1.f);
+
+#ifndef PHYSICS_ONLY
+	// Merges all submeshes into one collider.
+	static ref<mesh_collider_geometry> fromSubmeshes(const std::vector<struct submesh_asset>& submeshes, float scale = 1.f);
+#endif
+
+	// The volume and triangles are in the local space of the mesh.
+	template <typename callback_func>
+	void iterateTrianglesInVolume(const bounding_box& volume, const callback_func& func) const;
+
+	bounding_box aabb;
+
+	std::vector<vec3> vertices;
+	std::vector<indexed_triangle32> triangles; // Sorted, so that the triangles of each leaf are contiguous.
+	std::vector<mesh_collider_bvh_node> nodes;
+
+private:
+	void buildNodes(struct mesh_collider_build_triangle* buildTriangles, uint32 first, uint32 count);
+	void quantize(const bounding_box& box, uint16* outMin, uint16* outMax) const;
+
+	vec3 quantizationScale;
+};
+
+#ifndef PHYSICS_ONLY
+// Builds the geometry from all meshes in the file. Returns null, if the file contains no triangles.
+ref<mesh_collider_geometry> loadMeshColliderGeometry(const fs::path& meshFilepath, float scale = 1.f);
+#endif
+
+struct mesh_collider_component
+{
+	mesh_collider_component(ref<mesh_collider_geometry> geometry, quat rotation, vec3 position, physics_material material);
+
+	// The volume and triangles are in world space.
+	template <typename callback_func>
+	void iterateTrianglesInVolume(const bounding_box& volume, const callback_func& func) const;
+
+	// Also updates the world space AABB.
+	void setTransform(quat rotation, vec3 position);
+
+	quat getRotation() const { return rotation; }
+	vec3 getPosition() const { return position; }
+	bounding_box getAABB() const { return worldSpaceAABB; }
+
+	ref<mesh_collider_geometry> geometry;
+	physics_material material;
+
+private:
+	quat rotation;
+	vec3 position;
+	bounding_box worldSpaceAABB;
+};
+
+
+
+template <typename callback_func>
+inline void mesh_collider_geometry::iterateTrianglesInVolume(const bounding_box& volume, const callback_func& func) const
+{
+	if (nodes.empty() || !aabbVsAABB(volume, aabb))
+	{
+		return;
+	}
+
+	uint16 volMin[3], volMax[3];
+	quantize(volume, volMin, volMax);
+
+	uint32 numNodes = (uint32)nodes.size();
+
+	// Stackless traversal: Missed inner nodes skip their subtree, everything else continues with the next node.
+	uint32 nodeIndex = 0;
+	while (nodeIndex < numNodes)
+	{
+		const mesh_collider_bvh_node& node = nodes[nodeIndex];
+
+		bool overlap = node.quantizedMin[0] <= volMax[0] && node.quantizedMax[0] >= volMin[0]
+			&& node.quantizedMin[1] <= volMax[1] && node.quantizedMax[1] >= volMin[1]
+			&& node.quantizedMin[2] <= volMax[2] && node.quantizedMax[2] >= volMin[2];
+
+		if (!overlap)
+		{
+			nodeIndex = node.numTriangles ? nodeIndex + 1 : node.offset;
+			continue;
+		}
+
+		for (uint32 i = node.offset, end = node.offset + node.numTriangles; i < end; ++i)
+		{
+			vec3 a = vertices[triangles[i].a];
+			vec3 b = vertices[triangles[i].b];
+			vec3 c = vertices[triangles[i].c];
+
+			// The leaf bounds are shared by all its triangles, so test each one exactly.
+			if (min(a.x, min(b.x, c.x)) > volume.maxCorner.x || max(a.x, max(b.x, c.x)) < volume.minCorner.x
+				|| min(a.y, min(b.y, c.y)) > volume.maxCorner.y || max(a.y, max(b.y, c.y)) < volume.minCorner.y
+				|| min(a.z, min(b.z, c.z)) > volume.maxCorner.z || max(a.z, max(b.z, c.z)) < volume.minCorner.z)
+			{
+				continue;
+			}
+
+			func(a, b, c);
+		}
+
+		++nodeIndex;
+	}
+}
+
+template <typename callback_func>
+inline void mesh_collider_component::iterateTrianglesInVolume(const bounding_box& volume, const callback_func& func) const
+{
+	if (!geometry || !aabbVsAABB(volume, worldSpaceAABB))
+	{
+		return;
+	}
+
+	quat invRotation = conjugate(rotation);
+	bounding_box localVolume = volume.transformToAABB(invRotation, invRotation * -position);
+
+	geometry->iterateTrianglesInVolume(localVolume, [this, &func](vec3 a, vec3 b, vec3 c)
+	{
+		func(rotation * a + position, rotation * b + position, rotation * c + position);
+	});
+}
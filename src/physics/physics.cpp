@@ -3,12 +3,21 @@
 #include "collision_broad.h"
 #include "collision_narrow.h"
 #include "heightmap_collision.h"
+#include "island.h"
+#include "scene_query.h"
+#include "physics_simd.h"
+#include "physics_snapshot.h"
 #include "core/cpu_profiling.h"
+#include "core/timer.h"
 
 #ifndef PHYSICS_ONLY
 #include "core/log.h"
 #endif
 
+#ifdef PHYSICS_USE_JOB_SYSTEM
+#include "core/job_system.h"
+#endif
+
 #include <unordered_set>
 
 static std::vector<bounding_hull_geometry> boundingHullGeometries;
@@ -16,14 +25,14 @@ static std::vector<bounding_hull_geometry> boundingHullGeometries;
 struct constraint_context
 {
 	std::vector<constraint_edge> constraintEdges;
-	uint16 firstFreeConstraintEdge = INVALID_CONSTRAINT_EDGE; // Free-list in constraintEdges array.
+	uint32 firstFreeConstraintEdge = INVALID_CONSTRAINT_EDGE; // Free-list in constraintEdges array.
 
 
 	constraint_edge& getFreeConstraintEdge()
 	{
 		if (firstFreeConstraintEdge == INVALID_CONSTRAINT_EDGE)
 		{
-			firstFreeConstraintEdge = (uint16)constraintEdges.size();
+			firstFreeConstraintEdge = (uint32)constraintEdges.size();
 			constraintEdges.push_back(constraint_edge{ entt::null, constraint_type_none, INVALID_CONSTRAINT_EDGE, INVALID_CONSTRAINT_EDGE });
 		}
 
@@ -38,7 +47,7 @@ struct constraint_context
 
 	void freeConstraintEdge(constraint_edge& edge)
 	{
-		uint16 index = (uint16)(&edge - constraintEdges.data());
+		uint32 index = (uint32)(&edge - constraintEdges.data());
 		edge.nextConstraintEdge = firstFreeConstraintEdge;
 		firstFreeConstraintEdge = index;
 	}
@@ -49,6 +58,13 @@ struct force_field_global_state
 	vec3 force;
 };
 
+uint32 allocateBoundingHullGeometry(bounding_hull_geometry&& geometry)
+{
+	uint32 index = (uint32)boundingHullGeometries.size();
+	boundingHullGeometries.push_back(std::move(geometry));
+	return index;
+}
+
 #ifndef PHYSICS_ONLY
 // This is a bit dirty. PHYSICS_ONLY is defined when building the learning DLL, where we don't need bounding hulls.
 
@@ -74,13 +90,14 @@ uint32 allocateBoundingHullGeometry(const std::string& meshFilepath)
 		}
 	}
 
-	uint32 index = (uint32)boundingHullGeometries.size();
-	boundingHullGeometries.push_back(bounding_hull_geometry::fromMesh(
-		builder.getPositions(),
-		builder.getNumVertices(),
-		(indexed_triangle16*)builder.getTriangles(),
-		builder.getNumTriangles()));
-	return index;
+	// Artist meshes are neither guaranteed to be convex nor to be low-poly, so build a budgeted hull from the vertices.
+	bounding_hull_geometry geometry = bounding_hull_geometry::fromPoints(builder.getPositions(), builder.getNumVertices());
+	if (geometry.vertices.empty())
+	{
+		return INVALID_BOUNDING_HULL_INDEX;
+	}
+
+	return allocateBoundingHullGeometry(std::move(geometry));
 }
 #endif
 
@@ -96,7 +113,7 @@ static void addConstraintEdge(scene_entity& e, constraint_entity_reference_compo
 	constraint_context& context = createOrGetContextVariable<constraint_context>(*e.registry);
 
 	constraint_edge& edge = context.getFreeConstraintEdge();
-	uint16 edgeIndex = (uint16)(&edge - context.constraintEdges.data());
+	uint32 edgeIndex = (uint32)(&edge - context.constraintEdges.data());
 
 	edge.constraintEntity = constraintEntity;
 	edge.type = type;
@@ -628,131 +645,194 @@ void testPhysicsInteraction(game_scene& scene, ray r, float strength)
 	}
 }
 
-static void getWorldSpaceColliders(game_scene& scene, bounding_box* outWorldspaceAABBs, collider_union* outWorldSpaceColliders, uint16 dummyRigidBodyIndex)
+void getWorldSpaceCollider(const collider_component& collider, const trs& transform, collider_union& outCollider, bounding_box& outAABB)
+{
+	outCollider.type = collider.type;
+	outCollider.material = collider.material;
+	outCollider.layer = collider.layer;
+
+	switch (collider.type)
+	{
+		case collider_type_sphere:
+		{
+			vec3 center = transform.position + transform.rotation * collider.sphere.center;
+			outAABB = bounding_box::fromCenterRadius(center, collider.sphere.radius);
+			outCollider.sphere = { center, collider.sphere.radius };
+		} break;
+
+		case collider_type_capsule:
+		{
+			vec3 posA = transform.rotation * collider.capsule.positionA + transform.position;
+			vec3 posB = transform.rotation * collider.capsule.positionB + transform.position;
+
+			float radius = collider.capsule.radius;
+			vec3 radius3(radius);
+
+			outAABB = bounding_box::negativeInfinity();
+			outAABB.grow(posA + radius3);
+			outAABB.grow(posA - radius3);
+			outAABB.grow(posB + radius3);
+			outAABB.grow(posB - radius3);
+
+			outCollider.capsule = { posA, posB, radius };
+		} break;
+
+		case collider_type_cylinder:
+		{
+			vec3 posA = transform.rotation * collider.cylinder.positionA + transform.position;
+			vec3 posB = transform.rotation * collider.cylinder.positionB + transform.position;
+			float radius = collider.cylinder.radius;
+
+			vec3 a = posB - posA;
+			float aa = dot(a, a);
+
+			float x = 1.f - a.x * a.x / aa;
+			float y = 1.f - a.y * a.y / aa;
+			float z = 1.f - a.z * a.z / aa;
+			x = sqrt(max(0.f, x));
+			y = sqrt(max(0.f, y));
+			z = sqrt(max(0.f, z));
+
+			vec3 e = radius * vec3(x, y, z);
+
+			outAABB = bounding_box::fromMinMax(min(posA - e, posB - e), max(posA + e, posB + e));
+
+			outCollider.cylinder = { posA, posB, radius };
+		} break;
+
+		case collider_type_aabb:
+		{
+			outAABB = collider.aabb.transformToAABB(transform.rotation, transform.position);
+			if (transform.rotation == quat::identity)
+			{
+				outCollider.aabb = outAABB;
+			}
+			else
+			{
+				outCollider.type = collider_type_obb;
+				outCollider.obb = collider.aabb.transformToOBB(transform.rotation, transform.position);
+			}
+		} break;
+
+		case collider_type_obb:
+		{
+			outAABB = collider.obb.transformToAABB(transform.rotation, transform.position);
+			outCollider.obb = collider.obb.transformToOBB(transform.rotation, transform.position);
+		} break;
+
+		case collider_type_hull:
+		{
+			const bounding_hull_geometry& geometry = boundingHullGeometries[collider.hull.geometryIndex];
+
+			quat rotation = transform.rotation * collider.hull.rotation;
+			vec3 position = transform.rotation * collider.hull.position + transform.position;
+
+			outAABB = geometry.aabb.transformToAABB(rotation, position);
+			outCollider.hull.rotation = rotation;
+			outCollider.hull.position = position;
+			outCollider.hull.geometryPtr = &geometry;
+		} break;
+	}
+}
+
+// Sleeping bodies don't move, so their world space colliders are kept from the first frame in which they were seen asleep.
+// Indexed like the colliders. A slot is only valid, if it stores the current collider entity.
+struct sleeping_collider_cache_context
+{
+	std::vector<entity_handle> colliderEntities;
+	std::vector<collider_union> colliders;
+	std::vector<bounding_box> aabbs;
+};
+
+static void getWorldSpaceColliders(game_scene& scene, bounding_box* outWorldspaceAABBs, collider_union* outWorldSpaceColliders, broadphase_collider_state* outStates, 
+	uint32* outSleepIslands, physics_index dummyRigidBodyIndex)
 {
 	CPU_PROFILE_BLOCK("Get world space colliders");
 
+	uint32 numColliders = scene.numberOfComponentsOfType<collider_component>();
+
+	sleeping_collider_cache_context& cache = scene.createOrGetContextVariable<sleeping_collider_cache_context>();
+	cache.colliderEntities.resize(numColliders, entt::null);
+	cache.colliders.resize(numColliders);
+	cache.aabbs.resize(numColliders);
+
+	uint32 numCached = 0;
 	uint32 pushIndex = 0;
 
 	for (auto [entityHandle, collider] : scene.view<collider_component>().each())
 	{
-		bounding_box& bb = outWorldspaceAABBs[pushIndex];
-		collider_union& col = outWorldSpaceColliders[pushIndex];
-		++pushIndex;
+		uint32 index = pushIndex++;
+		bounding_box& bb = outWorldspaceAABBs[index];
+		collider_union& col = outWorldSpaceColliders[index];
+		broadphase_collider_state& state = outStates[index];
 
 		scene_entity entity = { collider.parentEntity, scene };
 
-		physics_transform1_component* physicsTransformComponent = entity.getComponentIfExists<physics_transform1_component>();
-		transform_component* transformComponent = entity.getComponentIfExists<transform_component>();
-		const trs& transform = physicsTransformComponent ? *physicsTransformComponent : transformComponent ? *transformComponent : trs::identity;
-
-		col.type = collider.type;
-		col.material = collider.material;
+		physics_object_type objectType;
+		physics_index objectIndex;
+		state = broadphase_collider_awake;
+		outSleepIslands[index] = INVALID_SLEEP_ISLAND;
 
-		if (entity.hasComponent<rigid_body_component>())
+		if (rigid_body_component* rb = entity.getComponentIfExists<rigid_body_component>())
 		{
-			col.objectIndex = (uint16)entity.getComponentIndex<rigid_body_component>();
-			col.objectType = physics_object_type_rigid_body;
+			objectIndex = (physics_index)entity.getComponentIndex<rigid_body_component>();
+			objectType = physics_object_type_rigid_body;
+			state = rb->isSleeping() ? broadphase_collider_sleeping : broadphase_collider_awake;
+			outSleepIslands[index] = rb->sleepIsland;
 		}
 		else if (entity.hasComponent<force_field_component>())
 		{
-			col.objectIndex = (uint16)entity.getComponentIndex<force_field_component>();
-			col.objectType = physics_object_type_force_field;
+			objectIndex = (physics_index)entity.getComponentIndex<force_field_component>();
+			objectType = physics_object_type_force_field;
 		}
 		else if (entity.hasComponent<trigger_component>())
 		{
-			col.objectIndex = (uint16)entity.getComponentIndex<trigger_component>();
-			col.objectType = physics_object_type_trigger;
+			objectIndex = (physics_index)entity.getComponentIndex<trigger_component>();
+			objectType = physics_object_type_trigger;
 		}
 		else
 		{
-			col.objectIndex = dummyRigidBodyIndex;
-			col.objectType = physics_object_type_static_collider;
+			objectIndex = dummyRigidBodyIndex;
+			objectType = physics_object_type_static_collider;
+			state = broadphase_collider_static;
 		}
 
-		switch (collider.type)
+		if (state == broadphase_collider_sleeping && cache.colliderEntities[index] == entityHandle)
 		{
-			case collider_type_sphere:
-			{
-				vec3 center = transform.position + transform.rotation * collider.sphere.center;
-				bb = bounding_box::fromCenterRadius(center, collider.sphere.radius);
-				col.sphere = { center, collider.sphere.radius };
-			} break;
-
-			case collider_type_capsule:
-			{
-				vec3 posA = transform.rotation * collider.capsule.positionA + transform.position;
-				vec3 posB = transform.rotation * collider.capsule.positionB + transform.position;
-
-				float radius = collider.capsule.radius;
-				vec3 radius3(radius);
-
-				bb = bounding_box::negativeInfinity();
-				bb.grow(posA + radius3);
-				bb.grow(posA - radius3);
-				bb.grow(posB + radius3);
-				bb.grow(posB - radius3);
-
-				col.capsule = { posA, posB, radius };
-			} break;
-
-			case collider_type_cylinder:
+			col = cache.colliders[index];
+			bb = cache.aabbs[index];
+			if (col.type == collider_type_hull)
 			{
-				vec3 posA = transform.rotation * collider.cylinder.positionA + transform.position;
-				vec3 posB = transform.rotation * collider.cylinder.positionB + transform.position;
-				float radius = collider.cylinder.radius;
-
-				vec3 a = posB - posA;
-				float aa = dot(a, a);
-
-				float x = 1.f - a.x * a.x / aa;
-				float y = 1.f - a.y * a.y / aa;
-				float z = 1.f - a.z * a.z / aa;
-				x = sqrt(max(0.f, x));
-				y = sqrt(max(0.f, y));
-				z = sqrt(max(0.f, z));
-
-				vec3 e = radius * vec3(x, y, z);
-
-				bb = bounding_box::fromMinMax(min(posA - e, posB - e), max(posA + e, posB + e));
-
-				col.cylinder = { posA, posB, radius };
-			} break;
+				// The geometry array may have been reallocated in the meantime.
+				col.hull.geometryPtr = &boundingHullGeometries[collider.hull.geometryIndex];
+			}
+			++numCached;
+		}
+		else
+		{
+			physics_transform1_component* physicsTransformComponent = entity.getComponentIfExists<physics_transform1_component>();
+			transform_component* transformComponent = entity.getComponentIfExists<transform_component>();
+			const trs& transform = physicsTransformComponent ? *physicsTransformComponent : transformComponent ? *transformComponent : trs::identity;
 
-			case collider_type_aabb:
-			{
-				bb = collider.aabb.transformToAABB(transform.rotation, transform.position);
-				if (transform.rotation == quat::identity)
-				{
-					col.aabb = bb;
-				}
-				else
-				{
-					col.type = collider_type_obb;
-					col.obb = collider.aabb.transformToOBB(transform.rotation, transform.position);
-				}
-			} break;
+			getWorldSpaceCollider(collider, transform, col, bb);
 
-			case collider_type_obb:
+			if (state == broadphase_collider_sleeping)
 			{
-				bb = collider.obb.transformToAABB(transform.rotation, transform.position);
-				col.obb = collider.obb.transformToOBB(transform.rotation, transform.position);
-			} break;
-
-			case collider_type_hull:
+				cache.colliderEntities[index] = entityHandle;
+				cache.colliders[index] = col;
+				cache.aabbs[index] = bb;
+			}
+			else
 			{
-				const bounding_hull_geometry& geometry = boundingHullGeometries[collider.hull.geometryIndex];
-
-				quat rotation = transform.rotation * collider.hull.rotation;
-				vec3 position = transform.rotation * collider.hull.position + transform.position;
-
-				bb = geometry.aabb.transformToAABB(rotation, position);
-				col.hull.rotation = rotation;
-				col.hull.position = position;
-				col.hull.geometryPtr = &geometry;
-			} break;
+				cache.colliderEntities[index] = entt::null;
+			}
 		}
+
+		col.objectIndex = objectIndex;
+		col.objectType = objectType;
 	}
+
+	CPU_PROFILE_STAT("Cached sleeping colliders", numCached);
 }
 
 // Returns the accumulated force from all global force fields and writes localized forces (from force fields with colliders) in outLocalizedForceFields.
@@ -773,7 +853,7 @@ static vec3 getForceFieldStates(game_scene& scene, force_field_global_state* out
 		if (entity.hasComponent<collider_component>())
 		{
 			// Localized force field.
-			uint16 index = (uint16)entity.getComponentIndex<force_field_component>();
+			physics_index index = (physics_index)entity.getComponentIndex<force_field_component>();
 			outLocalForceFields[index].force = force;
 		}
 		else
@@ -799,8 +879,8 @@ static void getConstraintBodyPairs(game_scene& scene, constraint_body_pair* body
 
 		scene_entity rbAEntity = { reference.entityA, scene };
 		scene_entity rbBEntity = { reference.entityB, scene };
-		pair.rbA = (uint16)rbAEntity.getComponentIndex<rigid_body_component>();
-		pair.rbB = (uint16)rbBEntity.getComponentIndex<rigid_body_component>();
+		pair.rbA = (physics_index)rbAEntity.getComponentIndex<rigid_body_component>();
+		pair.rbB = (physics_index)rbBEntity.getComponentIndex<rigid_body_component>();
 	}
 }
 
@@ -878,46 +958,6 @@ void validate(uint32 line, collision_constraint* constraints, uint32 count)
 		VALIDATE1(line, "Collision", c.bias);
 	}
 }
-void validate(uint32 line, simd_collision_constraint_batch* constraints, uint32 count)
-{
-	for (uint32 i = 0; i < count; ++i)
-	{
-		simd_collision_constraint_batch& c = constraints[i];
-		for (uint32 j = 0; j < CONSTRAINT_SIMD_WIDTH; ++j)
-		{
-			VALIDATE1(line, "Collision", c.relGlobalAnchorA[0][j]);
-			VALIDATE1(line, "Collision", c.relGlobalAnchorA[1][j]);
-			VALIDATE1(line, "Collision", c.relGlobalAnchorA[2][j]);
-			VALIDATE1(line, "Collision", c.relGlobalAnchorB[0][j]);
-			VALIDATE1(line, "Collision", c.relGlobalAnchorB[1][j]);
-			VALIDATE1(line, "Collision", c.relGlobalAnchorB[2][j]);
-			VALIDATE1(line, "Collision", c.normal[0][j]);
-			VALIDATE1(line, "Collision", c.normal[1][j]);
-			VALIDATE1(line, "Collision", c.normal[2][j]);
-			VALIDATE1(line, "Collision", c.tangent[0][j]);
-			VALIDATE1(line, "Collision", c.tangent[1][j]);
-			VALIDATE1(line, "Collision", c.tangent[2][j]);
-			VALIDATE1(line, "Collision", c.normalImpulseToAngularVelocityA[0][j]);
-			VALIDATE1(line, "Collision", c.normalImpulseToAngularVelocityA[1][j]);
-			VALIDATE1(line, "Collision", c.normalImpulseToAngularVelocityA[2][j]);
-			VALIDATE1(line, "Collision", c.tangentImpulseToAngularVelocityA[0][j]);
-			VALIDATE1(line, "Collision", c.tangentImpulseToAngularVelocityA[1][j]);
-			VALIDATE1(line, "Collision", c.tangentImpulseToAngularVelocityA[2][j]);
-			VALIDATE1(line, "Collision", c.normalImpulseToAngularVelocityB[0][j]);
-			VALIDATE1(line, "Collision", c.normalImpulseToAngularVelocityB[1][j]);
-			VALIDATE1(line, "Collision", c.normalImpulseToAngularVelocityB[2][j]);
-			VALIDATE1(line, "Collision", c.tangentImpulseToAngularVelocityB[0][j]);
-			VALIDATE1(line, "Collision", c.tangentImpulseToAngularVelocityB[1][j]);
-			VALIDATE1(line, "Collision", c.tangentImpulseToAngularVelocityB[2][j]);
-			VALIDATE1(line, "Collision", c.effectiveMassInNormalDir[j]);
-			VALIDATE1(line, "Collision", c.effectiveMassInTangentDir[j]);
-			VALIDATE1(line, "Collision", c.friction[j]);
-			VALIDATE1(line, "Collision", c.impulseInNormalDir[j]);
-			VALIDATE1(line, "Collision", c.impulseInTangentDir[j]);
-			VALIDATE1(line, "Collision", c.bias[j]);
-		}
-	}
-}
 
 #define VALIDATE(arr, count) validate(__LINE__, arr, count)
 
@@ -926,258 +966,1266 @@ void validate(uint32 line, simd_collision_constraint_batch* constraints, uint32
 #endif
 
 
-struct entity_pair
+// Bodies slower than these thresholds for TIME_TO_SLEEP seconds are put to sleep.
+#define SLEEP_LINEAR_VELOCITY_THRESHOLD 0.05f
+#define SLEEP_ANGULAR_VELOCITY_THRESHOLD 0.05f
+#define TIME_TO_SLEEP 0.5f
+
+struct sleep_context
 {
-	entity_handle a;
-	entity_handle b;
+	uint32 nextSleepIsland = 0;
 
-	operator uint64() const { return ((uint64)a << 32) | (uint64)b; }
-	bool operator<(entity_pair o) const { return (uint64)*this < (uint64)o; }
-	bool operator==(entity_pair o) const { return a == o.a && b == o.b; }
-	bool operator!=(entity_pair o) const { return !(*this == o); }
+	// If the number of bodies or colliders changes, everything is woken up, since a sleeping body may have lost its support.
+	uint32 numRigidBodies = 0;
+	uint32 numColliders = 0;
 };
 
-struct collision_entity_pair : entity_pair
+// Local force fields are only known to touch a body after the narrow phase, which sleeping bodies have skipped. Their sleep islands are woken up 
+// at the beginning of the next step instead, so that all bodies of the island go through the narrow phase together.
+struct force_field_wake_up_context
 {
-	uint16 contactOffset;
-	uint16 numContacts;
+	std::vector<uint32> sleepIslands;
 };
 
-struct event_context
+static bool isColliderSleeping(game_scene& scene, entity_handle colliderEntityHandle)
 {
-	std::vector<entity_pair> prevFrameTriggerOverlaps;
-	std::vector<collision_entity_pair> prevFrameCollisions;
-};
+	scene_entity colliderEntity = { colliderEntityHandle, scene };
+	if (!colliderEntity.valid())
+	{
+		return false;
+	}
 
-static void handleNonCollisionInteractions(game_scene& scene, 
-	const force_field_global_state* ffGlobal, const non_collision_interaction* nonCollisionInteractions, uint32 numNonCollisionInteractions,
-	uint32 numRigidBodies, uint32 numTriggers)
+	// Heightmaps and meshes in contact cache keys have no collider.
+	collider_component* collider = colliderEntity.getComponentIfExists<collider_component>();
+	if (!collider)
+	{
+		return false;
+	}
+
+	scene_entity rbEntity = { collider->parentEntity, scene };
+	rigid_body_component* rb = rbEntity.getComponentIfExists<rigid_body_component>();
+	return rb && rb->isSleeping();
+}
+
+static bool canWakeUpOthers(const rigid_body_component& rb)
 {
-	std::vector<entity_pair> triggerOverlaps;
+	// Kinematic bodies only wake up others if they move.
+	return !rb.isSleeping() && (rb.invMass != 0.f || squaredLength(rb.linearVelocity) != 0.f || squaredLength(rb.angularVelocity) != 0.f);
+}
 
-	for (uint32 i = 0; i < numNonCollisionInteractions; ++i)
-	{
-		non_collision_interaction interaction = nonCollisionInteractions[i];
-		rigid_body_component& rb = scene.getComponentAtIndex<rigid_body_component>(numRigidBodies - 1 - interaction.rigidBodyIndex);
+static bool hasExternalInput(const rigid_body_component& rb)
+{
+	// Sleeping bodies have zero velocity, so any velocity must have been set from outside.
+	return squaredLength(rb.forceAccumulator) != 0.f || squaredLength(rb.torqueAccumulator) != 0.f
+		|| squaredLength(rb.linearVelocity) != 0.f || squaredLength(rb.angularVelocity) != 0.f;
+}
 
-		if (interaction.otherType == physics_object_type_force_field)
-		{
-			const force_field_global_state& ff = ffGlobal[interaction.otherIndex];
-			rb.forceAccumulator += ff.force;
-		}
-		else if (interaction.otherType == physics_object_type_trigger)
-		{
-			scene_entity triggerEntity = scene.getEntityFromComponentAtIndex<trigger_component>(numTriggers - 1 - interaction.otherIndex);
-			scene_entity rbEntity = scene.getEntityFromComponent(rb);
+// Motors drive their bodies from the inside, so bodies attached to an active motor never fall asleep.
+static bool* getActiveMotors(game_scene& scene, memory_arena& arena, uint32 numConstraints, const constraint_offsets& offsets)
+{
+	bool* result = arena.allocate<bool>(numConstraints, true);
 
-			entity_pair overlap = { triggerEntity.handle, rbEntity.handle };
+	bool* hinges = result + offsets.constraintOffsets[constraint_type_hinge];
+	const hinge_constraint* hingeConstraints = scene.raw<hinge_constraint>();
+	for (uint32 i = 0, count = scene.numberOfComponentsOfType<hinge_constraint>(); i < count; ++i)
+	{
+		hinges[i] = hingeConstraints[i].maxMotorTorque > 0.f;
+	}
 
-			triggerOverlaps.push_back(overlap);
-		}
+	bool* coneTwists = result + offsets.constraintOffsets[constraint_type_cone_twist];
+	const cone_twist_constraint* coneTwistConstraints = scene.raw<cone_twist_constraint>();
+	for (uint32 i = 0, count = scene.numberOfComponentsOfType<cone_twist_constraint>(); i < count; ++i)
+	{
+		coneTwists[i] = coneTwistConstraints[i].maxSwingMotorTorque > 0.f || coneTwistConstraints[i].maxTwistMotorTorque > 0.f;
 	}
 
-	std::sort(triggerOverlaps.begin(), triggerOverlaps.end());
+	bool* sliders = result + offsets.constraintOffsets[constraint_type_slider];
+	const slider_constraint* sliderConstraints = scene.raw<slider_constraint>();
+	for (uint32 i = 0, count = scene.numberOfComponentsOfType<slider_constraint>(); i < count; ++i)
+	{
+		sliders[i] = sliderConstraints[i].maxMotorForce > 0.f;
+	}
 
-	// De-duplicate. Since we operate on entities here, multiple colliders may report the same overlap.
-	triggerOverlaps.erase(std::unique(triggerOverlaps.begin(), triggerOverlaps.end()), triggerOverlaps.end());
+	return result;
+}
 
-	event_context& context = scene.createOrGetContextVariable<event_context>();
+// Wakes up sleeping bodies, which are touched by an awake body, are connected to one by a constraint, are pushed from outside or were
+// reached by a local force field in the last step.
+// The whole sleep island of such a body is woken up with it. Touching is decided by the broadphase overlaps, so that all 
+// woken bodies take part in this frame's narrow phase.
+static void wakeUpRigidBodies(game_scene& scene, memory_arena& arena, const collider_union* worldSpaceColliders,
+	const collider_pair* overlaps, uint32 numOverlaps, const constraint_body_pair* constraintBodyPairs, const bool* activeMotors, uint32 numConstraints,
+	uint32 numRigidBodies, uint32 numColliders, bool enableSleeping)
+{
+	rigid_body_component* rbs = scene.raw<rigid_body_component>();
 
-	auto prevIterator = context.prevFrameTriggerOverlaps.begin();
-	auto thisIterator = triggerOverlaps.begin();
+	sleep_context& context = scene.createOrGetContextVariable<sleep_context>();
 
-	auto prevEnd = context.prevFrameTriggerOverlaps.end();
-	auto thisEnd = triggerOverlaps.end();
+	bool wakeUpAll = !enableSleeping || numRigidBodies != context.numRigidBodies || numColliders != context.numColliders;
+	context.numRigidBodies = numRigidBodies;
+	context.numColliders = numColliders;
 
-	auto triggerEvent = [&scene](entity_pair pair, trigger_event_type type)
+	if (wakeUpAll)
 	{
-		scene_entity triggerEntity = { pair.a, scene };
-		scene_entity otherEntity = { pair.b, scene };
-		const trigger_component& triggerComp = triggerEntity.getComponent<trigger_component>();
-		triggerComp.callback(trigger_event{ triggerEntity, otherEntity, type });
-	};
+		for (uint32 i = 0; i < numRigidBodies; ++i)
+		{
+			if (rbs[i].isSleeping())
+			{
+				rbs[i].wakeUp();
+			}
+		}
+		scene.createOrGetContextVariable<force_field_wake_up_context>().sleepIslands.clear();
+		return;
+	}
 
-	while (prevIterator != prevEnd && thisIterator != thisEnd)
+	memory_marker marker = arena.getMarker();
+
+	bool* wakeUp = arena.allocate<bool>(numRigidBodies, true);
+
+	for (uint32 i = 0; i < numRigidBodies; ++i)
 	{
-		entity_pair p = *prevIterator;
-		entity_pair t = *thisIterator;
+		wakeUp[i] = rbs[i].isSleeping() && hasExternalInput(rbs[i]);
+	}
 
-		if (p == t)
+	auto wakeUpPair = [rbs, wakeUp](uint32 rbA, uint32 rbB)
+	{
+		if (rbs[rbA].isSleeping() && canWakeUpOthers(rbs[rbB]))
 		{
-			++prevIterator;
-			++thisIterator;
-			continue;
+			wakeUp[rbA] = true;
 		}
-
-		if (p < t)
+		if (rbs[rbB].isSleeping() && canWakeUpOthers(rbs[rbA]))
 		{
-			triggerEvent(p, trigger_event_leave);
-			++prevIterator;
+			wakeUp[rbB] = true;
 		}
-		else
+	};
+
+	for (uint32 i = 0; i < numOverlaps; ++i)
+	{
+		const collider_union& colliderA = worldSpaceColliders[overlaps[i].colliderA];
+		const collider_union& colliderB = worldSpaceColliders[overlaps[i].colliderB];
+
+		if (colliderA.objectType == physics_object_type_rigid_body && colliderB.objectType == physics_object_type_rigid_body)
 		{
-			triggerEvent(t, trigger_event_enter);
-			++thisIterator;
+			wakeUpPair(colliderA.objectIndex, colliderB.objectIndex);
 		}
 	}
 
-	while (prevIterator != prevEnd)
+	for (uint32 i = 0; i < numConstraints; ++i)
 	{
-		triggerEvent(*(prevIterator++), trigger_event_leave);
-	}
+		constraint_body_pair pair = constraintBodyPairs[i];
+		wakeUpPair(pair.rbA, pair.rbB);
 
-	while (thisIterator != thisEnd)
-	{
-		triggerEvent(*(thisIterator++), trigger_event_enter);
+		if (activeMotors[i])
+		{
+			wakeUp[pair.rbA] |= rbs[pair.rbA].isSleeping();
+			wakeUp[pair.rbB] |= rbs[pair.rbB].isSleeping();
+			rbs[pair.rbA].sleepTimer = 0.f;
+			rbs[pair.rbB].sleepTimer = 0.f;
+		}
 	}
 
-	context.prevFrameTriggerOverlaps = std::move(triggerOverlaps);
-}
 
-static void handleCollisionCallbacks(game_scene& scene, const collider_pair* colliderPairs, uint8* contactCountPerCollision, uint32 numColliderPairs,
-	uint32 numColliders, const collision_contact* contacts, const rigid_body_global_state* rbGlobal, uint32 dummyRigidBodyIndex,
-	const collision_begin_event_func& collisionBeginCallback, const collision_end_event_func& collisionEndCallback)
-{
-	std::vector<collision_entity_pair> collisions;
+	// Collect the sleep islands of all woken bodies and wake up all their members.
+	std::vector<uint32>& forceFieldIslands = scene.createOrGetContextVariable<force_field_wake_up_context>().sleepIslands;
 
-	uint16 contactOffset = 0;
+	uint32* islandsToWakeUp = arena.allocate<uint32>(numRigidBodies + (uint32)forceFieldIslands.size());
+	uint32 numIslandsToWakeUp = 0;
 
-	for (uint32 i = 0; i < numColliderPairs; ++i)
+	for (uint32 island : forceFieldIslands)
 	{
-		collider_pair colliderPair = colliderPairs[i];
+		islandsToWakeUp[numIslandsToWakeUp++] = island;
+	}
+	forceFieldIslands.clear();
 
-		if (colliderPair.colliderB < numColliders)
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		if (wakeUp[i])
 		{
-			uint16 numContacts = contactCountPerCollision[i];
-
-			scene_entity aEntity = scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - colliderPair.colliderA);
-			scene_entity bEntity = scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - colliderPair.colliderB);
-
-			collision_entity_pair overlap = { aEntity.handle, bEntity.handle, contactOffset, numContacts };
-
-			collisions.push_back(overlap);
-			contactOffset += numContacts;
+			islandsToWakeUp[numIslandsToWakeUp++] = rbs[i].sleepIsland;
 		}
 	}
 
-	std::sort(collisions.begin(), collisions.end());
-
-	event_context& context = scene.createOrGetContextVariable<event_context>();
-
-	if (collisionBeginCallback || collisionEndCallback)
+	if (numIslandsToWakeUp > 0)
 	{
-		auto prevIterator = context.prevFrameCollisions.begin();
-		auto thisIterator = collisions.begin();
-
-		auto prevEnd = context.prevFrameCollisions.end();
-		auto thisEnd = collisions.end();
+		std::sort(islandsToWakeUp, islandsToWakeUp + numIslandsToWakeUp);
 
-		auto beginEvent = [contacts, rbGlobal, &collisionBeginCallback, &scene, dummyRigidBodyIndex](collision_entity_pair pair)
+		for (uint32 i = 0; i < numRigidBodies; ++i)
 		{
-			if (collisionBeginCallback)
+			rigid_body_component& rb = rbs[i];
+			if (rb.isSleeping() && std::binary_search(islandsToWakeUp, islandsToWakeUp + numIslandsToWakeUp, rb.sleepIsland))
 			{
-				scene_entity colliderAEntity = { pair.a, scene };
-				scene_entity colliderBEntity = { pair.b, scene };
+				rb.wakeUp();
+			}
+		}
+	}
+
+	arena.resetToMarker(marker);
+}
 
-				const collider_component& colliderA = colliderAEntity.getComponent<collider_component>();
-				const collider_component& colliderB = colliderBEntity.getComponent<collider_component>();
+// Removes all overlaps between sleeping and other solid colliders, since these don't need to go through the narrow phase.
+// Overlaps with triggers and force fields are kept, so that these still generate events and can wake up bodies.
+static uint32 removeSleepingOverlaps(const collider_union* worldSpaceColliders, collider_pair* overlaps, uint32 numOverlaps, const bool* rbSleeping)
+{
+	uint32 numRemainingOverlaps = 0;
 
-				scene_entity rbAEntity = { colliderA.parentEntity, scene };
-				scene_entity rbBEntity = { colliderB.parentEntity, scene };
+	for (uint32 i = 0; i < numOverlaps; ++i)
+	{
+		collider_pair overlap = overlaps[i];
+		const collider_union& colliderA = worldSpaceColliders[overlap.colliderA];
+		const collider_union& colliderB = worldSpaceColliders[overlap.colliderB];
 
+		bool aSleeping = colliderA.objectType == physics_object_type_rigid_body && rbSleeping[colliderA.objectIndex];
+		bool bSleeping = colliderB.objectType == physics_object_type_rigid_body && rbSleeping[colliderB.objectIndex];
 
-				const collision_contact* c = contacts + pair.contactOffset;
-				uint32 numContacts = pair.numContacts;
-				ASSERT(numContacts > 0);
+		bool aSolid = colliderA.objectType == physics_object_type_rigid_body || colliderA.objectType == physics_object_type_static_collider;
+		bool bSolid = colliderB.objectType == physics_object_type_rigid_body || colliderB.objectType == physics_object_type_static_collider;
 
-				float norm = 1.f / numContacts;
+		if ((aSleeping || bSleeping) && aSolid && bSolid)
+		{
+			continue;
+		}
 
-				vec3 point(0.f);
-				vec3 normal(0.f);
-				for (uint32 i = 0; i < numContacts; ++i)
-				{
-					point += c[i].point;
-					normal += c[i].normal;
-				}
+		overlaps[numRemainingOverlaps++] = overlap;
+	}
 
-				point *= norm;
-				normal *= norm;
+	return numRemainingOverlaps;
+}
 
+static uint32 countSleepingRigidBodies(const bool* rbSleeping, uint32 numRigidBodies)
+{
+	uint32 result = 0;
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		result += rbSleeping[i];
+	}
+	return result;
+}
 
-				auto& rbAGlobal = rbGlobal[rbAEntity.hasComponent<rigid_body_component>() ? rbAEntity.getComponentIndex<rigid_body_component>() : dummyRigidBodyIndex];
-				auto& rbBGlobal = rbGlobal[rbBEntity.hasComponent<rigid_body_component>() ? rbBEntity.getComponentIndex<rigid_body_component>() : dummyRigidBodyIndex];
+// Puts islands to sleep, if all their bodies have been at rest for long enough. Bodies without any contacts or constraints are handled individually.
+// Must be called after the velocities have been integrated.
+static void putRigidBodiesToSleep(game_scene& scene, memory_arena& arena, const island_description& islands, uint32 numRigidBodies, float dt)
+{
+	CPU_PROFILE_BLOCK("Put rigid bodies to sleep");
 
-				vec3 velA = rbAGlobal.linearVelocity + cross(rbAGlobal.angularVelocity, point - rbAGlobal.position);
-				vec3 velB = rbBGlobal.linearVelocity + cross(rbBGlobal.angularVelocity, point - rbBGlobal.position);
+	rigid_body_component* rbs = scene.raw<rigid_body_component>();
+	sleep_context& context = scene.createOrGetContextVariable<sleep_context>();
 
-				collision_begin_event e = { rbAEntity, rbBEntity, colliderA, colliderB, point, normal, velB - velA };
-				collisionBeginCallback(e);
-			}
-		};
+	const float linearThresholdSq = SLEEP_LINEAR_VELOCITY_THRESHOLD * SLEEP_LINEAR_VELOCITY_THRESHOLD;
+	const float angularThresholdSq = SLEEP_ANGULAR_VELOCITY_THRESHOLD * SLEEP_ANGULAR_VELOCITY_THRESHOLD;
 
-		auto endEvent = [&collisionEndCallback, &scene](collision_entity_pair pair)
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		rigid_body_component& rb = rbs[i];
+		if (rb.isSleeping() || rb.invMass == 0.f)
 		{
-			if (collisionEndCallback)
-			{
-				scene_entity colliderAEntity = { pair.a, scene };
-				scene_entity colliderBEntity = { pair.b, scene };
+			continue;
+		}
+
+		bool atRest = squaredLength(rb.linearVelocity) < linearThresholdSq && squaredLength(rb.angularVelocity) < angularThresholdSq;
+		rb.sleepTimer = atRest ? (rb.sleepTimer + dt) : 0.f;
+	}
 
-				const collider_component& colliderA = colliderAEntity.getComponent<collider_component>();
-				const collider_component& colliderB = colliderBEntity.getComponent<collider_component>();
+	memory_marker marker = arena.getMarker();
 
-				scene_entity rbAEntity = { colliderA.parentEntity, scene };
-				scene_entity rbBEntity = { colliderB.parentEntity, scene };
+	bool* inIsland = arena.allocate<bool>(numRigidBodies, true);
 
-				collision_end_event e = { rbAEntity, rbBEntity, colliderA, colliderB };
-				collisionEndCallback(e);
-			}
-		};
+	for (uint32 island = 0; island < islands.numIslands; ++island)
+	{
+		const physics_index* bodies = islands.allIslandBodies + islands.islandBodyOffsets[island];
+		uint32 numBodies = islands.islandBodyOffsets[island + 1] - islands.islandBodyOffsets[island];
 
-		while (prevIterator != prevEnd && thisIterator != thisEnd)
+		bool canSleep = true;
+		for (uint32 i = 0; i < numBodies; ++i)
 		{
-			collision_entity_pair p = *prevIterator;
-			collision_entity_pair t = *thisIterator;
+			inIsland[bodies[i]] = true;
+			canSleep &= (rbs[bodies[i]].sleepTimer >= TIME_TO_SLEEP);
+		}
 
-			if (p == t)
+		if (canSleep)
+		{
+			uint32 sleepIsland = context.nextSleepIsland++;
+			for (uint32 i = 0; i < numBodies; ++i)
 			{
-				++prevIterator;
-				++thisIterator;
-				continue;
+				rbs[bodies[i]].putToSleep(sleepIsland);
 			}
+		}
+	}
 
-			if (p < t)
+	for (uint32 i = 0; i < numRigidBodies; ++i)
+	{
+		rigid_body_component& rb = rbs[i];
+		if (!inIsland[i] && !rb.isSleeping() && rb.invMass != 0.f && rb.sleepTimer >= TIME_TO_SLEEP)
+		{
+			rb.putToSleep(context.nextSleepIsland++);
+		}
+	}
+
+	arena.resetToMarker(marker);
+}
+
+struct entity_pair
+{
+	entity_handle a;
+	entity_handle b;
+
+	operator uint64() const { return ((uint64)a << 32) | (uint64)b; }
+	bool operator<(entity_pair o) const { return (uint64)*this < (uint64)o; }
+	bool operator==(entity_pair o) const { return a == o.a && b == o.b; }
+	bool operator!=(entity_pair o) const { return !(*this == o); }
+};
+
+struct event_context
+{
+	std::vector<entity_pair> prevFrameTriggerOverlaps;
+	pair_key_set collisions; // Colliding pairs, for which a begin event has been fired.
+};
+
+static void handleNonCollisionInteractions(game_scene& scene, 
+	const force_field_global_state* ffGlobal, const non_collision_interaction* nonCollisionInteractions, uint32 numNonCollisionInteractions,
+	uint32 numRigidBodies, uint32 numTriggers)
+{
+	std::vector<entity_pair> triggerOverlaps;
+	std::vector<uint32>& forceFieldIslands = scene.createOrGetContextVariable<force_field_wake_up_context>().sleepIslands;
+
+	for (uint32 i = 0; i < numNonCollisionInteractions; ++i)
+	{
+		non_collision_interaction interaction = nonCollisionInteractions[i];
+		rigid_body_component& rb = scene.getComponentAtIndex<rigid_body_component>(numRigidBodies - 1 - interaction.rigidBodyIndex);
+
+		if (interaction.otherType == physics_object_type_force_field)
+		{
+			const force_field_global_state& ff = ffGlobal[interaction.otherIndex];
+			if (!rb.isSleeping())
+			{
+				rb.forceAccumulator += ff.force;
+			}
+			else if (squaredLength(ff.force) != 0.f)
+			{
+				// Woken up with its island next step. Waking the body up alone here would let it move without its contacts.
+				forceFieldIslands.push_back(rb.sleepIsland);
+			}
+		}
+		else if (interaction.otherType == physics_object_type_trigger)
+		{
+			scene_entity triggerEntity = scene.getEntityFromComponentAtIndex<trigger_component>(numTriggers - 1 - interaction.otherIndex);
+			scene_entity rbEntity = scene.getEntityFromComponent(rb);
+
+			entity_pair overlap = { triggerEntity.handle, rbEntity.handle };
+
+			triggerOverlaps.push_back(overlap);
+		}
+	}
+
+	std::sort(triggerOverlaps.begin(), triggerOverlaps.end());
+
+	// De-duplicate. Since we operate on entities here, multiple colliders may report the same overlap.
+	triggerOverlaps.erase(std::unique(triggerOverlaps.begin(), triggerOverlaps.end()), triggerOverlaps.end());
+
+	event_context& context = scene.createOrGetContextVariable<event_context>();
+
+	auto prevIterator = context.prevFrameTriggerOverlaps.begin();
+	auto thisIterator = triggerOverlaps.begin();
+
+	auto prevEnd = context.prevFrameTriggerOverlaps.end();
+	auto thisEnd = triggerOverlaps.end();
+
+	auto triggerEvent = [&scene](entity_pair pair, trigger_event_type type)
+	{
+		scene_entity triggerEntity = { pair.a, scene };
+		scene_entity otherEntity = { pair.b, scene };
+		const trigger_component& triggerComp = triggerEntity.getComponent<trigger_component>();
+		triggerComp.callback(trigger_event{ triggerEntity, otherEntity, type });
+	};
+
+	while (prevIterator != prevEnd && thisIterator != thisEnd)
+	{
+		entity_pair p = *prevIterator;
+		entity_pair t = *thisIterator;
+
+		if (p == t)
+		{
+			++prevIterator;
+			++thisIterator;
+			continue;
+		}
+
+		if (p < t)
+		{
+			triggerEvent(p, trigger_event_leave);
+			++prevIterator;
+		}
+		else
+		{
+			triggerEvent(t, trigger_event_enter);
+			++thisIterator;
+		}
+	}
+
+	while (prevIterator != prevEnd)
+	{
+		triggerEvent(*(prevIterator++), trigger_event_leave);
+	}
+
+	while (thisIterator != thisEnd)
+	{
+		triggerEvent(*(thisIterator++), trigger_event_enter);
+	}
+
+	context.prevFrameTriggerOverlaps = std::move(triggerOverlaps);
+}
+
+struct new_collision
+{
+	entity_handle a;
+	entity_handle b;
+	uint32 contactOffset;
+	uint32 numContacts;
+};
+
+// Fires the events from this frame's changes to the colliding pairs, without going over all collisions of the last frame.
+// Sleeping bodies don't go through the narrow phase. Their collisions are kept alive, so that no end and begin events are fired when they fall asleep or wake up.
+static void handleCollisionCallbacks(game_scene& scene, memory_arena& arena, const collider_pair* testedColliderPairs, uint32 numTestedColliderPairs,
+	const collider_pair* colliderPairs, const uint8* contactCountPerCollision, uint32 numColliderPairs,
+	uint32 numColliders, const broadphase_pair_deltas& broadphaseDeltas, const collision_contact* contacts, const rigid_body_global_state* rbGlobal, uint32 dummyRigidBodyIndex,
+	const collision_begin_event_func& collisionBeginCallback, const collision_end_event_func& collisionEndCallback)
+{
+	CPU_PROFILE_BLOCK("Collision callbacks");
+
+	pair_key_set& collisions = scene.createOrGetContextVariable<event_context>().collisions;
+	uint32 frame = ++collisions.frame;
+
+	auto getColliderEntity = [&scene, numColliders](physics_index colliderIndex)
+	{
+		return scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - colliderIndex).handle;
+	};
+
+	auto beginEvent = [contacts, rbGlobal, &collisionBeginCallback, &scene, dummyRigidBodyIndex](const new_collision& collision)
+	{
+		if (collisionBeginCallback)
+		{
+			scene_entity colliderAEntity = { collision.a, scene };
+			scene_entity colliderBEntity = { collision.b, scene };
+
+			const collider_component& colliderA = colliderAEntity.getComponent<collider_component>();
+			const collider_component& colliderB = colliderBEntity.getComponent<collider_component>();
+
+			scene_entity rbAEntity = { colliderA.parentEntity, scene };
+			scene_entity rbBEntity = { colliderB.parentEntity, scene };
+
+
+			const collision_contact* c = contacts + collision.contactOffset;
+			uint32 numContacts = collision.numContacts;
+			ASSERT(numContacts > 0);
+
+			float norm = 1.f / numContacts;
+
+			vec3 point(0.f);
+			vec3 normal(0.f);
+			for (uint32 i = 0; i < numContacts; ++i)
+			{
+				point += c[i].point;
+				normal += c[i].normal;
+			}
+
+			point *= norm;
+			normal *= norm;
+
+
+			auto& rbAGlobal = rbGlobal[rbAEntity.hasComponent<rigid_body_component>() ? rbAEntity.getComponentIndex<rigid_body_component>() : dummyRigidBodyIndex];
+			auto& rbBGlobal = rbGlobal[rbBEntity.hasComponent<rigid_body_component>() ? rbBEntity.getComponentIndex<rigid_body_component>() : dummyRigidBodyIndex];
+
+			vec3 velA = rbAGlobal.linearVelocity + cross(rbAGlobal.angularVelocity, point - rbAGlobal.position);
+			vec3 velB = rbBGlobal.linearVelocity + cross(rbBGlobal.angularVelocity, point - rbBGlobal.position);
+
+			collision_begin_event e = { rbAEntity, rbBEntity, colliderA, colliderB, point, normal, velB - velA };
+			collisionBeginCallback(e);
+		}
+	};
+
+	auto endEvent = [&collisionEndCallback, &scene](entity_handle a, entity_handle b)
+	{
+		scene_entity colliderAEntity = { a, scene };
+		scene_entity colliderBEntity = { b, scene };
+
+		// Pairs removed by the broad phase may reference deleted colliders.
+		if (collisionEndCallback && colliderAEntity.valid() && colliderBEntity.valid()
+			&& colliderAEntity.hasComponent<collider_component>() && colliderBEntity.hasComponent<collider_component>())
+		{
+			const collider_component& colliderA = colliderAEntity.getComponent<collider_component>();
+			const collider_component& colliderB = colliderBEntity.getComponent<collider_component>();
+
+			scene_entity rbAEntity = { colliderA.parentEntity, scene };
+			scene_entity rbBEntity = { colliderB.parentEntity, scene };
+
+			collision_end_event e = { rbAEntity, rbBEntity, colliderA, colliderB };
+			collisionEndCallback(e);
+		}
+	};
+
+	// Mark this frame's collisions. Those which are not in the set yet begin.
+	new_collision* newCollisions = arena.allocate<new_collision>(numColliderPairs);
+	uint32 numNewCollisions = 0;
+
+	uint32 contactOffset = 0;
+	for (uint32 i = 0; i < numColliderPairs; ++i)
+	{
+		collider_pair colliderPair = colliderPairs[i];
+
+		// Collisions with heightmaps and meshes have no events.
+		if (colliderPair.colliderB < numColliders)
+		{
+			uint32 numContacts = contactCountPerCollision[i];
+
+			entity_handle a = getColliderEntity(colliderPair.colliderA);
+			entity_handle b = getColliderEntity(colliderPair.colliderB);
+			uint64 key = getPairKey(a, b);
+
+			uint32 slot = collisions.find(key);
+			if (slot != UINT32_MAX)
+			{
+				collisions.lastSeen[slot] = frame;
+			}
+			else
+			{
+				collisions.insert(key);
+				newCollisions[numNewCollisions++] = { a, b, contactOffset, numContacts };
+			}
+
+			contactOffset += numContacts;
+		}
+	}
+
+	// Pairs which the narrow phase tested, but which did not collide.
+	for (uint32 i = 0; i < numTestedColliderPairs; ++i)
+	{
+		entity_handle a = getColliderEntity(testedColliderPairs[i].colliderA);
+		entity_handle b = getColliderEntity(testedColliderPairs[i].colliderB);
+
+		uint32 slot = collisions.find(getPairKey(a, b));
+		if (slot != UINT32_MAX && collisions.lastSeen[slot] != frame)
+		{
+			collisions.removeAt(slot);
+			endEvent(a, b);
+		}
+	}
+
+	// Pairs which the broad phase reports as separated end in any case, even if they were sleeping.
+	for (uint32 i = 0; i < broadphaseDeltas.numRemoved; ++i)
+	{
+		broadphase_pair pair = broadphaseDeltas.removed[i];
+
+		uint32 slot = collisions.find(getPairKey(pair.a, pair.b));
+		if (slot != UINT32_MAX)
+		{
+			collisions.removeAt(slot);
+			endEvent(pair.a, pair.b);
+		}
+	}
+
+	for (uint32 i = 0; i < numNewCollisions; ++i)
+	{
+		beginEvent(newCollisions[i]);
+	}
+
+	CPU_PROFILE_STAT("Collision begin events", numNewCollisions);
+}
+
+// Contacts closer than this (in the local space of rigid body A) are considered the same as in the last frame.
+#define CONTACT_CACHE_MATCH_DISTANCE 0.05f
+
+struct cached_contact
+{
+	vec3 localPoint; // Relative to rigid body A. World space, if collider A has no rigid body.
+	contact_impulse impulse;
+};
+
+struct cached_manifold : entity_pair
+{
+	uint32 contactOffset;
+	uint32 numContacts;
+};
+
+struct contact_cache_context
+{
+	std::vector<cached_manifold> manifolds; // Sorted.
+	std::vector<cached_contact> contacts;
+};
+
+struct separating_axis_cache_context
+{
+	std::vector<separating_axis_cache_entry> entries; // Sorted by pair key.
+};
+
+static entity_pair* getCollisionEntityPairs(game_scene& scene, memory_arena& arena, const collider_pair* colliderPairs, uint32 numColliderPairs, uint32 numColliders,
+	const entity_handle* staticTriangleColliderEntities)
+{
+	entity_pair* result = arena.allocate<entity_pair>(numColliderPairs);
+
+	for (uint32 i = 0; i < numColliderPairs; ++i)
+	{
+		collider_pair colliderPair = colliderPairs[i];
+
+		// Collisions with heightmaps and meshes have no second collider. They are keyed by the entity of the heightmap or mesh instead.
+		entity_handle b = (colliderPair.colliderB < numColliders) 
+			? scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - colliderPair.colliderB).handle 
+			: staticTriangleColliderEntities[colliderPair.colliderB - numColliders];
+
+		result[i] = { scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - colliderPair.colliderA).handle, b };
+	}
+
+	return result;
+}
+
+// Looks up the impulses of last frame's matching contacts. Contacts without a match start from zero.
+static void getCachedContactImpulses(game_scene& scene, const entity_pair* collisionEntityPairs, const uint8* contactCountPerCollision, uint32 numCollisions,
+	const collision_contact* contacts, const constraint_body_pair* collisionBodyPairs, const rigid_body_global_state* rbGlobal, uint32 dummyRigidBodyIndex,
+	vec3* outLocalContactPoints, contact_impulse* outImpulses)
+{
+	CPU_PROFILE_BLOCK("Get cached contact impulses");
+
+	contact_cache_context& cache = scene.createOrGetContextVariable<contact_cache_context>();
+
+	uint32 contactOffset = 0;
+	for (uint32 i = 0; i < numCollisions; ++i)
+	{
+		uint32 numContacts = contactCountPerCollision[i];
+		entity_pair pair = collisionEntityPairs[i];
+
+		auto it = std::lower_bound(cache.manifolds.begin(), cache.manifolds.end(), pair);
+		const cached_manifold* manifold = (it != cache.manifolds.end() && *it == pair) ? &*it : 0;
+
+		bool alreadyMatched[256] = {};
+
+		for (uint32 j = 0; j < numContacts; ++j)
+		{
+			uint32 contactIndex = contactOffset + j;
+
+			uint32 rbA = collisionBodyPairs[contactIndex].rbA;
+			vec3 point = contacts[contactIndex].point;
+			vec3 localPoint = (rbA == dummyRigidBodyIndex) ? point : conjugate(rbGlobal[rbA].rotation) * (point - rbGlobal[rbA].position);
+			outLocalContactPoints[contactIndex] = localPoint;
+
+			contact_impulse& impulse = outImpulses[contactIndex];
+			impulse = { 0.f, vec3(0.f) };
+
+			if (manifold)
+			{
+				float bestDistance = CONTACT_CACHE_MATCH_DISTANCE * CONTACT_CACHE_MATCH_DISTANCE;
+				uint32 bestMatch = UINT32_MAX;
+
+				for (uint32 k = 0; k < manifold->numContacts; ++k)
+				{
+					float distance = squaredLength(cache.contacts[manifold->contactOffset + k].localPoint - localPoint);
+					if (!alreadyMatched[k] && distance < bestDistance)
+					{
+						bestDistance = distance;
+						bestMatch = k;
+					}
+				}
+
+				if (bestMatch != UINT32_MAX)
+				{
+					alreadyMatched[bestMatch] = true;
+					impulse = cache.contacts[manifold->contactOffset + bestMatch].impulse;
+				}
+			}
+		}
+
+		contactOffset += numContacts;
+	}
+}
+
+static void updateContactCache(game_scene& scene, const entity_pair* collisionEntityPairs, const uint8* contactCountPerCollision, uint32 numCollisions,
+	const broadphase_pair_deltas& broadphaseDeltas, const vec3* localContactPoints, const contact_impulse* impulses)
+{
+	CPU_PROFILE_BLOCK("Update contact cache");
+
+	contact_cache_context& cache = scene.createOrGetContextVariable<contact_cache_context>();
+
+	std::vector<cached_manifold> manifolds;
+	std::vector<cached_contact> cachedContacts;
+
+	// Keep the manifolds of sleeping bodies, so that they are warm started when they wake up. 
+	// Manifolds whose colliders don't overlap in the broad phase anymore are dropped without looking at the bodies.
+	for (const cached_manifold& prev : cache.manifolds)
+	{
+		if (!containsBroadphasePair(broadphaseDeltas.removed, broadphaseDeltas.numRemoved, prev.a, prev.b)
+			&& (isColliderSleeping(scene, prev.a) || isColliderSleeping(scene, prev.b)))
+		{
+			cached_manifold manifold = prev;
+			manifold.contactOffset = (uint32)cachedContacts.size();
+			manifolds.push_back(manifold);
+
+			cachedContacts.insert(cachedContacts.end(), cache.contacts.begin() + prev.contactOffset, cache.contacts.begin() + prev.contactOffset + prev.numContacts);
+		}
+	}
+
+	uint32 contactOffset = 0;
+	for (uint32 i = 0; i < numCollisions; ++i)
+	{
+		uint32 numContacts = contactCountPerCollision[i];
+
+		cached_manifold manifold;
+		manifold.a = collisionEntityPairs[i].a;
+		manifold.b = collisionEntityPairs[i].b;
+		manifold.contactOffset = (uint32)cachedContacts.size();
+		manifold.numContacts = numContacts;
+		manifolds.push_back(manifold);
+
+		for (uint32 j = 0; j < numContacts; ++j)
+		{
+			cachedContacts.push_back({ localContactPoints[contactOffset + j], impulses[contactOffset + j] });
+		}
+
+		contactOffset += numContacts;
+	}
+
+	std::sort(manifolds.begin(), manifolds.end());
+
+	cache.manifolds = std::move(manifolds);
+	cache.contacts = std::move(cachedContacts);
+}
+
+void savePhysicsContextState(game_scene& scene, physics_snapshot_writer& writer)
+{
+	contact_cache_context& cache = scene.createOrGetContextVariable<contact_cache_context>();
+	writer.writeArray(cache.manifolds);
+	writer.writeArray(cache.contacts);
+	writer.writeArray(scene.createOrGetContextVariable<separating_axis_cache_context>().entries);
+
+	writer.write(scene.createOrGetContextVariable<sleep_context>());
+	writer.writeArray(scene.createOrGetContextVariable<force_field_wake_up_context>().sleepIslands);
+
+	event_context& events = scene.createOrGetContextVariable<event_context>();
+	writer.writeArray(events.prevFrameTriggerOverlaps);
+	writer.writeArray(events.collisions.getPairs());
+}
+
+bool restorePhysicsContextState(game_scene& scene, physics_snapshot_reader& reader)
+{
+	contact_cache_context& cache = scene.createOrGetContextVariable<contact_cache_context>();
+	event_context& events = scene.createOrGetContextVariable<event_context>();
+
+	// The restored bodies may sleep at other poses.
+	scene.createOrGetContextVariable<sleeping_collider_cache_context>().colliderEntities.clear();
+
+	std::vector<uint64> collisions;
+	if (!reader.readArray(cache.manifolds)
+		|| !reader.readArray(cache.contacts)
+		|| !reader.readArray(scene.createOrGetContextVariable<separating_axis_cache_context>().entries)
+		|| !reader.read(scene.createOrGetContextVariable<sleep_context>())
+		|| !reader.readArray(scene.createOrGetContextVariable<force_field_wake_up_context>().sleepIslands)
+		|| !reader.readArray(events.prevFrameTriggerOverlaps)
+		|| !reader.readArray(collisions))
+	{
+		return false;
+	}
+
+	events.collisions.clear();
+	for (uint64 key : collisions)
+	{
+		events.collisions.insert(key);
+	}
+	return true;
+}
+
+// Islands are distributed over at most this many independent solvers, which are then solved in parallel.
+// We don't create one solver per island, since many small islands would leave most SIMD lanes empty.
+#define MAX_NUM_ISLAND_GROUPS 8
+
+#define INVALID_LOCAL_BODY_INDEX INVALID_PHYSICS_INDEX
+
+// Pose at the end of the step of a body, which has already been integrated by the sub-stepped solver.
+struct substep_pose
+{
+	quat rotation;
+	vec3 position;
+	bool integrated;
+};
+
+struct constraint_input
+{
+	const distance_constraint* distanceConstraints;
+	const ball_constraint* ballConstraints;
+	const fixed_constraint* fixedConstraints;
+	const hinge_constraint* hingeConstraints;
+	const cone_twist_constraint* coneTwistConstraints;
+	const slider_constraint* sliderConstraints;
+	const collision_contact* contacts;
+	const contact_impulse* contactImpulses; // May be null.
+};
+
+struct island_group
+{
+	constraint_solver solver;
+
+	// Local copy of all bodies referenced by the constraints in this group. The last entry is the dummy.
+	// The first numDynamicBodies entries are the bodies of the islands and are exclusively owned by this group.
+	// The remaining ones are static or kinematic bodies, which may be shared between groups but are never written back.
+	rigid_body_global_state* rbs;
+	physics_index* globalBodyIndices;
+	uint32 numDynamicBodies;
+
+	uint32* globalContactIndices;
+	uint32 numContacts;
+
+	uint32 numConstraints;
+
+	uint32 numSubsteps; // 0 if not sub-stepped.
+};
+
+static constraint_type getConstraintType(const constraint_offsets& offsets, uint32 pairIndex)
+{
+	uint32 type = 0;
+	while (type + 1 < constraint_type_count && pairIndex >= offsets.constraintOffsets[type + 1])
+	{
+		++type;
+	}
+	return (constraint_type)type;
+}
+
+template <typename constraint_t>
+static constraint_t* allocateIslandConstraints(memory_arena& arena, const uint32* numConstraintsPerType, constraint_type type)
+{
+	return arena.allocate<constraint_t>(numConstraintsPerType[type]);
+}
+
+static void initializeIslandGroup(island_group& group, memory_arena& arena, const island_description& islands, const uint32* islandToGroup, uint32 groupIndex,
+	const constraint_body_pair* allBodyPairs, const constraint_offsets& offsets, const constraint_input& input,
+	const rigid_body_global_state* rbGlobal, physics_index* globalToLocal, uint32 dummyRigidBodyIndex, const physics_simd_kernels* simd, float dt, uint32 numSubsteps)
+{
+	uint32 numConstraintsPerType[constraint_type_count] = {};
+	uint32 numDynamicBodies = 0;
+
+	for (uint32 island = 0; island < islands.numIslands; ++island)
+	{
+		if (islandToGroup[island] == groupIndex)
+		{
+			for (uint32 i = islands.islandOffsets[island]; i < islands.islandOffsets[island + 1]; ++i)
+			{
+				++numConstraintsPerType[getConstraintType(offsets, islands.allIslands[i])];
+			}
+			numDynamicBodies += islands.islandBodyOffsets[island + 1] - islands.islandBodyOffsets[island];
+		}
+	}
+
+	uint32 typeOffsets[constraint_type_count];
+	uint32 numConstraints = 0;
+	for (uint32 type = 0; type < constraint_type_count; ++type)
+	{
+		typeOffsets[type] = numConstraints;
+		numConstraints += numConstraintsPerType[type];
+	}
+
+
+	// Map global to local body indices. Dynamic bodies come first, then the static bodies referenced by the constraints.
+	physics_index* globalBodyIndices = arena.allocate<physics_index>(numDynamicBodies + 2 * numConstraints);
+	uint32 numLocalBodies = 0;
+
+	for (uint32 island = 0; island < islands.numIslands; ++island)
+	{
+		if (islandToGroup[island] == groupIndex)
+		{
+			for (uint32 i = islands.islandBodyOffsets[island]; i < islands.islandBodyOffsets[island + 1]; ++i)
+			{
+				physics_index rb = islands.allIslandBodies[i];
+				globalToLocal[rb] = (physics_index)numLocalBodies;
+				globalBodyIndices[numLocalBodies++] = rb;
+			}
+		}
+	}
+
+	ASSERT(numLocalBodies == numDynamicBodies);
+
+	for (uint32 island = 0; island < islands.numIslands; ++island)
+	{
+		if (islandToGroup[island] == groupIndex)
+		{
+			for (uint32 i = islands.islandOffsets[island]; i < islands.islandOffsets[island + 1]; ++i)
+			{
+				constraint_body_pair pair = allBodyPairs[islands.allIslands[i]];
+				physics_index rbs[] = { pair.rbA, pair.rbB };
+				for (physics_index rb : rbs)
+				{
+					if (rb != dummyRigidBodyIndex && globalToLocal[rb] == INVALID_LOCAL_BODY_INDEX)
+					{
+						globalToLocal[rb] = (physics_index)numLocalBodies;
+						globalBodyIndices[numLocalBodies++] = rb;
+					}
+				}
+			}
+		}
+	}
+
+	physics_index localDummyRigidBodyIndex = (physics_index)numLocalBodies;
+
+	rigid_body_global_state* rbs = arena.allocate<rigid_body_global_state>(numLocalBodies + 1);
+	for (uint32 i = 0; i < numLocalBodies; ++i)
+	{
+		rbs[i] = rbGlobal[globalBodyIndices[i]];
+	}
+	rbs[localDummyRigidBodyIndex] = rbGlobal[dummyRigidBodyIndex];
+
+
+	// Gather constraints, sorted by type. Within each type, the original order is preserved.
+	constraint_body_pair* bodyPairs = arena.allocate<constraint_body_pair>(numConstraints);
+
+	distance_constraint* distanceConstraints = allocateIslandConstraints<distance_constraint>(arena, numConstraintsPerType, constraint_type_distance);
+	ball_constraint* ballConstraints = allocateIslandConstraints<ball_constraint>(arena, numConstraintsPerType, constraint_type_ball);
+	fixed_constraint* fixedConstraints = allocateIslandConstraints<fixed_constraint>(arena, numConstraintsPerType, constraint_type_fixed);
+	hinge_constraint* hingeConstraints = allocateIslandConstraints<hinge_constraint>(arena, numConstraintsPerType, constraint_type_hinge);
+	cone_twist_constraint* coneTwistConstraints = allocateIslandConstraints<cone_twist_constraint>(arena, numConstraintsPerType, constraint_type_cone_twist);
+	slider_constraint* sliderConstraints = allocateIslandConstraints<slider_constraint>(arena, numConstraintsPerType, constraint_type_slider);
+	collision_contact* contacts = allocateIslandConstraints<collision_contact>(arena, numConstraintsPerType, constraint_type_collision);
+
+	uint32* globalContactIndices = arena.allocate<uint32>(numConstraintsPerType[constraint_type_collision]);
+	contact_impulse* contactImpulses = input.contactImpulses ? arena.allocate<contact_impulse>(numConstraintsPerType[constraint_type_collision]) : 0;
+
+	uint32 counter[constraint_type_count] = {};
+
+	for (uint32 island = 0; island < islands.numIslands; ++island)
+	{
+		if (islandToGroup[island] == groupIndex)
+		{
+			for (uint32 i = islands.islandOffsets[island]; i < islands.islandOffsets[island + 1]; ++i)
 			{
-				endEvent(p);
-				++prevIterator;
+				uint32 pairIndex = islands.allIslands[i];
+				constraint_type type = getConstraintType(offsets, pairIndex);
+
+				uint32 indexInType = pairIndex - offsets.constraintOffsets[type];
+				uint32 localIndexInType = counter[type]++;
+
+				constraint_body_pair pair = allBodyPairs[pairIndex];
+				constraint_body_pair& localPair = bodyPairs[typeOffsets[type] + localIndexInType];
+				localPair.rbA = (pair.rbA == dummyRigidBodyIndex) ? localDummyRigidBodyIndex : globalToLocal[pair.rbA];
+				localPair.rbB = (pair.rbB == dummyRigidBodyIndex) ? localDummyRigidBodyIndex : globalToLocal[pair.rbB];
+
+				switch (type)
+				{
+					case constraint_type_distance: distanceConstraints[localIndexInType] = input.distanceConstraints[indexInType]; break;
+					case constraint_type_ball: ballConstraints[localIndexInType] = input.ballConstraints[indexInType]; break;
+					case constraint_type_fixed: fixedConstraints[localIndexInType] = input.fixedConstraints[indexInType]; break;
+					case constraint_type_hinge: hingeConstraints[localIndexInType] = input.hingeConstraints[indexInType]; break;
+					case constraint_type_cone_twist: coneTwistConstraints[localIndexInType] = input.coneTwistConstraints[indexInType]; break;
+					case constraint_type_slider: sliderConstraints[localIndexInType] = input.sliderConstraints[indexInType]; break;
+					case constraint_type_collision:
+					{
+						contacts[localIndexInType] = input.contacts[indexInType];
+						globalContactIndices[localIndexInType] = indexInType;
+						if (contactImpulses)
+						{
+							contactImpulses[localIndexInType] = input.contactImpulses[indexInType];
+						}
+					} break;
+				}
 			}
-			else
+		}
+	}
+
+	for (uint32 i = 0; i < numLocalBodies; ++i)
+	{
+		globalToLocal[globalBodyIndices[i]] = INVALID_LOCAL_BODY_INDEX;
+	}
+
+	if (numSubsteps > 1)
+	{
+		// Static and kinematic bodies are integrated as well, so that contacts with moving kinematic bodies are updated correctly.
+		// They are not written back.
+		group.solver.initializeSubsteps(arena, rbs, numLocalBodies,
+			distanceConstraints, bodyPairs + typeOffsets[constraint_type_distance], numConstraintsPerType[constraint_type_distance],
+			ballConstraints, bodyPairs + typeOffsets[constraint_type_ball], numConstraintsPerType[constraint_type_ball],
+			fixedConstraints, bodyPairs + typeOffsets[constraint_type_fixed], numConstraintsPerType[constraint_type_fixed],
+			hingeConstraints, bodyPairs + typeOffsets[constraint_type_hinge], numConstraintsPerType[constraint_type_hinge],
+			coneTwistConstraints, bodyPairs + typeOffsets[constraint_type_cone_twist], numConstraintsPerType[constraint_type_cone_twist],
+			sliderConstraints, bodyPairs + typeOffsets[constraint_type_slider], numConstraintsPerType[constraint_type_slider],
+			contacts, bodyPairs + typeOffsets[constraint_type_collision], numConstraintsPerType[constraint_type_collision],
+			localDummyRigidBodyIndex, simd, dt, numSubsteps, contactImpulses);
+
+		group.numSubsteps = numSubsteps;
+	}
+	else
+	{
+		group.solver.initialize(arena, rbs,
+			distanceConstraints, bodyPairs + typeOffsets[constraint_type_distance], numConstraintsPerType[constraint_type_distance],
+			ballConstraints, bodyPairs + typeOffsets[constraint_type_ball], numConstraintsPerType[constraint_type_ball],
+			fixedConstraints, bodyPairs + typeOffsets[constraint_type_fixed], numConstraintsPerType[constraint_type_fixed],
+			hingeConstraints, bodyPairs + typeOffsets[constraint_type_hinge], numConstraintsPerType[constraint_type_hinge],
+			coneTwistConstraints, bodyPairs + typeOffsets[constraint_type_cone_twist], numConstraintsPerType[constraint_type_cone_twist],
+			sliderConstraints, bodyPairs + typeOffsets[constraint_type_slider], numConstraintsPerType[constraint_type_slider],
+			contacts, bodyPairs + typeOffsets[constraint_type_collision], numConstraintsPerType[constraint_type_collision],
+			localDummyRigidBodyIndex, simd, dt, contactImpulses);
+
+		group.numSubsteps = 0;
+	}
+
+	group.rbs = rbs;
+	group.globalBodyIndices = globalBodyIndices;
+	group.numDynamicBodies = numDynamicBodies;
+	group.globalContactIndices = globalContactIndices;
+	group.numContacts = numConstraintsPerType[constraint_type_collision];
+	group.numConstraints = numConstraints;
+}
+
+static void solveIslandGroup(island_group& group, uint32 numIterations)
+{
+	CPU_PROFILE_BLOCK("Solve island group");
+
+	if (group.numSubsteps > 0)
+	{
+		for (uint32 substep = 0; substep < group.numSubsteps; ++substep)
+		{
+			group.solver.solveSubstep();
+		}
+	}
+	else
+	{
+		for (uint32 it = 0; it < numIterations; ++it)
+		{
+			group.solver.solveOneIteration();
+		}
+	}
+}
+
+// Each island group is solved on its own copy of the rigid body states, so the result does not depend on the number of 
+// threads or the order in which the groups are processed.
+// If outContactImpulses is not null, the accumulated impulse of each solved contact is written to it. It may alias input.contactImpulses.
+// If numSubsteps is greater than 1, the step is solved in that many substeps with one iteration each, instead of numIterations iterations.
+// The solver then also integrates the bodies of the islands and writes their end poses to outSubstepPoses.
+static void solveConstraintsOnIslands(memory_arena& arena, const island_description& islands, 
+	const constraint_body_pair* allBodyPairs, const constraint_offsets& offsets, const constraint_input& input,
+	rigid_body_global_state* rbGlobal, uint32 numRigidBodies, uint32 dummyRigidBodyIndex, uint32 numIterations, uint32 numSubsteps, 
+	const physics_simd_kernels* simd, float dt, contact_impulse* outContactImpulses, substep_pose* outSubstepPoses)
+{
+	ASSERT(numSubsteps <= 1 || outSubstepPoses);
+
+	if (islands.numIslands == 0 || (numIterations == 0 && numSubsteps <= 1))
+	{
+		return;
+	}
+
+	uint32 numGroups = min(islands.numIslands, (uint32)MAX_NUM_ISLAND_GROUPS);
+	island_group* groups = arena.allocate<island_group>(numGroups);
+
+	{
+		CPU_PROFILE_BLOCK("Initialize island solvers");
+
+		// Distribute islands over groups. Largest islands first, each to the group with the least work so far.
+		// Ties are resolved by index, which makes the distribution deterministic.
+		uint32* sortedIslands = arena.allocate<uint32>(islands.numIslands);
+		for (uint32 i = 0; i < islands.numIslands; ++i)
+		{
+			sortedIslands[i] = i;
+		}
+		std::stable_sort(sortedIslands, sortedIslands + islands.numIslands, [&islands](uint32 a, uint32 b)
+		{
+			uint32 sizeA = islands.islandOffsets[a + 1] - islands.islandOffsets[a];
+			uint32 sizeB = islands.islandOffsets[b + 1] - islands.islandOffsets[b];
+			return sizeA > sizeB;
+		});
+
+		uint32 groupLoad[MAX_NUM_ISLAND_GROUPS] = {};
+
+		uint32* islandToGroup = arena.allocate<uint32>(islands.numIslands);
+		for (uint32 i = 0; i < islands.numIslands; ++i)
+		{
+			uint32 island = sortedIslands[i];
+
+			uint32 minGroup = 0;
+			for (uint32 g = 1; g < numGroups; ++g)
+			{
+				if (groupLoad[g] < groupLoad[minGroup])
+				{
+					minGroup = g;
+				}
+			}
+
+			islandToGroup[island] = minGroup;
+			groupLoad[minGroup] += islands.islandOffsets[island + 1] - islands.islandOffsets[island];
+		}
+
+		physics_index* globalToLocal = arena.allocate<physics_index>(numRigidBodies + 1);
+		memset(globalToLocal, 0xFF, sizeof(physics_index) * (numRigidBodies + 1));
+
+		// This is done sequentially, since the solver initialization resets the arena to markers internally.
+		for (uint32 g = 0; g < numGroups; ++g)
+		{
+			initializeIslandGroup(groups[g], arena, islands, islandToGroup, g, allBodyPairs, offsets, input, rbGlobal, globalToLocal, dummyRigidBodyIndex, simd, dt, numSubsteps);
+		}
+	}
+
+	{
+		CPU_PROFILE_BLOCK("Solve islands");
+
+#ifdef PHYSICS_USE_JOB_SYSTEM
+		if (numGroups > 1)
+		{
+			struct solve_islands_job_data
+			{
+				island_group* groups;
+				uint32 numGroups;
+				uint32 numIterations;
+			};
+
+			solve_islands_job_data data = { groups, numGroups, numIterations };
+
+			job_handle parentJob = highPriorityJobQueue.createJob<solve_islands_job_data>([](solve_islands_job_data& data, job_handle parent)
+			{
+				for (uint32 g = 0; g < data.numGroups; ++g)
+				{
+					struct solve_island_group_job_data
+					{
+						island_group* group;
+						uint32 numIterations;
+					};
+
+					solve_island_group_job_data groupData = { &data.groups[g], data.numIterations };
+
+					highPriorityJobQueue.createJob<solve_island_group_job_data>([](solve_island_group_job_data& data, job_handle)
+					{
+						solveIslandGroup(*data.group, data.numIterations);
+					}, groupData, parent).submitNow();
+				}
+			}, data);
+
+			parentJob.submitNow();
+			parentJob.waitForCompletion();
+		}
+		else
+		{
+			// A single group is solved on this thread, so its large colors can be distributed over the workers instead. With several
+			// groups this is not done, since every group job would fan out into further jobs per color and iteration.
+			groups[0].solver.setParallelColors(true);
+			solveIslandGroup(groups[0], numIterations);
+		}
+#else
+		for (uint32 g = 0; g < numGroups; ++g)
+		{
+			solveIslandGroup(groups[g], numIterations);
+		}
+#endif
+	}
+
+	{
+		CPU_PROFILE_BLOCK("Write back island results");
+
+		for (uint32 g = 0; g < numGroups; ++g)
+		{
+			const island_group& group = groups[g];
+			for (uint32 i = 0; i < group.numDynamicBodies; ++i)
 			{
-				beginEvent(t);
-				++thisIterator;
+				rigid_body_global_state& global = rbGlobal[group.globalBodyIndices[i]];
+				global.linearVelocity = group.rbs[i].linearVelocity;
+				global.angularVelocity = group.rbs[i].angularVelocity;
+
+				// The global state keeps the pose at the start of the step, which is needed by the continuous collision detection.
+				if (group.numSubsteps > 0)
+				{
+					outSubstepPoses[group.globalBodyIndices[i]] = { group.rbs[i].rotation, group.rbs[i].position, true };
+				}
 			}
 		}
 
-		if (collisionEndCallback)
+		if (outContactImpulses)
 		{
-			while (prevIterator != prevEnd)
+			for (uint32 g = 0; g < numGroups; ++g)
 			{
-				endEvent(*(prevIterator++));
+				island_group& group = groups[g];
+
+				contact_impulse* localImpulses = arena.allocate<contact_impulse>(group.numContacts);
+				group.solver.getContactImpulses(localImpulses);
+
+				for (uint32 i = 0; i < group.numContacts; ++i)
+				{
+					outContactImpulses[group.globalContactIndices[i]] = localImpulses[i];
+				}
 			}
 		}
+	}
+}
 
-		if (collisionBeginCallback)
+// Fast bodies can pass through thin geometry within one step. For bodies with continuous collision detection enabled, we sweep their colliders
+// from the start to the end of the step and move the body back to the first time of impact. The contact is then resolved in the next step,
+// so the velocity is kept. Only the translation is swept, and only against static colliders, kinematic bodies, heightmaps and mesh colliders.
+static void continuousCollisionDetection(game_scene& scene, const rigid_body_global_state* rbGlobal, uint32 numRigidBodies, float dt)
+{
+	CPU_PROFILE_BLOCK("Continuous collision detection");
+
+	uint32 numClampedBodies = 0;
+
+	uint32 rbIndex = numRigidBodies - 1; // EnTT iterates back to front.
+	for (auto [entityHandle, rb, transform] : scene.group<rigid_body_component, physics_transform1_component>().each())
+	{
+		const rigid_body_global_state& global = rbGlobal[rbIndex--];
+
+		if (!rb.continuousCollisionDetection || rb.isSleeping() || rb.invMass == 0.f)
+		{
+			continue;
+		}
+
+		vec3 motion = rb.linearVelocity * dt;
+		float motionLength = length(motion);
+		if (motionLength < 1e-4f)
+		{
+			continue;
+		}
+		vec3 direction = motion / motionLength;
+
+		// The global state still holds the pose at the start of the step.
+		trs startTransform(global.position - global.rotation * global.localCOGPosition, global.rotation);
+
+		scene_query_filter filter;
+		filter.includeDynamicBodies = false;
+		filter.ignoreInitialOverlaps = true; // Existing contacts have already been handled by the solver.
+		filter.ignoredEntity = entityHandle;
+
+		float timeOfImpact = motionLength;
+
+		for (collider_component& collider : collider_component_iterator({ entityHandle, scene }))
 		{
-			while (thisIterator != thisEnd)
+			collider_union worldSpaceCollider;
+			bounding_box aabb;
+			getWorldSpaceCollider(collider, startTransform, worldSpaceCollider, aabb);
+
+			// Colliders which move less than half their thickness can't pass through anything.
+			vec3 extent = aabb.getRadius();
+			if (motionLength < min(extent.x, min(extent.y, extent.z)))
+			{
+				continue;
+			}
+
+			scene_query_hit hit;
+			if (colliderSweep(scene, worldSpaceCollider, direction, timeOfImpact, hit, filter))
 			{
-				beginEvent(*(thisIterator++));
+				timeOfImpact = hit.distance;
 			}
 		}
+
+		if (timeOfImpact < motionLength)
+		{
+			vec3 cogPosition = global.position + direction * timeOfImpact;
+			transform.position = cogPosition - transform.rotation * rb.localCOGPosition;
+			++numClampedBodies;
+		}
 	}
 
-	context.prevFrameCollisions = std::move(collisions);
+	CPU_PROFILE_STAT("Num CCD clamped bodies", numClampedBodies);
+}
+
+static void simulateCloth(cloth_component& cloth, const physics_settings& settings, const cloth_collision_context* collision, const physics_simd_kernels* simd, 
+	vec3 force, float dt)
+{
+	cloth.applyWindForce(force);
+	if (settings.numClothXPBDSubsteps > 0)
+	{
+		cloth.simulateXPBD(settings.numClothXPBDSubsteps, settings.numClothPositionIterations, dt, collision, simd);
+	}
+	else
+	{
+		cloth.simulate(settings.numClothVelocityIterations, settings.numClothPositionIterations, settings.numClothDriftIterations, dt, collision, simd);
+	}
 }
 
-static void physicsStepInternal(game_scene& scene, memory_arena& arena, const physics_settings& settings, float dt)
+static void physicsStepInternal(game_scene& scene, memory_arena& arena, const physics_settings& settings, float dt, physics_step_stats* outStats)
 {
 	CPU_PROFILE_BLOCK("Physics step");
 
@@ -1203,52 +2251,195 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 
 
 	memory_marker marker = arena.getMarker();
+	arena.resetHighWaterMark();
+
+	// Phase timings for the stats. The timestamps are cheap enough to always take them.
+	uint64 broadphaseStart = getTimestamp();
 
 	rigid_body_global_state* rbGlobal = arena.allocate<rigid_body_global_state>(numRigidBodies + 1); // Reserve one slot for dummy.
 	force_field_global_state* ffGlobal = arena.allocate<force_field_global_state>(numForceFields);
 	bounding_box* worldSpaceAABBs = arena.allocate<bounding_box>(numColliders);
 	collider_union* worldSpaceColliders = arena.allocate<collider_union>(numColliders);
+	broadphase_collider_state* colliderStates = arena.allocate<broadphase_collider_state>(numColliders);
+	uint32* colliderSleepIslands = arena.allocate<uint32>(numColliders);
 
-	collider_pair* overlappingColliderPairs = arena.allocate<collider_pair>(numColliders * numColliders + 5000); // Conservative estimate.
+	arena_array<collider_pair> overlappingColliderPairs(arena, numColliders); // Grows with the actual number of overlaps.
 
 	uint32 dummyRigidBodyIndex = numRigidBodies;
 
+	// All bodies (including the dummy) and colliders must be addressable by physics_index. The largest index is reserved as invalid.
+	// Define PHYSICS_32_BIT_INDICES for larger scenes.
+	ASSERT(numRigidBodies + 1 < MAX_PHYSICS_INDEX_COUNT);
+	ASSERT(numColliders < MAX_PHYSICS_INDEX_COUNT);
+
 	// Collision detection.
-	getWorldSpaceColliders(scene, worldSpaceAABBs, worldSpaceColliders, dummyRigidBodyIndex);
+	getWorldSpaceColliders(scene, worldSpaceAABBs, worldSpaceColliders, colliderStates, colliderSleepIslands, dummyRigidBodyIndex);
 	VALIDATE(worldSpaceColliders, numColliders);
 	VALIDATE(worldSpaceAABBs, numColliders);
 
+	// Null if the CPU supports none of the SIMD widths.
+	const physics_simd_kernels* simdKernels = getPhysicsSIMDKernels(settings.simdWidth);
+
 	// Broad phase.
-	uint32 numBroadphaseOverlaps = broadphase(scene, worldSpaceAABBs, arena, overlappingColliderPairs, settings.simdBroadPhase);
+	broadphase_pair_deltas broadphaseDeltas;
+	uint32 numBroadphaseOverlaps;
+	if (settings.broadphaseType == broadphase_type_aabb_tree)
+	{
+		numBroadphaseOverlaps = aabbTreeBroadphase(scene, worldSpaceAABBs, colliderStates, colliderSleepIslands, arena, overlappingColliderPairs, broadphaseDeltas);
+	}
+	else
+	{
+		numBroadphaseOverlaps = broadphase(scene, worldSpaceAABBs, colliderStates, colliderSleepIslands, arena, overlappingColliderPairs, broadphaseDeltas, settings.simdBroadPhase ? simdKernels : 0);
+		updateAABBTree(scene, worldSpaceAABBs); // The scene queries use the tree.
+	}
+
+	uint64 narrowphaseStart = getTimestamp();
 
+	// The narrow phase output is bounded by the number of overlaps. Heightmap collisions are appended afterwards and grow these arrays if necessary.
 	non_collision_interaction* nonCollisionInteractions = arena.allocate<non_collision_interaction>(numBroadphaseOverlaps);
-	collision_contact* contacts = arena.allocate<collision_contact>(numBroadphaseOverlaps * 4 + 5000); // Each collision can have up to 4 contact points.
-	constraint_body_pair* allConstraintBodyPairs = arena.allocate<constraint_body_pair>(numConstraints + numBroadphaseOverlaps * 4 + 5000);
-	collider_pair* collidingColliderPairs = overlappingColliderPairs; // We reuse this buffer.
-	uint8* contactCountPerCollision = arena.allocate<uint8>(numColliders * numColliders + 5000);
+	arena_array<collision_contact> contactArray(arena, numBroadphaseOverlaps * 4); // Each collision can have up to 4 contact points.
+	arena_array<constraint_body_pair> constraintBodyPairArray(arena, numConstraints + numBroadphaseOverlaps * 4);
+	arena_array<collider_pair> collidingColliderPairArray(arena, numBroadphaseOverlaps); // Separate from the overlaps, which the collision events need.
+	arena_array<uint8> contactCountPerCollisionArray(arena, numBroadphaseOverlaps);
 
+	collision_contact* contacts = contactArray.data;
+	constraint_body_pair* allConstraintBodyPairs = constraintBodyPairArray.data;
 	constraint_body_pair* collisionBodyPairs = allConstraintBodyPairs + numConstraints;
+	collider_pair* collidingColliderPairs = collidingColliderPairArray.data;
+	uint8* contactCountPerCollision = contactCountPerCollisionArray.data;
+
+	// The constraint body pairs are needed to wake up sleeping bodies before the narrow phase.
+	constraint_body_pair* distanceConstraintBodyPairs = allConstraintBodyPairs + 0;
+	constraint_body_pair* ballConstraintBodyPairs = distanceConstraintBodyPairs + numDistanceConstraints;
+	constraint_body_pair* fixedConstraintBodyPairs = ballConstraintBodyPairs + numBallConstraints;
+	constraint_body_pair* hingeConstraintBodyPairs = fixedConstraintBodyPairs + numFixedConstraints;
+	constraint_body_pair* coneTwistConstraintBodyPairs = hingeConstraintBodyPairs + numHingeConstraints;
+	constraint_body_pair* sliderConstraintBodyPairs = coneTwistConstraintBodyPairs + numConeTwistConstraints;
+
+	getConstraintBodyPairs<distance_constraint>(scene, distanceConstraintBodyPairs);
+	getConstraintBodyPairs<ball_constraint>(scene, ballConstraintBodyPairs);
+	getConstraintBodyPairs<fixed_constraint>(scene, fixedConstraintBodyPairs);
+	getConstraintBodyPairs<hinge_constraint>(scene, hingeConstraintBodyPairs);
+	getConstraintBodyPairs<cone_twist_constraint>(scene, coneTwistConstraintBodyPairs);
+	getConstraintBodyPairs<slider_constraint>(scene, sliderConstraintBodyPairs);
+
+	constraint_offsets offsets;
+	offsets.constraintOffsets[constraint_type_distance] = (uint32)(distanceConstraintBodyPairs - allConstraintBodyPairs);
+	offsets.constraintOffsets[constraint_type_ball] = (uint32)(ballConstraintBodyPairs - allConstraintBodyPairs);
+	offsets.constraintOffsets[constraint_type_fixed] = (uint32)(fixedConstraintBodyPairs - allConstraintBodyPairs);
+	offsets.constraintOffsets[constraint_type_hinge] = (uint32)(hingeConstraintBodyPairs - allConstraintBodyPairs);
+	offsets.constraintOffsets[constraint_type_cone_twist] = (uint32)(coneTwistConstraintBodyPairs - allConstraintBodyPairs);
+	offsets.constraintOffsets[constraint_type_slider] = (uint32)(sliderConstraintBodyPairs - allConstraintBodyPairs);
+	offsets.constraintOffsets[constraint_type_collision] = (uint32)(collisionBodyPairs - allConstraintBodyPairs);
+
+
+	// Sleeping.
+	bool* rbSleeping = arena.allocate<bool>(numRigidBodies);
+	{
+		CPU_PROFILE_BLOCK("Wake up rigid bodies");
+
+		bool* activeMotors = getActiveMotors(scene, arena, numConstraints, offsets);
+
+		wakeUpRigidBodies(scene, arena, worldSpaceColliders, overlappingColliderPairs.data, numBroadphaseOverlaps, allConstraintBodyPairs, activeMotors, numConstraints,
+			numRigidBodies, numColliders, settings.enableSleeping);
+
+		rigid_body_component* rbs = scene.raw<rigid_body_component>();
+		for (uint32 i = 0; i < numRigidBodies; ++i)
+		{
+			rbSleeping[i] = rbs[i].isSleeping();
+		}
+
+		numBroadphaseOverlaps = removeSleepingOverlaps(worldSpaceColliders, overlappingColliderPairs.data, numBroadphaseOverlaps, rbSleeping);
+	}
 
 	// Narrow phase.
-	narrowphase_result narrowPhaseResult = narrowphase(worldSpaceColliders, overlappingColliderPairs, numBroadphaseOverlaps, arena,
-		contacts, collisionBodyPairs, collidingColliderPairs, contactCountPerCollision, nonCollisionInteractions, settings.simdNarrowPhase);
+	separating_axis_cache_context& separatingAxisContext = scene.createOrGetContextVariable<separating_axis_cache_context>();
+	separating_axis_cache separatingAxisCache;
+	if (settings.cacheSeparatingAxes)
+	{
+		entity_handle* colliderEntities = arena.allocate<entity_handle>(numColliders);
+		for (uint32 i = 0; i < numColliders; ++i)
+		{
+			colliderEntities[i] = scene.getEntityFromComponentAtIndex<collider_component>(numColliders - 1 - i).handle;
+		}
+
+		separatingAxisCache.colliderEntities = colliderEntities;
+		separatingAxisCache.entries = separatingAxisContext.entries.data();
+		separatingAxisCache.numEntries = (uint32)separatingAxisContext.entries.size();
+		separatingAxisCache.outEntries = arena.allocate<separating_axis_cache_entry>(numBroadphaseOverlaps);
+		separatingAxisCache.numOutEntries = 0;
+	}
+
+	narrowphase_result narrowPhaseResult = narrowphase(worldSpaceColliders, overlappingColliderPairs.data, numBroadphaseOverlaps, arena,
+		contacts, collisionBodyPairs, collidingColliderPairs, contactCountPerCollision, nonCollisionInteractions, 
+		settings.cacheSeparatingAxes ? &separatingAxisCache : 0, settings.simdNarrowPhase ? simdKernels : 0);
+
+	if (settings.cacheSeparatingAxes)
+	{
+		// Only this frame's separated pairs are kept. Pairs which collided or left the broad phase start from scratch next time.
+		separating_axis_cache_entry* entries = separatingAxisCache.outEntries;
+		uint32 numEntries = separatingAxisCache.numOutEntries;
+		std::sort(entries, entries + numEntries, [](const separating_axis_cache_entry& a, const separating_axis_cache_entry& b) { return a.pairKey < b.pairKey; });
+		separatingAxisContext.entries.assign(entries, entries + numEntries);
+	}
+	else
+	{
+		separatingAxisContext.entries.clear();
+	}
 	
 
-	// Heightmap collisions.
+	// Heightmap and mesh collisions.
+	contactArray.count = narrowPhaseResult.numContacts;
+	constraintBodyPairArray.count = numConstraints + narrowPhaseResult.numContacts;
+	collidingColliderPairArray.count = narrowPhaseResult.numCollisions;
+	contactCountPerCollisionArray.count = narrowPhaseResult.numCollisions;
+
+	// Heightmaps and meshes are identified by indices after the colliders, which map to their entities.
+	uint32 numStaticTriangleColliders = scene.numberOfComponentsOfType<heightmap_collider_component>() + scene.numberOfComponentsOfType<mesh_collider_component>();
+	ASSERT(numColliders + numStaticTriangleColliders <= MAX_PHYSICS_INDEX_COUNT);
+	entity_handle* staticTriangleColliderEntities = arena.allocate<entity_handle>(numStaticTriangleColliders);
+	uint32 numStaticTriangleCollidersProcessed = 0;
+
+	heightmap_job_context& heightmapJobContext = scene.createOrGetContextVariable<heightmap_job_context>();
+
 	for (auto [entityHandle, heightmap] : scene.view<heightmap_collider_component>().each())
 	{
-		narrowphase_result heightmapCollisionResult = heightmapCollision(heightmap, worldSpaceColliders, worldSpaceAABBs, numColliders,
-			contacts + narrowPhaseResult.numContacts, collisionBodyPairs + narrowPhaseResult.numContacts,
-			collidingColliderPairs + narrowPhaseResult.numCollisions, contactCountPerCollision + narrowPhaseResult.numCollisions,
-			arena, (uint16)dummyRigidBodyIndex);
+		physics_index staticColliderIndex = (physics_index)(numColliders + numStaticTriangleCollidersProcessed);
+		staticTriangleColliderEntities[numStaticTriangleCollidersProcessed++] = entityHandle;
+
+		narrowphase_result heightmapCollisionResult = heightmapCollision(heightmap, staticColliderIndex, worldSpaceColliders, worldSpaceAABBs, numColliders,
+			contactArray, constraintBodyPairArray, collidingColliderPairArray, contactCountPerCollisionArray,
+			arena, (physics_index)dummyRigidBodyIndex, rbSleeping, settings.simdNarrowPhase ? simdKernels : 0, &heightmapJobContext);
 
 		narrowPhaseResult.numCollisions += heightmapCollisionResult.numCollisions;
 		narrowPhaseResult.numContacts += heightmapCollisionResult.numContacts;
 		narrowPhaseResult.numNonCollisionInteractions += heightmapCollisionResult.numNonCollisionInteractions;
 	}
 
+	for (auto [entityHandle, mesh] : scene.view<mesh_collider_component>().each())
+	{
+		physics_index staticColliderIndex = (physics_index)(numColliders + numStaticTriangleCollidersProcessed);
+		staticTriangleColliderEntities[numStaticTriangleCollidersProcessed++] = entityHandle;
+
+		narrowphase_result meshCollisionResult = meshCollision(mesh, staticColliderIndex, worldSpaceColliders, worldSpaceAABBs, numColliders,
+			contactArray, constraintBodyPairArray, collidingColliderPairArray, contactCountPerCollisionArray,
+			arena, (physics_index)dummyRigidBodyIndex, rbSleeping, settings.simdNarrowPhase ? simdKernels : 0, &heightmapJobContext);
+
+		narrowPhaseResult.numCollisions += meshCollisionResult.numCollisions;
+		narrowPhaseResult.numContacts += meshCollisionResult.numContacts;
+		narrowPhaseResult.numNonCollisionInteractions += meshCollisionResult.numNonCollisionInteractions;
+	}
+
+	// The heightmap and mesh collisions may have moved the arrays.
+	contacts = contactArray.data;
+	allConstraintBodyPairs = constraintBodyPairArray.data;
+	collisionBodyPairs = allConstraintBodyPairs + numConstraints;
+	collidingColliderPairs = collidingColliderPairArray.data;
+	contactCountPerCollision = contactCountPerCollisionArray.data;
+
 	VALIDATE(contacts, narrowPhaseResult.numContacts);
 
+	uint64 narrowphaseEnd = getTimestamp();
 
 	vec3 globalForceField = getForceFieldStates(scene, ffGlobal);
 
@@ -1256,6 +2447,7 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 		numRigidBodies, numTriggers);
 
 	CPU_PROFILE_STAT("Num rigid bodies", numRigidBodies);
+	CPU_PROFILE_STAT("Num sleeping rigid bodies", countSleepingRigidBodies(rbSleeping, numRigidBodies));
 	CPU_PROFILE_STAT("Num colliders", numColliders);
 	CPU_PROFILE_STAT("Num broadphase overlaps", numBroadphaseOverlaps);
 	CPU_PROFILE_STAT("Num narrowphase collisions", narrowPhaseResult.numCollisions);
@@ -1270,7 +2462,12 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 		for (auto [entityHandle, rb, transform] : scene.group<rigid_body_component, physics_transform1_component>().each())
 		{
 			rigid_body_global_state& global = rbGlobal[rbIndex--];
-			rb.forceAccumulator += globalForceField;
+
+			// Global force fields act everywhere, so they don't wake up sleeping bodies. Otherwise nothing could ever sleep in the wind.
+			if (!rb.isSleeping())
+			{
+				rb.forceAccumulator += globalForceField;
+			}
 			rb.applyGravityAndIntegrateForces(global, transform, dt);
 		}
 	}
@@ -1280,8 +2477,11 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 
 	VALIDATE(rbGlobal, numRigidBodies);
 
+	uint64 solverStart = getTimestamp();
 
-	handleCollisionCallbacks(scene, collidingColliderPairs, contactCountPerCollision, narrowPhaseResult.numCollisions, numColliders, contacts, rbGlobal, dummyRigidBodyIndex,
+
+	handleCollisionCallbacks(scene, arena, overlappingColliderPairs.data, numBroadphaseOverlaps, collidingColliderPairs, contactCountPerCollision, narrowPhaseResult.numCollisions, 
+		numColliders, broadphaseDeltas, contacts, rbGlobal, dummyRigidBodyIndex,
 		settings.collisionBeginCallback, settings.collisionEndCallback);
 
 
@@ -1297,42 +2497,54 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 	cone_twist_constraint* coneTwistConstraints = scene.raw<cone_twist_constraint>();
 	slider_constraint* sliderConstraints = scene.raw<slider_constraint>();
 
-	constraint_body_pair* distanceConstraintBodyPairs = allConstraintBodyPairs + 0;
-	constraint_body_pair* ballConstraintBodyPairs = distanceConstraintBodyPairs + numDistanceConstraints;
-	constraint_body_pair* fixedConstraintBodyPairs = ballConstraintBodyPairs + numBallConstraints;
-	constraint_body_pair* hingeConstraintBodyPairs = fixedConstraintBodyPairs + numFixedConstraints;
-	constraint_body_pair* coneTwistConstraintBodyPairs = hingeConstraintBodyPairs + numHingeConstraints;
-	constraint_body_pair* sliderConstraintBodyPairs = coneTwistConstraintBodyPairs + numConeTwistConstraints;
+	constraint_input constraintInput;
+	constraintInput.distanceConstraints = distanceConstraints;
+	constraintInput.ballConstraints = ballConstraints;
+	constraintInput.fixedConstraints = fixedConstraints;
+	constraintInput.hingeConstraints = hingeConstraints;
+	constraintInput.coneTwistConstraints = coneTwistConstraints;
+	constraintInput.sliderConstraints = sliderConstraints;
+	constraintInput.contacts = contacts;
+	constraintInput.contactImpulses = 0;
+
+	// Warm start contacts with the impulses from the last frame.
+	entity_pair* collisionEntityPairs = 0;
+	vec3* localContactPoints = 0;
+	contact_impulse* contactImpulses = 0;
+
+	if (settings.warmStartContacts)
+	{
+		collisionEntityPairs = getCollisionEntityPairs(scene, arena, collidingColliderPairs, narrowPhaseResult.numCollisions, numColliders, staticTriangleColliderEntities);
+		localContactPoints = arena.allocate<vec3>(numContacts);
+		contactImpulses = arena.allocate<contact_impulse>(numContacts);
 
-	getConstraintBodyPairs<distance_constraint>(scene, distanceConstraintBodyPairs);
-	getConstraintBodyPairs<ball_constraint>(scene, ballConstraintBodyPairs);
-	getConstraintBodyPairs<fixed_constraint>(scene, fixedConstraintBodyPairs);
-	getConstraintBodyPairs<hinge_constraint>(scene, hingeConstraintBodyPairs);
-	getConstraintBodyPairs<cone_twist_constraint>(scene, coneTwistConstraintBodyPairs);
-	getConstraintBodyPairs<slider_constraint>(scene, sliderConstraintBodyPairs);
+		getCachedContactImpulses(scene, collisionEntityPairs, contactCountPerCollision, narrowPhaseResult.numCollisions, 
+			contacts, collisionBodyPairs, rbGlobal, dummyRigidBodyIndex, localContactPoints, contactImpulses);
+
+		constraintInput.contactImpulses = contactImpulses;
+	}
+	else
+	{
+		scene.createOrGetContextVariable<contact_cache_context>() = {};
+	}
+
+	island_description islands = buildIslands(arena, allConstraintBodyPairs, numConstraints + numContacts, rbGlobal, numRigidBodies, (physics_index)dummyRigidBodyIndex);
+
+	CPU_PROFILE_STAT("Num islands", islands.numIslands);
 
 
 	// Solve constraints.
-	constraint_solver constraintSolver;
-	constraintSolver.initialize(arena, rbGlobal,
-		distanceConstraints, distanceConstraintBodyPairs, numDistanceConstraints,
-		ballConstraints, ballConstraintBodyPairs, numBallConstraints,
-		fixedConstraints, fixedConstraintBodyPairs, numFixedConstraints,
-		hingeConstraints, hingeConstraintBodyPairs, numHingeConstraints,
-		coneTwistConstraints, coneTwistConstraintBodyPairs, numConeTwistConstraints,
-		sliderConstraints, sliderConstraintBodyPairs, numSliderConstraints,
-		contacts, collisionBodyPairs, numContacts,
-		dummyRigidBodyIndex, settings.simdConstraintSolver, dt);
+	substep_pose* substepPoses = (settings.numRigidSolverSubsteps > 1) ? arena.allocate<substep_pose>(numRigidBodies, true) : 0;
 
-	{
-		CPU_PROFILE_BLOCK("Solve constraints");
+	solveConstraintsOnIslands(arena, islands, allConstraintBodyPairs, offsets, constraintInput, rbGlobal, numRigidBodies, dummyRigidBodyIndex,
+		settings.numRigidSolverIterations, settings.numRigidSolverSubsteps, settings.simdConstraintSolver ? simdKernels : 0, dt, contactImpulses, substepPoses);
 
-		for (uint32 it = 0; it < settings.numRigidSolverIterations; ++it)
-		{
-			constraintSolver.solveOneIteration();
-		}
+	if (settings.warmStartContacts)
+	{
+		updateContactCache(scene, collisionEntityPairs, contactCountPerCollision, narrowPhaseResult.numCollisions, broadphaseDeltas, localContactPoints, contactImpulses);
 	}
 
+	uint64 solverEnd = getTimestamp();
 
 	// Integrate velocities.
 	{
@@ -1341,27 +2553,145 @@ static void physicsStepInternal(game_scene& scene, memory_arena& arena, const ph
 		uint32 rbIndex = numRigidBodies - 1; // EnTT iterates back to front.
 		for (auto [entityHandle, rb, transform] : scene.group<rigid_body_component, physics_transform1_component>().each())
 		{
-			rigid_body_global_state& global = rbGlobal[rbIndex--];
+			uint32 index = rbIndex--;
+			rigid_body_global_state& global = rbGlobal[index];
 
-			rb.integrateVelocity(global, transform, dt);
+			if (rb.isSleeping())
+			{
+				continue;
+			}
+
+			if (substepPoses && substepPoses[index].integrated)
+			{
+				// Already integrated by the solver, so only the end pose is taken over.
+				rigid_body_global_state end = global;
+				end.rotation = substepPoses[index].rotation;
+				end.position = substepPoses[index].position;
+				rb.integrateVelocity(end, transform, 0.f);
+			}
+			else
+			{
+				rb.integrateVelocity(global, transform, dt);
+			}
 		}
 	}
 
+	continuousCollisionDetection(scene, rbGlobal, numRigidBodies, dt);
+
+	if (settings.enableSleeping)
+	{
+		putRigidBodiesToSleep(scene, arena, islands, numRigidBodies, dt);
+	}
+
 	VALIDATE(rbGlobal, numRigidBodies);
 
 	// Cloth. This needs to get integrated with the rest of the system.
 
-	for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+	if (numCloths > 0)
 	{
-		cloth.applyWindForce(globalForceField);
-		cloth.simulate(settings.numClothVelocityIterations, settings.numClothPositionIterations, settings.numClothDriftIterations, dt);
+		CPU_PROFILE_BLOCK("Simulate cloths");
+
+		const physics_simd_kernels* clothSIMD = settings.simdConstraintSolver ? simdKernels : 0;
+
+		// The colliders are still at the poses from the beginning of the step.
+		cloth_collision_context clothCollisionContext;
+		clothCollisionContext.colliders = worldSpaceColliders;
+		clothCollisionContext.aabbs = worldSpaceAABBs;
+		clothCollisionContext.numColliders = numColliders;
+		clothCollisionContext.numHeightmaps = scene.numberOfComponentsOfType<heightmap_collider_component>();
+
+		const heightmap_collider_component** heightmaps = arena.allocate<const heightmap_collider_component*>(clothCollisionContext.numHeightmaps);
+		uint32 heightmapIndex = 0;
+		for (auto [entityHandle, heightmap] : scene.view<heightmap_collider_component>().each())
+		{
+			heightmaps[heightmapIndex++] = &heightmap;
+		}
+		clothCollisionContext.heightmaps = heightmaps;
+
+		const cloth_collision_context* clothCollision = settings.clothCollisions ? &clothCollisionContext : 0;
+
+#ifdef PHYSICS_USE_JOB_SYSTEM
+		if (numCloths > 1)
+		{
+			// Cloths do not interact, so each one gets its own job.
+			cloth_component** cloths = arena.allocate<cloth_component*>(numCloths);
+			uint32 clothIndex = 0;
+			for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+			{
+				cloths[clothIndex++] = &cloth;
+			}
+
+			struct simulate_cloths_job_data
+			{
+				cloth_component** cloths;
+				uint32 numCloths;
+				const physics_settings* settings;
+				const cloth_collision_context* collision;
+				const physics_simd_kernels* simd;
+				vec3 force;
+				float dt;
+			};
+
+			simulate_cloths_job_data data = { cloths, numCloths, &settings, clothCollision, clothSIMD, globalForceField, dt };
+
+			job_handle parentJob = highPriorityJobQueue.createJob<simulate_cloths_job_data>([](simulate_cloths_job_data& data, job_handle parent)
+			{
+				for (uint32 i = 0; i < data.numCloths; ++i)
+				{
+					struct simulate_cloth_job_data
+					{
+						cloth_component* cloth;
+						const physics_settings* settings;
+						const cloth_collision_context* collision;
+						const physics_simd_kernels* simd;
+						vec3 force;
+						float dt;
+					};
+
+					simulate_cloth_job_data clothData = { data.cloths[i], data.settings, data.collision, data.simd, data.force, data.dt };
+
+					highPriorityJobQueue.createJob<simulate_cloth_job_data>([](simulate_cloth_job_data& data, job_handle)
+					{
+						simulateCloth(*data.cloth, *data.settings, data.collision, data.simd, data.force, data.dt);
+					}, clothData, parent).submitNow();
+				}
+			}, data);
+
+			parentJob.submitNow();
+			parentJob.waitForCompletion();
+		}
+		else
+#endif
+		{
+			for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+			{
+				simulateCloth(cloth, settings, clothCollision, clothSIMD, globalForceField, dt);
+			}
+		}
 	}
 
+	uint64 stepEnd = getTimestamp();
+
+	CPU_PROFILE_STAT("Physics arena high water mark (KB)", (uint32)BYTE_TO_KB(arena.getHighWaterMark() - marker.before));
+
+	if (outStats)
+	{
+		// Everything between the phases (callbacks, force fields, cloth etc.) is counted as integration.
+		++outStats->numSteps;
+		outStats->broadphaseMilliseconds += getMilliseconds(broadphaseStart, narrowphaseStart);
+		outStats->narrowphaseMilliseconds += getMilliseconds(narrowphaseStart, narrowphaseEnd);
+		outStats->solverMilliseconds += getMilliseconds(solverStart, solverEnd);
+		outStats->integrateMilliseconds += getMilliseconds(narrowphaseEnd, solverStart) + getMilliseconds(solverEnd, stepEnd);
+		outStats->numBroadphaseOverlaps += numBroadphaseOverlaps;
+		outStats->numCollisions += narrowPhaseResult.numCollisions;
+		outStats->numContacts += narrowPhaseResult.numContacts;
+		outStats->arenaHighWaterMark = max(outStats->arenaHighWaterMark, arena.getHighWaterMark() - marker.before);
+	}
 
 	arena.resetToMarker(marker);
 }
 
-void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const physics_settings& settings, float dt)
+void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const physics_settings& settings, float dt, physics_step_stats* outStats)
 {
 	if (settings.fixedFrameRate)
 	{
@@ -1379,7 +2709,7 @@ void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const phy
 
 			while (timer >= physicsFixedTimeStep && physicsIterations++ < maxPhysicsIterationsPerFrame)
 			{
-				physicsStepInternal(scene, arena, settings, physicsFixedTimeStep);
+				physicsStepInternal(scene, arena, settings, physicsFixedTimeStep, outStats);
 				timer -= physicsFixedTimeStep;
 			}
 		}
@@ -1403,7 +2733,7 @@ void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const phy
 	}
 	else
 	{
-		physicsStepInternal(scene, arena, settings, dt);
+		physicsStepInternal(scene, arena, settings, dt, outStats);
 
 		for (auto [entityHandle, transform, physicsTransform1] : scene.group(component_group<transform_component, physics_transform1_component>).each())
 		{
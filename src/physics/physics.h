@@ -10,6 +10,12 @@
 
 #define GRAVITY -9.81f
 
+// The physics only DLL runs single threaded. Physics only builds, which link the job system (like the benchmark), define 
+// PHYSICS_WITH_JOB_SYSTEM to keep the parallel paths.
+#if !defined(PHYSICS_ONLY) || defined(PHYSICS_WITH_JOB_SYSTEM)
+#define PHYSICS_USE_JOB_SYSTEM
+#endif
+
 struct physics_properties
 {
 	mat3 inertia;
@@ -102,7 +108,9 @@ struct collider_union
 
 	// These two are only used internally and should not be read outside.
 	physics_object_type objectType;
-	uint16 objectIndex; // Depending on objectType: Rigid body index, force field index, ...
+	physics_index objectIndex; // Depending on objectType: Rigid body index, force field index, ...
+
+	uint8 layer = 0; // Only used for filtering scene queries. Must stay behind the fields above, which are loaded together with the material.
 };
 
 struct collider_component : collider_union
@@ -176,7 +184,7 @@ struct physics_reference_component
 	entity_handle firstColliderEntity = entt::null;
 
 	uint32 numConstraints = 0;
-	uint16 firstConstraintEdge = INVALID_CONSTRAINT_EDGE;
+	uint32 firstConstraintEdge = INVALID_CONSTRAINT_EDGE;
 };
 
 struct force_field_component
@@ -205,6 +213,7 @@ struct trigger_component
 #define INVALID_BOUNDING_HULL_INDEX -1
 
 uint32 allocateBoundingHullGeometry(const std::string& meshFilepath);
+uint32 allocateBoundingHullGeometry(bounding_hull_geometry&& geometry);
 
 struct distance_constraint_handle { entity_handle entity; };
 struct ball_constraint_handle { entity_handle entity; };
@@ -321,7 +330,7 @@ struct constraint_entity_iterator
 
 	struct iterator
 	{
-		uint16 constraintEdgeIndex;
+		uint32 constraintEdgeIndex;
 		entt::registry* registry;
 
 		friend bool operator!=(const iterator& a, const iterator& b) { return a.constraintEdgeIndex != b.constraintEdgeIndex; }
@@ -332,7 +341,7 @@ struct constraint_entity_iterator
 	iterator begin() { return iterator{ firstConstraintEdgeIndex, registry }; }
 	iterator end() { return iterator{ INVALID_CONSTRAINT_EDGE, registry }; }
 
-	uint16 firstConstraintEdgeIndex = INVALID_CONSTRAINT_EDGE;
+	uint32 firstConstraintEdgeIndex = INVALID_CONSTRAINT_EDGE;
 	entt::registry* registry;
 };
 
@@ -379,22 +388,77 @@ struct collision_end_event
 typedef std::function<void(const collision_begin_event&)> collision_begin_event_func;
 typedef std::function<void(const collision_end_event&)> collision_end_event_func;
 
+enum broadphase_type
+{
+	broadphase_type_sweep_and_prune,
+	broadphase_type_aabb_tree,
+
+	broadphase_type_count,
+};
+
+static const char* broadphaseTypeNames[] =
+{
+	"Sweep and prune",
+	"AABB tree",
+};
+
+static_assert(arraysize(broadphaseTypeNames) == broadphase_type_count);
+
+enum physics_simd_width
+{
+	physics_simd_width_auto, // The widest one supported by the CPU.
+	physics_simd_width_4,
+	physics_simd_width_8,
+	physics_simd_width_16,
+
+	physics_simd_width_count,
+};
+
+static const char* physicsSIMDWidthNames[] =
+{
+	"Auto",
+	"4 (SSE4.1)",
+	"8 (AVX2)",
+	"16 (AVX-512)",
+};
+
+static_assert(arraysize(physicsSIMDWidthNames) == physics_simd_width_count);
+
 struct physics_settings
 {
 	bool fixedFrameRate = true;
 	uint32 frameRate = 120;
 	uint32 maxPhysicsIterationsPerFrame = 4;
+	// Simulates a clone of the scene on its own thread (see physics_thread.h), which the application starts and stops. Ignored by physicsStep.
+	bool asynchronous = false;
 
+	// Warm starting is meant to allow fewer iterations. Compare the stack drift of the benchmark's box_stacks scene before lowering this.
 	uint32 numRigidSolverIterations = 30;
+	// If greater than 1, each step is solved in this many substeps with one iteration each, instead of numRigidSolverIterations iterations (TGS-style).
+	// The bodies are integrated after every substep and the contact penetration is updated from their movement, which makes stacks stiffer for the
+	// same total iteration count. The constraints are linearized once per step, and the contacts from the collision pass are reused in all substeps.
+	uint32 numRigidSolverSubsteps = 1;
+	bool warmStartContacts = true; // Initializes the collision solver with the impulses from the last frame.
+	bool enableSleeping = true; // Excludes bodies at rest from the simulation until something touches them.
+	bool cacheSeparatingAxes = true; // OBB and hull pairs test the axis which separated them in the last frame first.
 
 	uint32 numClothVelocityIterations = 0;
 	uint32 numClothPositionIterations = 1;
 	uint32 numClothDriftIterations = 0;
+	// If greater than 0, cloth is solved with XPBD in this many substeps with numClothPositionIterations iterations each, instead of the iterations above.
+	// The stiffness then comes from the compliances of the cloth and does not change with the iteration count or the timestep.
+	uint32 numClothXPBDSubsteps = 0;
+	bool clothCollisions = true; // Pushes cloth particles out of rigid bodies, static colliders and heightmaps.
 
-	bool simdBroadPhase = true;
+	broadphase_type broadphaseType = broadphase_type_sweep_and_prune;
+
+	bool simdBroadPhase = true; // Only used by sweep and prune.
 	bool simdNarrowPhase = true;
 	bool simdConstraintSolver = true;
 
+	// Forcing a width is mostly useful for benchmarking. If the CPU does not support it, the widest supported width is used instead.
+	physics_simd_width simdWidth = physics_simd_width_auto;
+
 	collision_begin_event_func collisionBeginCallback;
 	collision_end_event_func collisionEndCallback;
 };
@@ -402,4 +466,24 @@ struct physics_settings
 
 
 void testPhysicsInteraction(game_scene& scene, ray r, float strength = 1000.f);
-void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const physics_settings& settings, float dt);
+
+// Transforms the local space collider into world space. Hulls are converted to world space by pointing to their geometry.
+void getWorldSpaceCollider(const collider_component& collider, const trs& transform, collider_union& outCollider, bounding_box& outAABB);
+// Filled by the physics step, if requested. The values are summed over all fixed steps taken, so reset this before each call, if you want per-call values.
+struct physics_step_stats
+{
+	uint32 numSteps;
+
+	float broadphaseMilliseconds;
+	float narrowphaseMilliseconds; // Including heightmap collisions.
+	float solverMilliseconds; // Island building, warm starting and constraint solving.
+	float integrateMilliseconds; // Forces, velocities, CCD, sleeping and cloth.
+
+	uint32 numBroadphaseOverlaps;
+	uint32 numCollisions;
+	uint32 numContacts;
+
+	uint64 arenaHighWaterMark; // Maximum over all steps, in bytes.
+};
+
+void physicsStep(game_scene& scene, memory_arena& arena, float& timer, const physics_settings& settings, float dt, physics_step_stats* outStats = 0);
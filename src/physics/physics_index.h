@@ -0,0 +1,20 @@
+#pragma once
+
+// Type used for rigid body and collider indices throughout the physics step (broadphase, narrowphase, islands and solver batches).
+// 16 bit indices keep all of these structures compact, but limit a scene to 65535 rigid bodies and colliders.
+// Define PHYSICS_32_BIT_INDICES=1 in the project settings for larger scenes.
+
+#ifndef PHYSICS_32_BIT_INDICES
+#define PHYSICS_32_BIT_INDICES 0
+#endif
+
+#if PHYSICS_32_BIT_INDICES
+typedef uint32 physics_index;
+#define INVALID_PHYSICS_INDEX UINT32_MAX
+#else
+typedef uint16 physics_index;
+#define INVALID_PHYSICS_INDEX UINT16_MAX
+#endif
+
+// The largest index is reserved as an invalid marker.
+#define MAX_PHYSICS_INDEX_COUNT ((uint64)INVALID_PHYSICS_INDEX)
@@ -0,0 +1,79 @@
+#include "pch.h"
+#include "physics_simd.h"
+#include "core/cpu_features.h"
+
+// Defined in physics_simd_w*.cpp.
+extern const physics_simd_kernels physicsSIMDKernels4;
+extern const physics_simd_kernels physicsSIMDKernels8;
+extern const physics_simd_kernels physicsSIMDKernels16;
+
+void pushColliderPairs(arena_array<collider_pair>& outCollisions, const collider_pair* pairs, uint32 count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	outCollisions.reserve(outCollisions.count + count);
+	memcpy(outCollisions.data + outCollisions.count, pairs, sizeof(collider_pair) * count);
+	outCollisions.count += count;
+}
+
+void physicsSIMDAssertionFailed(const char* condition, const char* file, int line)
+{
+	std::cout << "Assertion '" << condition << "' failed [" << file << " : " << line << "].\n";
+}
+
+#if ENABLE_CPU_PROFILING
+physics_simd_profile_block::physics_simd_profile_block(const char* name)
+	: recorder(name)
+{
+}
+
+physics_simd_profile_block::~physics_simd_profile_block()
+{
+}
+
+void physicsSIMDProfileStat(const char* label, uint32 value)
+{
+	CPU_PROFILE_STAT(label, value);
+}
+#endif
+
+static bool isSIMDWidthSupported(physics_simd_width width)
+{
+	const cpu_features& cpu = getCPUFeatures();
+
+	switch (width)
+	{
+		// Compiled without AVX2, the 4-wide kernels don't use FMA (see core/simd.h). Compiled with it, the whole program requires AVX2 anyway.
+		case physics_simd_width_4: return cpu.sse4_1;
+		case physics_simd_width_8: return cpu.sse4_1 && cpu.avx2 && cpu.fma;
+		case physics_simd_width_16: return cpu.sse4_1 && cpu.avx2 && cpu.fma && cpu.avx512f && cpu.avx512dq && cpu.avx512bw && cpu.avx512vl;
+	}
+	return false;
+}
+
+const physics_simd_kernels* getPhysicsSIMDKernels(physics_simd_width width)
+{
+	if (width == physics_simd_width_auto || !isSIMDWidthSupported(width))
+	{
+		width = physics_simd_width_auto;
+		for (uint32 w = physics_simd_width_count - 1; w > physics_simd_width_auto; --w)
+		{
+			if (isSIMDWidthSupported((physics_simd_width)w))
+			{
+				width = (physics_simd_width)w;
+				break;
+			}
+		}
+	}
+
+	switch (width)
+	{
+		case physics_simd_width_4: return &physicsSIMDKernels4;
+		case physics_simd_width_8: return &physicsSIMDKernels8;
+		case physics_simd_width_16: return &physicsSIMDKernels16;
+	}
+	return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "physics.h"
+#include "collision_broad.h"
+#include "collision_narrow.h"
+#include "core/cpu_profiling.h"
+
+// The SIMD parts of the physics step (sweep and prune, narrow phase and constraint solver) are compiled once per vector width,
+// each in its own translation unit with the matching instruction set enabled (see physics_simd_w*.cpp).
+// The widest width supported by the CPU is picked at runtime, so the binary runs on any machine with SSE4.1 and FMA.
+
+#define PHYSICS_MAX_SIMD_WIDTH 16
+
+struct heightmap_triangle_batch;
+struct cloth_solver_data;
+
+struct physics_simd_kernels
+{
+	uint32 width;
+
+	void (*determineOverlaps)(const sap_endpoint* endpoints, uint32 numEndpoints, const bounding_box* worldSpaceAABBs, const broadphase_collider_state* colliderStates, 
+		uint32 numColliders, memory_arena& arena, arena_array<collider_pair>& outCollisions);
+
+	// Indexed like the scalar table in collision_narrow.cpp. Null if there is no SIMD test for a pair of collider types.
+	collision_func collisionFunctions[collider_type_count][collider_type_count];
+
+	// Triangle tests for heightmaps and mesh colliders (see heightmap_collision.cpp). Each writes at most one contact per triangle and returns the number of contacts.
+	uint32 (*collideSphereVsTriangles)(const bounding_sphere& sphere, const heightmap_triangle_batch& triangles, collision_contact* outContacts);
+	uint32 (*collideCapsuleVsTriangles)(const bounding_capsule& capsule, const heightmap_triangle_batch& triangles, collision_contact* outContacts);
+	uint32 (*collideAABBVsTriangles)(vec3 center, vec3 radius, const heightmap_triangle_batch& triangles, collision_contact* outContacts);
+
+	simd_constraint_solver (*initializeDistanceVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const distance_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+	void (*relinearizeDistanceVelocityConstraints)(simd_constraint_solver constraints, const rigid_body_global_state* rbs, const distance_constraint* input, const constraint_body_pair* bodyPairs, float dt);
+	void (*solveDistanceVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+
+	simd_constraint_solver (*initializeBallVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const ball_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+	void (*relinearizeBallVelocityConstraints)(simd_constraint_solver constraints, const rigid_body_global_state* rbs, const ball_constraint* input, const constraint_body_pair* bodyPairs, float dt);
+	void (*solveBallVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+
+	simd_constraint_solver (*initializeFixedVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const fixed_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+	void (*relinearizeFixedVelocityConstraints)(simd_constraint_solver constraints, const rigid_body_global_state* rbs, const fixed_constraint* input, const constraint_body_pair* bodyPairs, float dt);
+	void (*solveFixedVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+
+	simd_constraint_solver (*initializeHingeVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const hinge_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+	void (*relinearizeHingeVelocityConstraints)(simd_constraint_solver constraints, const rigid_body_global_state* rbs, const hinge_constraint* input, const constraint_body_pair* bodyPairs, float dt);
+	void (*solveHingeVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+
+	simd_constraint_solver (*initializeConeTwistVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const cone_twist_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+	void (*relinearizeConeTwistVelocityConstraints)(simd_constraint_solver constraints, const rigid_body_global_state* rbs, const cone_twist_constraint* input, const constraint_body_pair* bodyPairs, float dt);
+	void (*solveConeTwistVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+
+	simd_constraint_solver (*initializeSliderVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const slider_constraint* input, const constraint_body_pair* bodyPairs, uint32 count, float dt);
+	void (*relinearizeSliderVelocityConstraints)(simd_constraint_solver constraints, const rigid_body_global_state* rbs, const slider_constraint* input, const constraint_body_pair* bodyPairs, float dt);
+	void (*solveSliderVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+
+	simd_constraint_solver (*initializeCollisionVelocityConstraints)(memory_arena& arena, const rigid_body_global_state* rbs, const collision_contact* contacts, const contact_impulse* initialImpulses, 
+		const constraint_body_pair* bodyPairs, uint32 numContacts, physics_index dummyRigidBodyIndex, float dt);
+	void (*updateCollisionVelocityConstraintBias)(simd_constraint_solver constraints, const collision_contact* contacts, float dt);
+	void (*warmStartCollisionVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+	void (*solveCollisionVelocityConstraints)(simd_constraint_solver constraints, rigid_body_global_state* rbs);
+	void (*getCollisionImpulses)(simd_constraint_solver constraints, contact_impulse* outImpulses);
+
+	// Cloth constraints (see cloth.cpp). Solve all colors once.
+	void (*solveClothVelocities)(const cloth_solver_data& data);
+	void (*solveClothPositions)(const cloth_solver_data& data);
+	void (*solveClothPositionsXPBD)(const cloth_solver_data& data);
+};
+
+// Out-of-line helpers for the kernels. The kernel translation units must not instantiate inline or template code from shared headers,
+// because they are compiled with a different instruction set than the rest of the program (see physics_simd_kernels.h).
+void pushColliderPairs(arena_array<collider_pair>& outCollisions, const collider_pair* pairs, uint32 count);
+void physicsSIMDAssertionFailed(const char* condition, const char* file, int line);
+
+#if ENABLE_CPU_PROFILING
+struct physics_simd_profile_block
+{
+	cpu_profile_block_recorder recorder;
+
+	physics_simd_profile_block(const char* name);
+	~physics_simd_profile_block();
+};
+
+void physicsSIMDProfileStat(const char* label, uint32 value);
+#endif
+
+// Returns the kernels for the requested width, or the widest width supported by the CPU, if the requested one is not supported or auto.
+// Returns null if the CPU does not even support the 4-wide kernels. The scalar code paths have to be used in that case.
+const physics_simd_kernels* getPhysicsSIMDKernels(physics_simd_width width = physics_simd_width_auto);
@@ -0,0 +1,161 @@
+#pragma once
+
+// Instantiates the SIMD kernels for one vector width. Included once by each of physics_simd_w*.cpp, which define
+// PHYSICS_SIMD_WIDTH and PHYSICS_SIMD_KERNELS and are compiled with the matching instruction set.
+// Everything in here ends up in an anonymous namespace, so that the different widths do not clash.
+
+#include "physics_simd.h"
+#include "heightmap_collision.h"
+#include "cloth.h"
+#include "bounding_volumes_simd.h"
+#include "core/math_simd.h"
+#include "core/cpu_profiling.h"
+
+#if PHYSICS_SIMD_WIDTH == 4
+#if !defined(SIMD_SSE_2)
+#error The 4-wide kernels require SSE.
+#endif
+typedef w4_float w_float;
+typedef w4_int w_int;
+#elif PHYSICS_SIMD_WIDTH == 8
+#if !defined(SIMD_AVX_2)
+#error The 8-wide kernels must be compiled with AVX2.
+#endif
+typedef w8_float w_float;
+typedef w8_int w_int;
+#elif PHYSICS_SIMD_WIDTH == 16
+#if !defined(SIMD_AVX_512)
+#error The 16-wide kernels must be compiled with AVX-512.
+#endif
+typedef w16_float w_float;
+typedef w16_int w_int;
+#else
+#error Unsupported SIMD width.
+#endif
+
+static_assert(PHYSICS_SIMD_WIDTH <= PHYSICS_MAX_SIMD_WIDTH);
+
+typedef wN_vec2<w_float> w_vec2;
+typedef wN_vec3<w_float> w_vec3;
+typedef wN_vec4<w_float> w_vec4;
+typedef wN_quat<w_float> w_quat;
+typedef wN_mat2<w_float> w_mat2;
+typedef wN_mat3<w_float> w_mat3;
+
+typedef wN_bounding_sphere<w_float> w_bounding_sphere;
+typedef wN_bounding_capsule<w_float> w_bounding_capsule;
+typedef wN_bounding_cylinder<w_float> w_bounding_cylinder;
+typedef wN_bounding_box<w_float> w_bounding_box;
+typedef wN_bounding_oriented_box<w_float> w_bounding_oriented_box;
+typedef wN_line_segment<w_float> w_line_segment;
+
+namespace
+{
+// Inline functions and template instantiations from shared headers would be emitted as COMDATs here, compiled with this width's
+// instruction set. The linker keeps an arbitrary copy of each for the whole program, so the kernels must not use any. Shared
+// functionality is either reimplemented below (with internal linkage) or called out of line (see physics_simd.cpp).
+// This includes the constructors of the scalar math types and the scalar math functions, which construct them. The kernels only 
+// read and write the members of those types. The static functions of core/math_simd.h and bounding_volumes_simd.h are fine.
+
+#undef ASSERT
+#define ASSERT(cond) \
+	(void)((!!(cond)) || (physicsSIMDAssertionFailed(#cond, __FILE__, __LINE__), ::__debugbreak(), 0))
+
+#if ENABLE_CPU_PROFILING
+#undef _CPU_PROFILE_BLOCK_
+#define _CPU_PROFILE_BLOCK_(counter, name) physics_simd_profile_block COMPOSITE_VARNAME(__PROFILE_BLOCK, counter)(name)
+#define CPU_PROFILE_STAT(label, value) physicsSIMDProfileStat(label, value)
+#endif
+
+// Replaces memory_arena::allocate<T>.
+template <typename T>
+static T* allocateArray(memory_arena& arena, uint32 count)
+{
+	return (T*)arena.allocate(sizeof(T) * count, alignof(T));
+}
+
+// Replace the min and max templates from pch.h.
+static uint32 minUint32(uint32 a, uint32 b) { return (a < b) ? a : b; }
+static uint32 maxUint32(uint32 a, uint32 b) { return (a < b) ? b : a; }
+
+// Replaces the exclusivePrefixSum template from core/math.h.
+static void exclusivePrefixSumUint32(const uint32* input, uint32* output, uint32 count)
+{
+	if (count > 0)
+	{
+		output[0] = 0;
+		for (uint32 i = 1; i < count; ++i)
+		{
+			output[i] = output[i - 1] + input[i - 1];
+		}
+	}
+}
+
+#include "collision_broad_simd.h"
+#include "collision_narrow_simd.h"
+#include "heightmap_collision_simd.h"
+#include "constraints_simd.h"
+#include "cloth_simd.h"
+}
+
+#define SIMD_COLLISION(a, b) getSIMDCollisionFunction<a, b>()
+
+extern const physics_simd_kernels PHYSICS_SIMD_KERNELS =
+{
+	PHYSICS_SIMD_WIDTH,
+
+	determineOverlapsSIMD,
+
+	// Same layout as the scalar table. The first type is always the smaller one.
+	{
+		{ SIMD_COLLISION(bounding_sphere, bounding_sphere), SIMD_COLLISION(bounding_sphere, bounding_capsule), SIMD_COLLISION(bounding_sphere, bounding_cylinder),
+			SIMD_COLLISION(bounding_sphere, bounding_box), SIMD_COLLISION(bounding_sphere, bounding_oriented_box), 0 },
+		{ 0, SIMD_COLLISION(bounding_capsule, bounding_capsule), SIMD_COLLISION(bounding_capsule, bounding_cylinder),
+			SIMD_COLLISION(bounding_capsule, bounding_box), SIMD_COLLISION(bounding_capsule, bounding_oriented_box), 0 },
+		{ 0, 0, SIMD_COLLISION(bounding_cylinder, bounding_cylinder),
+			SIMD_COLLISION(bounding_cylinder, bounding_box), SIMD_COLLISION(bounding_cylinder, bounding_oriented_box), 0 },
+		{ 0, 0, 0, SIMD_COLLISION(bounding_box, bounding_box), SIMD_COLLISION(bounding_box, bounding_oriented_box), 0 },
+		{ 0, 0, 0, 0, SIMD_COLLISION(bounding_oriented_box, bounding_oriented_box), 0 },
+		{ 0, 0, 0, 0, 0, 0 },
+	},
+
+	collideSphereVsTrianglesSIMD,
+	collideCapsuleVsTrianglesSIMD,
+	collideAABBVsTrianglesSIMD,
+
+	initializeDistanceVelocityConstraintsSIMD,
+	relinearizeDistanceVelocityConstraintsSIMD,
+	solveDistanceVelocityConstraintsSIMD,
+
+	initializeBallVelocityConstraintsSIMD,
+	relinearizeBallVelocityConstraintsSIMD,
+	solveBallVelocityConstraintsSIMD,
+
+	initializeFixedVelocityConstraintsSIMD,
+	relinearizeFixedVelocityConstraintsSIMD,
+	solveFixedVelocityConstraintsSIMD,
+
+	initializeHingeVelocityConstraintsSIMD,
+	relinearizeHingeVelocityConstraintsSIMD,
+	solveHingeVelocityConstraintsSIMD,
+
+	initializeConeTwistVelocityConstraintsSIMD,
+	relinearizeConeTwistVelocityConstraintsSIMD,
+	solveConeTwistVelocityConstraintsSIMD,
+
+	initializeSliderVelocityConstraintsSIMD,
+	relinearizeSliderVelocityConstraintsSIMD,
+	solveSliderVelocityConstraintsSIMD,
+
+	initializeCollisionVelocityConstraintsSIMD,
+	updateCollisionVelocityConstraintBiasSIMD,
+	warmStartCollisionVelocityConstraintsSIMD,
+	solveCollisionVelocityConstraintsSIMD,
+	getCollisionImpulsesSIMD,
+
+	solveClothVelocitiesSIMD,
+	solveClothPositionsSIMD,
+	solveClothPositionsXPBDSIMD,
+};
+
+#undef SIMD_COLLISION
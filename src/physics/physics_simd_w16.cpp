@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// Compiled with /arch:AVX512, see premake5.lua.
+#define PHYSICS_SIMD_WIDTH 16u
+#define PHYSICS_SIMD_KERNELS physicsSIMDKernels16
+#include "physics_simd_kernels.h"
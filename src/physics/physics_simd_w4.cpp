@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// Compiled with the default instruction set (SSE4.1 without FMA), see premake5.lua and core/simd.h.
+#define PHYSICS_SIMD_WIDTH 4u
+#define PHYSICS_SIMD_KERNELS physicsSIMDKernels4
+#include "physics_simd_kernels.h"
@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// Compiled with /arch:AVX2, see premake5.lua.
+#define PHYSICS_SIMD_WIDTH 8u
+#define PHYSICS_SIMD_KERNELS physicsSIMDKernels8
+#include "physics_simd_kernels.h"
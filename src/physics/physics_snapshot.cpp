@@ -0,0 +1,203 @@
+#include "pch.h"
+#include "physics_snapshot.h"
+#include "collision_broad.h"
+#include "mesh_collider.h"
+#include "core/cpu_profiling.h"
+
+// Trivially copyable pools, which are copied as a whole. Their order in the pools is checked before restoring.
+#define SNAPSHOT_POOLS \
+	rigid_body_component, \
+	physics_transform0_component, \
+	physics_transform1_component, \
+	sap_endpoint_indirection_component, \
+	distance_constraint, \
+	ball_constraint, \
+	fixed_constraint, \
+	hinge_constraint, \
+	cone_twist_constraint, \
+	slider_constraint
+
+template <typename component_t>
+static void saveLayout(game_scene& scene, physics_snapshot_writer& writer)
+{
+	auto view = scene.view<component_t>();
+	uint32 count = (uint32)view.size();
+	writer.write(count);
+
+	entity_handle* entities = (entity_handle*)writer.allocate(sizeof(entity_handle) * count);
+	for (entity_handle entityHandle : view)
+	{
+		*entities++ = entityHandle;
+	}
+}
+
+template <typename component_t>
+static bool checkLayout(game_scene& scene, physics_snapshot_reader& reader)
+{
+	auto view = scene.view<component_t>();
+	uint32 count;
+	if (!reader.read(count) || count != (uint32)view.size())
+	{
+		return false;
+	}
+
+	const entity_handle* entities = (const entity_handle*)reader.consume(sizeof(entity_handle) * count);
+	if (!entities)
+	{
+		return false;
+	}
+
+	for (entity_handle entityHandle : view)
+	{
+		if (*entities++ != entityHandle)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// EnTT stores components in pages, which are only contiguous within a page.
+template <typename component_t>
+static void savePool(game_scene& scene, physics_snapshot_writer& writer)
+{
+	static_assert(std::is_trivially_copyable_v<component_t>);
+
+	auto& storage = scene.registry.storage<component_t>();
+	uint32 count = (uint32)storage.size();
+	component_t** pages = storage.raw();
+	const uint32 pageSize = (uint32)entt::component_traits<component_t>::page_size;
+
+	for (uint32 i = 0; i < count; i += pageSize)
+	{
+		writer.write(pages[i / pageSize], sizeof(component_t) * min(pageSize, count - i));
+	}
+}
+
+template <typename component_t>
+static bool restorePool(game_scene& scene, physics_snapshot_reader& reader)
+{
+	auto& storage = scene.registry.storage<component_t>();
+	uint32 count = (uint32)storage.size();
+	component_t** pages = storage.raw();
+	const uint32 pageSize = (uint32)entt::component_traits<component_t>::page_size;
+
+	for (uint32 i = 0; i < count; i += pageSize)
+	{
+		if (!reader.read(pages[i / pageSize], sizeof(component_t) * min(pageSize, count - i)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename... component_t>
+static void saveLayouts(game_scene& scene, physics_snapshot_writer& writer)
+{
+	(saveLayout<component_t>(scene, writer), ...);
+}
+
+template <typename... component_t>
+static bool checkLayouts(game_scene& scene, physics_snapshot_reader& reader)
+{
+	return (checkLayout<component_t>(scene, reader) && ...);
+}
+
+template <typename... component_t>
+static void savePools(game_scene& scene, physics_snapshot_writer& writer)
+{
+	(savePool<component_t>(scene, writer), ...);
+}
+
+template <typename... component_t>
+static bool restorePools(game_scene& scene, physics_snapshot_reader& reader)
+{
+	return (restorePool<component_t>(scene, reader) && ...);
+}
+
+void savePhysicsSnapshot(game_scene& scene, physics_snapshot& outSnapshot)
+{
+	CPU_PROFILE_BLOCK("Save physics snapshot");
+
+	outSnapshot.buffer.clear();
+	physics_snapshot_writer writer = { outSnapshot.buffer };
+
+	// Layout first, so that restoring can reject the snapshot before anything is overwritten.
+	saveLayouts<SNAPSHOT_POOLS, cloth_component, mesh_collider_component>(scene, writer);
+	for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+	{
+		writer.write(cloth.gridSizeX);
+		writer.write(cloth.gridSizeY);
+		writer.write(cloth.getNumConstraints());
+	}
+
+	savePools<SNAPSHOT_POOLS>(scene, writer);
+	for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+	{
+		cloth.saveState(writer);
+	}
+
+	// Mesh colliders can be moved. Their geometry is shared and never changes.
+	for (auto [entityHandle, mesh] : scene.view<mesh_collider_component>().each())
+	{
+		writer.write(mesh.getRotation());
+		writer.write(mesh.getPosition());
+	}
+
+	saveBroadphaseState(scene, writer);
+	savePhysicsContextState(scene, writer);
+}
+
+bool restorePhysicsSnapshot(game_scene& scene, const physics_snapshot& snapshot)
+{
+	CPU_PROFILE_BLOCK("Restore physics snapshot");
+
+	physics_snapshot_reader reader = { snapshot.buffer.data(), snapshot.buffer.size() };
+
+	if (!checkLayouts<SNAPSHOT_POOLS, cloth_component, mesh_collider_component>(scene, reader))
+	{
+		return false;
+	}
+	for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+	{
+		uint32 gridSizeX, gridSizeY, numConstraints;
+		if (!reader.read(gridSizeX) || !reader.read(gridSizeY) || !reader.read(numConstraints) 
+			|| gridSizeX != cloth.gridSizeX || gridSizeY != cloth.gridSizeY || numConstraints != cloth.getNumConstraints())
+		{
+			return false;
+		}
+	}
+
+	// The layout matches, so the rest can only fail if the buffer is corrupt.
+	bool success = restorePools<SNAPSHOT_POOLS>(scene, reader);
+	for (auto [entityHandle, cloth] : scene.view<cloth_component>().each())
+	{
+		success = success && cloth.restoreState(reader);
+	}
+	for (auto [entityHandle, mesh] : scene.view<mesh_collider_component>().each())
+	{
+		quat rotation;
+		vec3 position;
+		if (success && reader.read(rotation) && reader.read(position))
+		{
+			mesh.setTransform(rotation, position);
+		}
+		else
+		{
+			success = false;
+		}
+	}
+	success = success
+		&& restoreBroadphaseState(scene, reader)
+		&& restorePhysicsContextState(scene, reader);
+
+	ASSERT(success && reader.offset == reader.size);
+
+	for (auto [entityHandle, transform, physicsTransform1] : scene.group(component_group<transform_component, physics_transform1_component>).each())
+	{
+		transform = physicsTransform1;
+	}
+
+	return success;
+}
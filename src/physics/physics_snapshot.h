@@ -0,0 +1,131 @@
+#pragma once
+
+#include "physics.h"
+
+// Snapshots capture the complete simulation state of a scene in one contiguous buffer: Rigid bodies, physics transforms, constraints,
+// cloth particles and the internal state carried from one step to the next (broadphase endpoint order and AABB tree, contact and separating axis caches,
+// sleep islands, collision events). Restoring a snapshot and simulating with the same settings and time steps gives bit-identical results.
+// This is meant for rollback and for resetting training episodes, without rebuilding the scene.
+//
+// A snapshot can only be restored into the scene it was taken from, and only as long as no entity with physics components has been
+// created or deleted since (i.e. the component pools must have the same layout). This is checked before anything is overwritten.
+
+struct physics_snapshot
+{
+	std::vector<uint8> buffer; // Saving into the same snapshot again reuses this, so only the first save allocates.
+};
+
+void savePhysicsSnapshot(game_scene& scene, physics_snapshot& outSnapshot);
+
+// Returns false and leaves the scene untouched, if the scene's layout does not match the snapshot.
+// The render transforms of rigid bodies are set to the restored physics transforms.
+bool restorePhysicsSnapshot(game_scene& scene, const physics_snapshot& snapshot);
+
+
+
+
+// Internal.
+
+struct physics_snapshot_writer
+{
+	std::vector<uint8>& buffer;
+
+	uint8* allocate(uint64 size)
+	{
+		uint64 offset = buffer.size();
+		buffer.resize(offset + size);
+		return buffer.data() + offset;
+	}
+
+	void write(const void* data, uint64 size)
+	{
+		memcpy(allocate(size), data, size);
+	}
+
+	template <typename T>
+	void write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		write(&value, sizeof(T));
+	}
+
+	template <typename T>
+	void writeArray(const T* data, uint32 count)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		write(count);
+		write(data, sizeof(T) * count);
+	}
+
+	template <typename T>
+	void writeArray(const std::vector<T>& v)
+	{
+		writeArray(v.data(), (uint32)v.size());
+	}
+};
+
+struct physics_snapshot_reader
+{
+	const uint8* data;
+	uint64 size;
+	uint64 offset = 0;
+
+	// Returns null if the buffer is too small.
+	const uint8* consume(uint64 readSize)
+	{
+		if (offset + readSize > size)
+		{
+			return 0;
+		}
+		const uint8* result = data + offset;
+		offset += readSize;
+		return result;
+	}
+
+	bool read(void* out, uint64 readSize)
+	{
+		const uint8* in = consume(readSize);
+		if (!in)
+		{
+			return false;
+		}
+		memcpy(out, in, readSize);
+		return true;
+	}
+
+	template <typename T>
+	bool read(T& out)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return read(&out, sizeof(T));
+	}
+
+	// Fails if the stored count does not match.
+	template <typename T>
+	bool readArray(T* out, uint32 expectedCount)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		uint32 count;
+		return read(count) && count == expectedCount && read(out, sizeof(T) * count);
+	}
+
+	template <typename T>
+	bool readArray(std::vector<T>& out)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		uint32 count;
+		if (!read(count) || offset + sizeof(T) * count > size)
+		{
+			return false;
+		}
+		out.resize(count);
+		return read(out.data(), sizeof(T) * count);
+	}
+};
+
+// Implemented next to the respective context variables.
+void saveBroadphaseState(game_scene& scene, physics_snapshot_writer& writer);
+bool restoreBroadphaseState(game_scene& scene, physics_snapshot_reader& reader);
+
+void savePhysicsContextState(game_scene& scene, physics_snapshot_writer& writer);
+bool restorePhysicsContextState(game_scene& scene, physics_snapshot_reader& reader);
@@ -0,0 +1,195 @@
+#include "pch.h"
+#include "physics_thread.h"
+#include "physics_snapshot.h"
+#include "rigid_body.h"
+#include "core/cpu_profiling.h"
+#include "core/log.h"
+
+void physics_thread::start(game_scene& scene, const physics_settings& settings)
+{
+	ASSERT(!isRunning());
+	ASSERT(settings.fixedFrameRate);
+
+	physicsScene = game_scene();
+	scene.cloneTo(physicsScene);
+
+	this->settings = settings;
+	fixedTimeStep = 1.0 / settings.frameRate;
+
+	entities.clear();
+	for (auto [entityHandle, physicsTransform1] : physicsScene.view<physics_transform1_component>().each())
+	{
+		entities.push_back(entityHandle);
+	}
+
+	// The main thread starts out with the initial state as both the current and the previous snapshot.
+	writeIndex = 0;
+	sharedIndex = 1;
+	readIndex = 2;
+	writeSnapshot(snapshots[readIndex], 0.0);
+	writeSnapshot(previous, 0.0);
+
+	requestedTime = 0.0;
+	numSimulatedSteps = 0;
+	running = true;
+
+	thread = std::thread([this]() { threadFunc(); });
+}
+
+void physics_thread::stop(game_scene* writeBackTo)
+{
+	if (!isRunning())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard lock(mutex);
+		running = false;
+	}
+	wakeCondition.notify_one();
+	thread.join();
+
+	if (writeBackTo)
+	{
+		writeBack(*writeBackTo);
+	}
+
+	physicsScene = game_scene();
+}
+
+void physics_thread::writeSnapshot(transform_snapshot& snapshot, double time)
+{
+	snapshot.time = time;
+	snapshot.transforms.resize(entities.size());
+	for (uint32 i = 0; i < (uint32)entities.size(); ++i)
+	{
+		snapshot.transforms[i] = physicsScene.registry.get<physics_transform1_component>(entities[i]);
+	}
+}
+
+void physics_thread::threadFunc()
+{
+	// Without a fixed frame rate, physicsStep takes exactly one step of the given length. The fixed rate is handled here instead.
+	physics_settings stepSettings = settings;
+	stepSettings.fixedFrameRate = false;
+	float timer = 0.f;
+
+	while (true)
+	{
+		double targetTime;
+		{
+			std::unique_lock lock(mutex);
+			wakeCondition.wait(lock, [this]() { return !running || numSimulatedSteps * fixedTimeStep < requestedTime; });
+			if (!running)
+			{
+				break;
+			}
+			targetTime = requestedTime;
+		}
+
+		// Like on the main thread, the simulation may run up to one step ahead of the requested time.
+		uint32 physicsIterations = 0;
+		while (numSimulatedSteps * fixedTimeStep < targetTime && physicsIterations++ < settings.maxPhysicsIterationsPerFrame)
+		{
+			CPU_PROFILE_BLOCK("Async physics step");
+
+			physicsStep(physicsScene, arena, timer, stepSettings, (float)fixedTimeStep);
+			++numSimulatedSteps;
+		}
+
+		if (numSimulatedSteps * fixedTimeStep < targetTime)
+		{
+			numSimulatedSteps = (uint64)ceil(targetTime / fixedTimeStep);
+			LOG_WARNING("Dropping physics frames");
+		}
+
+		writeSnapshot(snapshots[writeIndex], numSimulatedSteps * fixedTimeStep);
+		writeIndex = sharedIndex.exchange(writeIndex | NEW_SNAPSHOT_BIT) & ~NEW_SNAPSHOT_BIT;
+	}
+}
+
+void physics_thread::update(game_scene& scene, float dt)
+{
+	CPU_PROFILE_BLOCK("Interpolate async physics");
+
+	ASSERT(isRunning());
+
+	{
+		std::lock_guard lock(mutex);
+		requestedTime += dt;
+	}
+	wakeCondition.notify_one();
+
+	if (sharedIndex.load() & NEW_SNAPSHOT_BIT)
+	{
+		// The buffer of the old previous snapshot goes back to the physics thread, which overwrites it.
+		previous.time = snapshots[readIndex].time;
+		std::swap(previous.transforms, snapshots[readIndex].transforms);
+		readIndex = sharedIndex.exchange(readIndex) & ~NEW_SNAPSHOT_BIT;
+	}
+
+	const transform_snapshot& current = snapshots[readIndex];
+
+	// Rendering lags one step behind, so that usually there is a newer snapshot to interpolate towards.
+	double renderTime = min(max(requestedTime - fixedTimeStep, previous.time), current.time);
+	float t = (current.time > previous.time) ? (float)((renderTime - previous.time) / (current.time - previous.time)) : 1.f;
+
+	for (uint32 i = 0; i < (uint32)entities.size(); ++i)
+	{
+		scene_entity entity = { entities[i], scene };
+		if (!scene.isEntityValid(entity))
+		{
+			continue;
+		}
+
+		if (transform_component* transform = entity.getComponentIfExists<transform_component>())
+		{
+			*transform = lerp(previous.transforms[i], current.transforms[i], t);
+		}
+		if (physics_transform1_component* physicsTransform1 = entity.getComponentIfExists<physics_transform1_component>())
+		{
+			*physicsTransform1 = current.transforms[i];
+		}
+	}
+}
+
+void physics_thread::writeBack(game_scene& scene)
+{
+	CPU_PROFILE_BLOCK("Write back async physics");
+
+	physics_snapshot snapshot;
+	savePhysicsSnapshot(physicsScene, snapshot);
+	if (restorePhysicsSnapshot(scene, snapshot))
+	{
+		return;
+	}
+
+	// The pool layouts differ, e.g. because entities were created in the meantime. Copy at least the motion of the bodies.
+	// Contact caches etc. are rebuilt by the next steps.
+	for (entity_handle entityHandle : entities)
+	{
+		scene_entity src = { entityHandle, physicsScene };
+		scene_entity dst = { entityHandle, scene };
+		if (!scene.isEntityValid(dst))
+		{
+			continue;
+		}
+
+		rigid_body_component* srcRb = src.getComponentIfExists<rigid_body_component>();
+		rigid_body_component* dstRb = dst.getComponentIfExists<rigid_body_component>();
+		if (!srcRb || !dstRb || !dst.hasComponent<physics_transform1_component>())
+		{
+			continue;
+		}
+
+		dstRb->linearVelocity = srcRb->linearVelocity;
+		dstRb->angularVelocity = srcRb->angularVelocity;
+		dstRb->wakeUp();
+
+		const trs& transform = src.getComponent<physics_transform1_component>();
+		dst.getComponent<physics_transform0_component>() = transform;
+		dst.getComponent<physics_transform1_component>() = transform;
+		dst.getComponent<transform_component>() = transform;
+	}
+}
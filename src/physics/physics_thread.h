@@ -0,0 +1,74 @@
+#pragma once
+
+#include "physics.h"
+#include "core/memory.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Runs the fixed rate simulation on its own thread, so that physics spikes do not show up in the frame time.
+// The thread simulates a private clone of the scene. After each batch of steps it publishes the transforms of all rigid bodies through
+// a lock-free triple buffer. The main thread interpolates between the last two snapshots it received, one fixed step behind the requested time.
+//
+// While running, the physics components of the original scene are output only: Forces, new bodies, edited colliders etc. are not seen by the simulation.
+// Stop (and write back) and restart the thread to apply such changes, as well as changed settings.
+// Collision callbacks are called from the physics thread.
+
+struct physics_thread
+{
+	physics_thread() { arena.initialize(0, GB(1)); }
+	~physics_thread() { stop(); }
+
+	// Only the fixed frame rate mode is supported.
+	void start(game_scene& scene, const physics_settings& settings);
+
+	// If writeBackTo is set, the simulated state is copied into it, so that the simulation can continue from there on the main thread.
+	void stop(game_scene* writeBackTo = 0);
+
+	bool isRunning() const { return thread.joinable(); }
+
+	// Advances the requested simulation time by dt and writes the interpolated transforms into the scene.
+	// The physics transforms of the scene are set to the latest snapshot, so that scene queries see the newest state.
+	void update(game_scene& scene, float dt);
+
+private:
+	struct transform_snapshot
+	{
+		double time;
+		std::vector<trs> transforms; // One per rigid body, in the order of entities.
+	};
+
+	void threadFunc();
+	void writeSnapshot(transform_snapshot& snapshot, double time);
+	void writeBack(game_scene& scene);
+
+	game_scene physicsScene;
+	physics_settings settings;
+	memory_arena arena;
+	double fixedTimeStep;
+
+	std::vector<entity_handle> entities;
+
+	// The physics thread writes into writeIndex and the main thread reads from readIndex. The third buffer is exchanged through sharedIndex,
+	// whose high bit is set if it holds a snapshot, which the main thread has not seen yet.
+	static constexpr uint32 NEW_SNAPSHOT_BIT = (1u << 31);
+
+	transform_snapshot snapshots[3];
+	uint32 writeIndex;
+	uint32 readIndex;
+	std::atomic<uint32> sharedIndex;
+
+	transform_snapshot previous; // Main thread only. The snapshot before snapshots[readIndex].
+
+	// Only for waking the physics thread up. Snapshots are never exchanged under the lock.
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	double requestedTime;
+	bool running = false;
+
+	uint64 numSimulatedSteps; // Physics thread only.
+
+	std::thread thread;
+};
@@ -19,11 +19,14 @@ rigid_body_component::rigid_body_component(bool kinematic, float gravityFactor,
 	this->gravityFactor = gravityFactor;
 	this->linearDamping = linearDamping;
 	this->angularDamping = angularDamping;
+	this->continuousCollisionDetection = false;
 	this->localCOGPosition = vec3(0.f);
 	this->linearVelocity = vec3(0.f);
 	this->angularVelocity = vec3(0.f);
 	this->forceAccumulator = vec3(0.f);
 	this->torqueAccumulator = vec3(0.f);
+	this->sleepTimer = 0.f;
+	this->sleepIsland = INVALID_SLEEP_ISLAND;
 }
 
 void rigid_body_component::recalculateProperties(entt::registry* registry, const physics_reference_component& reference)
@@ -97,6 +100,20 @@ void rigid_body_component::applyGravityAndIntegrateForces(rigid_body_global_stat
 	global.rotation = transform.rotation;
 	global.position = transform.position + transform.rotation * localCOGPosition;
 
+	global.localCOGPosition = localCOGPosition;
+
+	if (isSleeping())
+	{
+		// Sleeping bodies behave like kinematic bodies at rest. Forces, which arrived after the wake-up pass, are kept in the accumulators, 
+		// so that the whole sleep island is woken up at the beginning of the next step. Waking the body up alone here would let it move
+		// without its sleeping neighbors.
+		global.invInertia = mat3::zero;
+		global.invMass = 0.f;
+		global.linearVelocity = vec3(0.f);
+		global.angularVelocity = vec3(0.f);
+		return;
+	}
+
 	mat3 rot = quaternionToMat3(global.rotation);
 	global.invInertia = rot * invInertia * transpose(rot);
 	global.invMass = invMass;
@@ -120,7 +137,6 @@ void rigid_body_component::applyGravityAndIntegrateForces(rigid_body_global_stat
 
 	global.linearVelocity = linearVelocity;
 	global.angularVelocity = angularVelocity;
-	global.localCOGPosition = localCOGPosition;
 }
 
 void rigid_body_component::integrateVelocity(const rigid_body_global_state& global, trs& transform, float dt)
@@ -140,3 +156,18 @@ void rigid_body_component::integrateVelocity(const rigid_body_global_state& glob
 	transform.rotation = rotation;
 	transform.position = position - rotation * localCOGPosition;
 }
+
+void rigid_body_component::putToSleep(uint32 island)
+{
+	ASSERT(island != INVALID_SLEEP_ISLAND);
+
+	sleepIsland = island;
+	linearVelocity = vec3(0.f);
+	angularVelocity = vec3(0.f);
+}
+
+void rigid_body_component::wakeUp()
+{
+	sleepIsland = INVALID_SLEEP_ISLAND;
+	sleepTimer = 0.f;
+}
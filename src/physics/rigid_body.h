@@ -15,6 +15,8 @@ struct rigid_body_global_state
 	vec3 angularVelocity;
 };
 
+static constexpr uint32 INVALID_SLEEP_ISLAND = UINT32_MAX;
+
 struct rigid_body_component
 {
 	rigid_body_component() : rigid_body_component(true, 1.f) {}
@@ -27,6 +29,11 @@ struct rigid_body_component
 	void applyGravityAndIntegrateForces(rigid_body_global_state& global, const trs& transform, float dt);
 	void integrateVelocity(const rigid_body_global_state& global, trs& transform, float dt);
 
+	// The physics step keeps the world space colliders of sleeping bodies. Wake a body up before moving it by hand.
+	bool isSleeping() const { return sleepIsland != INVALID_SLEEP_ISLAND; }
+	void putToSleep(uint32 island);
+	void wakeUp();
+
 
 	// In entity's local space.
 	vec3 localCOGPosition;
@@ -37,12 +44,20 @@ struct rigid_body_component
 	float linearDamping;
 	float angularDamping;
 
+	// Prevents fast bodies from tunneling through static geometry. Only needed for small and fast bodies, like projectiles.
+	bool continuousCollisionDetection;
+
 	// In global space.
 	vec3 linearVelocity;
 	vec3 angularVelocity;
 
 	vec3 forceAccumulator;
 	vec3 torqueAccumulator;
+
+	// Sleeping bodies are excluded from the simulation until something wakes them up.
+	// Bodies which fell asleep together share a sleep island and are always woken up together.
+	float sleepTimer; // Time the body has been at rest.
+	uint32 sleepIsland;
 };
 
 struct physics_transform0_component : trs 
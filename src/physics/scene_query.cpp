@@ -0,0 +1,684 @@
+#include "pch.h"
+#include "scene_query.h"
+#include "collision_broad.h"
+#include "collision_gjk.h"
+#include "aabb_tree.h"
+#include "mesh_collider.h"
+#include "terrain/heightmap_collider.h"
+#include "core/cpu_profiling.h"
+
+
+#define SWEEP_TOLERANCE 1e-3f
+#define MAX_NUM_SWEEP_ITERATIONS 32
+
+
+// Iterating over heightmap triangles needs temporary memory. Queries may be issued from multiple threads, so each thread gets its own arena.
+static memory_arena& getHeightmapQueryArena()
+{
+	thread_local memory_arena arena;
+	if (!arena.base())
+	{
+		arena.initialize(0, GB(1));
+	}
+	return arena;
+}
+
+static bool passesFilter(const scene_query_filter& filter, const physics_material& material)
+{
+	return material.type == physics_material_type_none || (filter.materialTypeMask & (1u << material.type));
+}
+
+// Returns false, if the collider is filtered out.
+static bool getQueryCollider(game_scene& scene, entity_handle colliderEntityHandle, const scene_query_filter& filter,
+	scene_entity& outEntity, collider_union& outCollider, bounding_box& outAABB)
+{
+	const collider_component& collider = scene.registry.get<collider_component>(colliderEntityHandle);
+
+	if (!(filter.layerMask & (1u << collider.layer)) || !passesFilter(filter, collider.material))
+	{
+		return false;
+	}
+
+	if (collider.parentEntity == filter.ignoredEntity)
+	{
+		return false;
+	}
+
+	scene_entity entity = { collider.parentEntity, scene };
+
+	if (!filter.includeTriggers && (entity.hasComponent<trigger_component>() || entity.hasComponent<force_field_component>()))
+	{
+		return false;
+	}
+
+	if (!filter.includeDynamicBodies)
+	{
+		rigid_body_component* rb = entity.getComponentIfExists<rigid_body_component>();
+		if (rb && rb->invMass != 0.f)
+		{
+			return false;
+		}
+	}
+
+	physics_transform1_component* physicsTransformComponent = entity.getComponentIfExists<physics_transform1_component>();
+	transform_component* transformComponent = entity.getComponentIfExists<transform_component>();
+	const trs& transform = physicsTransformComponent ? *physicsTransformComponent : transformComponent ? *transformComponent : trs::identity;
+
+	getWorldSpaceCollider(collider, transform, outCollider, outAABB);
+	outEntity = entity;
+	return true;
+}
+
+// Calls func(supportFunction, radius). Spheres and capsules are passed as their core (a point or a segment) and their radius,
+// which makes the GJK queries much more robust for these shapes.
+template <typename func_t>
+static auto visitCollider(const collider_union& collider, const func_t& func)
+{
+	switch (collider.type)
+	{
+		case collider_type_sphere:
+		{
+			bounding_capsule core = { collider.sphere.center, collider.sphere.center, 0.f };
+			return func(capsule_support_fn{ core }, collider.sphere.radius);
+		}
+		case collider_type_capsule:
+		{
+			bounding_capsule core = { collider.capsule.positionA, collider.capsule.positionB, 0.f };
+			return func(capsule_support_fn{ core }, collider.capsule.radius);
+		}
+		case collider_type_cylinder: return func(cylinder_support_fn{ collider.cylinder }, 0.f);
+		case collider_type_aabb: return func(aabb_support_fn{ collider.aabb }, 0.f);
+		case collider_type_obb: return func(obb_support_fn{ collider.obb }, 0.f);
+		case collider_type_hull: return func(hull_support_fn{ collider.hull }, 0.f);
+	}
+
+	ASSERT(false);
+	return func(aabb_support_fn{ collider.aabb }, 0.f);
+}
+
+// Returns the enter and exit distance of the ray into the box.
+static bool clipRay(const ray& r, const bounding_box& aabb, float maxDistance, float& outEnter, float& outExit)
+{
+	vec3 invDirection = vec3(1.f / r.direction.x, 1.f / r.direction.y, 1.f / r.direction.z);
+	vec3 t0 = (aabb.minCorner - r.origin) * invDirection;
+	vec3 t1 = (aabb.maxCorner - r.origin) * invDirection;
+	vec3 tMin = min(t0, t1);
+	vec3 tMax = max(t0, t1);
+
+	outEnter = max(max(tMin.x, tMin.y), max(tMin.z, 0.f));
+	outExit = min(min(tMax.x, tMax.y), min(tMax.z, maxDistance));
+	return outEnter <= outExit;
+}
+
+
+
+
+// ----------------------------------------
+// Raycasts.
+// ----------------------------------------
+
+static bool raycastCollider(const ray& r, const collider_union& collider, float& outT)
+{
+	switch (collider.type)
+	{
+		case collider_type_sphere: return r.intersectSphere(collider.sphere, outT);
+		case collider_type_capsule: return r.intersectCapsule(collider.capsule, outT);
+		case collider_type_cylinder: return r.intersectCylinder(collider.cylinder, outT);
+		case collider_type_aabb: return r.intersectAABB(collider.aabb, outT);
+		case collider_type_obb: return r.intersectOBB(collider.obb, outT);
+		case collider_type_hull: return r.intersectHull(collider.hull, *collider.hull.geometryPtr, outT);
+	}
+	return false;
+}
+
+static vec3 getRaycastNormal(const ray& r, const collider_union& collider, float t)
+{
+	if (t <= 0.f)
+	{
+		return -r.direction;
+	}
+
+	// The intersection functions don't return normals, so we take the direction to the closest point on the collider,
+	// seen from just before the hit point.
+	bounding_sphere p = { r.origin + (t - 0.01f) * r.direction, 0.f };
+
+	vec3 normal = visitCollider(collider, [&p](const auto& support, float radius)
+	{
+		vec3 pointA, pointB;
+		if (!gjkDistance(sphere_support_fn{ p }, support, pointA, pointB))
+		{
+			return vec3(0.f);
+		}
+		return pointA - pointB;
+	});
+
+	return (squaredLength(normal) > 1e-12f) ? normalize(normal) : -r.direction;
+}
+
+
+static bool raycastTriangle(const ray& r, vec3 a, vec3 b, vec3 c, float maxDistance, scene_query_hit& outHit)
+{
+	float t;
+	bool frontFacing;
+	if (!r.intersectTriangle(a, b, c, t, frontFacing) || t > maxDistance)
+	{
+		return false;
+	}
+
+	vec3 normal = noz(cross(b - a, c - a));
+	outHit.distance = t;
+	outHit.point = r.origin + t * r.direction;
+	outHit.normal = frontFacing ? normal : -normal;
+	return true;
+}
+
+
+
+
+// ----------------------------------------
+// Sweeps.
+// ----------------------------------------
+
+template <typename shape_t>
+struct translated_support_fn
+{
+	const shape_t& shape;
+	vec3 translation;
+
+	vec3 operator()(vec3 dir) const
+	{
+		return shape(dir) + translation;
+	}
+};
+
+template <typename shape_t>
+static bounding_box getSupportAABB(const shape_t& shape, float radius)
+{
+	vec3 minCorner(shape(vec3(-1.f, 0.f, 0.f)).x, shape(vec3(0.f, -1.f, 0.f)).y, shape(vec3(0.f, 0.f, -1.f)).z);
+	vec3 maxCorner(shape(vec3(1.f, 0.f, 0.f)).x, shape(vec3(0.f, 1.f, 0.f)).y, shape(vec3(0.f, 0.f, 1.f)).z);
+	return bounding_box::fromMinMax(minCorner - vec3(radius), maxCorner + vec3(radius));
+}
+
+// Conservative advancement of shape A along the direction. Both shapes are given by their support function and a radius around it.
+template <typename shapeA_t, typename shapeB_t>
+static bool sweep(const shapeA_t& shapeA, float radiusA, vec3 direction, float maxDistance, const shapeB_t& shapeB, float radiusB, 
+	bool ignoreInitialOverlap, scene_query_hit& outHit)
+{
+	float radius = radiusA + radiusB;
+	float t = 0.f;
+
+	for (uint32 iteration = 0; iteration < MAX_NUM_SWEEP_ITERATIONS; ++iteration)
+	{
+		translated_support_fn<shapeA_t> movedA = { shapeA, t * direction };
+
+		vec3 pointA, pointB;
+		if (!gjkDistance(movedA, shapeB, pointA, pointB))
+		{
+			// The cores intersect. With a non-zero radius, this only happens if the shapes overlap at the start.
+			if (ignoreInitialOverlap && iteration == 0)
+			{
+				return false;
+			}
+
+			outHit.distance = t;
+			outHit.point = movedA(direction);
+			outHit.normal = -direction;
+			return true;
+		}
+
+		vec3 d = pointA - pointB;
+		float distance = length(d);
+		vec3 normal = d / distance;
+		float gap = distance - radius;
+
+		if (gap <= SWEEP_TOLERANCE)
+		{
+			if (ignoreInitialOverlap && iteration == 0)
+			{
+				return false;
+			}
+
+			outHit.distance = t;
+			outHit.point = pointB + normal * radiusB;
+			outHit.normal = normal;
+			return true;
+		}
+
+		// The shapes can not touch before shape A crosses the separating plane.
+		float approachSpeed = -dot(direction, normal);
+		if (approachSpeed <= 1e-6f)
+		{
+			return false;
+		}
+
+		t += gap / approachSpeed;
+		if (t > maxDistance)
+		{
+			return false;
+		}
+	}
+
+	return false;
+}
+
+
+
+
+// ----------------------------------------
+// Traversal.
+// ----------------------------------------
+
+struct closest_hit_collector
+{
+	scene_query_hit& hit;
+	float maxDistance;
+	bool found = false;
+
+	static const bool closestOnly = true;
+
+	void add(const scene_query_hit& h)
+	{
+		hit = h;
+		maxDistance = h.distance;
+		found = true;
+	}
+};
+
+struct all_hits_collector
+{
+	scene_query_hit* hits;
+	uint32 maxNumHits;
+	float maxDistance;
+	uint32 numHits = 0;
+
+	static const bool closestOnly = false;
+
+	// Keeps the hits sorted by distance. Once the buffer is full, only closer hits are accepted.
+	void add(const scene_query_hit& h)
+	{
+		uint32 index = min(numHits, maxNumHits - 1);
+		while (index > 0 && hits[index - 1].distance > h.distance)
+		{
+			if (index < maxNumHits)
+			{
+				hits[index] = hits[index - 1];
+			}
+			--index;
+		}
+		hits[index] = h;
+
+		numHits = min(numHits + 1, maxNumHits);
+		if (numHits == maxNumHits)
+		{
+			maxDistance = hits[numHits - 1].distance;
+		}
+	}
+};
+
+// Tests the triangles of a heightmap or mesh collider along the ray. iterateTrianglesInVolume(const bounding_box&, func) calls func(vec3 a, vec3 b, vec3 c)
+// for the triangles in the given world space volume.
+template <typename iterate_func, typename triangle_test_t, typename collector_t>
+static void castThroughTriangles(const ray& r, vec3 extent, bounding_box aabb, float segmentLength, scene_entity entity, 
+	const iterate_func& iterateTrianglesInVolume, const triangle_test_t& testTriangle, collector_t& collector)
+{
+	aabb.pad(extent);
+
+	float enter, exit;
+	if (!clipRay(r, aabb, collector.maxDistance, enter, exit))
+	{
+		return;
+	}
+
+	// Walk along the ray in short segments, so that we don't iterate over all triangles in the bounds of the whole ray.
+	// Hits inside a segment are always found while processing this segment, so closest hit queries can stop early.
+	segmentLength = max(segmentLength, SWEEP_TOLERANCE);
+
+	for (float segmentStart = enter; segmentStart < min(exit, collector.maxDistance); segmentStart += segmentLength)
+	{
+		float segmentEnd = min(segmentStart + segmentLength, exit);
+
+		bounding_box volume = bounding_box::negativeInfinity();
+		volume.grow(r.origin + segmentStart * r.direction);
+		volume.grow(r.origin + segmentEnd * r.direction);
+		volume.pad(extent + vec3(SWEEP_TOLERANCE));
+
+		iterateTrianglesInVolume(volume, [&](vec3 a, vec3 b, vec3 c)
+		{
+			scene_query_hit hit;
+			if (testTriangle(a, b, c, collector.maxDistance, hit))
+			{
+				hit.entity = entity;
+				hit.colliderEntity = entity;
+				collector.add(hit);
+			}
+		});
+
+		if (collector_t::closestOnly && collector.maxDistance <= segmentEnd)
+		{
+			break;
+		}
+	}
+}
+
+// Moves a shape along the ray through the scene. The shape fits into a box with the given extent around the ray origin.
+// testCollider(const collider_union&, float maxDistance, scene_query_hit&) and testTriangle(vec3 a, vec3 b, vec3 c, float maxDistance, scene_query_hit&)
+// return true if they hit the object before maxDistance, and fill out the distance, point and normal.
+template <typename collider_test_t, typename triangle_test_t, typename collector_t>
+static void castThroughScene(game_scene& scene, const ray& r, vec3 extent, const scene_query_filter& filter,
+	const collider_test_t& testCollider, const triangle_test_t& testTriangle, collector_t& collector)
+{
+	const dynamic_aabb_tree& tree = getAABBTree(scene);
+
+	tree.raycast(r, collector.maxDistance, extent, [&](int32 proxy, float maxDistance)
+	{
+		entity_handle colliderEntityHandle = (entity_handle)tree.getUserData(proxy);
+
+		scene_entity entity;
+		collider_union collider;
+		bounding_box aabb;
+		if (getQueryCollider(scene, colliderEntityHandle, filter, entity, collider, aabb))
+		{
+			scene_query_hit hit;
+			if (testCollider(collider, maxDistance, hit))
+			{
+				hit.entity = entity;
+				hit.colliderEntity = { colliderEntityHandle, scene };
+				collector.add(hit);
+			}
+		}
+		return collector.maxDistance;
+	});
+
+	if (!filter.includeHeightmaps)
+	{
+		return;
+	}
+
+	memory_arena& arena = getHeightmapQueryArena();
+
+	for (auto [entityHandle, heightmap] : scene.view<heightmap_collider_component>().each())
+	{
+		if (entityHandle == filter.ignoredEntity || !passesFilter(filter, heightmap.material))
+		{
+			continue;
+		}
+
+		castThroughTriangles(r, extent, heightmap.getAABB(), heightmap.chunkSize * 0.125f, { entityHandle, scene }, [&](const bounding_box& volume, const auto& func)
+		{
+			memory_marker marker = arena.getMarker();
+			heightmap.iterateTrianglesInVolume(volume, arena, func);
+			arena.resetToMarker(marker);
+		}, testTriangle, collector);
+	}
+
+	for (auto [entityHandle, mesh] : scene.view<mesh_collider_component>().each())
+	{
+		if (entityHandle == filter.ignoredEntity || !passesFilter(filter, mesh.material))
+		{
+			continue;
+		}
+
+		castThroughTriangles(r, extent, mesh.getAABB(), maxElement(mesh.getAABB().getRadius()) * 0.125f, { entityHandle, scene }, [&](const bounding_box& volume, const auto& func)
+		{
+			mesh.iterateTrianglesInVolume(volume, func);
+		}, testTriangle, collector);
+	}
+}
+
+// Calls callback(scene_entity entity, scene_entity colliderEntity) for each object, whose shape overlaps the given one. The callback may return false to stop.
+// overlapsCollider(const collider_union&) and overlapsTriangle(vec3 a, vec3 b, vec3 c) test the actual shapes.
+template <typename collider_test_t, typename triangle_test_t, typename callback_t>
+static void overlapScene(game_scene& scene, const bounding_box& shapeAABB, const scene_query_filter& filter,
+	const collider_test_t& overlapsCollider, const triangle_test_t& overlapsTriangle, const callback_t& callback)
+{
+	const dynamic_aabb_tree& tree = getAABBTree(scene);
+
+	bool stop = false;
+
+	tree.query(shapeAABB, [&](int32 proxy)
+	{
+		entity_handle colliderEntityHandle = (entity_handle)tree.getUserData(proxy);
+
+		scene_entity entity;
+		collider_union collider;
+		bounding_box aabb;
+		if (getQueryCollider(scene, colliderEntityHandle, filter, entity, collider, aabb)
+			&& aabbVsAABB(aabb, shapeAABB)
+			&& overlapsCollider(collider))
+		{
+			stop = !callback(entity, scene_entity{ colliderEntityHandle, scene });
+		}
+		return !stop;
+	});
+
+	if (stop || !filter.includeHeightmaps)
+	{
+		return;
+	}
+
+	memory_arena& arena = getHeightmapQueryArena();
+
+	for (auto [entityHandle, heightmap] : scene.view<heightmap_collider_component>().each())
+	{
+		if (entityHandle == filter.ignoredEntity || !passesFilter(filter, heightmap.material) || !aabbVsAABB(heightmap.getAABB(), shapeAABB))
+		{
+			continue;
+		}
+
+		bool overlaps = false;
+
+		memory_marker marker = arena.getMarker();
+		heightmap.iterateTrianglesInVolume(shapeAABB, arena, [&](vec3 a, vec3 b, vec3 c)
+		{
+			overlaps = overlaps || overlapsTriangle(a, b, c);
+		});
+		arena.resetToMarker(marker);
+
+		if (overlaps)
+		{
+			scene_entity heightmapEntity = { entityHandle, scene };
+			if (!callback(heightmapEntity, heightmapEntity))
+			{
+				return;
+			}
+		}
+	}
+
+	for (auto [entityHandle, mesh] : scene.view<mesh_collider_component>().each())
+	{
+		if (entityHandle == filter.ignoredEntity || !passesFilter(filter, mesh.material) || !aabbVsAABB(mesh.getAABB(), shapeAABB))
+		{
+			continue;
+		}
+
+		bool overlaps = false;
+		mesh.iterateTrianglesInVolume(shapeAABB, [&](vec3 a, vec3 b, vec3 c)
+		{
+			overlaps = overlaps || overlapsTriangle(a, b, c);
+		});
+
+		if (overlaps)
+		{
+			scene_entity meshEntity = { entityHandle, scene };
+			if (!callback(meshEntity, meshEntity))
+			{
+				return;
+			}
+		}
+	}
+}
+
+template <typename shapeA_t, typename shapeB_t>
+static bool overlaps(const shapeA_t& shapeA, float radiusA, const shapeB_t& shapeB, float radiusB)
+{
+	vec3 pointA, pointB;
+	if (!gjkDistance(shapeA, shapeB, pointA, pointB))
+	{
+		return true;
+	}
+
+	float radius = radiusA + radiusB;
+	return squaredLength(pointA - pointB) <= radius * radius;
+}
+
+
+
+
+// ----------------------------------------
+// Public interface.
+// ----------------------------------------
+
+template <typename collector_t>
+static void raycastInternal(game_scene& scene, const ray& r, const scene_query_filter& filter, collector_t& collector)
+{
+	auto testCollider = [&r](const collider_union& collider, float maxDistance, scene_query_hit& outHit)
+	{
+		float t;
+		if (!raycastCollider(r, collider, t) || t > maxDistance)
+		{
+			return false;
+		}
+
+		outHit.distance = t;
+		outHit.point = r.origin + t * r.direction;
+		outHit.normal = getRaycastNormal(r, collider, t);
+		return true;
+	};
+
+	auto testTriangle = [&r](vec3 a, vec3 b, vec3 c, float maxDistance, scene_query_hit& outHit)
+	{
+		return raycastTriangle(r, a, b, c, maxDistance, outHit);
+	};
+
+	castThroughScene(scene, r, vec3(0.f), filter, testCollider, testTriangle, collector);
+}
+
+bool raycast(game_scene& scene, const ray& r, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Raycast");
+
+	closest_hit_collector collector = { outHit, maxDistance };
+	raycastInternal(scene, r, filter, collector);
+	return collector.found;
+}
+
+uint32 raycastAll(game_scene& scene, const ray& r, float maxDistance, scene_query_hit* outHits, uint32 maxNumHits, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Raycast all");
+
+	if (maxNumHits == 0)
+	{
+		return 0;
+	}
+
+	all_hits_collector collector = { outHits, maxNumHits, maxDistance };
+	raycastInternal(scene, r, filter, collector);
+	return collector.numHits;
+}
+
+template <typename shape_t>
+static bool sweepInternal(game_scene& scene, const shape_t& shape, float radius, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter)
+{
+	bounding_box aabb = getSupportAABB(shape, radius);
+	ray r = { aabb.getCenter(), direction };
+	vec3 extent = aabb.getRadius();
+
+	auto testCollider = [&](const collider_union& collider, float maxDistance, scene_query_hit& outHit)
+	{
+		return visitCollider(collider, [&](const auto& support, float colliderRadius)
+		{
+			return sweep(shape, radius, direction, maxDistance, support, colliderRadius, filter.ignoreInitialOverlaps, outHit);
+		});
+	};
+
+	auto testTriangle = [&](vec3 a, vec3 b, vec3 c, float maxDistance, scene_query_hit& outHit)
+	{
+		return sweep(shape, radius, direction, maxDistance, extruded_triangle_support_fn(a, b, c), 0.f, filter.ignoreInitialOverlaps, outHit);
+	};
+
+	closest_hit_collector collector = { outHit, maxDistance };
+	castThroughScene(scene, r, extent, filter, testCollider, testTriangle, collector);
+	return collector.found;
+}
+
+bool sphereSweep(game_scene& scene, const bounding_sphere& sphere, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Sphere sweep");
+
+	bounding_capsule core = { sphere.center, sphere.center, 0.f };
+	return sweepInternal(scene, capsule_support_fn{ core }, sphere.radius, direction, maxDistance, outHit, filter);
+}
+
+bool capsuleSweep(game_scene& scene, const bounding_capsule& capsule, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Capsule sweep");
+
+	bounding_capsule core = { capsule.positionA, capsule.positionB, 0.f };
+	return sweepInternal(scene, capsule_support_fn{ core }, capsule.radius, direction, maxDistance, outHit, filter);
+}
+
+bool colliderSweep(game_scene& scene, const collider_union& collider, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Collider sweep");
+
+	return visitCollider(collider, [&](const auto& support, float radius)
+	{
+		return sweepInternal(scene, support, radius, direction, maxDistance, outHit, filter);
+	});
+}
+
+template <typename shape_t>
+static uint32 overlapInternal(game_scene& scene, const shape_t& shape, float shapeRadius, const bounding_box& shapeAABB,
+	scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter)
+{
+	if (maxNumOverlaps == 0)
+	{
+		return 0;
+	}
+
+	auto overlapsCollider = [&](const collider_union& collider)
+	{
+		return visitCollider(collider, [&](const auto& support, float radius)
+		{
+			return overlaps(shape, shapeRadius, support, radius);
+		});
+	};
+
+	auto overlapsTriangle = [&](vec3 a, vec3 b, vec3 c)
+	{
+		return overlaps(shape, shapeRadius, extruded_triangle_support_fn(a, b, c), 0.f);
+	};
+
+	uint32 numOverlaps = 0;
+	overlapScene(scene, shapeAABB, filter, overlapsCollider, overlapsTriangle, [&](scene_entity entity, scene_entity colliderEntity)
+	{
+		outOverlaps[numOverlaps++] = { entity, colliderEntity };
+		return numOverlaps < maxNumOverlaps;
+	});
+
+	return numOverlaps;
+}
+
+uint32 capsuleOverlap(game_scene& scene, const bounding_capsule& capsule, scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Capsule overlap");
+
+	bounding_box aabb = bounding_box::fromMinMax(min(capsule.positionA, capsule.positionB), max(capsule.positionA, capsule.positionB));
+	aabb.pad(vec3(capsule.radius));
+
+	bounding_capsule core = { capsule.positionA, capsule.positionB, 0.f };
+	return overlapInternal(scene, capsule_support_fn{ core }, capsule.radius, aabb, outOverlaps, maxNumOverlaps, filter);
+}
+
+uint32 sphereOverlap(game_scene& scene, const bounding_sphere& sphere, scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter)
+{
+	return capsuleOverlap(scene, bounding_capsule{ sphere.center, sphere.center, sphere.radius }, outOverlaps, maxNumOverlaps, filter);
+}
+
+uint32 boxOverlap(game_scene& scene, const bounding_oriented_box& box, scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter)
+{
+	CPU_PROFILE_BLOCK("Box overlap");
+
+	bounding_box aabb = bounding_box::fromCenterRadius(vec3(0.f), box.radius).transformToAABB(box.rotation, box.center);
+	return overlapInternal(scene, obb_support_fn{ box }, 0.f, aabb, outOverlaps, maxNumOverlaps, filter);
+}
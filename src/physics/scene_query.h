@@ -0,0 +1,55 @@
+#pragma once
+
+#include "physics.h"
+
+// Scene queries test against the colliders as they were in the last physics step (they use the broadphase's AABB tree),
+// so colliders added since then are not found. Heightmaps and mesh colliders are always tested.
+// None of the queries allocate. Results are written to the caller's buffers.
+
+struct scene_query_filter
+{
+	uint32 layerMask = UINT32_MAX; // Bit i includes colliders on layer i.
+	uint32 materialTypeMask = UINT32_MAX; // Bit i includes colliders with physics_material_type i. Colliders without a material type are always included.
+
+	bool includeTriggers = false; // Triggers and force fields.
+	bool includeHeightmaps = true; // Also includes mesh colliders. These have no layer, so they are only filtered by this and the material type.
+	bool includeDynamicBodies = true; // If false, only static colliders and kinematic bodies are tested.
+
+	bool ignoreInitialOverlaps = false; // Sweeps skip objects which already touch the shape at the start.
+
+	entity_handle ignoredEntity = entt::null; // E.g. the querying body itself.
+};
+
+struct scene_query_hit
+{
+	scene_entity entity; // The entity owning the collider, e.g. the rigid body.
+	scene_entity colliderEntity; // Same as entity for heightmaps and mesh colliders.
+
+	vec3 point;
+	vec3 normal; // Points towards the query shape.
+	float distance; // Along the ray or sweep direction. Shapes which overlap at the start report 0.
+};
+
+struct scene_query_overlap
+{
+	scene_entity entity;
+	scene_entity colliderEntity;
+};
+
+// Ray and sweep directions must be normalized.
+
+bool raycast(game_scene& scene, const ray& r, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter = {});
+
+// Hits are sorted by distance. If there are more than maxNumHits, the closest ones are returned. Returns the number of hits written.
+uint32 raycastAll(game_scene& scene, const ray& r, float maxDistance, scene_query_hit* outHits, uint32 maxNumHits, const scene_query_filter& filter = {});
+
+bool sphereSweep(game_scene& scene, const bounding_sphere& sphere, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter = {});
+bool capsuleSweep(game_scene& scene, const bounding_capsule& capsule, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter = {});
+
+// Sweeps a world space collider (see getWorldSpaceCollider). Only the translation is swept.
+bool colliderSweep(game_scene& scene, const collider_union& collider, vec3 direction, float maxDistance, scene_query_hit& outHit, const scene_query_filter& filter = {});
+
+// The overlap queries stop once the buffer is full. Returns the number of overlaps written.
+uint32 sphereOverlap(game_scene& scene, const bounding_sphere& sphere, scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter = {});
+uint32 capsuleOverlap(game_scene& scene, const bounding_capsule& capsule, scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter = {});
+uint32 boxOverlap(game_scene& scene, const bounding_oriented_box& box, scene_query_overlap* outOverlaps, uint32 maxNumOverlaps, const scene_query_filter& filter = {});
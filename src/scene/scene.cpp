@@ -3,6 +3,7 @@
 #include "physics/physics.h"
 #include "physics/collision_broad.h"
 #include "terrain/heightmap_collider.h"
+#include "physics/mesh_collider.h"
 #include "rendering/raytracing.h"
 
 
@@ -53,6 +54,7 @@ void game_scene::cloneTo(game_scene& target)
 		tree_component,
 #endif
 		heightmap_collider_component,
+		mesh_collider_component,
 
 		mesh_component,
 
@@ -3,6 +3,7 @@
 #include "asset/file_registry.h"
 
 #include "physics/physics.h"
+#include "physics/mesh_collider.h"
 #include "terrain/heightmap_collider.h"
 
 struct write_stream
@@ -123,6 +124,7 @@ using serialized_components = component_group_t<
 	cloth_component,
 	cloth_render_component,
 	physics_reference_component,
+	mesh_collider_component,
 
 	// Terrain.
 	terrain_component,
@@ -268,6 +270,55 @@ void deserializeFromMemoryStream<physics_reference_component>(scene_entity entit
 	}
 }
 
+// The geometry is stored with the component, since it may not come from a file. The BVH is rebuilt when loading.
+template <>
+void serializeToMemoryStream(scene_entity entity, const mesh_collider_component& component, write_stream& stream)
+{
+	stream.write(component.getRotation());
+	stream.write(component.getPosition());
+	stream.write(component.material);
+
+	uint32 numVertices = component.geometry ? (uint32)component.geometry->vertices.size() : 0;
+	uint32 numTriangles = component.geometry ? (uint32)component.geometry->triangles.size() : 0;
+
+	stream.write(numVertices);
+	for (uint32 i = 0; i < numVertices; ++i)
+	{
+		stream.write(component.geometry->vertices[i]);
+	}
+
+	stream.write(numTriangles);
+	for (uint32 i = 0; i < numTriangles; ++i)
+	{
+		stream.write(component.geometry->triangles[i]);
+	}
+}
+
+template <>
+void deserializeFromMemoryStream<mesh_collider_component>(scene_entity entity, read_stream& stream)
+{
+	READ(quat, rotation);
+	READ(vec3, position);
+	READ(physics_material, material);
+
+	READ(uint32, numVertices);
+	std::vector<vec3> vertices(numVertices);
+	for (uint32 i = 0; i < numVertices; ++i)
+	{
+		stream.read(vertices[i]);
+	}
+
+	READ(uint32, numTriangles);
+	std::vector<indexed_triangle32> triangles(numTriangles);
+	for (uint32 i = 0; i < numTriangles; ++i)
+	{
+		stream.read(triangles[i]);
+	}
+
+	ref<mesh_collider_geometry> geometry = numTriangles ? mesh_collider_geometry::fromTriangles(vertices.data(), numVertices, triangles.data(), numTriangles) : 0;
+	entity.addComponent<mesh_collider_component>(geometry, rotation, position, material);
+}
+
 static void serializeTexture(const ref<dx_texture>& tex, write_stream& stream)
 {
 	stream.write(tex ? tex->handle : asset_handle{ 0 });
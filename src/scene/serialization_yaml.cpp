@@ -82,6 +82,7 @@ namespace YAML
 			n["Gravity factor"] = c.gravityFactor;
 			n["Linear damping"] = c.linearDamping;
 			n["Angular damping"] = c.angularDamping;
+			n["CCD"] = c.continuousCollisionDetection;
 			return n;
 		}
 
@@ -95,6 +96,7 @@ namespace YAML
 			YAML_LOAD(n, c.gravityFactor, "Gravity factor");
 			YAML_LOAD(n, c.linearDamping, "Linear damping");
 			YAML_LOAD(n, c.angularDamping, "Angular damping");
+			YAML_LOAD(n, c.continuousCollisionDetection, "CCD");
 
 			return true;
 		}
@@ -164,6 +166,7 @@ namespace YAML
 			n["Restitution"] = c.material.restitution;
 			n["Friction"] = c.material.friction;
 			n["Density"] = c.material.density;
+			n["Layer"] = (uint32)c.layer;
 			return n;
 		}
 
@@ -238,6 +241,10 @@ namespace YAML
 				default: ASSERT(false); break;
 			}
 
+			uint32 layer = 0;
+			YAML_LOAD(n, layer, "Layer");
+			c.layer = (uint8)layer;
+
 			return true;
 		}
 	};
@@ -130,6 +130,7 @@ struct heightmap_collider_component
 	void iterateTrianglesInVolume(bounding_box volume, memory_arena& arena, const callback_func& func) const;
 
 	float getHeightAt(vec2 coord) const; // Returns -FLT_MAX if outside bounds.
+	bounding_box getAABB() const;
 
 	heightmap_collider_chunk& collider(uint32 x, uint32 z) { return colliders[z * chunksPerDim + x]; }
 	const heightmap_collider_chunk& collider(uint32 x, uint32 z) const { return colliders[z * chunksPerDim + x]; }